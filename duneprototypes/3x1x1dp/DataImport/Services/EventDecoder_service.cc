@@ -18,6 +18,8 @@
 
 #include "art/Framework/Services/Registry/ServiceDefinitionMacros.h"
 
+#include "tbb/task_arena.h"
+
 using namespace std;
 using namespace dlardaq;
 
@@ -271,8 +273,16 @@ ssize_t EventDecoder::Decode( const char *buf, size_t nb, bool cflag,
   else
     {
       size_t byteidx = 0;
-      HuffDataCompressor::Instance().DecompressEventData(m_nadc, m_nch, m_nsample, buf, nb, byteidx, adc);
-      
+      HuffDataCompressor &huff = HuffDataCompressor::Instance();
+
+      // with more than one thread find where the channels start
+      // and decode them in parallel
+      std::vector<size_t> choffsets;
+      if( m_nch > 1 && tbb::this_task_arena::max_concurrency() > 1 &&
+	  huff.IndexEventData(m_nadc, m_nch, m_nsample, buf, nb, choffsets) )
+	huff.DecompressEventData(m_nadc, m_nch, m_nsample, buf, nb, choffsets, byteidx, adc);
+      else
+	huff.DecompressEventData(m_nadc, m_nch, m_nsample, buf, nb, byteidx, adc);
     }  
 
   return adc.size();
@@ -8,8 +8,8 @@
 //
 //  The Huffman encoding scheme used here is the one developed by uBooNE
 //
-//  The basic idea is to handle binnary codes as strings --> maybe not 
-//  the most performant, but hopefully easier to understand ;-)
+//  The encoding scheme is defined with binary codes as strings,
+//  which are turned into tables for the encoder and decoder
 //
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
@@ -18,6 +18,7 @@
 #define __HUFFDATACOMPRESSOR_H__
 
 #include <map>
+#include <string>
 #include <vector>
 #include <deque>
 #include <bitset>
@@ -50,25 +51,51 @@ namespace dlardaq
     
     // the raw adc should just be adc values without event header
     // these data are in 1D array: [tdc + ch x ntdc]
+    // if choffsets is given it is filled with the channel index (see below)
     void CompressEventData( short nbadc, size_t nch, size_t seqlen,
 			    std::vector<adc16_t> &raw_in,
-			    std::vector<BYTE> &bin_out );
+			    std::vector<BYTE> &bin_out,
+			    std::vector<size_t> *choffsets = nullptr );
 
     // the raw adc should just be adc values without event header
     // these data are in 2D array: [ch, tdc]
     void CompressEventData( short nbadc, size_t nch, size_t seqlen,
 			    std::vector< std::vector<adc16_t> > &raw_in,
-			    std::vector<BYTE> &bin_out );
+			    std::vector<BYTE> &bin_out,
+			    std::vector<size_t> *choffsets = nullptr );
 
     
     // decompress event from binary sequence in memory
-    // 
+    // byteidx is set to the number of bytes used
     void DecompressEventData( short nbadc,       
 			      size_t nch,
 			      size_t seqlen, 
 			      const char *buf, size_t bufsize, size_t &byteidx,
 			      std::vector<adc16_t>  &adc );
 
+    // channel index of a compressed event: each channel starts on a byte
+    // boundary, choffsets holds the nch byte offsets where the channels
+    // begin followed by the size of the event data.
+    // 
+    // find the channel index by scanning the event without decoding it,
+    // returns false if the data cannot be indexed
+    bool IndexEventData( short nbadc,       
+			 size_t nch,
+			 size_t seqlen, 
+			 const char *buf, size_t bufsize,
+			 std::vector<size_t> &choffsets );
+
+    // decompress event using its channel index, channels are decoded in
+    // parallel. Falls back to the single stream decoding above if the
+    // index does not match the data
+    void DecompressEventData( short nbadc,       
+			      size_t nch,
+			      size_t seqlen, 
+			      const char *buf, size_t bufsize,
+			      const std::vector<size_t> &choffsets,
+			      size_t &byteidx,
+			      std::vector<adc16_t>  &adc );
+
     // NOTE: Before calling this function 
     //       one must ensure that the position of the input file 
     //       is always set at the begining of the event data
@@ -98,45 +125,51 @@ namespace dlardaq
     // define encoding scheme
     void SetEncoding();
 
-    // structure to collect Huffman codes
-    struct HuffAccum_t
+    // a code in the lower len bits of bits
+    struct HuffCode_t
     {
-      std::string codestr;  // binary code; leave empty for raw data
-      short value;            // value: diff / or raw adc
-      short nrep;           // number of repetitions of this code
-    };  
+      uint32_t bits;
+      uint8_t  len;
+    };
 
-    //
-    std::vector<HuffAccum_t> HuffBuffer;  // buffer for Huffman codes
+    // decoding table entry: code length (0 if none) and value
+    struct HuffTableEntry_t
+    {
+      uint8_t len;
+      short   value;
+    };
+
+    // compress a sequence of nsample values appending to bin_out
+    void EncodeChData( const adc16_t *raw_in, size_t nsample,
+		       std::vector<BYTE> &bin_out );
+
+    // result of decoding a channel
+    enum DecodeStatus_t
+      {
+	kDecodeOK = 0,
+	kDecodeTruncated,   // buffer ends before the last sample
+	kDecodeOverflow,    // more samples than expected, extra ones dropped
+	kDecodeBadRaw,      // raw packet cut by the end of the buffer
+	kDecodeBadStart,    // channel does not start with a raw packet
+	kDecodeBadBoundary  // no padding to the byte boundary
+      };
+
+    // decode a channel starting at bit pos (see implementation)
+    template<bool STORE>
+    DecodeStatus_t DecodeChData( const unsigned char *ubuf, size_t bufsize, size_t &pos,
+				 size_t seqlen, adc16_t *out, size_t &nsample ) const;
+
+    // find the end of a channel without decoding it
+    DecodeStatus_t CountChData( const unsigned char *ubuf, size_t bufsize, size_t &pos,
+				size_t seqlen ) const;
 
-    // add to buffer
-    void AddToHuffBuffer(short val, bool rawadc);
-    
-    
     //
     bool SetNbitsAdc( short nbadc );
 
-    //
-    void AddWordsToByteBuffer(std::string words, 
-			      std::vector<BYTE> &buf, 
-			      std::string &partbyte);
-    
-    //
-    void ReadNextByte( size_t &byteidx, const char *buf,
-		       std::deque< std::bitset<1> > &bits );
-
     // read next byte from file stream
     void ReadNextByte( std::ifstream &fin, std::deque< std::bitset<1> > &bits, bool &status );
     
     
-    // get code from value
-    std::string GetCodeFromValue(short val); 
-    
-    // get value from code
-    //short GetValueFromCode(std::string code, bool &ok);
-    
-    std::string GetBinaryString(short val, size_t strsize);
-        
     //
     //
     std::map<short, std::string> m_CmMap;     // map to compresss
@@ -145,6 +178,11 @@ namespace dlardaq
     // map to decompress is in the sorted vector of codes
     std::vector< std::pair<std::string, short> >  m_UCmMap;    
 
+    std::vector<HuffCode_t> m_EncTable;       // codes indexed by value + m_MaxDiff
+    HuffCode_t              m_RepCode;        // code for the sequence repetition
+    std::vector<HuffTableEntry_t> m_DecTable; // codes indexed by the next m_MaxCodeSize bits
+    bool                    m_UnaryCodes;     // codes can be counted from their 1s
+
     int    m_Verbosity;                       //
 
     short  m_MaxAdcBits;                      // max ADC bits
@@ -8,8 +8,10 @@
 //
 //  The Huffman encoding scheme used here is the one developed by uBooNE
 //
-//  The basic idea is to handle binnary codes as strings --> maybe not 
-//  the most performant, but maybe easier to understand
+//  The encoding scheme is defined with binary codes as strings,
+//  which are turned into tables for the encoder and decoder: codes are
+//  written to / read from the byte stream with 64-bit bit fields and
+//  each code is found from a table indexed by the next bits
 //
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
@@ -17,6 +19,12 @@
 #include <iomanip>
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
 
 #include "LogMsg.h"
 #include "HuffDataCompressor.h"
@@ -25,6 +33,78 @@
 using namespace std;
 using namespace dlardaq;
 
+namespace
+{
+  //
+  // next n bits (1 <= n <= 57) from bit position pos of the buffer,
+  // most significant bit first; bits past the end of the buffer are 0
+  inline uint64_t PeekBits(const unsigned char *buf, size_t bufsize, size_t pos, size_t n)
+  {
+    size_t byte = pos >> 3;
+    uint64_t w  = 0;
+    if(byte + 8 <= bufsize)
+      {
+	memcpy(&w, buf + byte, sizeof(w));
+	w = __builtin_bswap64(w); // NOTE: assumes little-endian host
+      }
+    else
+      {
+	for(size_t i=0;i<8;i++)
+	  w = (w << 8) | (byte + i < bufsize ? buf[byte + i] : 0);
+      }
+    return (w << (pos & 7)) >> (64 - n);
+  }
+
+  //
+  // number of 1s in the lower 16 bits of v (the popcnt instruction
+  // is not part of the baseline x86-64 instruction set)
+  struct OnesTable
+  {
+    uint8_t n[256];
+    constexpr OnesTable() : n()
+    {
+      for(int i=0;i<256;i++) n[i] = (i & 1) + n[i >> 1];
+    }
+  };
+  constexpr OnesTable kOnes;
+
+  inline size_t CountOnes16(uint64_t v)
+  {
+    return kOnes.n[v & 0xff] + kOnes.n[(v >> 8) & 0xff];
+  }
+
+  //
+  // append bit fields to a byte vector, most significant bit first
+  class BitWriter
+  {
+  public:
+    BitWriter(std::vector<BYTE> &out) : m_out(out), m_acc(0), m_nbits(0) {;}
+
+    // write the lower len (<= 32) bits of bits
+    void Put(uint64_t bits, size_t len)
+    {
+      m_acc    = (m_acc << len) | (bits & ((uint64_t(1) << len) - 1));
+      m_nbits += len;
+      while(m_nbits >= 8)
+	{
+	  m_nbits -= 8;
+	  m_out.push_back( (m_acc >> m_nbits) & 0xff );
+	}
+    }
+
+    // pad with 0 to the next byte boundary
+    void Flush()
+    {
+      if(m_nbits > 0) Put(0, 8 - m_nbits);
+    }
+
+  private:
+    std::vector<BYTE> &m_out;
+    uint64_t m_acc;
+    size_t   m_nbits;
+  };
+}
+
 //
 //
 //
@@ -126,6 +206,40 @@ void HuffDataCompressor::SetEncoding()
       string bincode = it->second;
       m_UCmMap[bincode.size()-1] = std::make_pair(bincode, deltaval);
     }
+
+  // tables for the encoder and decoder
+  m_EncTable.assign( 2*m_MaxDiff + 1, HuffCode_t{0, 0} );
+  m_RepCode = HuffCode_t{0, 0};
+  m_DecTable.assign( size_t(1) << m_MaxCodeSize, HuffTableEntry_t{0, 0} );
+  for(it = m_CmMap.begin();it!=m_CmMap.end();it++)
+    {
+      short deltaval = it->first;
+      HuffCode_t code;
+      code.bits = strtoul(it->second.c_str(), 0, 2);
+      code.len  = it->second.size();
+      
+      if(std::abs(deltaval) <= m_MaxDiff) 
+	m_EncTable[deltaval + m_MaxDiff] = code;
+      else
+	m_RepCode = code;
+
+      // the codes are prefix free: all m_MaxCodeSize-bit sequences 
+      // starting with this code decode to it
+      size_t nfree = m_MaxCodeSize - code.len;
+      for(size_t j=0;j<(size_t(1) << nfree);j++)
+	m_DecTable[ (code.bits << nfree) | j ] = HuffTableEntry_t{code.len, deltaval};
+    }
+
+  // codes made of 0s ending with their only 1, with "1" for the
+  // repetition, can be counted from the packet bits (see CountChData)
+  m_UnaryCodes = m_SeqEnable && m_MaxCodeSize < 16;
+  for(it = m_CmMap.begin();it!=m_CmMap.end();it++)
+    {
+      const string &bincode = it->second;
+      if( bincode.find('1') != bincode.size() - 1 || 
+	  (bincode.size() == 1) != (it->first == m_NSeqRepVal) )
+	m_UnaryCodes = false;
+    }
 }
 
 //
@@ -160,81 +274,6 @@ void HuffDataCompressor::PrintEncoding()
 
 
 
-//
-//
-//
-// access map to compress
-std::string HuffDataCompressor::GetCodeFromValue(short val)
-{
-  string emptystr = "";
-  
-  if(std::abs(val) > m_MaxDiff && val != m_NSeqRepVal)
-    {
-      msg_err<<__FILE__<<", "<<__LINE__<<" the value '"<<val<<"' exceeds range"<<endl;
-      return emptystr;
-    }
-
-  std::map<short, std::string>::iterator it;
-  it = m_CmMap.find( val );
-  if(it != m_CmMap.end())
-    return it->second;
-  
-  //
-  msg_err<<__FILE__<<", "<<__LINE__<<" the value '"<<val<<"' could not be found"<<endl;
-  return emptystr;
-}
-
-
-//
-// Internal buffer to store raw adc / adc differences
-//
-// Add to huff buffer
-void HuffDataCompressor::AddToHuffBuffer(short val, bool rawadc)
-{
-  HuffAccum_t tmp;
-  tmp.value   = val;
-  tmp.nrep    = 0;
-  tmp.codestr = "";
-
-  if(!rawadc) 
-    tmp.codestr = GetCodeFromValue(val);
-  else
-    {
-      HuffBuffer.push_back( tmp );
-      return;
-    }
-  
-  // check if the last value was the same
-  if( HuffBuffer.back().value == tmp.value && 
-      !HuffBuffer.back().codestr.empty() )
-    {
-      // just increment repetition counter
-      HuffBuffer.back().nrep += 1;
-    }
-  else
-    {
-      // add new entry
-      HuffBuffer.push_back( tmp );
-    }
-}
-
-//
-//
-//
-// get binary string
-std::string HuffDataCompressor::GetBinaryString(short val, size_t strsize)
-{
-  std::string s = bitset<16> ( val ).to_string();
-
-  if(strsize < 16)
-    return s.substr(s.size() - strsize); //crop to required size
-    
-  // ok we have a long string. Why?
-  msg_warn<<__FILE__<<", "<<__LINE__<<" the string looks too long"<<endl;
-  while(s.size() < strsize) s = "0" + s; //pad 0 to front
-  return s;
-}
-
 //
 //
 //
@@ -255,176 +294,117 @@ bool HuffDataCompressor::SetNbitsAdc( short nbadc )
 //
 //
 //
-// add words to byte buffer keeping track of the remainder
-// partbyte ("partial byte") contains the remainder string
-void HuffDataCompressor::AddWordsToByteBuffer(std::string words, 
-					      std::vector<BYTE> &buf, 
-					      std::string &partbyte)
+// compress ch data using huffman codes
+void HuffDataCompressor::CompressChData( short nbadc, std::vector<adc16_t> &raw_in,
+					 std::vector<BYTE> &bin_out )
 {
-  if( words.empty() && partbyte.empty() ) return;
-
-  // nothing to add yet
-  if( words.size() < m_NbitsByte && partbyte.empty() )
-    {
-      partbyte = words;
-      return;
-    }
-  
-  // just pad with 0 and finish
-  if(words.empty() && !partbyte.empty())
+  if(!SetNbitsAdc( nbadc ))
     {
-      // pad partial byte until we get to a full byte
-      while(partbyte.size() < m_NbitsByte) partbyte += "0";
-      buf.push_back( (strtoul(partbyte.c_str(), 0, 2) & 0xff) );
-      partbyte.clear();
+      bin_out.clear();
+      msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
       return;
     }
   
-  for(size_t i=0;i<words.size();i++)
-    {
-      if(partbyte.size() == m_NbitsByte)
-	{
-	  buf.push_back( (strtoul(partbyte.c_str(), 0, 2) & 0xff) );
-	  partbyte.clear();
-	}
-      
-      partbyte += words[i];
-    }
+  EncodeChData( raw_in.data(), raw_in.size(), bin_out );
 }
 
 
-
 //
 //
 //
-// compress ch data using huffman codes
-void HuffDataCompressor::CompressChData( short nbadc, std::vector<adc16_t> &raw_in,
-					 std::vector<BYTE> &bin_out )
+// append the compressed sequence to bin_out
+// 
+// The stream is a sequence of m_PacketSize bit packets starting with a flag:
+//   0 + m_NbitsHC bits of raw ADC, or
+//   1 + m_NbitsHC bits of Huffman codes, which can continue in the next packet
+// A code packet followed by a raw one is padded with 0, the last packet is not.
+// The channel ends with 0 padding to the byte boundary.
+void HuffDataCompressor::EncodeChData( const adc16_t *raw_in, size_t nsample,
+				       std::vector<BYTE> &bin_out )
 {
-  if(!SetNbitsAdc( nbadc ))
-    {
-      bin_out.clear();
-      msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
-      return;
-    }
+  BitWriter out( bin_out );
   
+  // packet being filled starting with its flag bit
+  uint64_t bitword = 0;
+  size_t   wordlen = 0;
   
-  HuffBuffer.clear();
-  
-  // calculate differences and fill our HC buffer
-  short delta;
-  for(size_t i=0;i<raw_in.size();i++)
+  // add a code, writing out packets as they fill up
+  auto addCode = [&]( const HuffCode_t &code )
     {
-      if(i==0) delta = m_MaxDiff + 1;
-      else delta = raw_in[i] - raw_in[i-1];
-      
-      if(std::abs(delta) > m_MaxDiff)  // store uncompressed raw data
-	AddToHuffBuffer( (short)raw_in[i], true );
-      else
-	AddToHuffBuffer( delta, false );
-    }
-  
-  
-  // not defined unless SeqEnable is set
-  string bitrepcode = "";
-  if(m_SeqEnable) 
+      bitword  = (bitword << code.len) | code.bits;
+      wordlen += code.len;
+      if( wordlen < m_PacketSize ) return;
+
+      // too large for one packet: carry over for next iteration
+      size_t rest = wordlen - m_PacketSize;
+      out.Put( bitword >> rest, m_PacketSize );
+      bitword  = (uint64_t(1) << rest) | (bitword & ((uint64_t(1) << rest) - 1));
+      wordlen  = rest + 1;
+    };
+
+  // add nrep+1 repetitions of the same difference
+  auto addRun = [&]( short delta, int nrep )
     {
-      bitrepcode = GetCodeFromValue( m_NSeqRepVal ); //NSeqRep );
-      if(bitrepcode.empty())
+      const HuffCode_t &code = m_EncTable[delta + m_MaxDiff];
+      for(int jj=0;jj<=nrep;jj++)
 	{
-	  msg_err<<__FILE__<<", "<<__LINE__
-		 <<" encoding repetion failed. Aborting ..."<<endl;
-	  return;
+	  if( jj > 0 && m_SeqEnable && jj + m_NSeqRep <= nrep )
+	    {
+	      addCode( m_RepCode );
+	      jj += (m_NSeqRep-1);
+	    }
+	  else
+	    addCode( code );
 	}
-    }  
-  
-  // now compress stream
-  short nhcrep;  //repetition 
-  string bitword, bitcode, partbyte;
-  bitword  = "";
-  partbyte = ""; // string to hold ramainder of byte
+    };
 
-  for(size_t i=0;i<HuffBuffer.size();i++)
+  bool  inrun    = false;
+  short rundelta = 0;
+  int   nrep     = 0;
+  for(size_t i=0;i<nsample;i++)
     {
+      short delta;
+      if(i==0) delta = m_MaxDiff + 1;
+      else delta = raw_in[i] - raw_in[i-1];
       
-      //cout<<i
-      //<<" "<<HuffBuffer[i].value
-      //<<" "<<HuffBuffer[i].nrep;
-      //if( !HuffBuffer[i].codestr.empty() ) cout<<" "<<HuffBuffer[i].codestr<<endl;
-      //else cout<<" rawadc "<<endl;
-	
-      if(HuffBuffer[i].codestr.empty()) //raw adc
+      if(std::abs(delta) <= m_MaxDiff)  // compress
 	{
-	  // write out whatever we have in the buffer
-	  if(bitword.size() > m_NbitsHead) // more than just a header
+	  if( inrun && delta == rundelta )
 	    {
-	      // pad with zero's to buffer length
-	      while(bitword.size() < m_PacketSize) bitword += "0"; 
-	      AddWordsToByteBuffer( bitword, bin_out, partbyte );
+	      nrep++;
+	      continue;
 	    }
-	  
-	  // uncompressed data
-	  bitword = "0" + GetBinaryString( HuffBuffer[i].value, m_NbitsHC );
-	  
-	  //
-	  AddWordsToByteBuffer( bitword, bin_out, partbyte );
-	  bitword = "1";
+	  if( inrun ) addRun( rundelta, nrep );
+	  inrun    = true;
+	  rundelta = delta;
+	  nrep     = 0;
 	  continue;
 	}
 
-      // compress data
-      bitcode  = HuffBuffer[i].codestr;
-      nhcrep   = HuffBuffer[i].nrep;
+      // store uncompressed raw data
+      if( inrun ) addRun( rundelta, nrep );
+      inrun = false;
 
-      for(short jj=0;jj<=nhcrep;jj++)
+      // write out whatever we have in the buffer padded with 0s
+      if( wordlen > m_NbitsHead ) // more than just a header
 	{
-	  //
-	  if(jj==0)
-	    bitword += bitcode;
-	  else if(jj+m_NSeqRep <= nhcrep && m_SeqEnable)
-	    {
-	      bitword += bitrepcode;
-	      jj += (m_NSeqRep-1);
-	    }
-	  else
-	    bitword += bitcode;
-	  
-	  
-	  // attempt to write to compresssed stream
-	  if(bitword.size() >= m_PacketSize) // check the size
-	    {
-	      if(bitword.size() == m_PacketSize) //write it out
-		{
-		  AddWordsToByteBuffer( bitword, bin_out, partbyte );
-		  bitword = "1"; //next iteration of compression
-		}
-	      else
-		{
-		  // too large for one packet 
-		  string towrite = bitword.substr(0, m_PacketSize);
-		  string tosave  = bitword.substr(m_PacketSize);
-		  
-		  // write out
-		  AddWordsToByteBuffer( towrite, bin_out, partbyte );
-		  
-		  // carry over for next iteration
-		  bitword = "1" + tosave; 
-		}
-	    }
-	} // end for
+	  size_t len = std::max( wordlen, m_PacketSize );
+	  out.Put( bitword << (len - wordlen), len );
+	}
+      
+      // uncompressed data with 0 flag
+      out.Put( raw_in[i] & ((1u << m_NbitsHC) - 1), m_PacketSize );
+      bitword = 1;
+      wordlen = 1;
+    }
+  if( inrun ) addRun( rundelta, nrep );
 
-    } // end i-loop
-  
-  //cout<<"Last bitword and partial byte"<<bitword<<" "<<partbyte<<endl;
-  
   // write whatever is left
-  if(bitword.size() > m_NbitsHead) // more than just a header
-    AddWordsToByteBuffer( bitword, bin_out, partbyte );
-  
-  //cout<<"Last partial byte word "<<partbyte<<endl;
+  if( wordlen > m_NbitsHead ) // more than just a header
+    out.Put( bitword, wordlen );
   
   // write out remaning byte padded with 0s to next byte boundary
-  AddWordsToByteBuffer( "", bin_out, partbyte );
+  out.Flush();
 }
 
 
@@ -434,9 +414,11 @@ void HuffDataCompressor::CompressChData( short nbadc, std::vector<adc16_t> &raw_
 // compress event data using huffman codes
 void HuffDataCompressor::CompressEventData( short nbadc, size_t nch, size_t seqlen,
 					    std::vector<adc16_t> &raw_in,
-					    std::vector<BYTE> &bin_out )
+					    std::vector<BYTE> &bin_out,
+					    std::vector<size_t> *choffsets )
 {
   bin_out.clear();
+  if( choffsets ) choffsets->clear();
   if(!SetNbitsAdc( nbadc ))
     {
       msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
@@ -451,11 +433,10 @@ void HuffDataCompressor::CompressEventData( short nbadc, size_t nch, size_t seql
   
   for(size_t i=0;i<nch;i++)
     {
-      size_t istart = i*seqlen;
-      // get ch data
-      std::vector<adc16_t> chdata(&raw_in[istart], &raw_in[istart+seqlen]);
-      CompressChData( nbadc, chdata, bin_out );
+      if( choffsets ) choffsets->push_back( bin_out.size() );
+      EncodeChData( raw_in.data() + i*seqlen, seqlen, bin_out );
     }
+  if( choffsets ) choffsets->push_back( bin_out.size() );
 }
 
 
@@ -464,9 +445,11 @@ void HuffDataCompressor::CompressEventData( short nbadc, size_t nch, size_t seql
 // compress event data using huffman codes
 void HuffDataCompressor::CompressEventData( short nbadc, size_t nch, size_t seqlen,
 					    std::vector< std::vector<adc16_t> > &raw_in,
-					    std::vector<BYTE> &bin_out )
+					    std::vector<BYTE> &bin_out,
+					    std::vector<size_t> *choffsets )
 {
   bin_out.clear();
+  if( choffsets ) choffsets->clear();
   if(!SetNbitsAdc( nbadc ))
     {
       msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
@@ -485,28 +468,14 @@ void HuffDataCompressor::CompressEventData( short nbadc, size_t nch, size_t seql
 	{
 	  msg_err<<"No support for compression of unequal sequence lenghts at the moment"<<endl;
 	  bin_out.clear();
+	  if( choffsets ) choffsets->clear();
 	  return;
 	}
 
-      CompressChData( nbadc, raw_in[i], bin_out );
+      if( choffsets ) choffsets->push_back( bin_out.size() );
+      EncodeChData( raw_in[i].data(), seqlen, bin_out );
     }
-}
-
-
-//
-//
-//
-// decode individual bits from a byte
-void HuffDataCompressor::ReadNextByte(size_t &byteidx, const char *buf,
-				      std::deque<bitset<1> > &bits)
-{
-  unsigned short bitmask = 1 << (m_NbitsByte - 1);
-  
-  // decode individual bits
-  for(size_t i=0;i<m_NbitsByte;i++)
-    bits.push_back( bitset<1>( (buf[byteidx] & (bitmask >> i)) != 0) );
-  
-  byteidx++;
+  if( choffsets ) choffsets->push_back( bin_out.size() );
 }
 
 
@@ -536,208 +505,418 @@ void HuffDataCompressor::ReadNextByte(std::ifstream &fin, std::deque< std::bitse
 
 //
 //
-// 
-// Decompress event from binary sequence (only single event)
 //
-void HuffDataCompressor::DecompressEventData( short nbadc,
-					      size_t nch,
-					      size_t seqlen, 
-					      const char *buf, size_t bufsize, size_t &byteidx,
-					      std::vector<adc16_t> &adc )
+// decode one channel of seqlen samples starting at bit pos into out
+//
+// The channel must start with a raw packet and ends with 0 padding to
+// the byte boundary. pos is moved to the byte boundary after the channel
+// and nsample is set to the number of samples decoded, less than seqlen
+// if the buffer ends first. With STORE false the samples are only
+// counted, to find where the channel ends.
+template<bool STORE>
+HuffDataCompressor::DecodeStatus_t HuffDataCompressor::DecodeChData( const unsigned char *ubuf, 
+								      size_t bufsize, size_t &pos,
+								      size_t seqlen, adc16_t *out,
+								      size_t &nsample ) const
 {
-  if(!SetNbitsAdc( nbadc ))
+  const size_t nbits = bufsize * m_NbitsByte;
+  const uint64_t tablemask = m_DecTable.size() - 1;
+
+  DecodeStatus_t status = kDecodeOK;
+  adc16_t last      = 0;
+  short   lastdelta = 0;
+  size_t  n         = 0;
+
+  // code bits not decoded yet, carried over to the next packet
+  // once they are longer than any code nothing can be decoded
+  // until the next raw packet
+  uint64_t code    = 0;
+  size_t   codelen = 0;
+  bool     badcode = false;
+
+  while( n < seqlen )
     {
-      msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
-      return;
-    }
-  adc.clear();
-
-  vector< adc16_t > chdata;
-  deque< bitset<1> > bitqueue;
-
-  stringstream ss;
-  short lastdelta  = -999;
-  size_t bitsread  = 0;
-  int noread       = 0;
-
-  size_t chread  = 0;
-
-  byteidx   = 0;
-  // basic idea is to read bits one byte at a time from the input buffer
-  // the first entry in the bitqueue deck should always be aligned on the 
-  // compressed / raw flag and the deck should contain at least m_PacketSize bits
-  while( adc.size() != nch*seqlen )
-    {
-      if(byteidx<bufsize) ReadNextByte(byteidx, buf, bitqueue);
-      else noread++;
-      
-      if(noread > 1) //loopcounter == 1, we process last bits but not read new byte
+      if( pos >= nbits )
 	{
-	  msg_err<<"There seems to be a problem with decoding"<<endl
-		 <<"Bytes read "<<byteidx<<" out of "<<bufsize<<endl
-		 <<"Samples accumulated in this channel "<<chdata.size()<<endl
-		 <<"Remaining bits are "<<bitqueue.size()<<" "<<bitqueue.empty()<<endl;
-	  break;
+	  nsample = n;
+	  return kDecodeTruncated;
 	}
-      
-      //read more bytes if possible
-      if( bitqueue.size() < m_PacketSize && byteidx != bufsize) 
-	continue;
 
-      bool iscomp = bitqueue.front().test(0);
-      bitsread++;
-      bitqueue.pop_front(); // compressed / raw flag      
+      bool iscomp = PeekBits( ubuf, bufsize, pos, 1 );
+      pos++;
 
       if(!iscomp) // uncompressed
 	{
-	  ss.str(""); //clear our code string (could carry over from compressed)
-	  
-	  if( bitqueue.size() < m_NbitsHC ) 
+	  if( nbits - pos < m_NbitsHC )
 	    {
-	      msg_err<<"Fatal decoding error has been encountered : "<<endl
-		     <<" Number of bits in the uncompressed stream should be at least "
-		     <<m_NbitsHC<<" the current value is "<<bitqueue.size()<<endl;
-	      abort();
+	      nsample = n;
+	      return kDecodeBadRaw;
 	    }
-	  
-	  size_t bitcounter = 0;
-	  while(bitcounter < m_NbitsHC) 
-	    {
-	      ss << bitqueue.front();
-	      bitqueue.pop_front();
-	      bitcounter++;
-	    }
-	  bitsread += bitcounter;
-
-	  adc16_t val = ( strtoul(ss.str().c_str(), 0, 2) & 0x7FFF );
-	  chdata.push_back( val );
-	  ss.str("");
+	  last = PeekBits( ubuf, bufsize, pos, m_NbitsHC ) & 0x7FFF;
+	  if( STORE ) out[n] = last;
+	  n++;
+	  pos    += m_NbitsHC;
+	  codelen = 0;
+	  badcode = false;
+	  continue;
 	}
-      else // handle compressed bits
+
+      if( n == 0 )
 	{
-	  size_t bitcounter = 0;
-	  size_t bitstoread = m_NbitsHC;
-	  if( bitqueue.size() < m_NbitsHC ) 
-	    bitstoread = bitqueue.size();
-	  
-	  while( bitcounter < bitstoread )
-	    {	      
-	      ss << bitqueue.front();
-	      bitqueue.pop_front();
-	      bitcounter++;
-	      bitsread++;
-	      // check if we have a good code
-	      size_t strsize = ss.str().size();
-	      if( strsize >= m_MinCodeSize && strsize <= m_MaxCodeSize ) 
-		{
-		  bool ok = (m_UCmMap[strsize-1].first == ss.str());
-		  if(!ok) continue; //not a good code
-		  short val = m_UCmMap[strsize-1].second;
-		  
-		  ss.str(""); //reset string code
+	  nsample = n;
+	  return kDecodeBadStart;
+	}
 
-		  
-		  // add to our adc vector
-		  if( std::abs(val) <= m_MaxDiff)
-		    {
-		      adc16_t newval = chdata.back() + val;
-		      chdata.push_back( newval );
-		      lastdelta = val;
-		    }
-		  else if(val == m_NSeqRepVal)
-		    {
-		      for(short j=0;j<m_NSeqRep;j++)
-			{
-			  adc16_t newval = chdata.back() + lastdelta; //add same value
-			  chdata.push_back( newval );
-			}
-		    }		
-		}// end of if
-	      
-	      // we got the whole sequence now
-	      if(chdata.size() == seqlen) break;
+      // handle compressed bits
+      size_t bitstoread = std::min( m_NbitsHC, nbits - pos );
+      if( bitstoread == 0 ) continue;
+      code     = (code << bitstoread) | PeekBits( ubuf, bufsize, pos, bitstoread );
+      codelen += bitstoread;
+      pos     += bitstoread;
 
-	    } // end while bitcounter
-	} // end else 
-      
-      // check if we finished decoding data for a given channel
-      if(chdata.size() == seqlen)
+      while( codelen > 0 && !badcode )
 	{
-	  
-	  // calculate number of padded bits to the byte boundary
-	  size_t padbits = bitsread % m_NbitsByte;
-	  if(padbits > 0) padbits = m_NbitsByte - padbits;
-	  
-	  if(m_Verbosity > 1)
-	    {
-	      msg_info<<"Bytes read : "<<byteidx<<endl
-		      <<"Bits read  : "<<bitsread<<endl
-		      <<"Bits to boundary : "<<padbits<<endl
-		      <<"Last value : "<<chdata.back()<<" ADC "<<endl;
-	    }
-	  
-	  // error checking
-	  if( bitqueue.size() < padbits )
+	  // look up the next m_MaxCodeSize bits
+	  uint64_t idx;
+	  if( codelen >= m_MaxCodeSize ) idx = code >> (codelen - m_MaxCodeSize);
+	  else idx = code << (m_MaxCodeSize - codelen);
+	  const HuffTableEntry_t &entry = m_DecTable[ idx & tablemask ];
+
+	  if( entry.len == 0 || entry.len > codelen )
 	    {
-	      msg_err<<"Fatal decoding error has been encountered : "<<endl
-		     <<"Byte boundary does not appear to be valid"<<endl
-		     <<"Check that the codes are padded with 0 to the next byte boundary"<<endl;
-	      abort();
+	      // no complete code yet
+	      if( codelen >= m_MaxCodeSize ) badcode = true;
+	      break;
 	    }
-	  
-	  // remove padded bits
-	  while(padbits > 0)
+	  codelen -= entry.len;
+	  code    &= (uint64_t(1) << codelen) - 1;
+
+	  // add to our adc sequence
+	  short val = entry.value;
+	  if( std::abs(val) <= m_MaxDiff)
 	    {
-	      bitqueue.pop_front();
-	      padbits--;
+	      last += val;
+	      if( STORE ) out[n] = last;
+	      n++;
+	      lastdelta = val;
 	    }
-	  
-	  // some basic check
-	  if(!bitqueue.empty())
+	  else if(val == m_NSeqRepVal)
 	    {
-	      if(bitqueue.front().test(0) && chread <= (nch-1) )
+	      size_t nrep = m_NSeqRep;
+	      if( n + nrep > seqlen )
 		{
-		  msg_err<<"Fatal decoding error had been encounter : "<<endl
-			 <<"The first bit of the next ch sequence should always be 0 and not "
-			 <<bitqueue.front()<<endl;
-		  abort();
+		  status = kDecodeOverflow;
+		  nrep   = seqlen - n;
+		}
+	      for(size_t j=0;j<nrep;j++)
+		{
+		  last += lastdelta; //add same value
+		  if( STORE ) out[n] = last;
+		  n++;
 		}
 	    }
-
-	  // reset the bitsread counter
-	  bitsread = 0;
-	  
-	  // save channel data
-	  adc.insert(adc.end(), chdata.begin(), chdata.end() );
-	  chread++;
-	  chdata.clear();
 	  
-	  if(m_Verbosity > 1)
-	    cout<<"Decoded "<<adc.size()<<" samples"<<endl<<endl;
+	  // we got the whole sequence now
+	  if( n >= seqlen ) break;
 	}
+      if( badcode ) codelen = 0;
+    } // end while
+  nsample = n;
+
+  // bits of the last packet after the last code are the byte padding:
+  // move to the byte boundary
+  pos -= codelen;
+  size_t padbits = pos % m_NbitsByte;
+  if(padbits > 0) padbits = m_NbitsByte - padbits;
+
+  if(m_Verbosity > 1)
+    {
+      msg_info<<"Bytes read : "<<(pos + padbits) / m_NbitsByte<<endl
+	      <<"Bits to boundary : "<<padbits<<endl
+	      <<"Last value : "<<last<<" ADC "<<endl;
+    }
+
+  // error checking
+  if( pos + padbits > nbits ) return kDecodeBadBoundary;
+  pos += padbits;
+  
+  return status;
+}
+
+
+//
+//
+//
+// find the end of a channel starting at bit pos like DecodeChData<false>
+// but counting the samples of a whole code packet at once
+//
+// With codes made of 0s ending with their only 1 and "1" for the
+// repetition, each 1 of the code stream ends a code: a repetition if it
+// starts the code (it follows a 1 or a raw packet), a difference
+// otherwise. Packets which the decoder would not read this way are left
+// to DecodeChData, which also gives the status of bad channels.
+HuffDataCompressor::DecodeStatus_t HuffDataCompressor::CountChData( const unsigned char *ubuf, 
+								     size_t bufsize, size_t &pos,
+								     size_t seqlen ) const
+{
+  const size_t start = pos;
+  auto decode = [&]()
+    {
+      size_t nsample = 0;
+      pos = start;
+      return DecodeChData<false>( ubuf, bufsize, pos, seqlen, nullptr, nsample );
+    };
+  if( !m_UnaryCodes ) return decode();
+
+  const size_t   nbits    = bufsize * m_NbitsByte;
+  const uint64_t paymask  = (uint64_t(1) << m_NbitsHC) - 1;
+  const uint64_t histmask = (uint64_t(1) << m_MaxCodeSize) - 1;
+
+  // last m_MaxCodeSize code bits before the packet: all 1 after a
+  // raw packet, where a new code starts
+  uint64_t hist = histmask;
+  size_t   n    = 0;
+  while( n < seqlen )
+    {
+      if( pos >= nbits ) return decode();
       
-      // basic consistency check
-      if(chread == nch)
+      // bits past the end of the buffer are read as 0
+      uint64_t packet = PeekBits( ubuf, bufsize, pos, m_PacketSize );
+      if( (packet >> m_NbitsHC) == 0 ) // uncompressed
 	{
-	  // let's see if we grabbed more bytes than needed
-	  if(bitqueue.size() > 0) // should be no more than 8
-	    {
-	      msg_info<<"Bits remaning in the queue "<<bitqueue.size()<<endl;
-	      byteidx--;
-	    }
-	  
-	  
-	  if(m_Verbosity > 0)
+	  if( pos + m_PacketSize > nbits ) return decode();
+	  n++;
+	  pos += m_PacketSize;
+	  hist = histmask;
+	  continue;
+	}
+      if( n == 0 ) return decode();
+
+      uint64_t bits = packet & paymask;
+      uint64_t w    = (hist << m_NbitsHC) | bits;
+      
+      // a 1 after m_MaxCodeSize 0s is not read as a code by the decoder
+      uint64_t run = ~w;
+      for(size_t len=1;len<m_MaxCodeSize;)
+	{
+	  size_t shift = std::min( len, m_MaxCodeSize - len );
+	  run &= run >> shift;
+	  len += shift;
+	}
+      uint64_t bad   = bits & (run >> 1);
+
+      uint64_t rep   = bits & (w >> 1);
+      size_t   nrep  = CountOnes16( rep );
+      size_t   nsamp = CountOnes16( bits ) - nrep + nrep * m_NSeqRep;
+      if( n + nsamp < seqlen )
+	{
+	  if( bad ) return decode();
+	  n   += nsamp;
+	  pos += m_PacketSize;
+	  hist = w & histmask;
+	  continue;
+	}
+
+      // the channel ends in this packet: find its last code, the bits
+      // after it are the padding and the next channel
+      for(size_t j=m_NbitsHC;j-- > 0;)
+	{
+	  if( ((bits >> j) & 1) == 0 ) continue;
+	  if( (bad >> j) & 1 ) return decode();
+	  n += ((rep >> j) & 1) ? m_NSeqRep : 1;
+	  if( n >= seqlen )
 	    {
-	      if(m_Verbosity > 1) 	      
-		msg_info<<"Bits remaning in the queue "<<bitqueue.size()<<endl;
-	      msg_info<<"DECOMPRESSED EVENT STATUS: OK "<<endl;
+	      pos += m_PacketSize - j;
+	      break;
 	    }
+	}
+    }
+  if( n > seqlen ) return decode();
+  
+  // move to the byte boundary
+  size_t padbits = pos % m_NbitsByte;
+  if(padbits > 0) padbits = m_NbitsByte - padbits;
+  if( pos + padbits > nbits ) return decode();
+  pos += padbits;
+  
+  return kDecodeOK;
+}
 
-	  // ok we are done
+
+//
+//
+// 
+// Decompress event from binary sequence (only single event)
+//
+void HuffDataCompressor::DecompressEventData( short nbadc,
+					      size_t nch,
+					      size_t seqlen, 
+					      const char *buf, size_t bufsize, size_t &byteidx,
+					      std::vector<adc16_t> &adc )
+{
+  if(!SetNbitsAdc( nbadc ))
+    {
+      msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
+      return;
+    }
+  adc.clear();
+  adc.resize( nch*seqlen );
+
+  const unsigned char *ubuf = reinterpret_cast<const unsigned char*>(buf);
+  const size_t nbits = bufsize * m_NbitsByte;
+
+  size_t pos = 0; // position in bits
+  byteidx    = 0;
+
+  for(size_t ch=0;ch<nch;ch++)
+    {
+      size_t nsample = 0;
+      DecodeStatus_t status = DecodeChData<true>( ubuf, bufsize, pos, seqlen, 
+						  adc.data() + ch*seqlen, nsample );
+      switch( status )
+	{
+	case kDecodeOK:
 	  break;
+	case kDecodeTruncated:
+	  msg_err<<"There seems to be a problem with decoding"<<endl
+		 <<"Bytes read "<<bufsize<<" out of "<<bufsize<<endl
+		 <<"Samples accumulated in this channel "<<nsample<<endl;
+	  adc.resize( ch*seqlen + nsample );
+	  byteidx = bufsize;
+	  return;
+	case kDecodeOverflow:
+	  msg_err<<"Decoded more samples in the channel than "<<seqlen<<endl;
+	  break;
+	case kDecodeBadRaw:
+	  msg_err<<"Fatal decoding error has been encountered : "<<endl
+		 <<" Number of bits in the uncompressed stream should be at least "
+		 <<m_NbitsHC<<" the current value is "<<nbits - pos<<endl;
+	  abort();
+	case kDecodeBadStart:
+	  msg_err<<"Fatal decoding error has been encountered : "<<endl
+		 <<" The channel sequence does not start with a raw ADC value"<<endl;
+	  abort();
+	case kDecodeBadBoundary:
+	  msg_err<<"Fatal decoding error has been encountered : "<<endl
+		 <<"Byte boundary does not appear to be valid"<<endl
+		 <<"Check that the codes are padded with 0 to the next byte boundary"<<endl;
+	  abort();
 	}
-    } // end while loop
+
+      // some basic check
+      if( ch + 1 < nch && pos < nbits && PeekBits( ubuf, bufsize, pos, 1 ) )
+	{
+	  msg_err<<"Fatal decoding error had been encounter : "<<endl
+		 <<"The first bit of the next ch sequence should always be 0 and not 1"<<endl;
+	  abort();
+	}
+
+      if(m_Verbosity > 1)
+	cout<<"Decoded "<<(ch+1)*seqlen<<" samples"<<endl<<endl;
+    }
+
+  byteidx = pos / m_NbitsByte;
+
+  if(m_Verbosity > 0)
+    msg_info<<"DECOMPRESSED EVENT STATUS: OK "<<endl;
+}
+
+
+//
+//
+//
+// Find the byte offsets of the channels of an event by counting the
+// samples of the codes without decoding them
+//
+bool HuffDataCompressor::IndexEventData( short nbadc,
+					 size_t nch,
+					 size_t seqlen, 
+					 const char *buf, size_t bufsize,
+					 std::vector<size_t> &choffsets )
+{
+  choffsets.clear();
+  if(!SetNbitsAdc( nbadc ))
+    {
+      msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
+      return false;
+    }
+
+  const unsigned char *ubuf = reinterpret_cast<const unsigned char*>(buf);
+  
+  choffsets.reserve( nch + 1 );
+  size_t pos = 0;
+  for(size_t ch=0;ch<nch;ch++)
+    {
+      choffsets.push_back( pos / m_NbitsByte );
+      if( CountChData( ubuf, bufsize, pos, seqlen ) != kDecodeOK )
+	{
+	  if(m_Verbosity > 0)
+	    msg_info<<"Could not index channel "<<ch<<" of the compressed event"<<endl;
+	  choffsets.clear();
+	  return false;
+	}
+    }
+  choffsets.push_back( pos / m_NbitsByte );
+
+  return true;
+}
+
+
+//
+//
+//
+// Decompress event from binary sequence using the channel offsets:
+// channels are decoded in parallel
+//
+void HuffDataCompressor::DecompressEventData( short nbadc,
+					      size_t nch,
+					      size_t seqlen, 
+					      const char *buf, size_t bufsize,
+					      const std::vector<size_t> &choffsets,
+					      size_t &byteidx,
+					      std::vector<adc16_t> &adc )
+{
+  bool goodindex = ( choffsets.size() == nch + 1 && choffsets.back() <= bufsize &&
+		     std::is_sorted( choffsets.begin(), choffsets.end() ) );
+  if( !goodindex || !SetNbitsAdc( nbadc ) )
+    {
+      if( goodindex ) msg_err<<"ADC "<<nbadc<<" bits exceeds max supported "<<m_MaxAdcBits<<endl;
+      else msg_err<<"Channel offsets do not match the event, decoding sequentially"<<endl;
+      return DecompressEventData( nbadc, nch, seqlen, buf, bufsize, byteidx, adc );
+    }
+
+  adc.clear();
+  adc.resize( nch*seqlen );
+
+  const unsigned char *ubuf = reinterpret_cast<const unsigned char*>(buf);
+
+  // each channel has to end exactly at the start of the next one:
+  // bits past it are read as 0 and cannot be taken from the next channel
+  std::atomic<bool> ok{true};
+  tbb::parallel_for( tbb::blocked_range<size_t>(0, nch),
+		     [&]( const tbb::blocked_range<size_t> &r )
+		     {
+		       for(size_t ch=r.begin();ch!=r.end();ch++)
+			 {
+			   size_t pos     = choffsets[ch] * m_NbitsByte;
+			   size_t nsample = 0;
+			   DecodeStatus_t status = DecodeChData<true>( ubuf, choffsets[ch+1], pos, seqlen,
+								       adc.data() + ch*seqlen, nsample );
+			   if( status != kDecodeOK || pos != choffsets[ch+1] * m_NbitsByte )
+			     ok = false;
+			 }
+		     } );
+
+  if( !ok )
+    {
+      msg_err<<"Channel offsets do not match the event, decoding sequentially"<<endl;
+      return DecompressEventData( nbadc, nch, seqlen, buf, bufsize, byteidx, adc );
+    }
+
+  byteidx = choffsets.back();
+
+  if(m_Verbosity > 0)
+    msg_info<<"DECOMPRESSED EVENT STATUS: OK "<<endl;
 }
 
 //
@@ -18,6 +18,7 @@
 
 #include "dlardaq.h"
 #include "LogMsg.h"
+#include "duneprototypes/Protodune/dualphase/RawDecoding/DPUnpack12.h"
 
 #include "art/Framework/Services/Registry/ServiceDefinitionMacros.h"
 using namespace std;
@@ -29,20 +30,7 @@ using namespace dlardaq;
 //
 void dlardaq::pack16into12(const void *in, void *out, size_t n8bit)
 {
-  const adc16_t* in16 = static_cast<const adc16_t*>(in);
-  BYTE* out8 = static_cast<BYTE*>(out);
-  BYTE* stop = out8 + n8bit;
-  
-  while(out8!=stop)
-    {
-      // we pack 2x12 bit values into 3x8bit
-      adc16_t v1 = *in16++;
-      adc16_t v2 = *in16++;
-      
-      *out8++ = ( v1 >> 4 ) & 0xff;
-      *out8++ = ( (v1 & 0xf) << 4 ) + ( ( v2 >> 8) & 0xf );
-      *out8++ = v2 & 0xff;
-    }
+  lris::pack16into12( static_cast<const adc16_t*>(in), out, n8bit );
 }
 
 //
@@ -51,20 +39,7 @@ void dlardaq::pack16into12(const void *in, void *out, size_t n8bit)
 //
 void dlardaq::unpack12into16(const void *in, void *out, size_t n8bit)
 {
-  const BYTE* in8  = static_cast<const BYTE*>(in);
-  const BYTE* stop = in8 + n8bit;
-
-  adc16_t* out16 = static_cast<adc16_t*>(out);
-
-  while(in8!=stop)
-    {
-      BYTE v1 = *in8++;
-      BYTE v2 = *in8++;
-      BYTE v3 = *in8++;
-
-      *out16++ = ((v1 << 4) + ((v2 >> 4) & 0xf)) & 0xfff;
-      *out16++ = (((v2 & 0xf) << 8 ) + (v3 & 0xff)) & 0xfff;
-    }
+  lris::unpack12into16( in, static_cast<adc16_t*>(out), n8bit );
 }
 
 //
@@ -0,0 +1,281 @@
+// test_HuffDataCompressor.cxx
+//
+// Round-trip fuzz test of the Huffman compression of HuffDataCompressor.
+// Random channel data are compressed with CompressEventData and with the
+// string-based encoder HuffDataCompressor used before its encoder and
+// decoder became table driven; the two byte streams must be identical, and
+// DecompressEventData must give back the input data and the stream length,
+// also when the channels are decoded in parallel from the channel index.
+
+#include <string>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <map>
+#include <bitset>
+#include <cstdint>
+#include <cstdlib>
+#include "duneprototypes/3x1x1dp/DataImport/Services/HuffDataCompressor.h"
+
+#undef NDEBUG
+#include <cassert>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using dlardaq::adc16_t;
+using dlardaq::BYTE;
+using dlardaq::HuffDataCompressor;
+
+//**********************************************************************
+
+// Reference: the string-based encoder of HuffDataCompressor before the tables.
+class ReferenceEncoder {
+public:
+  ReferenceEncoder() {
+    codes[0]  = "01";
+    codes[-1] = "001";
+    codes[1]  = "0001";
+    codes[-2] = "00001";
+    codes[2]  = "000001";
+    codes[-3] = "0000001";
+    codes[3]  = "00000001";
+    codes[repval] = "1";
+  }
+
+  void compressCh(short nbadc, const vector<adc16_t>& raw_in, vector<BYTE>& bin_out) {
+    const size_t nbitshc = nbadc;
+    const size_t packetsize = nbitshc + 1;
+    struct Accum { string codestr; short value; short nrep; };
+    vector<Accum> buffer;
+    for ( size_t i=0; i<raw_in.size(); ++i ) {
+      short delta = i == 0 ? maxdiff + 1 : raw_in[i] - raw_in[i-1];
+      if ( std::abs(delta) > maxdiff ) {
+        buffer.push_back({"", (short)raw_in[i], 0});
+      } else if ( buffer.back().value == delta && !buffer.back().codestr.empty() ) {
+        buffer.back().nrep += 1;
+      } else {
+        buffer.push_back({codes[delta], delta, 0});
+      }
+    }
+    string bitword, partbyte;
+    for ( const Accum& acc : buffer ) {
+      if ( acc.codestr.empty() ) {
+        if ( bitword.size() > 1 ) {
+          while ( bitword.size() < packetsize ) bitword += "0";
+          addWords(bitword, bin_out, partbyte);
+        }
+        string s = std::bitset<16>(acc.value).to_string();
+        bitword = "0" + s.substr(s.size() - nbitshc);
+        addWords(bitword, bin_out, partbyte);
+        bitword = "1";
+        continue;
+      }
+      for ( short jj=0; jj<=acc.nrep; ++jj ) {
+        if ( jj == 0 ) bitword += acc.codestr;
+        else if ( jj + nseqrep <= acc.nrep ) {
+          bitword += codes[repval];
+          jj += nseqrep - 1;
+        } else bitword += acc.codestr;
+        if ( bitword.size() >= packetsize ) {
+          if ( bitword.size() == packetsize ) {
+            addWords(bitword, bin_out, partbyte);
+            bitword = "1";
+          } else {
+            addWords(bitword.substr(0, packetsize), bin_out, partbyte);
+            bitword = "1" + bitword.substr(packetsize);
+          }
+        }
+      }
+    }
+    if ( bitword.size() > 1 ) addWords(bitword, bin_out, partbyte);
+    addWords("", bin_out, partbyte);
+  }
+
+private:
+  static constexpr short maxdiff = 3;
+  static constexpr short nseqrep = 4;
+  static constexpr short repval = maxdiff + nseqrep;
+  std::map<short, string> codes;
+
+  void addWords(string words, vector<BYTE>& buf, string& partbyte) {
+    if ( words.empty() && partbyte.empty() ) return;
+    if ( words.size() < 8 && partbyte.empty() ) {
+      partbyte = words;
+      return;
+    }
+    if ( words.empty() && !partbyte.empty() ) {
+      while ( partbyte.size() < 8 ) partbyte += "0";
+      buf.push_back(strtoul(partbyte.c_str(), 0, 2) & 0xff);
+      partbyte.clear();
+      return;
+    }
+    for ( char c : words ) {
+      if ( partbyte.size() == 8 ) {
+        buf.push_back(strtoul(partbyte.c_str(), 0, 2) & 0xff);
+        partbyte.clear();
+      }
+      partbyte += c;
+    }
+  }
+};
+
+//**********************************************************************
+
+// Random channel data: a random walk with small steps, runs of equal steps
+// (exercising the repetition code), occasional jumps and flat stretches.
+vector<adc16_t> randomChannel(std::mt19937& gen, short nbadc, size_t seqlen) {
+  const int maxadc = (1 << nbadc) - 1;
+  std::uniform_int_distribution<int> adcdist(0, maxadc);
+  std::uniform_int_distribution<int> stepdist(-4, 4);
+  std::uniform_int_distribution<int> rundist(1, 12);
+  std::uniform_int_distribution<int> kinddist(0, 9);
+  vector<adc16_t> data;
+  int val = adcdist(gen);
+  while ( data.size() < seqlen ) {
+    int kind = kinddist(gen);
+    int step = kind == 0 ? adcdist(gen) - val : kind < 3 ? 0 : stepdist(gen);
+    int nrun = kind == 0 ? 1 : rundist(gen);
+    for ( int irun=0; irun<nrun && data.size()<seqlen; ++irun ) {
+      val += step;
+      if ( val < 0 || val > maxadc ) val = adcdist(gen);
+      data.push_back(val);
+    }
+  }
+  return data;
+}
+
+//**********************************************************************
+
+int test_HuffDataCompressor(size_t nevent =500) {
+  const string myname = "test_HuffDataCompressor: ";
+#ifdef NDEBUG
+  cout << myname << "NDEBUG must be off." << endl;
+  abort();
+#endif
+  string line = "-----------------------------";
+
+  HuffDataCompressor& huff = HuffDataCompressor::Instance();
+  ReferenceEncoder ref;
+  std::mt19937 gen(12345);
+  std::uniform_int_distribution<int> nbadcdist(8, 15);
+  std::uniform_int_distribution<size_t> nchdist(1, 6);
+  std::uniform_int_distribution<size_t> seqdist(1, 400);
+
+  cout << myname << line << endl;
+  cout << myname << "Compressing and decompressing " << nevent << " random events." << endl;
+  size_t nbytes = 0;
+  size_t nsample = 0;
+  for ( size_t iev=0; iev<nevent; ++iev ) {
+    short nbadc = iev < 8 ? 12 : nbadcdist(gen);
+    size_t nch = nchdist(gen);
+    size_t seqlen = iev % 50 == 0 ? 1 : seqdist(gen);
+    vector<adc16_t> raw;
+    for ( size_t ich=0; ich<nch; ++ich ) {
+      vector<adc16_t> chdata = randomChannel(gen, nbadc, seqlen);
+      raw.insert(raw.end(), chdata.begin(), chdata.end());
+    }
+
+    vector<BYTE> refout;
+    for ( size_t ich=0; ich<nch; ++ich ) {
+      vector<adc16_t> chdata(raw.begin() + ich*seqlen, raw.begin() + (ich+1)*seqlen);
+      ref.compressCh(nbadc, chdata, refout);
+    }
+    vector<BYTE> out;
+    huff.CompressEventData(nbadc, nch, seqlen, raw, out);
+    assert( out == refout );
+
+    // Trailing bytes of a following event must not be read.
+    vector<BYTE> buf(out);
+    buf.push_back(static_cast<BYTE>(0x80));
+    buf.push_back(0x55);
+    vector<adc16_t> back;
+    size_t byteidx = 0;
+    huff.DecompressEventData(nbadc, nch, seqlen, buf.data(), buf.size(), byteidx, back);
+    assert( back == raw );
+    assert( byteidx == out.size() );
+
+    // The channel index from the compressor and from the scan must agree
+    // and give the same data when decoding the channels in parallel.
+    vector<size_t> choffsets;
+    huff.CompressEventData(nbadc, nch, seqlen, raw, out, &choffsets);
+    assert( out == refout );
+    assert( choffsets.size() == nch + 1 );
+    assert( choffsets.front() == 0 && choffsets.back() == out.size() );
+    vector<size_t> scanoffsets;
+    assert( huff.IndexEventData(nbadc, nch, seqlen, buf.data(), buf.size(), scanoffsets) );
+    assert( scanoffsets == choffsets );
+    back.clear();
+    byteidx = 0;
+    huff.DecompressEventData(nbadc, nch, seqlen, buf.data(), buf.size(), choffsets, byteidx, back);
+    assert( back == raw );
+    assert( byteidx == out.size() );
+    nbytes += out.size();
+    nsample += raw.size();
+  }
+  cout << myname << "Compressed " << nsample << " samples into " << nbytes << " bytes." << endl;
+
+  cout << myname << line << endl;
+  cout << myname << "Checking a flat channel." << endl;
+  {
+    vector<adc16_t> raw(1000, 2048);
+    vector<BYTE> refout;
+    ref.compressCh(12, raw, refout);
+    vector<BYTE> out;
+    huff.CompressEventData(12, 1, raw.size(), raw, out);
+    assert( out == refout );
+    vector<adc16_t> back;
+    size_t byteidx = 0;
+    huff.DecompressEventData(12, 1, raw.size(), out.data(), out.size(), byteidx, back);
+    assert( back == raw );
+    assert( byteidx == out.size() );
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Checking that a bad channel index is not used." << endl;
+  {
+    const size_t nch = 8;
+    const size_t seqlen = 300;
+    vector<adc16_t> raw;
+    for ( size_t ich=0; ich<nch; ++ich ) {
+      vector<adc16_t> chdata = randomChannel(gen, 12, seqlen);
+      raw.insert(raw.end(), chdata.begin(), chdata.end());
+    }
+    vector<BYTE> out;
+    vector<size_t> choffsets;
+    huff.CompressEventData(12, nch, seqlen, raw, out, &choffsets);
+    vector<vector<size_t>> badoffsets(3, choffsets);
+    badoffsets[0].pop_back();
+    badoffsets[1][3] += 1;
+    badoffsets[2][5] = badoffsets[2][6];
+    for ( const vector<size_t>& offsets : badoffsets ) {
+      vector<adc16_t> back;
+      size_t byteidx = 0;
+      huff.DecompressEventData(12, nch, seqlen, out.data(), out.size(), offsets, byteidx, back);
+      assert( back == raw );
+      assert( byteidx == out.size() );
+    }
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Done." << endl;
+  return 0;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  size_t nevent = 500;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NEVENT]" << endl;
+      return 0;
+    }
+    nevent = std::stoul(sarg);
+  }
+  return test_HuffDataCompressor(nevent);
+}
+
+//**********************************************************************
@@ -10,6 +10,7 @@
 #include "lardataobj/RawData/RDTimeStamp.h"
 #include "artdaq-core/Data/Fragment.hh"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
 #include "daqdataformats/v3_3_3/Fragment.hpp"
 #include <hdf5.h>
 
@@ -73,6 +74,7 @@ class HDColdboxDataInterface : public PDSPTPCDataInterfaceParent {
   unsigned int fMaxChan = 1000000;  // no maximum for now
   unsigned int fDefaultCrate = 3;
   int fDebugLevel = 0;   // switch to turn on debugging printout
+  bool fHistogramPedestal = false;  // pedestals from AdcPedestalEstimator::compute instead of TMath
 
 };
 
@@ -10,6 +10,7 @@
 #include "lardataobj/RawData/RDTimeStamp.h"
 #include "artdaq-core/Data/Fragment.hh"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
 #include "daqdataformats/v3_3_3/Fragment.hpp"
 #include <hdf5.h>
 
@@ -69,6 +70,7 @@ class VDColdboxDataInterface : public PDSPTPCDataInterfaceParent {
   std::string fFileInfoLabel;
 
   int fMaxChan = 1000000;  // no maximum for now
+  bool fHistogramPedestal = false;  // pedestals from AdcPedestalEstimator::compute instead of TMath
 
 };
 
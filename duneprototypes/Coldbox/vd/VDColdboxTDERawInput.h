@@ -16,7 +16,10 @@
 
 #include "lardataobj/RawData/RawDigit.h"
 
+#include "duneprototypes/Protodune/dualphase/RawDecoding/RawEventPrefetcher.h"
+
 #include <fstream>
+#include <memory>
 #include <string>
 
 namespace raw {
@@ -107,10 +110,15 @@ class raw::VDColdboxTDERawInput
   uint32_t                    __eventNum;
   
   int                         __maxEvents;
+  bool                        __histPedestal;
 
   // number of uncompressed samples per channel
   size_t __nsacro;
   size_t __start_tde_cru;
+
+  // read-ahead of the next event records (null if disabled)
+  std::unique_ptr<lris::RawEventPrefetcher> __prefetch;
+  std::vector<BYTE> __evbuf;
     
   // close binary file
   void __close();
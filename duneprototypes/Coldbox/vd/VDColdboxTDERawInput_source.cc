@@ -10,13 +10,14 @@
 #include "lardataobj/RawData/RDTimeStamp.h"
 #include "canvas/Utilities/Exception.h"
 
-#include "TMath.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
 
 // DUNE includes
 #include "dunecore/DuneObj/RDStatus.h"
 
 #include "duneprototypes/Coldbox/vd/VDColdboxTDERawInput.h"
 #include "duneprototypes/Coldbox/vd/ChannelMap/VDColdboxTDEChannelMapService.h"
+#include "duneprototypes/Protodune/dualphase/RawDecoding/DPUnpack12.h"
 
 #include <exception>
 #include <thread>
@@ -47,34 +48,12 @@ namespace
   // from VDColdboxHDF5Utils
   void getMedianSigma(const raw::RawDigit::ADCvector_t &v_adc, 
 		      float &median,
-		      float &sigma) {
-    size_t asiz = v_adc.size();
-    int imed=0;
-    if (asiz == 0) {
-      median = 0;
-      sigma = 0;
-    }
-    else {
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
-
-      // add in a correction suggested by David Adams, May 6, 2019
-
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i = 0; i < asiz; ++i) {
-	if (v_adc.at(i) < imed) s1++;
-	if (v_adc.at(i) == imed) sm++;
-      }
-      if (sm > 0) {
-	float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-	//if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
-	median += mcorr;
-      }
-    }
+		      float &sigma,
+		      bool histogram) {
+    if( histogram )
+      AdcPedestalEstimator::compute(v_adc, median, sigma);
+    else
+      AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
   }
   
   void unpackData( const char *buf, size_t nb, bool cflag, 
@@ -83,26 +62,15 @@ namespace
     //data.clear();
     if( !cflag ) // unpack the uncompressed data into RawDigit
       {
-	data.push_back( raw::RawDigit::ADCvector_t(nsa) );
-	size_t sz = 0;
-	const BYTE* start = buf;
-	const BYTE* stop  = start + nb;
-	while(start!=stop)
+	if( nb < 3 )
 	  {
-	    BYTE v1 = *start++;
-	    BYTE v2 = *start++;
-	    BYTE v3 = *start++;
-	    
-	    uint16_t tmp1 = ((v1 << 4) + ((v2 >> 4) & 0xf)) & 0xfff;
-	    uint16_t tmp2 = (((v2 & 0xf) << 8 ) + (v3 & 0xff)) & 0xfff;
-	    
-	    
-	    if( sz == nsa ){ data.push_back(raw::RawDigit::ADCvector_t(nsa)); sz = 0; }
-	    data.back()[sz++] = (short)tmp1;
-	    
-	    if( sz == nsa ){ data.push_back(raw::RawDigit::ADCvector_t(nsa)); sz = 0; }
-	    data.back()[sz++] = (short)tmp2;
+	    data.push_back( raw::RawDigit::ADCvector_t(nsa) );
+	    return;
 	  }
+	// allocate all channels of the block, then unpack them at once
+	size_t first = data.size();
+	data.resize( first + lris::channels12( nb, nsa ) );
+	lris::unpack12Channels( buf, nb, nsa, &data[first] );
       }
     else { 
       // should not happen ... The data are not compressed for VD coldbox
@@ -154,8 +122,14 @@ namespace raw
     __outlbl_rdtime  = pset.get<std::string>("OutputLabelRDTime", "daq");
     __outlbl_status  = pset.get<std::string>("OutputLabelRDStatus", "daq");
     __maxEvents      = pset.get<int>("maxEvents", -1);
+    __histPedestal   = pset.get<bool>("HistogramPedestal", false);
+    unsigned nprefetch = pset.get<unsigned>("PrefetchEvents", 2);
     auto vecped_crps = pset.get<std::vector<UIntVec>>("InvertBaseline", std::vector<UIntVec>());
     auto select_crps = pset.get<std::vector<unsigned>>("SelectCRPs", std::vector<unsigned>());
+
+    // background reader for the next event records
+    if( nprefetch > 0 )
+      __prefetch = std::make_unique<lris::RawEventPrefetcher>( nprefetch );
         
     std::map<unsigned, unsigned> invped_crps;
     if( !vecped_crps.empty() ){
@@ -176,6 +150,8 @@ namespace raw
 	std::cout << myname << "       LogLevel             : " << __logLevel  << std::endl;
 	std::cout << myname << "       SamplesPerChannel    : " << __nsacro << std::endl;
 	std::cout << myname << "       maxEvents            : " << __maxEvents << std::endl;
+	std::cout << myname << "       HistogramPedestal    : " << __histPedestal << std::endl;
+	std::cout << myname << "       PrefetchEvents       : " << nprefetch << std::endl;
 	std::cout << myname << "       StartTDEChCRU        : " << __start_tde_cru << std::endl;
 	std::cout << myname << "       OutputLabelRawDigits : " << __outlbl_digits << std::endl;
 	std::cout << myname << "       OutputLabelRDStatus  : " << __outlbl_status << std::endl;
@@ -308,6 +284,14 @@ namespace raw
 
     __currentSubRunID = art::SubRunID();
     __file_seqno      = __get_file_seqno( name );
+
+    // start reading ahead now that the event table is known
+    if( __prefetch )
+      {
+	size_t nev = __eventNum;
+	if( __maxEvents > 0 && (size_t)__maxEvents < nev ) nev = __maxEvents;
+	__prefetch->start( name, __events, __evsz, nev );
+      }
   }
 
 
@@ -329,13 +313,20 @@ namespace raw
       return false;
     }
     
-    // move to the next file position
-    if( __events[ __eventCtr ] != __file.tellg() )
-      __file.seekg( __events[ __eventCtr ], std::ios::beg );
-    size_t bsz = __evsz[ __eventCtr ];
-    
-    std::vector<BYTE> buf;
-    __readChunk( buf, bsz );
+    std::vector<BYTE> &buf = __evbuf;
+    if( __prefetch )
+      {
+	// already read (or being read) in the background
+	if( !__prefetch->next( buf ) ) return false;
+      }
+    else
+      {
+	// move to the next file position
+	if( __events[ __eventCtr ] != __file.tellg() )
+	  __file.seekg( __events[ __eventCtr ], std::ios::beg );
+	size_t bsz = __evsz[ __eventCtr ];
+	__readChunk( buf, bsz );
+      }
     
     // increment our event counter
     __eventCtr++;
@@ -411,7 +402,7 @@ namespace raw
 	  }
 
 	  float median = 0., sigma = 0.;
-	  getMedianSigma(event.crodata[daqch], median, sigma);
+	  getMedianSigma(event.crodata[daqch], median, sigma, __histPedestal);
 	  data->push_back( raw::RawDigit(ch, __nsacro, 
 					 std::move( event.crodata[daqch] ), 
 					 event.compression) );
@@ -464,6 +455,9 @@ namespace raw
   ///
   void VDColdboxTDERawInput::__close()
   {
+    if( __prefetch )
+      __prefetch->stop();
+
     if(__file.is_open())
       __file.close();  
   
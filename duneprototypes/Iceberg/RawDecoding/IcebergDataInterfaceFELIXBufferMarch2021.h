@@ -16,6 +16,7 @@
 #ifndef IcebergDataInterfaceFELIXBufferMarch2021_H
 #define IcebergDataInterfaceFELIXBufferMarch2021_H
 
+#include <memory>
 #include <vector>
 
 #include "art/Utilities/ToolMacros.h"
@@ -30,6 +31,8 @@
 #include "lardataobj/RawData/RawDigit.h"
 #include "lardataobj/RawData/RDTimeStamp.h"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
+#include "duneprototypes/Iceberg/RawDecoding/IcebergFELIXBufferFile.h"
 
 class IcebergDataInterfaceFELIXBufferMarch2021 : public PDSPTPCDataInterfaceParent {
 
@@ -61,13 +64,14 @@ class IcebergDataInterfaceFELIXBufferMarch2021 : public PDSPTPCDataInterfacePare
 
   // open files
 
-  std::vector<FILE*> fInputFilePointers;
+  std::vector<std::unique_ptr<iceberg::rawdecoding::IcebergFELIXBufferFile>> fInputBuffers;
 
   // configuration parameters
 
   std::vector<std::string>   fInputFiles; 
   size_t                     fNSamples;
   bool                       fCompressHuffman;
+  bool                       fHistogramPedestal;
   ULong64_t                  fDesiredStartTimestamp;
   bool                       fFirstRead;
 
@@ -79,8 +83,6 @@ class IcebergDataInterfaceFELIXBufferMarch2021 : public PDSPTPCDataInterfacePare
 
   // private methods
 
-  void unpack14(const uint32_t *packed, uint16_t *unpacked);
-
   void computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, 
                           float &median, 
                           float &sigma);
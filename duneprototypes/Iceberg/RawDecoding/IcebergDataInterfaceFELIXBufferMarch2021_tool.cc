@@ -5,24 +5,32 @@
 #include "TString.h"
 #include <iostream>
 #include <set>
+#include <algorithm>
 #include "lardataobj/RawData/raw.h"
 
 #include "art/Framework/Services/Registry/ServiceHandle.h"
 
 // artdaq and dunepdlegacy includes
 #include "dunepdlegacy/Services/ChannelMap/IcebergChannelMapService.h"
+#include "duneprototypes/Iceberg/RawDecoding/IcebergUnpack14.h"
 
 IcebergDataInterfaceFELIXBufferMarch2021::IcebergDataInterfaceFELIXBufferMarch2021(fhicl::ParameterSet const& p)
 {
   fInputFiles = p.get<std::vector<std::string>>("InputFiles");
   fNSamples = p.get<size_t>("NSamples",2000);
   fCompressHuffman = p.get<bool>("CompressHuffman",false);
+  fHistogramPedestal = p.get<bool>("HistogramPedestal",false);
   fDesiredStartTimestamp = p.get<ULong64_t>("StartTimestamp",0);
 
-  fInputFilePointers.clear();
+  fInputBuffers.clear();
   for (size_t ifile=0; ifile<fInputFiles.size(); ++ifile)
     {
-      fInputFilePointers.push_back(fopen(fInputFiles.at(ifile).data(),"r"));
+      fInputBuffers.push_back(std::make_unique<iceberg::rawdecoding::IcebergFELIXBufferFile>(fInputFiles.at(ifile)));
+      if (!fInputBuffers.back()->isOpen())
+        {
+          throw cet::exception("IcebergDataInterfaceFELIXBufferMarch2021") <<
+            "Cannot open file " << fInputFiles.at(ifile);
+        }
     }
   fFirstRead = true;
 }
@@ -39,10 +47,8 @@ int IcebergDataInterfaceFELIXBufferMarch2021::retrieveData(art::Event &e,
 
   art::ServiceHandle<dune::IcebergChannelMapService> channelMap;
 
-  uint32_t framebuf[117];
-  uint16_t databuf[128];
+  uint16_t databuf[iceberg::rawdecoding::kIcebergFrameChannels];
   uint64_t timestampstart=0;
-  uint64_t timestamp=0;
 
   raw_digits.clear();
   rd_timestamps.clear();
@@ -50,128 +56,86 @@ int IcebergDataInterfaceFELIXBufferMarch2021::retrieveData(art::Event &e,
 
   size_t nfiles = fInputFiles.size();
 
+  // close all the input files and return nothing if we hit eof before the data
+
+  auto closeFiles = [this]()
+    {
+      for (auto &file : fInputBuffers) file.reset();
+    };
+  for (auto &file : fInputBuffers)
+    {
+      if (!file) return 0;
+    }
+
   // search for the first timestamp on the first read
   // don't do on subsequent reads so we don't always read in a frame just to see what
   // the timestamp is.
 
   if (fFirstRead)
     {
-      for (size_t ifile=0; ifile < nfiles; ++ ifile)
+      uint64_t first_timestamp = (fDesiredStartTimestamp > 16) ? fDesiredStartTimestamp - 16 : 0;
+      for (auto &file : fInputBuffers)
         {
-          do
+          size_t iframe = file->findTimestamp(first_timestamp, file->position());
+          if (iframe >= file->nFrames())
             {
-              if (fInputFilePointers.at(ifile) == 0) return 0;
-              fread(framebuf, sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-              if (feof(fInputFilePointers.at(ifile)))
-                {
-                  // close all the input files and return nothing if we hit eof here
-                  for (size_t jfile = 0; jfile < nfiles; ++jfile)
-                    {
-                      fclose(fInputFilePointers.at(jfile));
-                      fInputFilePointers.at(jfile) = 0;
-                    }
-                  return 0;
-                }
-              timestamp= framebuf[3];
-              timestamp <<= 32;
-              timestamp += framebuf[2];
+              closeFiles();
+              return 0;
             }
-          while (timestamp+16 < fDesiredStartTimestamp);
+          file->setPosition(iframe + 1);
         }
       fFirstRead = false;
     }
 
-  // align the readin
+  // align the readin:  the next frame of each file tells what the latest timestamp is,
+  // then each file starts at its first frame within 16 ticks of it
 
-  std::vector<std::vector<uint32_t>> fbcache(nfiles);
-  std::vector<uint64_t> tscache;
+  std::vector<size_t> firstframe(nfiles);
   uint64_t latest_timestamp=0;
 
-  // read one frame in from each file to see what the latest timestamp is
-
-  for (size_t ifile=0; ifile<nfiles; ++ifile)
+  for (auto &file : fInputBuffers)
     {
-      fbcache.at(ifile).resize(117);
-      if (fInputFilePointers.at(ifile) == 0) return 0;
-      fread(fbcache.at(ifile).data(), sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-      if (feof(fInputFilePointers.at(ifile)))
+      if (file->position() >= file->nFrames())
         {
-          //  close all the input files and return nothing if we hit eof here
-          for (size_t jfile = 0; jfile < nfiles; ++jfile)
-            {
-              fclose(fInputFilePointers.at(jfile));
-              fInputFilePointers.at(jfile) = 0;
-            }
+          closeFiles();
           return 0;
         }
-      timestamp= fbcache.at(ifile)[3];
-      timestamp <<= 32;
-      timestamp += fbcache.at(ifile)[2];
-      tscache.push_back(timestamp);
-      if (timestamp > latest_timestamp)
-        {
-          latest_timestamp = timestamp;
-        }
+      latest_timestamp = std::max(latest_timestamp, file->timestamp(file->position()));
     }
 
-  // read enough frames from the other files so that we align the frames to +- 16 ticks
-
   for (size_t ifile=0; ifile<nfiles; ++ifile)
     {
-      while (tscache.at(ifile) + 16 < latest_timestamp)
+      auto &file = fInputBuffers.at(ifile);
+      uint64_t aligned_timestamp = (latest_timestamp > 16) ? latest_timestamp - 16 : 0;
+      firstframe.at(ifile) = file->findTimestamp(aligned_timestamp, file->position());
+      if (firstframe.at(ifile) >= file->nFrames())
         {
-          if (fInputFilePointers.at(ifile) == 0) return 0;
-          fread(fbcache.at(ifile).data(), sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-          if (feof(fInputFilePointers.at(ifile)))
-            {
-              // close all the input files and return nohting if we hit eof here
-              for (size_t jfile = 0; jfile < nfiles; ++jfile)
-                {
-                  fclose(fInputFilePointers.at(jfile));
-                  fInputFilePointers.at(jfile) = 0;
-                }
-              return 0;
-            }
-          timestamp= fbcache.at(ifile)[3];
-          timestamp <<= 32;
-          timestamp += fbcache.at(ifile)[2];
-          tscache.at(ifile) = timestamp;
+          closeFiles();
+          return 0;
         }
+      file->prefetch(firstframe.at(ifile), fNSamples);
     }  
 
-  // actually read in the data now -- we already have the first tick read.
+  // actually read in the data now.  If a file ends during the event, return what we have
+  // and close all the input files.
 
+  bool at_end = false;
   for (size_t ifile=0; ifile < nfiles; ++ ifile)
     {
-      if (fInputFilePointers.at(ifile) == 0) break;
+      if (at_end) break;
+      auto &file = fInputBuffers.at(ifile);
       int slot = 0;
       int fiber = 0;
 
+      size_t nticks = std::min(fNSamples, file->nFrames() - firstframe.at(ifile));
+      if (nticks < fNSamples) at_end = true;
+      file->setPosition(firstframe.at(ifile) + nticks);
+
       std::vector<raw::RawDigit::ADCvector_t> adcvv(256);
-      for (size_t itick=0; itick<fNSamples; ++itick)
+      for (auto &adcv : adcvv) adcv.reserve(nticks);
+      for (size_t itick=0; itick<nticks; ++itick)
         {
-          if (itick == 0)  // already read in the first frame
-            {
-              for (size_t i=0; i<117; ++i)
-                {
-                  framebuf[i] = fbcache.at(ifile).at(i);
-                }
-            }
-          else
-            {
-              fread(framebuf, sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-              if (feof(fInputFilePointers.at(ifile)))
-                {
-                  // close all the input files and return what we have.
-                  for (size_t jfile = 0; jfile < nfiles; ++jfile)
-                    {
-                      fclose(fInputFilePointers.at(jfile));
-                      fInputFilePointers.at(jfile) = 0;
-                    }
-                  break;
-                }
-            }
-
+          const uint32_t *framebuf = file->frame(firstframe.at(ifile) + itick);
           int curslot = (framebuf[0] & 0x7000) >> 12;   // assume these are all the same
           int curfiber = (framebuf[0] & 0x8000) >> 15;
           if (itick>0)
@@ -193,7 +157,7 @@ int IcebergDataInterfaceFELIXBufferMarch2021::retrieveData(art::Event &e,
               fiber = curfiber;
             }
 
-          timestamp= framebuf[3];
+          uint64_t timestamp= framebuf[3];
           timestamp <<= 32;
           timestamp += framebuf[2];
           //std::cout << std::dec << "   Slot: " << slot << " Fiber: " << fiber 
@@ -205,15 +169,10 @@ int IcebergDataInterfaceFELIXBufferMarch2021::retrieveData(art::Event &e,
 
           // do the data-rearrangement transpose
 
-          unpack14(&(framebuf[4]),databuf);
-          for (size_t ichan=0; ichan<128; ++ichan)
-            {
-              adcvv.at(ichan).push_back(databuf[ichan]);
-            }
-          unpack14(&(framebuf[4+56]),databuf);
-          for (size_t ichan=0; ichan<128; ++ichan)
+          iceberg::rawdecoding::unpackIcebergFrame(framebuf,databuf);
+          for (size_t ichan=0; ichan<256; ++ichan)
             {
-              adcvv.at(ichan+128).push_back(databuf[ichan]);
+              adcvv[ichan].push_back(databuf[ichan]);
             }
         }
 
@@ -303,6 +262,8 @@ int IcebergDataInterfaceFELIXBufferMarch2021::retrieveData(art::Event &e,
 
         }
     }
+  if (at_end) closeFiles();
+
   // default all good status
   unsigned int statword = 0;
   rdstatuses.emplace_back(false,false,statword);
@@ -342,56 +303,10 @@ int IcebergDataInterfaceFELIXBufferMarch2021::retrieveDataAPAListWithLabels(art:
 
 void IcebergDataInterfaceFELIXBufferMarch2021::computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma)
 {
-  size_t asiz = v_adc.size();
-  int imed=0;
-  if (asiz == 0)
-    {
-      median = 0;
-      sigma = 0;
-    }
+  if (fHistogramPedestal)
+    AdcPedestalEstimator::compute(v_adc, median, sigma);
   else
-    {
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
-
-      // add in a correction suggested by David Adams, May 6, 2019
-
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i=0; i<asiz; ++i)
-        {
-          if (v_adc[i] < imed) s1++;
-          if (v_adc[i] == imed) sm++;
-        }
-      if (sm > 0)
-        {
-          float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-          //if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
-          median += mcorr;
-        }
-    }
-}
-
-void IcebergDataInterfaceFELIXBufferMarch2021::unpack14(const uint32_t *packed, uint16_t *unpacked) {
-  for (size_t i = 0; i < 128; i++) { // i == n'th U,V,X value
-    const size_t low_bit = i*14;
-    const size_t low_word = low_bit / 32;
-    const size_t high_bit = (i+1)*14-1;
-    const size_t high_word = high_bit / 32;
-    //std::cout << "low_word, high_word: " << low_word << " " << high_word << std::endl;
-    //glog.log("word %li :: low %li (%li[%li]) high %li (%li[%li])\n",i,low_bit,low_word,low_bit%32,high_bit,high_word,high_bit%32);
-    if (low_word == high_word) { //all the bits are in the same word
-      unpacked[i] = (packed[low_word] >> (low_bit%32)) & 0x3FFF;
-    } else { //some of the bits are in the next word
-      size_t high_off = high_word*32-low_bit;
-      //glog.log("pre_mask 0x%X post_mask 0x%X\n", (0x3FFF >> (14-high_off)), ((0x3FFF << high_off) & 0x3FFF) );
-      unpacked[i] = (packed[low_word] >> (low_bit%32)) & (0x3FFF >> (14-high_off));
-      unpacked[i] |= (packed[high_word] << high_off) & ((0x3FFF << high_off) & 0x3FFF);
-    }
-  }
+    AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
 }
 
 DEFINE_ART_CLASS_TOOL(IcebergDataInterfaceFELIXBufferMarch2021)
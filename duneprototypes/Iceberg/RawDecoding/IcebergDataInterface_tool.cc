@@ -66,6 +66,7 @@ IcebergDataInterface::IcebergDataInterface(fhicl::ParameterSet const& p)
   _full_tick_count = p.get<unsigned int>("FullTickCount",6000);
   _enforce_error_free = p.get<bool>("EnforceErrorFree",false);
   _enforce_no_duplicate_channels = p.get<bool>("EnforceNoDuplicateChannels", true);
+  _histogram_pedestal = p.get<bool>("HistogramPedestal", false);
 }
 
 // wrapper for backward compatibility.  Return data for all APA's represented in the fragments on these labels
@@ -1140,37 +1141,10 @@ bool IcebergDataInterface::_process_FELIX_AUX(art::Event &evt,
 
 void IcebergDataInterface::computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma)
 {
-  size_t asiz = v_adc.size();
-  int imed=0;
-  if (asiz == 0)
-    {
-      median = 0;
-      sigma = 0;
-    }
+  if (_histogram_pedestal)
+    AdcPedestalEstimator::compute(v_adc, median, sigma);
   else
-    {
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
-
-      // add in a correction suggested by David Adams, May 6, 2019
-
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i=0; i<asiz; ++i)
-        {
-          if (v_adc[i] < imed) s1++;
-          if (v_adc[i] == imed) sm++;
-        }
-      if (sm > 0)
-        {
-          float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-          //if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
-          median += mcorr;
-        }
-    }
+    AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
 }
 
 DEFINE_ART_CLASS_TOOL(IcebergDataInterface)
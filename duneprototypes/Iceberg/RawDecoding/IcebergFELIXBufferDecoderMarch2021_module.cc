@@ -22,6 +22,7 @@
 
 #include <memory>
 #include <cmath>
+#include <algorithm>
 
 // ROOT includes
 #include "TMath.h"
@@ -36,6 +37,10 @@
 
 // DUNE includes
 #include "dunecore/DuneObj/RDStatus.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcDigitCompressor.h"
+#include "duneprototypes/Iceberg/RawDecoding/IcebergUnpack14.h"
+#include "duneprototypes/Iceberg/RawDecoding/IcebergFELIXBufferFile.h"
 
 #include <stdio.h>
 
@@ -57,9 +62,9 @@ private:
   typedef art::PtrMaker<raw::RDTimeStamp> TSPmkr;
   typedef std::vector<raw::RDStatus> RDStatuses;
 
-  // open files
+  // open files, memory mapped
 
-  std::vector<FILE*> fInputFilePointers;
+  std::vector<std::unique_ptr<iceberg::rawdecoding::IcebergFELIXBufferFile>> fInputBuffers;
 
   // configuration parameters
 
@@ -67,12 +72,13 @@ private:
   size_t                     fNSamples;
   std::string                fOutputLabel;
   bool                       fCompressHuffman;
+  bool                       fCompressSmallest;
+  bool                       fHistogramPedestal;
   ULong64_t                  fDesiredStartTimestamp;
   bool                       fFirstRead;
 
   void computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma);
   // Converts 14 bit packed channel data (56 uint32 words from the WIB) to byte-aligned 16 bit arrays (128 uint16 values)
-  void unpack14(const uint32_t *packed, uint16_t *unpacked);
 };
 
 
@@ -83,6 +89,8 @@ IcebergFELIXBufferDecoderMarch2021::IcebergFELIXBufferDecoderMarch2021(fhicl::Pa
   fNSamples = p.get<size_t>("NSamples",2000);
   fOutputLabel = p.get<std::string>("OutputDataLabel","daq");
   fCompressHuffman = p.get<bool>("CompressHuffman",false);
+  fCompressSmallest = p.get<bool>("CompressSmallest",true);
+  fHistogramPedestal = p.get<bool>("HistogramPedestal",false);
   fDesiredStartTimestamp = p.get<ULong64_t>("StartTimestamp",0);
 
   produces<RawDigits>( fOutputLabel ); //the strings in <> are the typedefs defined above
@@ -90,10 +98,15 @@ IcebergFELIXBufferDecoderMarch2021::IcebergFELIXBufferDecoderMarch2021(fhicl::Pa
   produces<RDTsAssocs>( fOutputLabel );
   produces<RDStatuses>( fOutputLabel );
 
-  fInputFilePointers.clear();
+  fInputBuffers.clear();
   for (size_t ifile=0; ifile<fInputFiles.size(); ++ifile)
     {
-      fInputFilePointers.push_back(fopen(fInputFiles.at(ifile).data(),"r"));
+      fInputBuffers.push_back(std::make_unique<iceberg::rawdecoding::IcebergFELIXBufferFile>(fInputFiles.at(ifile)));
+      if (!fInputBuffers.back()->isOpen())
+        {
+          throw cet::exception("IcebergFELXIBufferDecoderMarch2021") <<
+            "Cannot open file " << fInputFiles.at(ifile);
+        }
     }
   fFirstRead = true;
 }
@@ -111,10 +124,8 @@ void IcebergFELIXBufferDecoderMarch2021::produce(art::Event &e)
 
   bool discard_data = false;
 
-  uint32_t framebuf[117];
-  uint16_t databuf[128];
+  uint16_t databuf[iceberg::rawdecoding::kIcebergFrameChannels];
   uint64_t timestampstart=0;
-  uint64_t timestamp=0;
 
   size_t nfiles = fInputFiles.size();
 
@@ -124,73 +135,51 @@ void IcebergFELIXBufferDecoderMarch2021::produce(art::Event &e)
 
   if (fFirstRead)
     {
-      for (size_t ifile=0; ifile < nfiles; ++ ifile)
+      // criterion so the next timestamp (+32) will be the one we want:  the
+      // first frame with timestamp+47 >= StartTimestamp is skipped
+      uint64_t first_timestamp = (fDesiredStartTimestamp > 47) ? fDesiredStartTimestamp - 47 : 0;
+      for (auto &file : fInputBuffers)
         {
-          do
+          size_t iframe = file->findTimestamp(first_timestamp, file->position());
+          if (iframe >= file->nFrames())
             {
-              fread(framebuf, sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-              if (feof(fInputFilePointers.at(ifile)))
-                {
-                  // don't handle this too gracefully at the moment
-                  throw cet::exception("IcebergFELXIBufferDecoderMarch2021") <<
-                    "Attempt to read off the end of file " << fInputFiles.at(ifile);
-                }
-              timestamp= framebuf[3];
-              timestamp <<= 32;
-              timestamp += framebuf[2];
+              // don't handle this too gracefully at the moment
+              throw cet::exception("IcebergFELXIBufferDecoderMarch2021") <<
+                "Attempt to read off the end of file " << file->path();
             }
-          while (timestamp+47 < fDesiredStartTimestamp);  
-          // criterion so the next timestamp (+32) will be the one we want
+          file->setPosition(iframe + 1);
         }
       fFirstRead = false;
     }
 
-  // align the readin
+  // align the readin:  the next frame of each file tells what the latest timestamp is,
+  // then each file starts at its first frame within 16 ticks of it
 
-  std::vector<std::vector<uint32_t>> fbcache(nfiles);
-  std::vector<uint64_t> tscache;
+  std::vector<size_t> firstframe(nfiles);
   uint64_t latest_timestamp=0;
 
-  // read one frame in from each file to see what the latest timestamp is
-
-  for (size_t ifile=0; ifile<nfiles; ++ifile)
+  for (auto &file : fInputBuffers)
     {
-      fbcache.at(ifile).resize(117);
-      fread(fbcache.at(ifile).data(), sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-      if (feof(fInputFilePointers.at(ifile)))
+      if (file->position() >= file->nFrames())
         {
-          // don't handle this too gracefully at the moment
           throw cet::exception("IcebergFELXIBufferDecoderMarch2021") <<
-            "Attempt to read off the end of file " << fInputFiles.at(ifile);
-        }
-      timestamp= fbcache.at(ifile)[3];
-      timestamp <<= 32;
-      timestamp += fbcache.at(ifile)[2];
-      tscache.push_back(timestamp);
-      if (timestamp > latest_timestamp)
-        {
-          latest_timestamp = timestamp;
+            "Attempt to read off the end of file " << file->path();
         }
+      latest_timestamp = std::max(latest_timestamp, file->timestamp(file->position()));
     }
 
-  // read enough frames from the other files so that we align the frames to +- 16 ticks
-
   for (size_t ifile=0; ifile<nfiles; ++ifile)
     {
-      while (tscache.at(ifile) + 16 < latest_timestamp)
+      auto &file = fInputBuffers.at(ifile);
+      uint64_t aligned_timestamp = (latest_timestamp > 16) ? latest_timestamp - 16 : 0;
+      firstframe.at(ifile) = file->findTimestamp(aligned_timestamp, file->position());
+      if (firstframe.at(ifile) + fNSamples > file->nFrames())
         {
-          fread(fbcache.at(ifile).data(), sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-          if (feof(fInputFilePointers.at(ifile)))
-            {
-              // don't handle this too gracefully at the moment
-              throw cet::exception("IcebergFELXIBufferDecoderMarch2021") <<
-                "Attempt to read off the end of file " << fInputFiles.at(ifile);
-            }
-          timestamp= fbcache.at(ifile)[3];
-          timestamp <<= 32;
-          timestamp += fbcache.at(ifile)[2];
-          tscache.at(ifile) = timestamp;
+          throw cet::exception("IcebergFELXIBufferDecoderMarch2021") <<
+            "Attempt to read off the end of file " << file->path();
         }
+      file->setPosition(firstframe.at(ifile) + fNSamples);
+      file->prefetch(firstframe.at(ifile), fNSamples);
     }  
 
   for (size_t ifile=0; ifile < nfiles; ++ ifile)
@@ -199,25 +188,10 @@ void IcebergFELIXBufferDecoderMarch2021::produce(art::Event &e)
       int fiber = 0;
 
       std::vector<raw::RawDigit::ADCvector_t> adcvv(256);
+      for (auto &adcv : adcvv) adcv.reserve(fNSamples);
       for (size_t itick=0; itick<fNSamples; ++itick)
         {
-          if (itick == 0)  // already read in the first frame
-            {
-              for (size_t i=0; i<117; ++i)
-                {
-                  framebuf[i] = fbcache.at(ifile).at(i);
-                }
-            }
-          else
-            {
-              fread(framebuf, sizeof(uint32_t), 117, fInputFilePointers.at(ifile));
-              if (feof(fInputFilePointers.at(ifile)))
-                {
-                  // don't handle this too gracefully at the moment
-                  throw cet::exception("IcebergFELXIBufferDecoderMarch2021") <<
-                    "Attempt to read off the end of file " << fInputFiles.at(ifile);
-                }
-            }
+          const uint32_t *framebuf = fInputBuffers.at(ifile)->frame(firstframe.at(ifile) + itick);
           int curslot = (framebuf[0] & 0x7000) >> 12;   // assume these are all the same
           int curfiber = (framebuf[0] & 0x8000) >> 15;
           if (itick>0)
@@ -251,15 +225,10 @@ void IcebergFELIXBufferDecoderMarch2021::produce(art::Event &e)
 
           // do the data-rearrangement transpose
 
-          unpack14(&(framebuf[4]),databuf);
-          for (size_t ichan=0; ichan<128; ++ichan)
-            {
-              adcvv.at(ichan).push_back(databuf[ichan]);
-            }
-          unpack14(&(framebuf[4+56]),databuf);
-          for (size_t ichan=0; ichan<128; ++ichan)
+          iceberg::rawdecoding::unpackIcebergFrame(framebuf,databuf);
+          for (size_t ichan=0; ichan<256; ++ichan)
             {
-              adcvv.at(ichan+128).push_back(databuf[ichan]);
+              adcvv[ichan].push_back(databuf[ichan]);
             }
         }
 
@@ -333,16 +302,10 @@ void IcebergFELIXBufferDecoderMarch2021::produce(art::Event &e)
           unsigned int offlineChannel = channelMap->GetOfflineNumberFromDetectorElements(1, slotloc2, fiberloc2, chloc, dune::IcebergChannelMapService::kFELIX); 
 
           size_t uncompressed_nticks = fNSamples;  
-          raw::Compress_t cflag=raw::kNone;
-          if (fCompressHuffman)
-            {
-              cflag = raw::kHuffman;
-              raw::Compress(adcvv.at(ichan),cflag);
-            }
 
-          raw::RawDigit raw_digit(offlineChannel, uncompressed_nticks, adcvv.at(ichan), cflag);
-          raw_digit.SetPedestal(median,sigma);
-          raw_digits.push_back(raw_digit);  
+          // compression, if requested, is done for all channels at once below
+          raw_digits.emplace_back(offlineChannel, uncompressed_nticks, std::move(adcvv.at(ichan)), raw::kNone);
+          raw_digits.back().SetPedestal(median,sigma);
 
           raw::RDTimeStamp rdtimestamp(timestampstart,offlineChannel);
           rd_timestamps.push_back(rdtimestamp);
@@ -369,6 +332,11 @@ void IcebergFELIXBufferDecoderMarch2021::produce(art::Event &e)
     }
   else
     {
+      if (fCompressHuffman)
+        {
+          AdcDigitCompressor::compress(raw_digits, fCompressSmallest);
+        }
+
       RDStatuses statuses;
       unsigned int statword=0;
       statuses.emplace_back(false,false,statword);
@@ -385,40 +353,10 @@ void IcebergFELIXBufferDecoderMarch2021::produce(art::Event &e)
 
 void IcebergFELIXBufferDecoderMarch2021::computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma)
 {
-  size_t asiz = v_adc.size();
-  if (asiz == 0)
-    {
-      median = 0;
-      sigma = 0;
-    }
+  if (fHistogramPedestal)
+    AdcPedestalEstimator::compute(v_adc, median, sigma, false);
   else
-    {
-      // this is actually faster than the code below by about one second per event.
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      median = TMath::Median(asiz,v_adc.data());
-      sigma = TMath::RMS(asiz,v_adc.data());
-    }
-
-  //  std::cout << "sigma: " << sigma << std::endl;
+    AdcPedestalEstimator::computeTMath(v_adc, median, sigma, false);
 }
 
-void IcebergFELIXBufferDecoderMarch2021::unpack14(const uint32_t *packed, uint16_t *unpacked) {
-  for (size_t i = 0; i < 128; i++) { // i == n'th U,V,X value
-    const size_t low_bit = i*14;
-    const size_t low_word = low_bit / 32;
-    const size_t high_bit = (i+1)*14-1;
-    const size_t high_word = high_bit / 32;
-    //std::cout << "low_word, high_word: " << low_word << " " << high_word << std::endl;
-    //glog.log("word %li :: low %li (%li[%li]) high %li (%li[%li])\n",i,low_bit,low_word,low_bit%32,high_bit,high_word,high_bit%32);
-    if (low_word == high_word) { //all the bits are in the same word
-      unpacked[i] = (packed[low_word] >> (low_bit%32)) & 0x3FFF;
-    } else { //some of the bits are in the next word
-      size_t high_off = high_word*32-low_bit;
-      //glog.log("pre_mask 0x%X post_mask 0x%X\n", (0x3FFF >> (14-high_off)), ((0x3FFF << high_off) & 0x3FFF) );
-      unpacked[i] = (packed[low_word] >> (low_bit%32)) & (0x3FFF >> (14-high_off));
-      unpacked[i] |= (packed[high_word] << high_off) & ((0x3FFF << high_off) & 0x3FFF);
-    }
-  }
-}
 DEFINE_ART_MODULE(IcebergFELIXBufferDecoderMarch2021)
@@ -0,0 +1,68 @@
+#include "IcebergFELIXBufferFile.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+iceberg::rawdecoding::IcebergFELIXBufferFile::IcebergFELIXBufferFile(const std::string &path)
+  : fPath(path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat st;
+  if (fstat(fd, &st) == 0)
+    {
+      fMapBytes = st.st_size;
+      if (fMapBytes == 0)
+	{
+	  fOpen = true;
+	}
+      else
+	{
+	  void *mem = mmap(nullptr, fMapBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	  if (mem != MAP_FAILED)
+	    {
+	      // events are read front to back
+	      madvise(mem, fMapBytes, MADV_SEQUENTIAL);
+	      fData = static_cast<const uint32_t*>(mem);
+	      fNFrames = fMapBytes/kFrameBytes;
+	      fOpen = true;
+	    }
+	}
+    }
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+}
+
+iceberg::rawdecoding::IcebergFELIXBufferFile::~IcebergFELIXBufferFile()
+{
+  if (fData != nullptr) munmap(const_cast<uint32_t*>(fData), fMapBytes);
+}
+
+size_t iceberg::rawdecoding::IcebergFELIXBufferFile::findTimestamp(uint64_t ts, size_t first) const
+{
+  if (first >= fNFrames) return fNFrames;
+  size_t lo = first;
+  size_t hi = fNFrames;
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo)/2;
+      if (timestamp(mid) < ts) lo = mid + 1;
+      else hi = mid;
+    }
+  return lo;
+}
+
+void iceberg::rawdecoding::IcebergFELIXBufferFile::prefetch(size_t first, size_t n) const
+{
+  if (fData == nullptr || first >= fNFrames) return;
+  n = std::min(n, fNFrames - first);
+  // madvise wants a page-aligned start
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t begin = first*kFrameBytes;
+  size_t aligned = begin - begin % page;
+  size_t end = (first + n)*kFrameBytes;
+  madvise(const_cast<char*>(reinterpret_cast<const char*>(fData)) + aligned, end - aligned, MADV_WILLNEED);
+}
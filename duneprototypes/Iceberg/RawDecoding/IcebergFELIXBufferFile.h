@@ -0,0 +1,70 @@
+#ifndef ICEBERGFELIXBUFFERFILE_H
+#define ICEBERGFELIXBUFFERFILE_H
+
+// Read-only, memory-mapped view of an Iceberg FELIX buffer dump: a sequence of
+// 117-word frames, one per tick, with the 64-bit timestamp in words 2 and 3.
+// Frames are handed out as pointers into the mapping, so decoding an event
+// copies nothing.  Frames have a fixed size, so frame i is at byte i*468 and
+// the timestamp lookup is a binary search over the mapped frames: seeking to a
+// timestamp touches O(log n) pages instead of reading the file up to it.  This
+// relies on the timestamps increasing through the dump, as they do for the
+// consecutive frames of one WIB link.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "duneprototypes/Iceberg/RawDecoding/IcebergUnpack14.h"
+
+namespace iceberg {
+namespace rawdecoding {
+
+  class IcebergFELIXBufferFile {
+
+  public:
+
+    static constexpr size_t kFrameBytes = kIcebergFrameWords*sizeof(uint32_t);
+
+    // Maps the file.  isOpen() is false if it cannot be opened or mapped.
+    explicit IcebergFELIXBufferFile(const std::string &path);
+    ~IcebergFELIXBufferFile();
+
+    IcebergFELIXBufferFile(const IcebergFELIXBufferFile &) = delete;
+    IcebergFELIXBufferFile &operator=(const IcebergFELIXBufferFile &) = delete;
+
+    bool isOpen() const { return fOpen; }
+    const std::string &path() const { return fPath; }
+
+    // Number of complete frames in the file.
+    size_t nFrames() const { return fNFrames; }
+
+    // Frame iframe < nFrames(), valid while this object lives.
+    const uint32_t *frame(size_t iframe) const { return fData + iframe*kIcebergFrameWords; }
+
+    static uint64_t timestamp(const uint32_t *frame) { return (uint64_t(frame[3]) << 32) + frame[2]; }
+    uint64_t timestamp(size_t iframe) const { return timestamp(frame(iframe)); }
+
+    // Index of the first frame at or after first whose timestamp is at least
+    // ts, or nFrames() if there is none.
+    size_t findTimestamp(uint64_t ts, size_t first =0) const;
+
+    // Read position, the next frame to be used, kept for the caller.
+    size_t position() const { return fPosition; }
+    void setPosition(size_t iframe) { fPosition = iframe; }
+
+    // Asks the kernel to read frames [first, first+n) ahead of use.
+    void prefetch(size_t first, size_t n) const;
+
+  private:
+
+    std::string fPath;
+    bool fOpen = false;
+    const uint32_t *fData = nullptr;
+    size_t fMapBytes = 0;
+    size_t fNFrames = 0;
+    size_t fPosition = 0;
+
+  };
+
+}
+}
+#endif
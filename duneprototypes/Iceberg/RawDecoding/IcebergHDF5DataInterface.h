@@ -29,6 +29,7 @@
 #include "lardataobj/RawData/RawDigit.h"
 #include "lardataobj/RawData/RDTimeStamp.h"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
 #include <hdf5.h>
 
 class IcebergHDF5DataInterface : public PDSPTPCDataInterfaceParent {
@@ -64,6 +65,7 @@ class IcebergHDF5DataInterface : public PDSPTPCDataInterfaceParent {
   long int _min_offline_channel;  // min offline channel to decode.  <0: no limit
   long int _max_offline_channel;  // max offline channel to decode.  <0: no limit.  max<min: no limit
   bool     _debugprint;             // print the crate, slot and fiber number to stdout when called
+  bool     _histogram_pedestal;     // pedestals from AdcPedestalEstimator::compute instead of TMath
 
   std::string _FileInfoLabel;     // art input label for the HDF5 file info data product
 
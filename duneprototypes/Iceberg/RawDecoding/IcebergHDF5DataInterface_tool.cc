@@ -20,6 +20,7 @@ IcebergHDF5DataInterface::IcebergHDF5DataInterface(fhicl::ParameterSet const& p)
   _max_offline_channel = p.get<long int>("MaxOfflineChannel",-1);
   _FileInfoLabel = p.get<std::string>("FileInfoLabel", "daq"),
     _debugprint = p.get<bool>("DebugPrint",false);
+  _histogram_pedestal = p.get<bool>("HistogramPedestal",false);
 }
 
 // wrapper for backward compatibility.  Return data for all APA's represented in the fragments on these labels
@@ -237,37 +238,10 @@ void IcebergHDF5DataInterface::getIcebergHDF5Data(
 
 void IcebergHDF5DataInterface::computeMedianSigma(const raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma)
 {
-  size_t asiz = v_adc.size();
-  int imed=0;
-  if (asiz == 0)
-    {
-      median = 0;
-      sigma = 0;
-    }
+  if (_histogram_pedestal)
+    AdcPedestalEstimator::compute(v_adc, median, sigma);
   else
-    {
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
-
-      // add in a correction suggested by David Adams, May 6, 2019
-
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i=0; i<asiz; ++i)
-        {
-          if (v_adc[i] < imed) s1++;
-          if (v_adc[i] == imed) sm++;
-        }
-      if (sm > 0)
-        {
-          float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-          //if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
-          median += mcorr;
-        }
-    }
+    AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
 }
 
 DEFINE_ART_CLASS_TOOL(IcebergHDF5DataInterface)
@@ -54,6 +54,7 @@
 
 // DUNE includes
 #include "dunecore/DuneObj/RDStatus.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
 
 class IcebergTPCRawDecoder : public art::EDProducer {
 
@@ -112,6 +113,7 @@ private:
 
   bool          _compress_Huffman;
   bool          _print_coldata_convert_count;
+  bool          _histogram_pedestal;
 
   //declare histogram data memebers
   bool  _make_histograms;
@@ -196,6 +198,7 @@ IcebergTPCRawDecoder::IcebergTPCRawDecoder(fhicl::ParameterSet const & p)
 
   _compress_Huffman = p.get<bool>("CompressHuffman",false);
   _print_coldata_convert_count = p.get<bool>("PrintColdataConvertCount",false);
+  _histogram_pedestal = p.get<bool>("HistogramPedestal",false);
 
   produces<RawDigits>( _output_label ); //the strings in <> are the typedefs defined above
   produces<RDTimeStamps>( _output_label );
@@ -1470,22 +1473,10 @@ bool IcebergTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawD
 
 void IcebergTPCRawDecoder::computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma)
 {
-  size_t asiz = v_adc.size();
-  if (asiz == 0)
-    {
-      median = 0;
-      sigma = 0;
-    }
+  if (_histogram_pedestal)
+    AdcPedestalEstimator::compute(v_adc, median, sigma, false);
   else
-    {
-      // this is actually faster than the code below by about one second per event.
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      median = TMath::Median(asiz,v_adc.data());
-      sigma = TMath::RMS(asiz,v_adc.data());
-    }
-
-  //  std::cout << "sigma: " << sigma << std::endl;
+    AdcPedestalEstimator::computeTMath(v_adc, median, sigma, false);
 }
 
 DEFINE_ART_MODULE(IcebergTPCRawDecoder)
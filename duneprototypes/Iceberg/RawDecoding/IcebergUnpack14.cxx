@@ -0,0 +1,125 @@
+#include "IcebergUnpack14.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define ICEBERG_UNPACK14_HAVE_AVX2_PATH 1
+#endif
+
+namespace {
+
+  using iceberg::rawdecoding::kIcebergBlockChannels;
+  using iceberg::rawdecoding::kIcebergBlockWords;
+
+  // Eight 14-bit values take 112 bits = 14 bytes, so a block is 16 groups of
+  // 14 bytes.  Values 0-3 of a group are in the 64-bit word at byte 0 of the
+  // group (bits 0, 14, 28, 42) and values 4-7 in the one at byte 6 (bits 8,
+  // 22, 36, 50), so neither load reads outside the group.  The byte order is
+  // that of the 32-bit words, i.e. this assumes a little-endian host.
+
+  constexpr size_t kGroupBytes = 14;
+  constexpr size_t kGroups = kIcebergBlockChannels/8;
+  constexpr uint64_t kADCMask = 0x3fff;
+
+  inline uint64_t load64(const uint8_t *p)
+  {
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    return w;
+  }
+
+  void unpackBlockScalar(const uint32_t *packed, uint16_t *unpacked)
+  {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(packed);
+    for (size_t g = 0; g < kGroups; ++g)
+      {
+	const uint8_t *s = bytes + g*kGroupBytes;
+	uint16_t *out = unpacked + 8*g;
+	uint64_t lo = load64(s);
+	uint64_t hi = load64(s + 6);
+	out[0] = lo         & kADCMask;
+	out[1] = (lo >> 14) & kADCMask;
+	out[2] = (lo >> 28) & kADCMask;
+	out[3] = (lo >> 42) & kADCMask;
+	out[4] = (hi >> 8)  & kADCMask;
+	out[5] = (hi >> 22) & kADCMask;
+	out[6] = (hi >> 36) & kADCMask;
+	out[7] = (hi >> 50) & kADCMask;
+      }
+  }
+
+#ifdef ICEBERG_UNPACK14_HAVE_AVX2_PATH
+
+  // A group is loaded into both 128-bit lanes.  The byte shuffle puts the
+  // four bytes holding value j in 32-bit slot j (values 0-3 in the low lane,
+  // 4-7 in the high lane), a per-slot shift and mask extract the values, and
+  // two groups are packed to 16 bits and stored together.  The 16-byte load
+  // of the last group would run two bytes past the block, so it is loaded two
+  // bytes early and shuffled with offsets two higher.
+
+  __attribute__((target("avx2")))
+  inline __m256i unpackGroup(const uint8_t *s, __m256i shuf)
+  {
+    const __m256i shift = _mm256_setr_epi32(0,6,4,2,0,6,4,2);
+    const __m256i mask = _mm256_set1_epi32(kADCMask);
+    __m256i w = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+    w = _mm256_shuffle_epi8(w, shuf);
+    return _mm256_and_si256(_mm256_srlv_epi32(w, shift), mask);
+  }
+
+  __attribute__((target("avx2")))
+  void unpackBlockAVX2(const uint32_t *packed, uint16_t *unpacked)
+  {
+    const __m256i shuf = _mm256_setr_epi8(0,1,2,3,    1,2,3,4,    3,4,5,6,    5,6,7,8,
+					  7,8,9,10,   8,9,10,11,  10,11,12,13, 12,13,14,15);
+    const __m256i shufLast = _mm256_setr_epi8(2,3,4,5,    3,4,5,6,    5,6,7,8,     7,8,9,10,
+					      9,10,11,12, 10,11,12,13, 12,13,14,15, 14,15,-1,-1);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(packed);
+    for (size_t g = 0; g < kGroups; g += 2)
+      {
+	__m256i a = unpackGroup(bytes + g*kGroupBytes, shuf);
+	__m256i b = (g + 2 < kGroups) ? unpackGroup(bytes + (g+1)*kGroupBytes, shuf)
+	  : unpackGroup(bytes + (g+1)*kGroupBytes - 2, shufLast);
+	// lanes are (a0-3 b0-3)(a4-7 b4-7); reorder to a0-7 b0-7
+	__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(unpacked + 8*g), v);
+      }
+  }
+
+#endif
+
+}
+
+bool iceberg::rawdecoding::haveIceberg14SIMDUnpack()
+{
+#ifdef ICEBERG_UNPACK14_HAVE_AVX2_PATH
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  return have_avx2;
+#else
+  return false;
+#endif
+}
+
+void iceberg::rawdecoding::unpackIceberg14Scalar(const uint32_t *packed, uint16_t *unpacked)
+{
+  unpackBlockScalar(packed, unpacked);
+}
+
+void iceberg::rawdecoding::unpackIceberg14(const uint32_t *packed, uint16_t *unpacked)
+{
+#ifdef ICEBERG_UNPACK14_HAVE_AVX2_PATH
+  if (haveIceberg14SIMDUnpack())
+    {
+      unpackBlockAVX2(packed, unpacked);
+      return;
+    }
+#endif
+  unpackBlockScalar(packed, unpacked);
+}
+
+void iceberg::rawdecoding::unpackIcebergFrame(const uint32_t *frame, uint16_t *unpacked)
+{
+  unpackIceberg14(frame + 4, unpacked);
+  unpackIceberg14(frame + 4 + kIcebergBlockWords, unpacked + kIcebergBlockChannels);
+}
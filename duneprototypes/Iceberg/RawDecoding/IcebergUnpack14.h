@@ -0,0 +1,37 @@
+#ifndef ICEBERGUNPACK14_H
+#define ICEBERGUNPACK14_H
+
+// Unpacking of the 14-bit ADC payload of the Iceberg FELIX buffer frames.  A
+// frame is 117 32-bit words: a 4-word header, then two blocks of 56 words, each
+// holding 128 channels of one time sample as a little-endian stream of 14-bit
+// values.  The unpackers use AVX2 when the CPU supports it and a branch-free
+// scalar loop otherwise; both are bit-identical to the per-value loop the
+// Iceberg decoders used before.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace iceberg {
+namespace rawdecoding {
+
+  constexpr size_t kIcebergFrameWords = 117;     // 32-bit words per FELIX buffer frame
+  constexpr size_t kIcebergBlockChannels = 128;  // channels per 14-bit block
+  constexpr size_t kIcebergBlockWords = 56;      // 32-bit words per 14-bit block
+  constexpr size_t kIcebergFrameChannels = 2*kIcebergBlockChannels;
+
+  // Unpacks the 128 values of one block (56 words) into unpacked.
+  void unpackIceberg14(const uint32_t *packed, uint16_t *unpacked);
+
+  // Unpacks both blocks of a frame into unpacked[0..255]; channel 128+i is
+  // value i of the second block.
+  void unpackIcebergFrame(const uint32_t *frame, uint16_t *unpacked);
+
+  // Same as unpackIceberg14, but always uses the scalar path.  Exposed for testing.
+  void unpackIceberg14Scalar(const uint32_t *packed, uint16_t *unpacked);
+
+  // True if unpackIceberg14 will use the vectorized path on this CPU.
+  bool haveIceberg14SIMDUnpack();
+
+}
+}
+#endif
@@ -0,0 +1,101 @@
+// bench_IcebergUnpack14.cxx
+//
+// Reports the frames per second of the Iceberg FELIX frame unpackers: the
+// per-value loop the decoders used before, the scalar unpacker and the
+// dispatched (SIMD if available) one.
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "duneprototypes/Iceberg/RawDecoding/IcebergUnpack14.h"
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace iceberg::rawdecoding;
+
+//**********************************************************************
+
+// Reference: the unpacker used by the Iceberg FELIX buffer decoders before IcebergUnpack14.
+void unpack14Reference(const uint32_t *packed, uint16_t *unpacked) {
+  for (size_t i = 0; i < 128; i++) {
+    const size_t low_bit = i*14;
+    const size_t low_word = low_bit / 32;
+    const size_t high_bit = (i+1)*14-1;
+    const size_t high_word = high_bit / 32;
+    if (low_word == high_word) {
+      unpacked[i] = (packed[low_word] >> (low_bit%32)) & 0x3FFF;
+    } else {
+      size_t high_off = high_word*32-low_bit;
+      unpacked[i] = (packed[low_word] >> (low_bit%32)) & (0x3FFF >> (14-high_off));
+      unpacked[i] |= (packed[high_word] << high_off) & ((0x3FFF << high_off) & 0x3FFF);
+    }
+  }
+}
+
+void unpackFrameReference(const uint32_t *frame, uint16_t *unpacked) {
+  unpack14Reference(frame + 4, unpacked);
+  unpack14Reference(frame + 4 + kIcebergBlockWords, unpacked + kIcebergBlockChannels);
+}
+
+void unpackFrameScalar(const uint32_t *frame, uint16_t *unpacked) {
+  unpackIceberg14Scalar(frame + 4, unpacked);
+  unpackIceberg14Scalar(frame + 4 + kIcebergBlockWords, unpacked + kIcebergBlockChannels);
+}
+
+//**********************************************************************
+
+// Unpacks every frame npass times and returns the rate in frames per second.
+double framesPerSecond(void (*unpacker)(const uint32_t*, uint16_t*),
+                       const vector<uint32_t>& frames, size_t nframes, size_t npass) {
+  vector<uint16_t> out(kIcebergFrameChannels);
+  uint64_t check = 0;
+  auto start = std::chrono::steady_clock::now();
+  for ( size_t ipass=0; ipass<npass; ++ipass ) {
+    for ( size_t ifrm=0; ifrm<nframes; ++ifrm ) {
+      unpacker(frames.data() + ifrm*kIcebergFrameWords, out.data());
+      check += out[ifrm % kIcebergFrameChannels];
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  // Keep the result live so the loop is not optimized away.
+  if ( check == 1 ) cout << "";
+  return nframes*npass/elapsed.count();
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  size_t nframes = 2000;    // one Iceberg readout window of one fiber
+  size_t npass = 500;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NFRAMES] [NPASS]" << endl;
+      return 0;
+    }
+    nframes = std::stoul(sarg);
+  }
+  if ( argc > 2 ) npass = std::stoul(argv[2]);
+
+  const string myname = "bench_IcebergUnpack14: ";
+  vector<uint32_t> frames(nframes*kIcebergFrameWords);
+  std::mt19937 gen(12345);
+  for ( uint32_t& word : frames ) word = gen();
+
+  cout << myname << "Unpacking " << nframes << " frames " << npass << " times." << endl;
+  cout << myname << std::setw(12) << "reference" << ": "
+       << framesPerSecond(unpackFrameReference, frames, nframes, npass) << " frames/s" << endl;
+  cout << myname << std::setw(12) << "scalar" << ": "
+       << framesPerSecond(unpackFrameScalar, frames, nframes, npass) << " frames/s" << endl;
+  cout << myname << std::setw(12) << (haveIceberg14SIMDUnpack() ? "simd" : "dispatched") << ": "
+       << framesPerSecond(unpackIcebergFrame, frames, nframes, npass) << " frames/s" << endl;
+  return 0;
+}
+
+//**********************************************************************
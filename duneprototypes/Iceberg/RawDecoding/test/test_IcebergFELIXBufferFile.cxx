@@ -0,0 +1,134 @@
+// test_IcebergFELIXBufferFile.cxx
+//
+// Test the memory-mapped Iceberg FELIX buffer reader: frames must match what
+// was written, and findTimestamp must agree with the linear scan the decoders
+// used before.
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+#include "duneprototypes/Iceberg/RawDecoding/IcebergFELIXBufferFile.h"
+
+#undef NDEBUG
+#include <cassert>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using iceberg::rawdecoding::IcebergFELIXBufferFile;
+using iceberg::rawdecoding::kIcebergFrameWords;
+
+//**********************************************************************
+
+// Reference: first frame at or after first with timestamp >= ts, by reading every frame.
+size_t linearScan(const vector<uint32_t>& words, size_t nframes, uint64_t ts, size_t first) {
+  for ( size_t ifrm=first; ifrm<nframes; ++ifrm ) {
+    const uint32_t* frame = words.data() + ifrm*kIcebergFrameWords;
+    uint64_t frame_ts = (uint64_t(frame[3]) << 32) + frame[2];
+    if ( frame_ts >= ts ) return ifrm;
+  }
+  return nframes;
+}
+
+//**********************************************************************
+
+int test_IcebergFELIXBufferFile(size_t nframes =1000) {
+  const string myname = "test_IcebergFELIXBufferFile: ";
+#ifdef NDEBUG
+  cout << myname << "NDEBUG must be off." << endl;
+  abort();
+#endif
+  string line = "-----------------------------";
+  string fname = "test_IcebergFELIXBufferFile_" + std::to_string(getpid()) + ".bin";
+
+  cout << myname << line << endl;
+  cout << myname << "Writing " << nframes << " frames and a partial one to " << fname << endl;
+  vector<uint32_t> words(nframes*kIcebergFrameWords + 20);
+  std::mt19937 gen(12345);
+  for ( uint32_t& word : words ) word = gen();
+  // Timestamps step by 25 or 32 ticks and cross a 32-bit boundary.
+  uint64_t ts = 0xffffff00;
+  for ( size_t ifrm=0; ifrm<nframes; ++ifrm ) {
+    uint32_t* frame = words.data() + ifrm*kIcebergFrameWords;
+    frame[2] = ts & 0xffffffff;
+    frame[3] = ts >> 32;
+    ts += (gen() % 2) ? 25 : 32;
+  }
+  {
+    std::ofstream out(fname, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(words.data()), words.size()*sizeof(uint32_t));
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Checking frames." << endl;
+  {
+    IcebergFELIXBufferFile file(fname);
+    assert( file.isOpen() );
+    assert( file.nFrames() == nframes );
+    for ( size_t ifrm=0; ifrm<nframes; ++ifrm ) {
+      for ( size_t iwrd=0; iwrd<kIcebergFrameWords; ++iwrd ) {
+        assert( file.frame(ifrm)[iwrd] == words[ifrm*kIcebergFrameWords + iwrd] );
+      }
+    }
+    file.prefetch(nframes - 10, 100);
+
+    cout << myname << line << endl;
+    cout << myname << "Checking timestamp search." << endl;
+    uint64_t ts0 = file.timestamp(size_t(0));
+    uint64_t ts1 = file.timestamp(nframes - 1);
+    for ( uint64_t target : {uint64_t(0), ts0 - 1, ts0, ts0 + 1, ts0 + 47, ts0 + 1000, ts1 - 16, ts1, ts1 + 1} ) {
+      for ( size_t first : {size_t(0), size_t(1), nframes/2, nframes - 1, nframes, nframes + 5} ) {
+        assert( file.findTimestamp(target, first) == linearScan(words, nframes, target, first) );
+      }
+    }
+    for ( int itry=0; itry<1000; ++itry ) {
+      uint64_t target = ts0 + gen() % (ts1 - ts0 + 100);
+      size_t first = gen() % nframes;
+      assert( file.findTimestamp(target, first) == linearScan(words, nframes, target, first) );
+    }
+  }
+  std::remove(fname.c_str());
+
+  cout << myname << line << endl;
+  cout << myname << "Checking empty and missing files." << endl;
+  {
+    std::ofstream out(fname, std::ios::binary);
+  }
+  {
+    IcebergFELIXBufferFile file(fname);
+    assert( file.isOpen() );
+    assert( file.nFrames() == 0 );
+    assert( file.findTimestamp(0) == 0 );
+  }
+  std::remove(fname.c_str());
+  IcebergFELIXBufferFile missing(fname);
+  assert( ! missing.isOpen() );
+  assert( missing.nFrames() == 0 );
+
+  cout << myname << line << endl;
+  cout << myname << "Done." << endl;
+  return 0;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  size_t nframes = 1000;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NFRAMES]" << endl;
+      return 0;
+    }
+    nframes = std::stoul(sarg);
+  }
+  return test_IcebergFELIXBufferFile(nframes);
+}
+
+//**********************************************************************
@@ -0,0 +1,108 @@
+// test_IcebergUnpack14.cxx
+//
+// Test that the Iceberg 14-bit unpackers reproduce the per-value loop of
+// IcebergFELIXBufferDecoderMarch2021::unpack14 bit for bit.
+
+#include <string>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include "duneprototypes/Iceberg/RawDecoding/IcebergUnpack14.h"
+
+#undef NDEBUG
+#include <cassert>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace iceberg::rawdecoding;
+
+//**********************************************************************
+
+// Reference: the unpacker used by the Iceberg FELIX buffer decoders before IcebergUnpack14.
+void unpack14Reference(const uint32_t *packed, uint16_t *unpacked) {
+  for (size_t i = 0; i < 128; i++) { // i == n'th U,V,X value
+    const size_t low_bit = i*14;
+    const size_t low_word = low_bit / 32;
+    const size_t high_bit = (i+1)*14-1;
+    const size_t high_word = high_bit / 32;
+    if (low_word == high_word) { //all the bits are in the same word
+      unpacked[i] = (packed[low_word] >> (low_bit%32)) & 0x3FFF;
+    } else { //some of the bits are in the next word
+      size_t high_off = high_word*32-low_bit;
+      unpacked[i] = (packed[low_word] >> (low_bit%32)) & (0x3FFF >> (14-high_off));
+      unpacked[i] |= (packed[high_word] << high_off) & ((0x3FFF << high_off) & 0x3FFF);
+    }
+  }
+}
+
+//**********************************************************************
+
+int test_IcebergUnpack14(size_t nframes =17) {
+  const string myname = "test_IcebergUnpack14: ";
+#ifdef NDEBUG
+  cout << myname << "NDEBUG must be off." << endl;
+  abort();
+#endif
+  string line = "-----------------------------";
+
+  cout << myname << line << endl;
+  cout << myname << "Filling " << nframes << " frames with random words." << endl;
+  vector<vector<uint32_t>> frames(nframes, vector<uint32_t>(kIcebergFrameWords));
+  std::mt19937 gen(12345);
+  for ( auto& frame : frames ) for ( uint32_t& word : frame ) word = gen();
+  // All-ones frame exercises the mask at every straddle.
+  if ( nframes > 1 ) for ( uint32_t& word : frames[1] ) word = 0xffffffff;
+
+  cout << myname << line << endl;
+  cout << myname << "Checking block unpackers (SIMD: " << haveIceberg14SIMDUnpack() << ")." << endl;
+  for ( const auto& frame : frames ) {
+    for ( size_t iblk=0; iblk<2; ++iblk ) {
+      const uint32_t* packed = frame.data() + 4 + iblk*kIcebergBlockWords;
+      // Copy the block alone so reads past its end would show up under ASan.
+      vector<uint32_t> block(packed, packed + kIcebergBlockWords);
+      vector<uint16_t> ref(kIcebergBlockChannels);
+      vector<uint16_t> scalar(kIcebergBlockChannels);
+      vector<uint16_t> fast(kIcebergBlockChannels);
+      unpack14Reference(block.data(), ref.data());
+      unpackIceberg14Scalar(block.data(), scalar.data());
+      unpackIceberg14(block.data(), fast.data());
+      assert( scalar == ref );
+      assert( fast == ref );
+    }
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Checking frame unpacker." << endl;
+  for ( const auto& frame : frames ) {
+    vector<uint16_t> ref(kIcebergFrameChannels);
+    vector<uint16_t> fast(kIcebergFrameChannels);
+    unpack14Reference(frame.data() + 4, ref.data());
+    unpack14Reference(frame.data() + 4 + kIcebergBlockWords, ref.data() + kIcebergBlockChannels);
+    unpackIcebergFrame(frame.data(), fast.data());
+    assert( fast == ref );
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Done." << endl;
+  return 0;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  size_t nframes = 17;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NFRAMES]" << endl;
+      return 0;
+    }
+    nframes = std::stoul(sarg);
+  }
+  return test_IcebergUnpack14(nframes);
+}
+
+//**********************************************************************
@@ -0,0 +1,139 @@
+#include "DPUnpack12.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define DP_UNPACK12_HAVE_AVX2_PATH 1
+#endif
+
+namespace
+{
+  void unpackScalar( const uint8_t *in, uint16_t *out, size_t n8bit )
+  {
+    const uint8_t *stop = in + n8bit;
+    while( in != stop )
+      {
+	uint16_t v1 = in[0];
+	uint16_t v2 = in[1];
+	uint16_t v3 = in[2];
+	out[0] = (v1 << 4) | (v2 >> 4);
+	out[1] = ((v2 & 0xf) << 8) | v3;
+	in  += 3;
+	out += 2;
+      }
+  }
+
+  void packScalar( const uint16_t *in, uint8_t *out, size_t n8bit )
+  {
+    const uint8_t *stop = out + n8bit;
+    while( out != stop )
+      {
+	uint16_t v1 = in[0];
+	uint16_t v2 = in[1];
+	out[0] = (v1 >> 4) & 0xff;
+	out[1] = ((v1 & 0xf) << 4) | ((v2 >> 8) & 0xf);
+	out[2] = v2 & 0xff;
+	in  += 2;
+	out += 3;
+      }
+  }
+
+#ifdef DP_UNPACK12_HAVE_AVX2_PATH
+
+  // 24 bytes (16 values) per step: 12 bytes in each 128-bit lane.
+  // The byte shuffle builds the big-endian 16-bit words b0b1 and b1b2
+  // of each triplet; v1 is the first shifted down by 4 and v2 the
+  // second masked to 12 bits. The 16-byte load of the upper lane
+  // reads 4 bytes past the step, so the last steps are left to the
+  // scalar loop.
+
+  constexpr size_t kStepBytes = 24;
+  constexpr size_t kStepValues = 16;
+
+  __attribute__((target("avx2")))
+  size_t unpackAVX2( const uint8_t *in, uint16_t *out, size_t n8bit )
+  {
+    const __m256i shuf = _mm256_setr_epi8( 1,0,  2,1,  4,3,  5,4,  7,6,  8,7,  10,9,  11,10,
+					   1,0,  2,1,  4,3,  5,4,  7,6,  8,7,  10,9,  11,10 );
+    const __m256i mask = _mm256_set1_epi16( 0xfff );
+    size_t done = 0;
+    for( ; done + kStepBytes + 4 <= n8bit; done += kStepBytes )
+      {
+	const uint8_t *s = in + done;
+	__m256i w = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i*>(s) ) ),
+					     _mm_loadu_si128( reinterpret_cast<const __m128i*>(s + 12) ), 1 );
+	w = _mm256_shuffle_epi8( w, shuf );
+	__m256i v = _mm256_blend_epi16( _mm256_srli_epi16( w, 4 ), _mm256_and_si256( w, mask ), 0xaa );
+	_mm256_storeu_si256( reinterpret_cast<__m256i*>( out + done / 3 * 2 ), v );
+      }
+    return done;
+  }
+
+  // Reverse of unpackAVX2: each 32-bit slot holding a pair v1, v2 is
+  // turned into the 24-bit value v1 << 12 | v2, whose three bytes are
+  // then shuffled out in big-endian order. The 16-byte store of the
+  // upper lane writes 4 bytes past the step, so the last steps are
+  // left to the scalar loop.
+
+  __attribute__((target("avx2")))
+  size_t packAVX2( const uint16_t *in, uint8_t *out, size_t n8bit )
+  {
+    const __m256i shuf = _mm256_setr_epi8( 2,1,0,  6,5,4,  10,9,8,  14,13,12,  -1,-1,-1,-1,
+					   2,1,0,  6,5,4,  10,9,8,  14,13,12,  -1,-1,-1,-1 );
+    const __m256i mask = _mm256_set1_epi32( 0xfff );
+    size_t done = 0;
+    for( ; done + kStepBytes + 4 <= n8bit; done += kStepBytes )
+      {
+	__m256i w = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + done / 3 * 2 ) );
+	__m256i v1 = _mm256_slli_epi32( _mm256_and_si256( w, mask ), 12 );
+	__m256i v2 = _mm256_and_si256( _mm256_srli_epi32( w, 16 ), mask );
+	__m256i b = _mm256_shuffle_epi8( _mm256_or_si256( v1, v2 ), shuf );
+	_mm_storeu_si128( reinterpret_cast<__m128i*>( out + done ), _mm256_castsi256_si128( b ) );
+	_mm_storeu_si128( reinterpret_cast<__m128i*>( out + done + 12 ), _mm256_extracti128_si256( b, 1 ) );
+      }
+    return done;
+  }
+
+#endif
+}
+
+bool lris::have12BitSIMDUnpack()
+{
+#ifdef DP_UNPACK12_HAVE_AVX2_PATH
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  return have_avx2;
+#else
+  return false;
+#endif
+}
+
+void lris::unpack12into16Scalar( const void *in, uint16_t *out, size_t n8bit )
+{
+  unpackScalar( static_cast<const uint8_t*>(in), out, n8bit );
+}
+
+void lris::pack16into12Scalar( const uint16_t *in, void *out, size_t n8bit )
+{
+  packScalar( in, static_cast<uint8_t*>(out), n8bit );
+}
+
+void lris::unpack12into16( const void *in, uint16_t *out, size_t n8bit )
+{
+  const uint8_t *in8 = static_cast<const uint8_t*>(in);
+  size_t done = 0;
+#ifdef DP_UNPACK12_HAVE_AVX2_PATH
+  if( have12BitSIMDUnpack() )
+    done = unpackAVX2( in8, out, n8bit );
+#endif
+  unpackScalar( in8 + done, out + done / 3 * 2, n8bit - done );
+}
+
+void lris::pack16into12( const uint16_t *in, void *out, size_t n8bit )
+{
+  uint8_t *out8 = static_cast<uint8_t*>(out);
+  size_t done = 0;
+#ifdef DP_UNPACK12_HAVE_AVX2_PATH
+  if( have12BitSIMDUnpack() )
+    done = packAVX2( in, out8, n8bit );
+#endif
+  packScalar( in + done / 3 * 2, out8 + done, n8bit - done );
+}
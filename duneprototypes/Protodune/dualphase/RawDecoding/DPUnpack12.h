@@ -0,0 +1,82 @@
+/*
+    Packing and unpacking of the 12-bit ADC data of the dual-phase
+    electronics (ProtoDUNE-DP, 3x1x1 and the VD coldbox TDE).
+
+    Two 12-bit values v1, v2 are stored in three bytes, most significant
+    bits first:
+       v1[11:4] | v1[3:0] v2[11:8] | v2[7:0]
+
+    The unpackers use AVX2 when the CPU supports it and a scalar loop
+    otherwise; both give the same result as the per-byte loops the
+    decoders used before.
+
+ */
+#ifndef DPUnpack12_h
+#define DPUnpack12_h
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lris
+{
+  // unpack n8bit bytes (a multiple of 3) into n8bit/3*2 values
+  void unpack12into16( const void *in, uint16_t *out, size_t n8bit );
+
+  // pack n8bit/3*2 values into n8bit bytes (a multiple of 3);
+  // only the lower 12 bits of each value are kept
+  void pack16into12( const uint16_t *in, void *out, size_t n8bit );
+
+  // same as above, but always use the scalar path. Exposed for testing.
+  void unpack12into16Scalar( const void *in, uint16_t *out, size_t n8bit );
+  void pack16into12Scalar( const uint16_t *in, void *out, size_t n8bit );
+
+  // true if the vectorized path is used on this CPU
+  bool have12BitSIMDUnpack();
+
+  // number of channels of nsa samples held in n8bit bytes
+  inline size_t channels12( size_t n8bit, size_t nsa )
+  {
+    return ( 2 * (n8bit / 3) + nsa - 1 ) / nsa;
+  }
+
+  // unpack n8bit bytes into channels12( n8bit, nsa ) consecutive channels of
+  // nsa samples each starting at channels. Each channel is resized to nsa
+  // and the samples missing from the last channel are set to 0.
+  // VEC is a vector of a 16-bit integer type (e.g., raw::RawDigit::ADCvector_t)
+  template<class VEC>
+  void unpack12Channels( const char *in, size_t n8bit, size_t nsa, VEC *channels )
+  {
+    static_assert( sizeof(typename VEC::value_type) == sizeof(uint16_t),
+		   "unpack12Channels needs 16-bit samples" );
+    size_t nsamples = 2 * (n8bit / 3);
+    size_t nch      = channels12( n8bit, nsa );
+    for( size_t ch=0;ch<nch;ch++ ) channels[ch].resize( nsa );
+
+    if( nsa % 2 == 0 ) // channels start on a 3-byte boundary
+      {
+	for( size_t ch=0;ch<nch;ch++ )
+	  {
+	    size_t n = std::min( nsa, nsamples - ch * nsa );
+	    auto out = reinterpret_cast<uint16_t*>( channels[ch].data() );
+	    unpack12into16( in + ch * nsa / 2 * 3, out, n / 2 * 3 );
+	    std::fill( out + n, out + nsa, 0 );
+	  }
+      }
+    else
+      {
+	std::vector<uint16_t> tmp( nsamples );
+	unpack12into16( in, tmp.data(), n8bit / 3 * 3 );
+	for( size_t ch=0;ch<nch;ch++ )
+	  {
+	    size_t n = std::min( nsa, nsamples - ch * nsa );
+	    auto out = reinterpret_cast<uint16_t*>( channels[ch].data() );
+	    std::copy( tmp.begin() + ch * nsa, tmp.begin() + ch * nsa + n, out );
+	    std::fill( out + n, out + nsa, 0 );
+	  }
+      }
+  }
+}
+
+#endif
@@ -14,8 +14,13 @@
 #include "lardataobj/RawData/RawDigit.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 
+#include "tbb/task_arena.h"
+
+#include "RawEventPrefetcher.h"
+
 
 // anonymous namespace 
 namespace 
@@ -104,6 +109,13 @@ namespace lris
 
     // number of uncompressed samples per channel
     size_t __nsacro;
+
+    // persistent worker pool for unpacking event fragments
+    tbb::task_arena __unpackPool;
+
+    // read-ahead of the next event records (null if disabled)
+    std::unique_ptr<RawEventPrefetcher> __prefetch;
+    std::vector<BYTE> __evbuf;
     
     // close binary file
     void __close();
@@ -111,7 +123,8 @@ namespace lris
     // read a chunk of binary data
     void __readChunk( std::vector<BYTE> &bytes, size_t sz );
 
-    // unpack binary data written by each L1 evb builder
+    // unpack binary data written by each L1 evb builder into a single
+    // presized event buffer, one fragment per worker in __unpackPool
     bool __unpackEvent( std::vector<BYTE> &buf, DaqEvent &event );
 
     //
@@ -160,7 +173,6 @@ namespace lris
     {
       eveinfo_t ei;
       const BYTE* bytes;
-      adcbuf_t crodata;
       //adcbuf_t lrodata;
     } fragment_t;
 
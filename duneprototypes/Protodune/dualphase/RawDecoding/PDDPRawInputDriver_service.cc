@@ -20,10 +20,11 @@
 #include "PDDPRawInputDriver.h"
 
 #include "PDDPChannelMap.h"
+#include "DPUnpack12.h"
+
+#include "tbb/parallel_for.h"
 
 #include <exception>
-#include <thread>
-#include <mutex>
 #include <regex>
 #include <sstream>
 #include <iterator>
@@ -48,42 +49,22 @@ using UIntVec = std::vector<unsigned>;
 //
 namespace 
 {
+  // number of channels unpackCroData makes from nb bytes of CRO data
+  size_t croChannels( size_t nb, bool cflag, unsigned nsa )
+  {
+    if( cflag ) return 0; // compressed format is not defined yet
+    if( nb < 3 ) return 1;  // a single empty channel
+    return lris::channels12( nb, nsa );
+  }
+
+  // unpack into the croChannels( nb, cflag, nsa ) channels starting at data
   void unpackCroData( const char *buf, size_t nb, bool cflag, 
-		      unsigned nsa, adcbuf_t &data )
+		      unsigned nsa, raw::RawDigit::ADCvector_t *data )
   {
-    //data.clear();
     if( !cflag ) // unpack the uncompressed data into RawDigit
       {
-	data.push_back( raw::RawDigit::ADCvector_t(nsa) );
-	size_t sz = 0;
-	const BYTE* start = buf;
-	const BYTE* stop  = start + nb;
-	while(start!=stop)
-	  {
-	    BYTE v1 = *start++;
-	    BYTE v2 = *start++;
-	    BYTE v3 = *start++;
-	    
-	    uint16_t tmp1 = ((v1 << 4) + ((v2 >> 4) & 0xf)) & 0xfff;
-	    uint16_t tmp2 = (((v2 & 0xf) << 8 ) + (v3 & 0xff)) & 0xfff;
-	    
-	    // if( offset > 0 ) // invert baseline: tmp fix for the signal inversion
-	    //   {
-	    // 	float ftmp1 = offset - tmp1;
-	    // 	if( ftmp1 < 0 ) ftmp1 = 0;
-	    // 	tmp1 = (uint16_t)(ftmp1);
-		
-	    // 	float ftmp2 = offset - tmp2;
-	    // 	if( ftmp2 < 0 ) ftmp2 = 0;
-	    // 	tmp2 = (uint16_t)(ftmp2);
-	    //   }
-	    
-	    if( sz == nsa ){ data.push_back(raw::RawDigit::ADCvector_t(nsa)); sz = 0; }
-	    data.back()[sz++] = (short)tmp1;
-	    
-	    if( sz == nsa ){ data.push_back(raw::RawDigit::ADCvector_t(nsa)); sz = 0; }
-	    data.back()[sz++] = (short)tmp2;
-	  }
+	if( nb < 3 ) data->assign( nsa, 0 );
+	else lris::unpack12Channels( buf, nb, nsa, data );
       }
     else
       //TODO finalize the format of compressed data
@@ -132,6 +113,8 @@ namespace lris
     const std::string myname = "PDDPRawInputDriver::ctor: ";
     
     __logLevel       = pset.get<int>("LogLevel", 0);
+    int nthreads     = pset.get<int>("UnpackThreads", 0);
+    unsigned nprefetch = pset.get<unsigned>("PrefetchEvents", 2);
     __outlbl_digits  = pset.get<std::string>("OutputLabelRawDigits", "daq");
     __outlbl_rdtime  = pset.get<std::string>("OutputLabelRDTime", "daq");
     __outlbl_status  = pset.get<std::string>("OutputLabelRDStatus", "daq");
@@ -155,6 +138,8 @@ namespace lris
       {
 	std::cout << myname << "       Configuration        : " << std::endl;
 	std::cout << myname << "       LogLevel             : " << __logLevel  << std::endl;
+	std::cout << myname << "       UnpackThreads        : " << nthreads << std::endl;
+	std::cout << myname << "       PrefetchEvents       : " << nprefetch << std::endl;
 	std::cout << myname << "       OutputLabelRawDigits : " << __outlbl_digits << std::endl;
 	std::cout << myname << "       OutputLabelRDStatus  : " << __outlbl_status << std::endl;
 	std::cout << myname << "       OutputLabelRDtime    : " << __outlbl_rdtime << std::endl;
@@ -192,6 +177,13 @@ namespace lris
 								      __prodlbl_rdtime );
     
     
+    // worker pool for unpacking the L1 event builder fragments, kept for the whole job
+    __unpackPool.initialize( nthreads > 0 ? nthreads : tbb::task_arena::automatic );
+
+    // background reader for the next event records
+    if( nprefetch > 0 )
+      __prefetch = std::make_unique<RawEventPrefetcher>( nprefetch );
+
     // number of uncompressed ADC samples per channel in PDDP CRO data (fixed parameter)
     __nsacro = 10000;
 
@@ -290,6 +282,10 @@ namespace lris
 
     __currentSubRunID = art::SubRunID();
     __file_seqno      = __get_file_seqno( name );
+
+    // start reading ahead now that the event table is known
+    if( __prefetch )
+      __prefetch->start( name, __events, __evsz, __eventNum );
   }
 
 
@@ -308,13 +304,20 @@ namespace lris
 	return false;
       }
     
-    // move to the next file position
-    if( __events[ __eventCtr ] != __file.tellg() )
-      __file.seekg( __events[ __eventCtr ], std::ios::beg );
-    size_t bsz = __evsz[ __eventCtr ];
-    
-    std::vector<BYTE> buf;
-    __readChunk( buf, bsz );
+    std::vector<BYTE> &buf = __evbuf;
+    if( __prefetch )
+      {
+	// already read (or being read) in the background
+	if( !__prefetch->next( buf ) ) return false;
+      }
+    else
+      {
+	// move to the next file position
+	if( __events[ __eventCtr ] != __file.tellg() )
+	  __file.seekg( __events[ __eventCtr ], std::ios::beg );
+	size_t bsz = __evsz[ __eventCtr ];
+	__readChunk( buf, bsz );
+      }
     
     // increment our event counter
     __eventCtr++;
@@ -444,6 +447,9 @@ namespace lris
   ///
   void PDDPRawInputDriver::__close()
   {
+    if( __prefetch )
+      __prefetch->stop();
+
     if(__file.is_open())
       __file.close();  
   
@@ -646,28 +652,30 @@ namespace lris
       }
   
     //mf::LogDebug(__FUNCTION__)<<"number of fragments "<<frags.size()<<"\n";
-    // 
-    std::mutex iomutex;
-    std::vector<std::thread> threads(frags.size() - 1);
-    unsigned nsa    = __nsacro;
-    //unsigned invped = __invped;
-    for (unsigned i = 1; i<frags.size(); ++i) 
+    if( frags.empty() ) return false;
+
+    // assign each fragment its channels in the event buffer
+    unsigned nsa = __nsacro;
+    std::vector<size_t> firstch( frags.size() + 1, 0 );
+    for( size_t i=0;i<frags.size();i++ )
       {
-	auto afrag = frags.begin() + i;
-	threads[i-1] = std::thread([&iomutex, i, nsa, afrag] {
-	    {
-	      std::lock_guard<std::mutex> iolock(iomutex);
-	      // make it look like we're using i so clang doesn't complain.  This had been commented out
-	      //msg_info << "Unpack thread #" << i << " is running\n";
-	      if (i==100000) std::cout << "Unpack thread #" << i << " is running\n";
-	    }
-	    //unpackLROData( f0->bytes, f0->ei.evszlro, ... );
-	    unpackCroData( afrag->bytes + afrag->ei.evszlro, afrag->ei.evszcro, 
-			   GETDCFLAG(afrag->ei.runflags), nsa, afrag->crodata);
-	  });
+	auto &ei = frags[i].ei;
+	firstch[i+1] = firstch[i] + croChannels( ei.evszcro, GETDCFLAG(ei.runflags), nsa );
       }
+    event.crodata.clear();
+    event.crodata.resize( firstch.back() );
+
+    // unpack all fragments in the worker pool directly into their channels
+    __unpackPool.execute( [&] {
+	tbb::parallel_for( size_t(0), frags.size(), [&]( size_t i ) {
+	    auto &afrag = frags[i];
+	    //unpackLROData( afrag.bytes, afrag.ei.evszlro, ... );
+	    unpackCroData( afrag.bytes + afrag.ei.evszlro, afrag.ei.evszcro, 
+			   GETDCFLAG(afrag.ei.runflags), nsa, event.crodata.data() + firstch[i] );
+	  });
+      });
   
-    // unpack first fragment in the main thread
+    // event info from the first fragment
     auto f0 = frags.begin();
     event.good      = EVDQFLAG( f0->ei.evflag );
     event.runnum    = f0->ei.runnum;
@@ -680,30 +688,17 @@ namespace lris
     event.trignum   = f0->ei.ti.num;
     event.trigstamp = f0->ei.ti.ts;
   
-    //unpackLROData( f0->bytes, f0->ei.evszlro, ... );
-    unpackCroData( f0->bytes + f0->ei.evszlro, f0->ei.evszcro, GETDCFLAG(f0->ei.runflags),
-		   nsa, event.crodata );
-    
     event.compression = raw::kNone;
     // the compression should be set for all L1 event builders, 
     // since this depends on loaded AMC firmware
     if( GETDCFLAG(f0->ei.runflags) ) 
       event.compression = raw::kHuffman;
   
-    // wait for other threads to complete
-    for (auto& t : threads) t.join();
-  
-    // merge with other fragments
+    // data quality of the other fragments
     for (auto it = frags.begin() + 1; it != frags.end(); ++it )
       {
 	event.good = ( event.good && EVDQFLAG( it->ei.evflag ) );
 	event.evflags.push_back( it->ei.evflag );
-	
-	// 
-	event.crodata.reserve(event.crodata.size() + it->crodata.size() );
-	std::move( std::begin( it->crodata ), std::end( it->crodata ), 
-		   std::back_inserter( event.crodata ));
-	it->crodata.clear();
       }
   
     return true;
@@ -0,0 +1,166 @@
+/*
+    Read-ahead of event records from a DP / TDE binary file
+
+    Once the event table of a file is unpacked, the offsets and sizes
+    of all event records are known. The prefetcher opens its own stream
+    on the file and a background thread reads the next few records
+    into recycled buffers while the source unpacks the current one,
+    so that reading from remote storage overlaps with unpacking.
+
+ */
+#ifndef RawEventPrefetcher_h
+#define RawEventPrefetcher_h
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "canvas/Utilities/Exception.h"
+
+namespace lris
+{
+  class RawEventPrefetcher
+  {
+  public:
+    typedef std::vector<char> buffer_t;
+
+    // depth is the number of records read ahead of the one being processed
+    explicit RawEventPrefetcher( unsigned depth ) : __depth( depth > 0 ? depth : 1 ) {}
+    ~RawEventPrefetcher(){ stop(); }
+
+    RawEventPrefetcher( RawEventPrefetcher const & ) = delete;
+    RawEventPrefetcher& operator=( RawEventPrefetcher const & ) = delete;
+
+    // start reading the first nev records of the table
+    void start( std::string const &name,
+		std::vector<std::streampos> const &events,
+		std::vector<uint32_t> const &evsz, size_t nev )
+    {
+      stop();
+
+      __file.open( name.c_str(), std::ios::in | std::ios::binary );
+      if( !__file.is_open() )
+	{
+	  throw art::Exception( art::errors::FileOpenError )
+	    << "Error opening binary file " << name << " for read-ahead" << std::endl;
+	}
+
+      if( nev > events.size() ) nev = events.size();
+      __events.assign( events.begin(), events.begin() + nev );
+      __evsz.assign( evsz.begin(), evsz.begin() + nev );
+      __stop  = false;
+      __done  = false;
+      __error = nullptr;
+      __reader = std::thread( &RawEventPrefetcher::__run, this );
+    }
+
+    // stop the reader thread and close the file
+    void stop()
+    {
+      {
+	std::lock_guard<std::mutex> lock( __mtx );
+	__stop = true;
+      }
+      __cv.notify_all();
+      if( __reader.joinable() ) __reader.join();
+
+      // keep the buffers for the next file
+      for( auto &b : __ready ) __free.push_back( std::move( b ) );
+      __ready.clear();
+      if( __file.is_open() ) __file.close();
+    }
+
+    // swap the next record into buf, and take back the previous one for reuse
+    // returns false once all records have been delivered
+    bool next( buffer_t &buf )
+    {
+      std::unique_lock<std::mutex> lock( __mtx );
+      __cv.wait( lock, [this]{ return !__ready.empty() || __done; } );
+      if( __ready.empty() )
+	{
+	  if( __error ) std::rethrow_exception( __error );
+	  return false;
+	}
+
+      buf.swap( __ready.front() );
+      __free.push_back( std::move( __ready.front() ) );
+      __ready.pop_front();
+      lock.unlock();
+      __cv.notify_all();
+      return true;
+    }
+
+  private:
+    unsigned __depth;
+
+    std::ifstream __file;
+    std::vector<std::streampos> __events;
+    std::vector<uint32_t> __evsz;
+
+    std::thread __reader;
+    std::mutex __mtx;
+    std::condition_variable __cv;
+    std::deque<buffer_t> __ready;  // records read, in file order
+    std::vector<buffer_t> __free;  // buffers to reuse
+    bool __stop = false;
+    bool __done = false;
+    std::exception_ptr __error;
+
+    //
+    void __run()
+    {
+      try
+	{
+	  for( size_t i=0;i<__events.size();i++ )
+	    {
+	      buffer_t buf;
+	      {
+		std::unique_lock<std::mutex> lock( __mtx );
+		__cv.wait( lock, [this]{ return __stop || __ready.size() < __depth; } );
+		if( __stop ) break;
+		if( !__free.empty() )
+		  {
+		    buf = std::move( __free.back() );
+		    __free.pop_back();
+		  }
+	      }
+
+	      // read outside of the lock; short reads are truncated as in __readChunk
+	      buf.resize( __evsz[i] );
+	      if( __events[i] != __file.tellg() )
+		__file.seekg( __events[i], std::ios::beg );
+	      __file.read( buf.data(), buf.size() );
+	      if( !__file )
+		{
+		  buf.resize( __file.gcount() );
+		  __file.clear();
+		}
+
+	      {
+		std::lock_guard<std::mutex> lock( __mtx );
+		__ready.push_back( std::move( buf ) );
+	      }
+	      __cv.notify_all();
+	    }
+	}
+      catch(...)
+	{
+	  std::lock_guard<std::mutex> lock( __mtx );
+	  __error = std::current_exception();
+	}
+
+      {
+	std::lock_guard<std::mutex> lock( __mtx );
+	__done = true;
+      }
+      __cv.notify_all();
+    }
+  };
+}
+
+#endif
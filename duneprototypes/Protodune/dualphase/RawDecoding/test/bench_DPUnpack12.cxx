@@ -0,0 +1,139 @@
+// bench_DPUnpack12.cxx
+//
+// Reports the throughput of the 12-bit unpackers on a block of CRO data laid
+// out as in the DP and TDE raw files: the per-sample loop the input sources
+// used before, the scalar channel unpacker and the dispatched (SIMD if
+// available) one.  Also reports the raw pack and unpack rates.
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "duneprototypes/Protodune/dualphase/RawDecoding/DPUnpack12.h"
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace lris;
+
+using Channels = vector<vector<short>>;
+
+//**********************************************************************
+
+// Reference: unpackCroData of the DP and TDE input sources before DPUnpack12.
+void unpackReference(const char *buf, size_t nb, size_t nsa, Channels& data) {
+  data.clear();
+  data.push_back(vector<short>(nsa));
+  size_t sz = 0;
+  const char* start = buf;
+  const char* stop  = start + nb;
+  while ( start != stop ) {
+    char v1 = *start++;
+    char v2 = *start++;
+    char v3 = *start++;
+    uint16_t tmp1 = ((v1 << 4) + ((v2 >> 4) & 0xf)) & 0xfff;
+    uint16_t tmp2 = (((v2 & 0xf) << 8 ) + (v3 & 0xff)) & 0xfff;
+    if ( sz == nsa ) { data.push_back(vector<short>(nsa)); sz = 0; }
+    data.back()[sz++] = (short)tmp1;
+    if ( sz == nsa ) { data.push_back(vector<short>(nsa)); sz = 0; }
+    data.back()[sz++] = (short)tmp2;
+  }
+}
+
+// The channel unpacker on fresh channel vectors, as the input sources use it.
+void unpackChannels(const char *buf, size_t nb, size_t nsa, Channels& data) {
+  data.clear();
+  data.resize(channels12(nb, nsa));
+  unpack12Channels(buf, nb, nsa, data.data());
+}
+
+// The same with the scalar path only.
+void unpackChannelsScalar(const char *buf, size_t nb, size_t nsa, Channels& data) {
+  data.clear();
+  data.resize(channels12(nb, nsa));
+  for ( size_t ch=0; ch<data.size(); ++ch ) {
+    data[ch].resize(nsa);
+    size_t n = std::min(nsa, nb/3*2 - ch*nsa);
+    unpack12into16Scalar(buf + ch*nsa/2*3, reinterpret_cast<uint16_t*>(data[ch].data()), n/2*3);
+  }
+}
+
+//**********************************************************************
+
+// Unpacks the buffer npass times and returns the rate in MB of packed data per second.
+double channelRate(void (*unpacker)(const char*, size_t, size_t, Channels&),
+                   const vector<char>& buf, size_t nsa, size_t npass) {
+  Channels data;
+  uint64_t check = 0;
+  auto start = std::chrono::steady_clock::now();
+  for ( size_t ipass=0; ipass<npass; ++ipass ) {
+    unpacker(buf.data(), buf.size(), nsa, data);
+    check += data[ipass % data.size()][ipass % nsa];
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  // Keep the result live so the loop is not optimized away.
+  if ( check == 1 ) cout << "";
+  return buf.size()*npass/elapsed.count()/1.e6;
+}
+
+// Returns the rate of a raw pack or unpack function in MB of packed data per second.
+template<class F>
+double rawRate(F f, size_t nb, size_t npass) {
+  auto start = std::chrono::steady_clock::now();
+  for ( size_t ipass=0; ipass<npass; ++ipass ) f();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return nb*npass/elapsed.count()/1.e6;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  size_t nch = 640;       // channels of one L1 event builder
+  size_t nsa = 10000;     // samples per channel in DP and TDE data
+  size_t npass = 20;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NCHAN] [NSAMPLE] [NPASS]" << endl;
+      return 0;
+    }
+    nch = std::stoul(sarg);
+  }
+  if ( argc > 2 ) nsa = std::stoul(argv[2]);
+  if ( argc > 3 ) npass = std::stoul(argv[3]);
+
+  const string myname = "bench_DPUnpack12: ";
+  vector<char> buf((nch*nsa + 1)/2*3);
+  std::mt19937 gen(12345);
+  for ( char& b : buf ) b = gen();
+
+  cout << myname << "Unpacking " << nch << " channels of " << nsa << " samples ("
+       << buf.size()/1.e6 << " MB) " << npass << " times." << endl;
+  cout << myname << std::setw(12) << "reference" << ": "
+       << channelRate(unpackReference, buf, nsa, npass) << " MB/s" << endl;
+  if ( nsa % 2 == 0 ) {
+    cout << myname << std::setw(12) << "scalar" << ": "
+         << channelRate(unpackChannelsScalar, buf, nsa, npass) << " MB/s" << endl;
+  }
+  cout << myname << std::setw(12) << (have12BitSIMDUnpack() ? "simd" : "dispatched") << ": "
+       << channelRate(unpackChannels, buf, nsa, npass) << " MB/s" << endl;
+
+  // Raw rates without channel vectors.
+  size_t nb = buf.size()/3*3;
+  vector<uint16_t> vals(nb/3*2);
+  vector<char> packed(nb);
+  cout << myname << "Raw rates:" << endl;
+  cout << myname << std::setw(12) << "unpack" << ": "
+       << rawRate([&]{ unpack12into16Scalar(buf.data(), vals.data(), nb); }, nb, npass) << " MB/s scalar, "
+       << rawRate([&]{ unpack12into16(buf.data(), vals.data(), nb); }, nb, npass) << " MB/s dispatched" << endl;
+  cout << myname << std::setw(12) << "pack" << ": "
+       << rawRate([&]{ pack16into12Scalar(vals.data(), packed.data(), nb); }, nb, npass) << " MB/s scalar, "
+       << rawRate([&]{ pack16into12(vals.data(), packed.data(), nb); }, nb, npass) << " MB/s dispatched" << endl;
+  return 0;
+}
+
+//**********************************************************************
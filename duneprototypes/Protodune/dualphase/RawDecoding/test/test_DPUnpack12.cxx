@@ -0,0 +1,140 @@
+// test_DPUnpack12.cxx
+//
+// Test that the 12-bit unpackers reproduce the per-byte loop of
+// dlardaq::unpack12into16 and the DP / TDE input sources bit for bit, that
+// pack16into12 is its inverse, and that unpack12Channels splits the data
+// into channels as the input sources did.
+
+#include <string>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include "duneprototypes/Protodune/dualphase/RawDecoding/DPUnpack12.h"
+
+#undef NDEBUG
+#include <cassert>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace lris;
+
+//**********************************************************************
+
+// Reference: the unpacker used by dlardaq and the DP input sources before DPUnpack12.
+// The bytes are taken as unsigned to avoid shifting negative values; the
+// masks make the result the same.
+void unpack12Reference(const char *in, uint16_t *out, size_t n8bit) {
+  const unsigned char* in8 = reinterpret_cast<const unsigned char*>(in);
+  const unsigned char* stop = in8 + n8bit;
+  while ( in8 != stop ) {
+    unsigned char v1 = *in8++;
+    unsigned char v2 = *in8++;
+    unsigned char v3 = *in8++;
+    *out++ = ((v1 << 4) + ((v2 >> 4) & 0xf)) & 0xfff;
+    *out++ = (((v2 & 0xf) << 8 ) + (v3 & 0xff)) & 0xfff;
+  }
+}
+
+// Reference: the channel splitting of unpackCroData before DPUnpack12.
+vector<vector<short>> channelsReference(const char *in, size_t n8bit, size_t nsa) {
+  vector<vector<short>> data(1, vector<short>(nsa));
+  vector<uint16_t> vals(n8bit/3*2);
+  unpack12Reference(in, vals.data(), n8bit);
+  size_t sz = 0;
+  for ( uint16_t v : vals ) {
+    if ( sz == nsa ) { data.emplace_back(nsa); sz = 0; }
+    data.back()[sz++] = v;
+  }
+  return data;
+}
+
+//**********************************************************************
+
+int test_DPUnpack12(size_t nbytes =3*1000) {
+  const string myname = "test_DPUnpack12: ";
+#ifdef NDEBUG
+  cout << myname << "NDEBUG must be off." << endl;
+  abort();
+#endif
+  string line = "-----------------------------";
+
+  cout << myname << line << endl;
+  cout << myname << "Filling " << nbytes << " random bytes." << endl;
+  std::mt19937 gen(12345);
+  vector<char> bytes(nbytes);
+  for ( char& b : bytes ) b = gen();
+
+  cout << myname << line << endl;
+  cout << myname << "Checking unpackers (SIMD: " << have12BitSIMDUnpack() << ")." << endl;
+  // Every length up to a few SIMD steps, then the full buffer.
+  vector<size_t> lengths;
+  for ( size_t nb=0; nb<=3*64 && nb<=nbytes; nb+=3 ) lengths.push_back(nb);
+  lengths.push_back(nbytes/3*3);
+  for ( size_t nb : lengths ) {
+    // Copy the input alone so reads past its end would show up under ASan.
+    vector<char> in(bytes.begin(), bytes.begin() + nb);
+    vector<uint16_t> ref(nb/3*2);
+    vector<uint16_t> scalar(nb/3*2);
+    vector<uint16_t> fast(nb/3*2);
+    unpack12Reference(in.data(), ref.data(), nb);
+    unpack12into16Scalar(in.data(), scalar.data(), nb);
+    unpack12into16(in.data(), fast.data(), nb);
+    assert( scalar == ref );
+    assert( fast == ref );
+
+    vector<char> packed(nb);
+    vector<char> packedScalar(nb);
+    pack16into12(fast.data(), packed.data(), nb);
+    pack16into12Scalar(fast.data(), packedScalar.data(), nb);
+    assert( packed == in );
+    assert( packedScalar == in );
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Checking that pack16into12 drops the upper 4 bits." << endl;
+  {
+    vector<uint16_t> vals(64);
+    for ( uint16_t& v : vals ) v = gen();
+    vector<char> packed(vals.size()/2*3);
+    pack16into12(vals.data(), packed.data(), packed.size());
+    vector<uint16_t> back(vals.size());
+    unpack12into16(packed.data(), back.data(), packed.size());
+    for ( size_t i=0; i<vals.size(); ++i ) assert( back[i] == (vals[i] & 0xfff) );
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Checking channel unpacker." << endl;
+  for ( size_t nsa : {1, 7, 10, 64, 333} ) {
+    for ( size_t nb : {size_t(3), size_t(3*50), size_t(3*331), nbytes/3*3} ) {
+      if ( nb > nbytes ) continue;
+      vector<vector<short>> ref = channelsReference(bytes.data(), nb, nsa);
+      vector<vector<short>> chans(channels12(nb, nsa));
+      unpack12Channels(bytes.data(), nb, nsa, chans.data());
+      assert( chans == ref );
+    }
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Done." << endl;
+  return 0;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  size_t nbytes = 3*1000;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NBYTES]" << endl;
+      return 0;
+    }
+    nbytes = std::stoul(sarg);
+  }
+  return test_DPUnpack12(nbytes);
+}
+
+//**********************************************************************
@@ -9,6 +9,7 @@
 
 #include "PD2HDChannelMapSP.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -23,6 +24,7 @@ void dune::PD2HDChannelMapSP::ReadMapFromFile(std::string &fullname)
 {
   std::ifstream inFile(fullname, std::ios::in);
   std::string line;
+  std::vector<HDChanInfo_t> chanInfos;   // file order, for the WIB-element table
 
   while (std::getline(inFile,line)) {
     std::stringstream linestream(line);
@@ -43,30 +45,85 @@ void dune::PD2HDChannelMapSP::ReadMapFromFile(std::string &fullname)
       >> chanInfo.asicchan
       >> chanInfo.wibframechan; 
 
+    if (linestream.fail()) continue;  // blank or malformed line
+
     chanInfo.valid = true;
 
     // fill maps.
 
     check_offline_channel(chanInfo.offlchan);
 
-    DetToChanInfo[chanInfo.crate][chanInfo.wib][chanInfo.link][chanInfo.wibframechan] = chanInfo;
+    chanInfos.push_back(chanInfo);
     OfflToChanInfo[chanInfo.offlchan] = chanInfo;
 
   }
   inFile.close();
 
+  BuildDetTable(chanInfos);
 }
 
-dune::PD2HDChannelMapSP::HDChanInfo_t dune::PD2HDChannelMapSP::GetChanInfoFromWIBElements(
-    unsigned int crate,
-    unsigned int slot,
-    unsigned int link,
-    unsigned int wibframechan ) const {
+// Lay out the WIB-element lookup table.  Crates present in the map get consecutive
+// blocks; within a block the index is wib, then link, then wibframechan, so the
+// channels of one WIB frame are contiguous.  Later lines in the file override earlier
+// ones for the same element, as the nested maps this replaces did.
 
-  unsigned int wib = slot + 1;
+void dune::PD2HDChannelMapSP::BuildDetTable(const std::vector<HDChanInfo_t> &chanInfos)
+{
+  unsigned int maxcrate = 0;
+  fNWib = 0;
+  fNLink = 0;
+  fNWibFrameChan = 0;
+  for (const auto &ci : chanInfos)
+    {
+      maxcrate = std::max(maxcrate, ci.crate);
+      fNWib = std::max(fNWib, ci.wib + 1);
+      fNLink = std::max(fNLink, ci.link + 1);
+      fNWibFrameChan = std::max(fNWibFrameChan, ci.wibframechan + 1);
+    }
 
-  HDChanInfo_t badInfo = {};
-  badInfo.valid = false;
+  fCrateIndex.assign(chanInfos.empty() ? 0 : maxcrate + 1, -1);
+  int ncrates = 0;
+  for (const auto &ci : chanInfos)
+    {
+      if (fCrateIndex[ci.crate] < 0) fCrateIndex[ci.crate] = ncrates++;
+    }
+
+  fBadCompactInfo = {};
+  fBadCompactInfo.valid = false;
+  fDetTable.assign(ncrates*fNWib*fNLink*fNWibFrameChan, fBadCompactInfo);
+  fAPANames.clear();
+
+  for (const auto &ci : chanInfos)
+    {
+      auto ian = std::find(fAPANames.begin(), fAPANames.end(), ci.APAName);
+      if (ian == fAPANames.end())
+	{
+	  fAPANames.push_back(ci.APAName);
+	  ian = fAPANames.end() - 1;
+	}
+      if (fAPANames.size() > 256 || ci.crate > 0xffff || ci.wibframechan > 0xffff ||
+	  std::max({ci.wib, ci.link, ci.femb_on_link, ci.cebchan, ci.plane, ci.chan_in_plane, ci.femb, ci.asic, ci.asicchan}) > 0xff)
+	{
+	  throw std::range_error("PD2HDChannelMapSP channel map entry does not fit the lookup table");
+	}
+
+      HDChanInfoCompact_t &cc = fDetTable.at(DetTableIndex(fCrateIndex[ci.crate], ci.wib, ci.link, ci.wibframechan));
+      cc.offlchan = ci.offlchan;
+      cc.crate = ci.crate;
+      cc.apaindex = ian - fAPANames.begin();
+      cc.wib = ci.wib;
+      cc.link = ci.link;
+      cc.femb_on_link = ci.femb_on_link;
+      cc.cebchan = ci.cebchan;
+      cc.plane = ci.plane;
+      cc.chan_in_plane = ci.chan_in_plane;
+      cc.femb = ci.femb;
+      cc.asic = ci.asic;
+      cc.asicchan = ci.asicchan;
+      cc.wibframechan = ci.wibframechan;
+      cc.valid = true;
+    }
+}
 
 // a hack -- ununderstood crates are mapped to crate 2
 // for use in the Coldbox
@@ -74,26 +131,66 @@ dune::PD2HDChannelMapSP::HDChanInfo_t dune::PD2HDChannelMapSP::GetChanInfoFromWI
 // data with two ununderstood crates, or an ununderstood crate and crate 2,
 // will have duplicate channels.
 
-  auto fm1 = DetToChanInfo.find(crate);
-  if (fm1 == DetToChanInfo.end()) 
-    {
-      unsigned int substituteCrate = 2;  
-      fm1 = DetToChanInfo.find(substituteCrate);
-      if (fm1 == DetToChanInfo.end()) return badInfo;
-    }
-  auto& m1 = fm1->second;
+int dune::PD2HDChannelMapSP::CrateBlock(unsigned int crate) const
+{
+  if (crate < fCrateIndex.size() && fCrateIndex[crate] >= 0) return fCrateIndex[crate];
+  unsigned int substituteCrate = 2;
+  if (substituteCrate < fCrateIndex.size()) return fCrateIndex[substituteCrate];
+  return -1;
+}
+
+const dune::PD2HDChannelMapSP::HDChanInfoCompact_t &dune::PD2HDChannelMapSP::GetCompactChanInfoFromWIBElements(
+    unsigned int crate,
+    unsigned int slot,
+    unsigned int link,
+    unsigned int wibframechan ) const {
+
+  unsigned int wib = slot + 1;
+  int cb = CrateBlock(crate);
+  if (cb < 0 || wib >= fNWib || link >= fNLink || wibframechan >= fNWibFrameChan) return fBadCompactInfo;
+  return fDetTable[DetTableIndex(cb, wib, link, wibframechan)];
+}
+
+const dune::PD2HDChannelMapSP::HDChanInfoCompact_t *dune::PD2HDChannelMapSP::GetCompactChanInfoBlock(
+    unsigned int crate,
+    unsigned int slot,
+    unsigned int link,
+    unsigned int firstwibframechan,
+    unsigned int nchans ) const {
 
-  auto fm2 = m1.find(wib);
-  if (fm2 == m1.end()) return badInfo;
-  auto& m2 = fm2->second;
+  unsigned int wib = slot + 1;
+  int cb = CrateBlock(crate);
+  if (cb < 0 || wib >= fNWib || link >= fNLink || firstwibframechan + nchans > fNWibFrameChan) return nullptr;
+  return &fDetTable[DetTableIndex(cb, wib, link, firstwibframechan)];
+}
 
-  auto fm3 = m2.find(link);
-  if (fm3 == m2.end()) return badInfo;
-  auto& m3 = fm3->second;
+dune::PD2HDChannelMapSP::HDChanInfo_t dune::PD2HDChannelMapSP::GetChanInfoFromWIBElements(
+    unsigned int crate,
+    unsigned int slot,
+    unsigned int link,
+    unsigned int wibframechan ) const {
 
-  auto fm4 = m3.find(wibframechan);
-  if (fm4 == m3.end()) return badInfo;
-  return fm4->second;
+  const HDChanInfoCompact_t &cc = GetCompactChanInfoFromWIBElements(crate, slot, link, wibframechan);
+
+  HDChanInfo_t info = {};
+  info.valid = false;
+  if (!cc.valid) return info;
+
+  info.offlchan = cc.offlchan;
+  info.crate = cc.crate;
+  info.APAName = fAPANames[cc.apaindex];
+  info.wib = cc.wib;
+  info.link = cc.link;
+  info.femb_on_link = cc.femb_on_link;
+  info.cebchan = cc.cebchan;
+  info.plane = cc.plane;
+  info.chan_in_plane = cc.chan_in_plane;
+  info.femb = cc.femb;
+  info.asic = cc.asic;
+  info.asicchan = cc.asicchan;
+  info.wibframechan = cc.wibframechan;
+  info.valid = true;
+  return info;
 }
 
 
@@ -12,6 +12,7 @@
 #ifndef PD2HDChannelMapSP_H
 #define PD2HDChannelMapSP_H
 
+#include <cstdint>
 #include <unordered_map>
 #include <vector>
 #include <string>
@@ -42,6 +43,26 @@ public:
     bool valid;          // true if valid, false if not
   } HDChanInfo_t;
 
+  // Compact form of HDChanInfo_t used by the WIB-element lookup table.  The APA
+  // name is interned; use GetAPAName(apaindex) to retrieve it.
+
+  typedef struct HDChanInfoCompact {
+    uint32_t offlchan;
+    uint16_t crate;
+    uint8_t  apaindex;
+    uint8_t  wib;
+    uint8_t  link;
+    uint8_t  femb_on_link;
+    uint8_t  cebchan;
+    uint8_t  plane;
+    uint8_t  chan_in_plane;
+    uint8_t  femb;
+    uint8_t  asic;
+    uint8_t  asicchan;
+    uint16_t wibframechan;
+    bool     valid;
+  } HDChanInfoCompact_t;
+
   PD2HDChannelMapSP();  // constructor
 
   // initialize:  read map from file
@@ -61,17 +82,48 @@ public:
 
   HDChanInfo_t GetChanInfoFromOfflChan(unsigned int offlchan) const;
 
+  // Fast accessors backed by a dense (crate, wib, link, wibframechan) table built in
+  // ReadMapFromFile.  GetCompactChanInfoFromWIBElements returns a record with valid = false
+  // for unmapped elements.  GetCompactChanInfoBlock returns a pointer to nchans consecutive
+  // records starting at firstwibframechan (e.g. all 64 channels of a WIBEth frame), or
+  // nullptr if the crate/slot/link is not in the map or the range runs off the table.
+
+  const HDChanInfoCompact_t &GetCompactChanInfoFromWIBElements(
+   unsigned int crate,
+   unsigned int slot,
+   unsigned int link,
+   unsigned int wibframechan) const;
+
+  const HDChanInfoCompact_t *GetCompactChanInfoBlock(
+   unsigned int crate,
+   unsigned int slot,
+   unsigned int link,
+   unsigned int firstwibframechan,
+   unsigned int nchans) const;
+
+  const std::string &GetAPAName(unsigned int apaindex) const { return fAPANames.at(apaindex); }
+
 private:
 
   const unsigned int fNChans = 2560*4;
 
-  // map of crate, slot, link, femb_on_link, plane, chan to channel info struct
+  // dense table of compact channel info indexed by crate, wib, link and wibframechan.
+  // fCrateIndex maps a crate number to its block in the table, -1 if absent.
+
+  std::vector<HDChanInfoCompact_t> fDetTable;
+  std::vector<int> fCrateIndex;
+  unsigned int fNWib = 0;
+  unsigned int fNLink = 0;
+  unsigned int fNWibFrameChan = 0;
+  std::vector<std::string> fAPANames;
+  HDChanInfoCompact_t fBadCompactInfo = {};
 
-  std::unordered_map<unsigned int,   // crate
-    std::unordered_map<unsigned int, // wib
-    std::unordered_map<unsigned int, // link
-    std::unordered_map<unsigned int, // wibframechan
-    HDChanInfo_t > > > > DetToChanInfo;
+  void BuildDetTable(const std::vector<HDChanInfo_t> &chanInfos);
+  int CrateBlock(unsigned int crate) const;
+  size_t DetTableIndex(int crateblock, unsigned int wib, unsigned int link, unsigned int wibframechan) const
+  {
+    return ((crateblock*fNWib + wib)*fNLink + link)*fNWibFrameChan + wibframechan;
+  }
 
   // map of chan info indexed by offline channel number
 
@@ -35,6 +35,29 @@ public:
 
   dune::PD2HDChannelMapSP::HDChanInfo_t GetChanInfoFromOfflChan(unsigned int offlchan) const;
 
+  // Compact table lookups; see PD2HDChannelMapSP.h
+
+  const dune::PD2HDChannelMapSP::HDChanInfoCompact_t &GetCompactChanInfoFromWIBElements(
+   unsigned int crate,
+   unsigned int slot,
+   unsigned int link,
+   unsigned int wibframechan) const
+  {
+    return fHDChanMap.GetCompactChanInfoFromWIBElements(crate,slot,link,wibframechan);
+  }
+
+  const dune::PD2HDChannelMapSP::HDChanInfoCompact_t *GetCompactChanInfoBlock(
+   unsigned int crate,
+   unsigned int slot,
+   unsigned int link,
+   unsigned int firstwibframechan,
+   unsigned int nchans) const
+  {
+    return fHDChanMap.GetCompactChanInfoBlock(crate,slot,link,firstwibframechan,nchans);
+  }
+
+  const std::string &GetAPAName(unsigned int apaindex) const { return fHDChanMap.GetAPAName(apaindex); }
+
 private:
 
   dune::PD2HDChannelMapSP fHDChanMap;
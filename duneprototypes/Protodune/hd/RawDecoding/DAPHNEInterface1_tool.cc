@@ -24,6 +24,9 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
   static const size_t FrameSize = sizeof(DAPHNEFrame);
   static const size_t StreamFrameSize = sizeof(DAPHNEStreamFrame);
 
+  //Channel map lookups, resolved once per (slot, link, channel)
+  utils::ChannelCache fChannelCache;
+
   template <class T>
   size_t GetNFrames(size_t frag_size, size_t frag_header_size) {
     return (frag_size - FragmentHeaderSize)/sizeof(T);
@@ -73,15 +76,17 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       auto frame
           = reinterpret_cast<DAPHNEStreamFrame*>(
               static_cast<uint8_t*>(frag->get_data()) + i*StreamFrameSize);
-      ProcessStreamFrame(frame, wf_map, daphne_tree);
+      //The first frame reserves room for the rest of the fragment
+      ProcessStreamFrame(frame, (n_frames - i)*frame->s_adcs_per_channel,
+                         wf_map, daphne_tree);
     }
   }
 
   void ProcessStreamFrame(
       DAPHNEStreamFrame * frame,
+      size_t n_adcs_reserve,
       std::unordered_map<unsigned int, std::vector<raw::OpDetWaveform>> & wf_map,
       utils::DAPHNETree * daphne_tree) {
-    art::ServiceHandle<dune::DAPHNEChannelMapService> channel_map;
     auto b_link = frame->daq_header.link_id;
     auto b_slot = frame->daq_header.slot_id;
   
@@ -94,21 +99,13 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       frame->header.channel_3};
     // Loop over channels
     for (size_t i = 0; i < frame->s_channels_per_frame; ++i) {
-      auto offline_channel = -1;
-  
-      try {
-        offline_channel = channel_map->GetOfflineChannel(
-          b_slot, b_link, frame_channels[i]);
-      }
-      catch (const std::range_error & err) {
-        std::cout << "WARNING: Could not find offline channel for " <<
-                     b_slot << " " << b_link << " " << frame_channels[i] << std::endl;
-      }
+      auto offline_channel = fChannelCache.Get(
+          *fChannelMap, b_slot, b_link, frame_channels[i]);
   
       //Make output
       auto & waveform = daphne::utils::MakeWaveform(
             offline_channel,
-            frame->s_adcs_per_channel,
+            n_adcs_reserve,
             frame->get_timestamp(),
             wf_map,
             true);
@@ -116,8 +113,6 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       // Loop over ADC values in the frame for channel i 
       for (size_t j = 0; j < static_cast<size_t>(frame->s_adcs_per_channel); ++j) {
         waveform.push_back(frame->get_adc(j, i));
-        if (daphne_tree != nullptr)
-          daphne_tree->fADCValue[j] = frame->get_adc(j, i);
       }
   
       if (daphne_tree != nullptr) {
@@ -128,7 +123,9 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
         daphne_tree->fTriggerSampleValue = 0;
         daphne_tree->fThreshold = 0;
         daphne_tree->fBaseline = 0;
-        daphne_tree->Fill();
+        daphne_tree->Fill(
+            waveform.data() + waveform.size() - frame->s_adcs_per_channel,
+            frame->s_adcs_per_channel);
       } 
     }
   }
@@ -138,21 +135,11 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       std::unordered_map<unsigned int, std::vector<raw::OpDetWaveform>> & wf_map,
       utils::DAPHNETree * daphne_tree) {
   
-    art::ServiceHandle<dune::DAPHNEChannelMapService> channel_map;
     int b_channel_0 = frame->get_channel();
     int b_link = frame->daq_header.link_id;
     int b_slot = frame->daq_header.slot_id;
-    auto offline_channel=-1;
-    try {
-       offline_channel = channel_map->GetOfflineChannel(
-          b_slot, b_link, b_channel_0);
-    }
-    catch (const std::range_error & err) {
-      //Just throw a warning so users can check out the rest of the data
-      //maybe we can configure this to crash for keepup reco
-      std::cout << "WARNING: Could not find offline channel for " <<
-                   b_slot << " " << b_link << " " << b_channel_0 << std::endl;
-    }
+    auto offline_channel = fChannelCache.Get(
+        *fChannelMap, b_slot, b_link, b_channel_0);
   
     //Make output waveform and fill
     auto & waveform = daphne::utils::MakeWaveform(
@@ -162,8 +149,6 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
         wf_map);
     for (size_t j = 0; j < static_cast<size_t>(frame->s_num_adcs); ++j) {
       waveform.push_back(frame->get_adc(j));
-      if (daphne_tree != nullptr)
-        daphne_tree->fADCValue[j] = frame->get_adc(j);
     }
 
     if (daphne_tree != nullptr) {
@@ -174,7 +159,9 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       daphne_tree->fTriggerSampleValue = frame->header.trigger_sample_value;
       daphne_tree->fThreshold = frame->header.threshold;
       daphne_tree->fBaseline = frame->header.baseline;
-      daphne_tree->Fill();
+      daphne_tree->Fill(
+          waveform.data() + waveform.size() - frame->s_num_adcs,
+          frame->s_num_adcs);
     }
   
   }
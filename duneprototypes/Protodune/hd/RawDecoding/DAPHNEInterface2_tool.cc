@@ -8,6 +8,12 @@
 #include "daqdataformats/v4_4_0/SourceID.hpp"
 
 #include "DAPHNEUtils.h"
+#include "PDHDFragmentArena.h"
+
+#include <algorithm>
+#include <iterator>
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
 
 namespace daphne {
 using dunedaq::daqdataformats::SourceID;
@@ -24,6 +30,15 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
   static const size_t FrameSize = sizeof(DAPHNEFrame);
   static const size_t StreamFrameSize = sizeof(DAPHNEStreamFrame);
 
+  //Channel map lookups, resolved once per (slot, link, channel)
+  utils::ChannelCache fChannelCache;
+
+  //Read fragments through the FragmentArena shared with the other readers
+  bool fUseFragmentArena = false;
+
+  //Unpack the fragments (slots) of an event concurrently
+  bool fParallelDecode = false;
+
   template <class T>
   size_t GetNFrames(size_t frag_size, size_t frag_header_size) {
     return (frag_size - FragmentHeaderSize)/sizeof(T);
@@ -32,7 +47,7 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
   //Determine if we're streaming, and pick the corresponding frame type
   //and processing method
   void UnpackFragment(
-      std::unique_ptr<Fragment> & frag,
+      const Fragment * frag,
       std::unordered_map<unsigned int, std::vector<raw::OpDetWaveform>> & wf_map,
       utils::DAPHNETree * daphne_tree) {
   
@@ -47,7 +62,7 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
   }
 
   void ProcessFrames(
-      std::unique_ptr<Fragment> & frag,
+      const Fragment * frag,
       std::unordered_map<unsigned int, std::vector<raw::OpDetWaveform>> & wf_map,
       utils::DAPHNETree * daphne_tree) {
   
@@ -63,7 +78,7 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
   
   //Get number of streaming Frames then loop over them and process each one
   void ProcessStreamFrames(
-      std::unique_ptr<Fragment> & frag,
+      const Fragment * frag,
       std::unordered_map<unsigned int, std::vector<raw::OpDetWaveform>> & wf_map,
       utils::DAPHNETree * daphne_tree) {
   
@@ -73,15 +88,17 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       auto frame
           = reinterpret_cast<DAPHNEStreamFrame*>(
               static_cast<uint8_t*>(frag->get_data()) + i*StreamFrameSize);
-      ProcessStreamFrame(frame, wf_map, daphne_tree);
+      //The first frame reserves room for the rest of the fragment
+      ProcessStreamFrame(frame, (n_frames - i)*frame->s_adcs_per_channel,
+                         wf_map, daphne_tree);
     }
   }
 
   void ProcessStreamFrame(
       DAPHNEStreamFrame * frame,
+      size_t n_adcs_reserve,
       std::unordered_map<unsigned int, std::vector<raw::OpDetWaveform>> & wf_map,
       utils::DAPHNETree * daphne_tree) {
-    art::ServiceHandle<dune::DAPHNEChannelMapService> channel_map;
     auto b_link = frame->daq_header.link_id;
     auto b_slot = frame->daq_header.slot_id;
   
@@ -94,21 +111,13 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       frame->header.channel_3};
     // Loop over channels
     for (size_t i = 0; i < frame->s_channels_per_frame; ++i) {
-      auto offline_channel = -1;
-  
-      try {
-        offline_channel = channel_map->GetOfflineChannel(
-          b_slot, b_link, frame_channels[i]);
-      }
-      catch (const std::range_error & err) {
-        std::cout << "WARNING: Could not find offline channel for " <<
-                     b_slot << " " << b_link << " " << frame_channels[i] << std::endl;
-      }
+      auto offline_channel = fChannelCache.Get(
+          *fChannelMap, b_slot, b_link, frame_channels[i]);
   
       //Make output
       auto & waveform = daphne::utils::MakeWaveform(
             offline_channel,
-            frame->s_adcs_per_channel,
+            n_adcs_reserve,
             frame->get_timestamp(),
             wf_map,
             true);
@@ -116,8 +125,6 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       // Loop over ADC values in the frame for channel i 
       for (size_t j = 0; j < static_cast<size_t>(frame->s_adcs_per_channel); ++j) {
         waveform.push_back(frame->get_adc(j, i));
-        if (daphne_tree != nullptr)
-          daphne_tree->fADCValue[j] = frame->get_adc(j, i);
       }
   
       if (daphne_tree != nullptr) {
@@ -128,7 +135,9 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
         daphne_tree->fTriggerSampleValue = 0;
         daphne_tree->fThreshold = 0;
         daphne_tree->fBaseline = 0;
-        daphne_tree->Fill();
+        daphne_tree->Fill(
+            waveform.data() + waveform.size() - frame->s_adcs_per_channel,
+            frame->s_adcs_per_channel);
       } 
     }
   }
@@ -138,21 +147,11 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       std::unordered_map<unsigned int, std::vector<raw::OpDetWaveform>> & wf_map,
       utils::DAPHNETree * daphne_tree) {
   
-    art::ServiceHandle<dune::DAPHNEChannelMapService> channel_map;
     int b_channel_0 = frame->get_channel();
     int b_link = frame->daq_header.link_id;
     int b_slot = frame->daq_header.slot_id;
-    auto offline_channel=-1;
-    try {
-       offline_channel = channel_map->GetOfflineChannel(
-          b_slot, b_link, b_channel_0);
-    }
-    catch (const std::range_error & err) {
-      //Just throw a warning so users can check out the rest of the data
-      //maybe we can configure this to crash for keepup reco
-      std::cout << "WARNING: Could not find offline channel for " <<
-                   b_slot << " " << b_link << " " << b_channel_0 << std::endl;
-    }
+    auto offline_channel = fChannelCache.Get(
+        *fChannelMap, b_slot, b_link, b_channel_0);
   
     //Make output waveform and fill
     auto & waveform = daphne::utils::MakeWaveform(
@@ -162,8 +161,6 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
         wf_map);
     for (size_t j = 0; j < static_cast<size_t>(frame->s_num_adcs); ++j) {
       waveform.push_back(frame->get_adc(j));
-      if (daphne_tree != nullptr)
-        daphne_tree->fADCValue[j] = frame->get_adc(j);
     }
 
     if (daphne_tree != nullptr) {
@@ -174,16 +171,86 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
       daphne_tree->fTriggerSampleValue = frame->header.trigger_sample_value;
       daphne_tree->fThreshold = frame->header.threshold;
       daphne_tree->fBaseline = frame->header.baseline;
-      daphne_tree->Fill();
+      daphne_tree->Fill(
+          waveform.data() + waveform.size() - frame->s_num_adcs,
+          frame->s_num_adcs);
     }
   
   }
 
+  //Unpack each fragment into its own map in a TBB task, then merge the maps
+  //in fragment order so that the result is the same as unpacking serially.
+  void UnpackFragmentsParallel(
+      const std::vector<const Fragment *> & frags,
+      std::unordered_map<unsigned int, WaveformVector> & wf_map) {
+
+    std::vector<std::unordered_map<unsigned int, WaveformVector>> frag_maps(frags.size());
+    std::vector<std::vector<unsigned int>> frag_orders(frags.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, frags.size()),
+                      [&](const tbb::blocked_range<size_t> & r) {
+      for (size_t i = r.begin(); i != r.end(); ++i) {
+        UnpackFragment(frags[i], frag_maps[i], nullptr);
+        frag_orders[i] = ChannelOrder(frags[i]);
+      }
+    });
+
+    for (size_t i = 0; i < frags.size(); ++i) {
+      bool is_stream = (frags[i]->get_fragment_type() != FragmentType::kDAPHNE);
+      for (unsigned int chan : frag_orders[i]) {
+        auto & src = frag_maps[i].at(chan);
+        auto it = wf_map.find(chan);
+        if (it == wf_map.end() || it->second.empty()) {
+          wf_map[chan] = std::move(src);
+        }
+        else if (is_stream) {
+          //A stream continues the channel's last waveform
+          auto & tail = it->second.back();
+          tail.insert(tail.end(), src.front().begin(), src.front().end());
+        }
+        else {
+          it->second.insert(it->second.end(),
+                            std::make_move_iterator(src.begin()),
+                            std::make_move_iterator(src.end()));
+        }
+      }
+    }
+  }
+
+  //Offline channels of a fragment in the order unpacking first meets them,
+  //which is the order they are first added to the waveform map
+  std::vector<unsigned int> ChannelOrder(const Fragment * frag) {
+    std::vector<unsigned int> order;
+    auto add = [&order](unsigned int chan) {
+      if (std::find(order.begin(), order.end(), chan) == order.end())
+        order.push_back(chan);
+    };
+    auto data = static_cast<uint8_t*>(frag->get_data());
+    if (frag->get_fragment_type() == FragmentType::kDAPHNE) {
+      auto n_frames = GetNFrames<DAPHNEFrame>(frag->get_size(), FragmentHeaderSize);
+      for (size_t i = 0; i < n_frames; ++i) {
+        auto frame = reinterpret_cast<DAPHNEFrame*>(data + i*FrameSize);
+        add(fChannelCache.Get(*fChannelMap, frame->daq_header.slot_id,
+                              frame->daq_header.link_id, frame->get_channel()));
+      }
+    }
+    else {
+      auto n_frames = GetNFrames<DAPHNEStreamFrame>(frag->get_size(), FragmentHeaderSize);
+      for (size_t i = 0; i < n_frames; ++i) {
+        auto frame = reinterpret_cast<DAPHNEStreamFrame*>(data + i*StreamFrameSize);
+        for (unsigned int chan : {frame->header.channel_0, frame->header.channel_1,
+                                  frame->header.channel_2, frame->header.channel_3})
+          add(fChannelCache.Get(*fChannelMap, frame->daq_header.slot_id,
+                                frame->daq_header.link_id, chan));
+      }
+    }
+    return order;
+  }
+
   bool CheckIsDetReadout(const SourceID & source_id) {
     return (source_id.subsystem == SourceID::Subsystem::kDetectorReadout);
   }
 
-  bool CheckFragSize(std::unique_ptr<Fragment> & frag) {
+  bool CheckFragSize(const Fragment * frag) {
     // Large enough to have header
     return (frag->get_size() > FragmentHeaderSize);
   }
@@ -191,7 +258,9 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
 
  public:
 
-  DAPHNEInterface1(fhicl::ParameterSet const& p) {};
+  DAPHNEInterface1(fhicl::ParameterSet const& p)
+    : fUseFragmentArena(p.get<bool>("UseFragmentArena", false)),
+      fParallelDecode(p.get<bool>("ParallelDecode", false)) {};
 
   void Process(
       art::Event &evt,
@@ -212,6 +281,16 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
     art::ServiceHandle<dune::HDF5RawFile3Service> rawFileService;
     auto raw_file = rawFileService->GetPtr();
     auto source_ids = raw_file->get_source_ids(record_id);
+    //The views of the record's fragments stay valid while it is held
+    pdhd::rawdecoding::FragmentArena::RecordPtr record;
+    if (fUseFragmentArena) record = pdhd::rawdecoding::FragmentArena::instance().record(*raw_file, record_id);
+
+    //HDF5 reads stay on this thread; only the unpacking is parallel.  The
+    //waveform tree is filled serially.
+    bool parallel = fParallelDecode && daphne_tree == nullptr;
+    std::vector<const Fragment *> frags;
+    std::vector<std::unique_ptr<Fragment>> owned_frags;
+
     //Loop over source ids
     for (const auto & source_id : source_ids)  {
       // only want detector readout data (i.e. not trigger info)
@@ -223,16 +302,31 @@ class DAPHNEInterface1 : public DAPHNEInterfaceBase {
         //Check that it's photon detectors
         if (!utils::CheckSubdet(geo_id, subdet_label)) continue;
 
-        //Get the fragment
-        auto frag = raw_file->get_frag_ptr(record_id, geo_id);
+        //Get the fragment. The arena indexes it by source id, which is
+        //the fragment the geo id maps to.
+        std::unique_ptr<Fragment> owned;
+        const Fragment * frag = nullptr;
+        if (record) {
+          frag = record->get(source_id);
+        }
+        else {
+          owned = raw_file->get_frag_ptr(record_id, geo_id);
+          frag = owned.get();
+        }
 
         // Too small to even have a header
-        if (!CheckFragSize(frag)) continue;
+        if (frag == nullptr || !CheckFragSize(frag)) continue;
 
-        //Process it
-        UnpackFragment(frag, wf_map, daphne_tree);
+        //Process it now, or hold it for the parallel unpacking
+        if (!parallel) {
+          UnpackFragment(frag, wf_map, daphne_tree);
+          continue;
+        }
+        frags.push_back(frag);
+        if (owned) owned_frags.push_back(std::move(owned));
       }
     }
+    if (parallel) UnpackFragmentsParallel(frags, wf_map);
   };
 
 };
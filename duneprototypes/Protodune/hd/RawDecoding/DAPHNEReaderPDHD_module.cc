@@ -114,6 +114,11 @@ void pdhd::DAPHNEReaderPDHD::produce(art::Event& evt) {
   WaveformVector opdet_waveforms;
   std::unordered_map<unsigned int, WaveformVector> wf_map;
 
+  if (fDAPHNETree != nullptr) {
+    fDAPHNETree->fRun = evt.run();
+    fDAPHNETree->fEvent = evt.event();
+  }
+
   //Process the event
   fDAPHNETool->Process(evt, fFileInfoLabel, fSubDetString, wf_map, fDAPHNETree);
 
@@ -137,6 +142,7 @@ void pdhd::DAPHNEReaderPDHD::produce(art::Event& evt) {
 
 void pdhd::DAPHNEReaderPDHD::endJob() {
   if (fDAPHNETree != nullptr) delete fDAPHNETree;
+  fDAPHNETree = nullptr;
 }
 
 DEFINE_ART_MODULE(pdhd::DAPHNEReaderPDHD)
@@ -1,16 +1,24 @@
 #include "DAPHNEUtils.h"
 #include "detdataformats/DetID.hpp"
 
+#include <algorithm>
+#include <iostream>
+
 namespace daphne::utils {
 
 DAPHNETree::DAPHNETree() : fTree(nullptr) {}
 DAPHNETree::DAPHNETree(TTree * tree) : fTree(tree) {
   SetBranches();
-};
+}
+
+void DAPHNETree::Fill(const raw::OpDetWaveform::value_type * adcs,
+                      size_t n_adcs) {
+  if (fTree == nullptr) return;
 
-void DAPHNETree::Fill() {
-  if (fTree != nullptr) 
-    fTree->Fill();
+  fNADC = n_adcs;
+  if (n_adcs > 0)
+    fADCBranch->SetAddress(const_cast<raw::OpDetWaveform::value_type *>(adcs));
+  fTree->Fill();
 }
 
 void DAPHNETree::SetBranches() {
@@ -28,7 +36,8 @@ void DAPHNETree::SetBranches() {
   fTree->Branch("DaphneChannel",& fDaphneChannel, "DaphneChannel/I");
   fTree->Branch("OfflineChannel", &fOfflineChannel, "OfflineChannel/I");
   fTree->Branch("FrameTimestamp",& fFrameTimestamp, "FrameTimestamp/l");
-  fTree->Branch("adc_channel", fADCValue, "adc_value[1024]/S");
+  fTree->Branch("NADC", &fNADC, "NADC/I");
+  fADCBranch = fTree->Branch("adc_channel", nullptr, "adc_value[NADC]/S");
 
   fTree->Branch("TriggerSampleValue", &fTriggerSampleValue,
                 "TriggerSampleValue/I"); //only for self-trigger
@@ -39,6 +48,42 @@ void DAPHNETree::SetBranches() {
 
 }
 
+ChannelCache::ChannelCache() {
+  for (auto & entry : fTable) entry.store(kUnresolved, std::memory_order_relaxed);
+}
+
+int ChannelCache::Get(dune::DAPHNEChannelMapService & channel_map,
+                      unsigned int slot, unsigned int link,
+                      unsigned int daphne_channel) {
+  //Triples outside the table are not expected; look them up every time
+  if (slot >= kNSlots || link >= kNLinks || daphne_channel >= kNChannels)
+    return Lookup(channel_map, slot, link, daphne_channel);
+
+  auto & entry = fTable[(slot*kNLinks + link)*kNChannels + daphne_channel];
+  int offline_channel = entry.load(std::memory_order_acquire);
+  if (offline_channel == kUnresolved) {
+    offline_channel = Lookup(channel_map, slot, link, daphne_channel);
+    entry.store(offline_channel, std::memory_order_release);
+  }
+  return offline_channel;
+}
+
+int ChannelCache::Lookup(dune::DAPHNEChannelMapService & channel_map,
+                         unsigned int slot, unsigned int link,
+                         unsigned int daphne_channel) {
+  std::lock_guard<std::mutex> lock(fMutex);
+  try {
+    return channel_map.GetOfflineChannel(slot, link, daphne_channel);
+  }
+  catch (const std::range_error & err) {
+    //Just throw a warning so users can check out the rest of the data
+    //maybe we can configure this to crash for keepup reco
+    std::cout << "WARNING: Could not find offline channel for " <<
+                 slot << " " << link << " " << daphne_channel << std::endl;
+  }
+  return -1;
+}
+
 raw::OpDetWaveform & MakeWaveform(
   unsigned int offline_chan,
   size_t n_adcs,
@@ -61,8 +106,10 @@ raw::OpDetWaveform & MakeWaveform(
 
 
   auto & waveform = wf_map.at(offline_chan).back();
-  //Reserve more adcs at once for efficiency
-  waveform.reserve(waveform.size() + n_adcs);
+  //Reserve more adcs at once for efficiency.  Grow at least geometrically so
+  //that streams appended frame by frame are not reallocated every frame.
+  if (waveform.capacity() < waveform.size() + n_adcs)
+    waveform.reserve(std::max(2*waveform.capacity(), waveform.size() + n_adcs));
   return waveform;
 
 }
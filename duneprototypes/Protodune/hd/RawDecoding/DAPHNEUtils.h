@@ -12,25 +12,59 @@
 
 #include "TTree.h"
 
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 namespace daphne {
 
   using WaveformVector = std::vector<raw::OpDetWaveform>;
 namespace utils {
 
+  //Waveform tree for debugging.  The decoders set the scalars of an entry
+  //and pass its ADCs to Fill, which fills the tree straight from them: the
+  //ADC branch is variable length, so it holds only the samples each waveform
+  //has, and is pointed at the caller's samples instead of a copy.
   class DAPHNETree {
    public:
-    int fRun, fEvent, fTriggerNumber, fNFrames, fSlot, fCrate, fDaphneChannel,
-        fOfflineChannel, fTriggerSampleValue, fThreshold, fBaseline;
-    long fTimestamp, fWindowEnd, fWindowBegin, fFrameTimestamp;
-    short fADCValue[1024];
-
+    int fRun = 0, fEvent = 0, fTriggerNumber = 0, fNFrames = 0, fSlot = 0,
+        fCrate = 0, fDaphneChannel = 0, fOfflineChannel = 0,
+        fTriggerSampleValue = 0, fThreshold = 0, fBaseline = 0;
+    long fTimestamp = 0, fWindowEnd = 0, fWindowBegin = 0, fFrameTimestamp = 0;
 
     DAPHNETree(TTree * tree);
     DAPHNETree();
-    void Fill();
-    void SetBranches();
+    DAPHNETree(const DAPHNETree &) = delete;
+    DAPHNETree & operator=(const DAPHNETree &) = delete;
+
+    //Fill an entry with the current scalars and the given ADCs
+    void Fill(const raw::OpDetWaveform::value_type * adcs, size_t n_adcs);
+
    private:
+    void SetBranches();
+
     TTree * fTree = nullptr;
+    int fNADC = 0;
+    TBranch * fADCBranch = nullptr;
+  };
+
+  //Offline channel of each (slot, link, DAPHNE channel), looked up in the
+  //channel map service the first time it is seen and read without locking
+  //afterwards, so decoding threads can share it.  -1 if the map has no entry;
+  //the warning for a missing entry is printed once.
+  class ChannelCache {
+   public:
+    ChannelCache();
+    int Get(dune::DAPHNEChannelMapService & channel_map,
+            unsigned int slot, unsigned int link, unsigned int daphne_channel);
+   private:
+    static constexpr unsigned int kNSlots = 16, kNLinks = 64, kNChannels = 64;
+    static constexpr int kUnresolved = -2;
+    int Lookup(dune::DAPHNEChannelMapService & channel_map,
+               unsigned int slot, unsigned int link, unsigned int daphne_channel);
+    std::array<std::atomic<int>, kNSlots*kNLinks*kNChannels> fTable;
+    std::mutex fMutex;  //serializes service lookups
   };
 
   raw::OpDetWaveform & MakeWaveform(
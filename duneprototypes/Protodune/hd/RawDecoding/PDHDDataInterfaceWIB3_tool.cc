@@ -4,7 +4,8 @@
 #include <sstream>
 #include <cstring>
 #include <string>
-#include "TMath.h"
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
 
 #include "art/Framework/Services/Registry/ServiceHandle.h"
 #include "messagefacility/MessageLogger/MessageLogger.h"
@@ -13,6 +14,9 @@
 #include "detdataformats/wib2/WIB2Frame.hpp"
 #include "duneprototypes/Protodune/hd/ChannelMap/PD2HDChannelMapService.h"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDDigitBuckets.h"
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDGeoIDIndex.h"
 
 class PDHDDataInterfaceWIB3 : public PDSPTPCDataInterfaceParent {
 
@@ -27,7 +31,10 @@ private:
   unsigned int fMaxChan = 1000000;  // no maximum for now
   unsigned int fDefaultCrate = 1;
   int fDebugLevel = 0;   // switch to turn on debugging printout
+  bool fHistogramPedestal = false;  // pedestals from AdcPedestalEstimator::compute instead of TMath
   std::string fSubDetectorString;  // two values seen in the data:  HD_TPC and VD_Bottom_TPC
+  bool fParallelDecode = false;    // decode the fragments of an APA concurrently
+  pdhd::rawdecoding::GeoIDIndex<dunedaq::daqdataformats::SourceID> fGeoIndex;  // crate -> source IDs, per file
   typedef std::vector<raw::RawDigit> RawDigits;
   typedef std::vector<raw::RDTimeStamp> RDTimeStamps;
 
@@ -38,7 +45,9 @@ public:
       fMaxChan(p.get<int>("MaxChan",1000000)),
       fDefaultCrate(p.get<unsigned int>("DefaultCrate", 1)),
       fDebugLevel(p.get<int>("DebugLevel",0)),
-      fSubDetectorString(p.get<std::string>("SubDetectorString","HD_TPC"))
+      fHistogramPedestal(p.get<bool>("HistogramPedestal", false)),
+      fSubDetectorString(p.get<std::string>("SubDetectorString","HD_TPC")),
+      fParallelDecode(p.get<bool>("ParallelDecode", false))
   { }
 
 
@@ -74,6 +83,11 @@ public:
 	std::cout << "PDHDDataInterface : " <<  "Retrieving Data for " << apalist.size() << " APAs " << std::endl;
       }
   
+    // one pass over the geo IDs of the record serves all the APAs on the list
+    art::ServiceHandle<dune::HDF5RawFile2Service> rawFileService;
+    auto rf = rawFileService->GetPtr();
+    fGeoIndex.update(*rf, rid, file_name, fSubDetectorString);
+
     for (const int & i : apalist)
       {
 	int apano = i;
@@ -105,178 +119,143 @@ public:
   }
 
 
-  // This is designed to get data from one APA. 
+  // This is designed to get data from one APA.  fGeoIndex must be up to date for rid.
   void getFragmentsForEvent(dunedaq::hdf5libs::HDF5RawDataFile::record_id_t &rid, RawDigits& raw_digits, RDTimeStamps &timestamps, int apano)
   {
-    using dunedaq::fddetdataformats::WIB2Frame;
     art::ServiceHandle<dune::PD2HDChannelMapService> channelMap;
     art::ServiceHandle<dune::HDF5RawFile2Service> rawFileService;
     auto rf = rawFileService->GetPtr();
-    auto sourceids = rf->get_source_ids(rid);
-    for (const auto &source_id : sourceids)  
+    if (fDebugLevel > 1)
       {
-	// only want detector readout data (i.e. not trigger info)
-	if (source_id.subsystem != dunedaq::daqdataformats::SourceID::Subsystem::kDetectorReadout) continue;
+	std::cout << "PDHDDataInterfaceWIB3 Tool found " << fGeoIndex.sourceIDs(apano).size() << " " << fSubDetectorString
+		  << " source IDs for APA " << apano << std::endl;
+      }
+    std::vector<std::unique_ptr<dunedaq::daqdataformats::Fragment>> frags;  // held for ParallelDecode
+    for (const auto &source_id : fGeoIndex.sourceIDs(apano))
+      {
+	// this reads the relevant dataset and returns a std::unique_ptr.  Memory is released when 
+	// it goes out of scope.  HDF5 reads stay on this thread; only decoding is parallel.
 
-	// look through the geo IDs and see if we are in the right crate
-	bool has_desired_apa = false;
-	auto gids = rf->get_geo_ids_for_source_id(rid, source_id);
-	for (const auto &gid : gids)
+	auto frag = rf->get_frag_ptr(rid, source_id);
+	if (fParallelDecode)
 	  {
-	    if (fDebugLevel > 1)
-	      {
-		std::cout << "PDHDDataInterfaceWIB3 Tool Geoid: " << std::hex << gid << std::dec << std::endl;
-	      }
-	    uint16_t detid = 0xffff & gid;
-	    dunedaq::detdataformats::DetID::Subdetector detidenum = static_cast<dunedaq::detdataformats::DetID::Subdetector>(detid);
-	    auto subdetector_string = dunedaq::detdataformats::DetID::subdetector_to_string(detidenum);
-	    if (fDebugLevel > 1)
-	      {
-		std::cout << "PDHDDataInterfaceWIB3 Tool subdetector string: " << subdetector_string << std::endl;
-		std::cout << "PDHDDataInterfaceWIB3 Tool looking for subdet: " << fSubDetectorString << std::endl;
-	      }
-	  
-	    if (subdetector_string == fSubDetectorString)
-	      {
-		uint16_t crate_from_geo = 0xffff & (gid >> 16);
-		if (fDebugLevel > 1)
-		  {
-		    std::cout << "crate from geo: " << crate_from_geo << std::endl;
-		  }
-
-		if (-1 == apano)
-		  {
-		    has_desired_apa = true;
-		    if (fDebugLevel > 1)
-		      {
-			std::cout << "assume desired APA, please use with caution" << std::endl;
-		      }
-		    break;
-		  }
-
-		if (crate_from_geo == apano)
-		  {
-		    has_desired_apa = true;
-		    if (fDebugLevel > 1)
-		      {
-			std::cout << "found desired APA" << std::endl;
-		      }
-		    break;
-		  }
-	      }
+	    frags.push_back(std::move(frag));
+	    continue;
 	  }
-	if (has_desired_apa)
+	decodeFragment(*frag, *channelMap, raw_digits, timestamps);
+      }
+    if (fParallelDecode)
+      {
+	decodeFragmentsParallel(frags, *channelMap, raw_digits, timestamps);
+      }
+  }
+
+  // Decode one fragment into RawDigits and RDTimeStamps.  Only reads shared
+  // state, so it may be called concurrently on different fragments.
+  void decodeFragment(dunedaq::daqdataformats::Fragment &frag, const dune::PD2HDChannelMapService &channelMap,
+		      RawDigits& raw_digits, RDTimeStamps &timestamps) const
+  {
+    using dunedaq::fddetdataformats::WIB2Frame;
+    auto frag_size = frag.get_size();
+    size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
+    if (frag_size <= fhs) return; // Too small to even have a header
+    size_t n_frames = (frag_size - fhs)/sizeof(WIB2Frame);
+    if (fDebugLevel > 0)
+      {
+	std::cout << "n_frames calc.: " << frag_size << " " << fhs << " " << sizeof(WIB2Frame) << " " << n_frames << std::endl;
+      }
+
+    std::vector<raw::RawDigit::ADCvector_t> adc_vectors(256);
+    unsigned int slot = 0, link = 0, crate = 0;
+    uint64_t firstframetimestamp = 0;
+
+    for (size_t i = 0; i < n_frames; ++i)
+      {
+	if (fDebugLevel > 2)
 	  {
-	    // this reads the relevant dataset and returns a std::unique_ptr.  Memory is released when 
-	    // it goes out of scope.
- 
-	    auto frag = rf->get_frag_ptr(rid, source_id);
-	    auto frag_size = frag->get_size();
-	    size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
-	    if (frag_size <= fhs) continue; // Too small to even have a header
-	    size_t n_frames = (frag_size - fhs)/sizeof(WIB2Frame);
-	    if (fDebugLevel > 0)
+	    // dump WIB frames in hex
+	    std::cout << "Frame number: " << i << std::endl;
+	    //size_t wfs32 = sizeof(WIB2Frame)/4;
+	    uint32_t *fdp = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(frag.get_data()) + i*sizeof(WIB2Frame));
+	    std::cout << std::dec;
+	    for (size_t iwdt = 0; iwdt < 1; iwdt++)  // dumps just the first 32 bits.  use wfs32 if you want them all
 	      {
-		std::cout << "n_frames calc.: " << frag_size << " " << fhs << " " << sizeof(WIB2Frame) << " " << n_frames << std::endl;
+		std::cout << iwdt << " : 10987654321098765432109876543210" << std::endl;
+		std::cout << iwdt << " : " << std::bitset<32>{fdp[iwdt]} << std::endl;
 	      }
+	    std::cout << std::dec;
+	  }
 
-	    std::vector<raw::RawDigit::ADCvector_t> adc_vectors(256);
-	    unsigned int slot = 0, link = 0, crate = 0;
-	    uint64_t firstframetimestamp = 0;
-          
-	    for (size_t i = 0; i < n_frames; ++i)
-	      {
-		if (fDebugLevel > 2)
-		  {
-		    // dump WIB frames in hex
-		    std::cout << "Frame number: " << i << std::endl;
-		    //size_t wfs32 = sizeof(WIB2Frame)/4;
-		    uint32_t *fdp = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(frag->get_data()) + i*sizeof(WIB2Frame));
-		    std::cout << std::dec;
-		    for (size_t iwdt = 0; iwdt < 1; iwdt++)  // dumps just the first 32 bits.  use wfs32 if you want them all
-		      {
-			std::cout << iwdt << " : 10987654321098765432109876543210" << std::endl;
-			std::cout << iwdt << " : " << std::bitset<32>{fdp[iwdt]} << std::endl;
-		      }
-		    std::cout << std::dec;
-		  }
-
-		auto frame = reinterpret_cast<WIB2Frame*>(static_cast<uint8_t*>(frag->get_data()) + i*sizeof(WIB2Frame));
-		for (size_t j = 0; j < adc_vectors.size(); ++j)
-		  {
-		    adc_vectors[j].push_back(frame->get_adc(j));
-		  }
-              
-		if (i == 0)
-		  {
-		    crate = frame->header.crate;
-		    slot = frame->header.slot;
-		    link = frame->header.link;
-		    firstframetimestamp = frame->get_timestamp();
-		  }
-	      }
-	    if (fDebugLevel > 0)
-	      {
-		std::cout << "PDHDDataInterfaceToolWIB3: crate, slot, link: "  << crate << ", " << slot << ", " << link << std::endl;
-	      }
+	auto frame = reinterpret_cast<WIB2Frame*>(static_cast<uint8_t*>(frag.get_data()) + i*sizeof(WIB2Frame));
+	for (size_t j = 0; j < adc_vectors.size(); ++j)
+	  {
+	    adc_vectors[j].push_back(frame->get_adc(j));
+	  }
 
-	    for (size_t iChan = 0; iChan < 256; ++iChan)
-	      {
-		const raw::RawDigit::ADCvector_t & v_adc = adc_vectors[iChan];
+	if (i == 0)
+	  {
+	    crate = frame->header.crate;
+	    slot = frame->header.slot;
+	    link = frame->header.link;
+	    firstframetimestamp = frame->get_timestamp();
+	  }
+      }
+    if (fDebugLevel > 0)
+      {
+	std::cout << "PDHDDataInterfaceToolWIB3: crate, slot, link: "  << crate << ", " << slot << ", " << link << std::endl;
+      }
 
-		uint32_t slotloc = slot;
-		slotloc &= 0x7;
+    uint32_t slotloc = slot;
+    slotloc &= 0x7;
 
-		auto hdchaninfo = channelMap->GetChanInfoFromWIBElements (crate, slotloc, link, iChan); 
-		unsigned int offline_chan = hdchaninfo.offlchan;
+    auto chaninfos = channelMap.GetCompactChanInfoBlock(crate, slotloc, link, 0, 256);
 
-		if (offline_chan > fMaxChan) continue;
+    for (size_t iChan = 0; iChan < 256; ++iChan)
+      {
+	const raw::RawDigit::ADCvector_t & v_adc = adc_vectors[iChan];
 
-		raw::RDTimeStamp rd_ts(frag->get_trigger_timestamp(), offline_chan);
-		timestamps.push_back(firstframetimestamp);
+	const auto &hdchaninfo = chaninfos ? chaninfos[iChan] :
+	  channelMap.GetCompactChanInfoFromWIBElements(crate, slotloc, link, iChan);
+	unsigned int offline_chan = hdchaninfo.offlchan;
 
-		float median = 0., sigma = 0.;
-		getMedianSigma(v_adc, median, sigma);
-		raw::RawDigit rd(offline_chan, v_adc.size(), v_adc);
-		rd.SetPedestal(median, sigma);
-		raw_digits.push_back(rd);
-	      }
-	  }
+	if (offline_chan > fMaxChan) continue;
+
+	raw::RDTimeStamp rd_ts(frag.get_trigger_timestamp(), offline_chan);
+	timestamps.push_back(firstframetimestamp);
+
+	float median = 0., sigma = 0.;
+	getMedianSigma(v_adc, median, sigma);
+	raw::RawDigit rd(offline_chan, v_adc.size(), v_adc);
+	rd.SetPedestal(median, sigma);
+	raw_digits.push_back(rd);
       }
   }
 
+  // Decode the fragments of one APA in TBB tasks, one bucket per fragment,
+  // then merge the buckets ordered by offline channel.
+  void decodeFragmentsParallel(std::vector<std::unique_ptr<dunedaq::daqdataformats::Fragment>> &frags,
+			       const dune::PD2HDChannelMapService &channelMap,
+			       RawDigits& raw_digits, RDTimeStamps &timestamps) const
+  {
+    std::vector<RawDigits> digit_buckets(frags.size());
+    std::vector<RDTimeStamps> ts_buckets(frags.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, frags.size()),
+		      [&](const tbb::blocked_range<size_t> &r)
+		      {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			  {
+			    decodeFragment(*frags[i], channelMap, digit_buckets[i], ts_buckets[i]);
+			  }
+		      });
+    pdhd::rawdecoding::mergeDigitBuckets(digit_buckets, ts_buckets, raw_digits, timestamps);
+  }
+
   void getMedianSigma(const raw::RawDigit::ADCvector_t &v_adc, float &median,
-					 float &sigma) {
-    size_t asiz = v_adc.size();
-    int imed=0;
-    if (asiz == 0) {
-      median = 0;
-      sigma = 0;
-    }
-    else {
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
-    
-      // add in a correction suggested by David Adams, May 6, 2019
-    
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i = 0; i < asiz; ++i) {
-	if (v_adc.at(i) < imed) s1++;
-	if (v_adc.at(i) == imed) sm++;
-      }
-      if (sm > 0) {
-	float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-	if (fDebugLevel > 0)
-	  {
-	    if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
-	  }
-	median += mcorr;
-      }
-    }
+					 float &sigma) const {
+    if (fHistogramPedestal)
+      AdcPedestalEstimator::compute(v_adc, median, sigma);
+    else
+      AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
   }
 };
 
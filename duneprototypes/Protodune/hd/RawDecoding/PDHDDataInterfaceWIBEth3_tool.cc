@@ -2,13 +2,16 @@
 // HDF5RawFile2Service.  This is needed because of a data format change on April 23, 2024 when
 // moving to the DUNE-DAQ 4.4.0 release
 
+#include <deque>
 #include <iostream>
 #include <list>
 #include <set>
 #include <sstream>
 #include <cstring>
 #include <string>
-#include "TMath.h"
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+#include "tbb/task_group.h"
 
 #include "art/Framework/Services/Registry/ServiceHandle.h"
 #include "messagefacility/MessageLogger/MessageLogger.h"
@@ -17,6 +20,11 @@
 #include "detdataformats/wibeth/WIBEthFrame.hpp"
 #include "duneprototypes/Protodune/hd/ChannelMap/PD2HDChannelMapService.h"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDWIBEthUnpack.h"
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDDigitBuckets.h"
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDFragmentArena.h"
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDGeoIDIndex.h"
 
 class PDHDDataInterfaceWIBEth3 : public PDSPTPCDataInterfaceParent {
 
@@ -31,7 +39,13 @@ private:
   unsigned int fMaxChan = 1000000;  // no maximum for now
   unsigned int fDefaultCrate = 1;
   int fDebugLevel = 0;   // switch to turn on debugging printout
+  bool fHistogramPedestal = false;  // pedestals from AdcPedestalEstimator::compute instead of TMath
   std::string fSubDetectorString;  // two values seen in the data:  HD_TPC and VD_Bottom_TPC
+  bool fUseBulkUnpack = true;      // transpose whole fragments with pdhd::rawdecoding::unpackWIBEthFrames
+  bool fParallelDecode = false;    // decode the fragments of an APA concurrently
+  bool fUseFragmentArena = false;  // share fragment reads with other readers via pdhd::rawdecoding::FragmentArena
+  bool fPrefetchAPAs = false;      // read the next APA's fragments while this one is decoded in a TBB task
+  pdhd::rawdecoding::GeoIDIndex<dunedaq::daqdataformats::SourceID> fGeoIndex;  // crate -> source IDs, per file
   typedef std::vector<raw::RawDigit> RawDigits;
   typedef std::vector<raw::RDTimeStamp> RDTimeStamps;
 
@@ -42,7 +56,12 @@ public:
       fMaxChan(p.get<int>("MaxChan",1000000)),
       fDefaultCrate(p.get<unsigned int>("DefaultCrate", 1)),
       fDebugLevel(p.get<int>("DebugLevel",0)),
-      fSubDetectorString(p.get<std::string>("SubDetectorString","HD_TPC"))
+      fHistogramPedestal(p.get<bool>("HistogramPedestal", false)),
+      fSubDetectorString(p.get<std::string>("SubDetectorString","HD_TPC")),
+      fUseBulkUnpack(p.get<bool>("UseBulkUnpack", true)),
+      fParallelDecode(p.get<bool>("ParallelDecode", false)),
+      fUseFragmentArena(p.get<bool>("UseFragmentArena", false)),
+      fPrefetchAPAs(p.get<bool>("PrefetchAPAs", false))
   { }
 
 
@@ -79,20 +98,52 @@ public:
 	std::cout << logname << " : " <<  "Retrieving Data for " << apalist.size() << " APAs " << std::endl;
       }
   
-    for (const int & i : apalist)
+    // one pass over the geo IDs of the record serves all the APAs on the list
+    art::ServiceHandle<dune::HDF5RawFile3Service> rawFileService;
+    auto rf = rawFileService->GetPtr();
+    fGeoIndex.update(*rf, rid, file_name, fSubDetectorString);
+
+    // Only the fragments of the listed APAs are read, always on this thread since the
+    // HDF5 library is not thread safe.  With PrefetchAPAs, APA k is decoded in a TBB
+    // task, which makes no HDF5 calls, while the fragments of APA k+1 are read.
+    // the views of the record's fragments stay valid while it is held
+    pdhd::rawdecoding::FragmentArena::RecordPtr record;
+    if (fUseFragmentArena) record = pdhd::rawdecoding::FragmentArena::instance().record(*rf, rid);
+    art::ServiceHandle<dune::PD2HDChannelMapService> channelMap;
+    const dune::PD2HDChannelMapService &chanMap = *channelMap;
+    std::deque<APAFragments> apa_frags;  // stable addresses for the decoding task
+    tbb::task_group decoding;
+
+    for (size_t k = 0; k < apalist.size(); ++k)
       {
-	int apano = i;
+	int apano = apalist[k];
 	if (fDebugLevel > 0)
 	  {
-	    std::cout << logname << " Tool called with requested APA:" << "apano: " << i << std::endl;
+	    std::cout << logname << " Tool called with requested APA:" << "apano: " << apano << std::endl;
 	  }
 
-	getFragmentsForEvent(rid, raw_digits, rd_timestamps, apano);
+	if (fPrefetchAPAs)
+	  {
+	    apa_frags.emplace_back();
+	    APAFragments &fragments = apa_frags.back();
+	    readFragments(rid, record.get(), apano, fragments);
+	    decoding.wait();   // APAs are decoded in order
+	    decoding.run([this, &fragments, &chanMap, &raw_digits, &rd_timestamps]
+			 {
+			   decodeFragments(fragments.frags, chanMap, raw_digits, rd_timestamps);
+			   fragments = APAFragments();
+			 });
+	  }
+	else
+	  {
+	    getFragmentsForEvent(rid, record.get(), raw_digits, rd_timestamps, apano);
+	  }
 
 	//Currently putting in dummy values for the RD Statuses
 	rdstatuses.clear();
 	rdstatuses.emplace_back(false, false, 0);
       }
+    decoding.wait();
 
     return 0;
   }
@@ -110,206 +161,236 @@ public:
   }
 
 
-  // This is designed to get data from one APA. 
-  void getFragmentsForEvent(dunedaq::hdf5libs::HDF5RawDataFile::record_id_t &rid, RawDigits& raw_digits, RDTimeStamps &timestamps, int apano)
+  // This is designed to get data from one APA.  fGeoIndex must be up to date for rid.
+  // Fragments are taken from record if given, else read with get_frag_ptr.
+  void getFragmentsForEvent(dunedaq::hdf5libs::HDF5RawDataFile::record_id_t &rid, pdhd::rawdecoding::FragmentArena::Record *record,
+			    RawDigits& raw_digits, RDTimeStamps &timestamps, int apano)
   {
-    using dunedaq::fddetdataformats::WIBEthFrame;
     art::ServiceHandle<dune::PD2HDChannelMapService> channelMap;
     art::ServiceHandle<dune::HDF5RawFile3Service> rawFileService;
     auto rf = rawFileService->GetPtr();
-    auto sourceids = rf->get_source_ids(rid);
-    for (const auto &source_id : sourceids)  
+    if (fDebugLevel > 1)
       {
-	// only want detector readout data (i.e. not trigger info)
-	if (source_id.subsystem != dunedaq::daqdataformats::SourceID::Subsystem::kDetectorReadout) continue;
-
-	// look through the geo IDs and see if we are in the right crate
-	bool has_desired_apa = false;
-	auto gids = rf->get_geo_ids_for_source_id(rid, source_id);
-	for (const auto &gid : gids)
+	std::cout << logname << " Tool found " << fGeoIndex.sourceIDs(apano).size() << " " << fSubDetectorString
+		  << " source IDs for APA " << apano << std::endl;
+      }
+    std::vector<const dunedaq::daqdataformats::Fragment*> frags;  // held for ParallelDecode
+    std::vector<std::unique_ptr<dunedaq::daqdataformats::Fragment>> owned_frags;
+    for (const auto &source_id : fGeoIndex.sourceIDs(apano))
+      {
+	// The arena reads the dataset once per record and keeps it for the other readers
+	// in the event.  Without it, get_frag_ptr returns a std::unique_ptr.  Memory is released when 
+	// it goes out of scope.  HDF5 reads stay on this thread; only decoding is parallel.
+
+	std::unique_ptr<dunedaq::daqdataformats::Fragment> owned;
+	const dunedaq::daqdataformats::Fragment *frag = getFragment(*rf, rid, record, source_id, owned);
+	if (frag == nullptr) continue;
+	if (fParallelDecode)
 	  {
-	    if (fDebugLevel > 1)
-	      {
-		std::cout << logname << " Tool Geoid: " << std::hex << gid << std::dec << std::endl;
-	      }
-	    uint16_t detid = 0xffff & gid;
-	    dunedaq::detdataformats::DetID::Subdetector detidenum = static_cast<dunedaq::detdataformats::DetID::Subdetector>(detid);
-	    auto subdetector_string = dunedaq::detdataformats::DetID::subdetector_to_string(detidenum);
-	    if (fDebugLevel > 1)
-	      {
-		std::cout << logname << " Tool subdetector string: " << subdetector_string << std::endl;
-		std::cout << logname << " Tool looking for subdet: " << fSubDetectorString << std::endl;
-	      }
-	  
-	    if (subdetector_string == fSubDetectorString)
-	      {
-		uint16_t crate_from_geo = 0xffff & (gid >> 16);
-		if (fDebugLevel > 1)
-		  {
-		    std::cout << "crate from geo: " << crate_from_geo << std::endl;
-		    uint16_t slot_from_geo = 0xffff & (gid >> 32);
-		    std::cout << "slot from geo: " << slot_from_geo << std::endl;
-		    uint16_t stream_from_geo = 0xffff & (gid >> 48);
-		    std::cout << "stream from geo: " << stream_from_geo << std::endl;
-		  }
-		  
+	    frags.push_back(frag);
+	    if (owned) owned_frags.push_back(std::move(owned));
+	    continue;
+	  }
+	decodeFragment(*frag, *channelMap, raw_digits, timestamps);
+      }
+    if (fParallelDecode)
+      {
+	decodeFragmentsParallel(frags, *channelMap, raw_digits, timestamps);
+      }
+    if (fDebugLevel > 0)
+      {
+	std::cout << "PDHDDataInterfaceToolWIBEth: number of raw digits found: "  << raw_digits.size() << std::endl;
+      }
+  }
 
-		if (-1 == apano)
-		  {
-		    has_desired_apa = true;
-		    if (fDebugLevel > 1)
-		      {
-			std::cout << "assume desired APA, please use with caution" << std::endl;
-		      }
-		    break;
-		  }
+  // The fragments of one APA, read ahead of their decoding.
+  struct APAFragments {
+    std::vector<const dunedaq::daqdataformats::Fragment*> frags;
+    std::vector<std::unique_ptr<dunedaq::daqdataformats::Fragment>> owned;
+  };
+
+  // The fragment of source_id, from record if given, else read with get_frag_ptr
+  // into owned.
+  const dunedaq::daqdataformats::Fragment *getFragment(dunedaq::hdf5libs::HDF5RawDataFile &rf,
+							dunedaq::hdf5libs::HDF5RawDataFile::record_id_t &rid,
+							pdhd::rawdecoding::FragmentArena::Record *record,
+							const dunedaq::daqdataformats::SourceID &source_id,
+							std::unique_ptr<dunedaq::daqdataformats::Fragment> &owned) const
+  {
+    if (record != nullptr) return record->get(source_id);
+    owned = rf.get_frag_ptr(rid, source_id);
+    return owned.get();
+  }
 
-		if (crate_from_geo == apano)
-		  {
-		    has_desired_apa = true;
-		    if (fDebugLevel > 1)
-		      {
-			std::cout << "found desired APA" << std::endl;
-		      }
-		    break;
-		  }
-	      }
-	  }
-	if (has_desired_apa)
-	  {
-	    // this reads the relevant dataset and returns a std::unique_ptr.  Memory is released when 
-	    // it goes out of scope.
- 
-	    auto frag = rf->get_frag_ptr(rid, source_id);
-	    auto frag_size = frag->get_size();
-	    size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
-	    if (frag_size <= fhs) continue; // Too small to even have a header
-	    size_t n_frames = (frag_size - fhs)/sizeof(WIBEthFrame);
-	    if (fDebugLevel > 0)
-	      {
-		std::cout << "n_frames calc.: " << frag_size << " " << fhs << " " << sizeof(WIBEthFrame) << " " << n_frames << std::endl;
-	      }
+  // Reads the fragments of one APA without decoding them.  fGeoIndex must be up to date for rid.
+  void readFragments(dunedaq::hdf5libs::HDF5RawDataFile::record_id_t &rid, pdhd::rawdecoding::FragmentArena::Record *record,
+		     int apano, APAFragments &fragments) const
+  {
+    art::ServiceHandle<dune::HDF5RawFile3Service> rawFileService;
+    auto rf = rawFileService->GetPtr();
+    for (const auto &source_id : fGeoIndex.sourceIDs(apano))
+      {
+	std::unique_ptr<dunedaq::daqdataformats::Fragment> owned;
+	const dunedaq::daqdataformats::Fragment *frag = getFragment(*rf, rid, record, source_id, owned);
+	if (frag == nullptr) continue;
+	fragments.frags.push_back(frag);
+	if (owned) fragments.owned.push_back(std::move(owned));
+      }
+  }
 
-	    std::vector<raw::RawDigit::ADCvector_t> adc_vectors(64);   // 64 channels per WIBEth frame
-	    unsigned int slot = 0, link = 0, crate = 0, stream = 0, locstream = 0;
-          
-	    for (size_t i = 0; i < n_frames; ++i)
-	      {
-		if (fDebugLevel > 2)
-		  {
-		    // dump WIB frames in binary
-		    std::cout << "Frame number: " << i << std::endl;
-		    size_t wfs32 = sizeof(WIBEthFrame)/4;
-		    uint32_t *fdp = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(frag->get_data()) + i*sizeof(WIBEthFrame));
-		    std::cout << std::dec;
-		    for (size_t iwdt = 0; iwdt < std::min(wfs32, (size_t) 4); iwdt++)  // dumps just the first 4 words.  use wfs32 if you want them all
-		      {
-			std::cout << iwdt << " : 10987654321098765432109876543210" << std::endl;
-			std::cout << iwdt << " : " << std::bitset<32>{fdp[iwdt]} << std::endl;
-		      }
-		    std::cout << std::dec;
-		  }
+  // Decodes the fragments of one APA.  Makes no HDF5 calls.
+  void decodeFragments(const std::vector<const dunedaq::daqdataformats::Fragment*> &frags,
+		       const dune::PD2HDChannelMapService &channelMap,
+		       RawDigits& raw_digits, RDTimeStamps &timestamps) const
+  {
+    if (fParallelDecode)
+      {
+	decodeFragmentsParallel(frags, channelMap, raw_digits, timestamps);
+      }
+    else
+      {
+	for (const auto *frag : frags) decodeFragment(*frag, channelMap, raw_digits, timestamps);
+      }
+  }
 
-		auto frame = reinterpret_cast<WIBEthFrame*>(static_cast<uint8_t*>(frag->get_data()) + i*sizeof(WIBEthFrame));
-		int adcvs = adc_vectors.size();  // convert to int
-		for (int jChan = 0; jChan < adcvs; ++jChan)   // these are ints because get_adc wants ints.
-		  {
-		    for (int kSample=0; kSample<64; ++kSample)
-		      {
-			adc_vectors[jChan].push_back(frame->get_adc(jChan,kSample));
-		      }
-		  }
-              
-		if (i == 0)
-		  {
-		    crate = frame->daq_header.crate_id;
-		    slot = frame->daq_header.slot_id;
-		    stream = frame->daq_header.stream_id;
-
-		    // local copy of the stream number -- change 0:3 & 64:67 to a single 0:3 number locstream
-		    // and set the link number
-		    // to be zero for stream from 0:3 and 1 for streams 64:67
-		    // n.b. locstream goes from 0 to 3 twice
-		  
-		    locstream = stream & 0x3;
-		    link = (stream >> 6) & 1;
+  // Decode one fragment: transpose the frames, look up offline channels and
+  // append one RawDigit and RDTimeStamp per valid channel.  Only reads shared
+  // state, so it may be called concurrently on different fragments.
+  void decodeFragment(const dunedaq::daqdataformats::Fragment &frag, const dune::PD2HDChannelMapService &channelMap,
+		      RawDigits& raw_digits, RDTimeStamps &timestamps) const
+  {
+    using dunedaq::fddetdataformats::WIBEthFrame;
+    auto frag_size = frag.get_size();
+    size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
+    if (frag_size <= fhs) return; // Too small to even have a header
+    size_t n_frames = (frag_size - fhs)/sizeof(WIBEthFrame);
+    if (fDebugLevel > 0)
+      {
+	std::cout << "n_frames calc.: " << frag_size << " " << fhs << " " << sizeof(WIBEthFrame) << " " << n_frames << std::endl;
+      }
 
-		  }
-	      }
-	    if (fDebugLevel > 0)
+    std::vector<raw::RawDigit::ADCvector_t> adc_vectors(64);   // 64 channels per WIBEth frame
+    unsigned int slot = 0, link = 0, crate = 0, stream = 0, locstream = 0;
+
+    if (fUseBulkUnpack)
+      {
+	auto frames = reinterpret_cast<WIBEthFrame*>(frag.get_data());
+	pdhd::rawdecoding::unpackWIBEthFrames(frames, n_frames, adc_vectors);
+      }
+
+    for (size_t i = 0; i < n_frames; ++i)
+      {
+	if (fDebugLevel > 2)
+	  {
+	    // dump WIB frames in binary
+	    std::cout << "Frame number: " << i << std::endl;
+	    size_t wfs32 = sizeof(WIBEthFrame)/4;
+	    uint32_t *fdp = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(frag.get_data()) + i*sizeof(WIBEthFrame));
+	    std::cout << std::dec;
+	    for (size_t iwdt = 0; iwdt < std::min(wfs32, (size_t) 4); iwdt++)  // dumps just the first 4 words.  use wfs32 if you want them all
 	      {
-		std::cout << "PDHDDataInterfaceToolWIBEth: crate, slot, link: "  << crate << ", " << slot << ", " << link << std::endl;
-		std::cout << "PDHDDataInterfaceToolWIBEth: stream, locstream: " << stream << ", " << locstream << std::endl;
+		std::cout << iwdt << " : 10987654321098765432109876543210" << std::endl;
+		std::cout << iwdt << " : " << std::bitset<32>{fdp[iwdt]} << std::endl;
 	      }
+	    std::cout << std::dec;
+	  }
 
-	    for (size_t iChan = 0; iChan < 64; ++iChan)
+	auto frame = reinterpret_cast<WIBEthFrame*>(static_cast<uint8_t*>(frag.get_data()) + i*sizeof(WIBEthFrame));
+	if (!fUseBulkUnpack)
+	  {
+	    int adcvs = adc_vectors.size();  // convert to int
+	    for (int jChan = 0; jChan < adcvs; ++jChan)   // these are ints because get_adc wants ints.
 	      {
-		const raw::RawDigit::ADCvector_t & v_adc = adc_vectors[iChan];
-
-		uint32_t slotloc = slot;
-		slotloc &= 0x7;
-
-		size_t wibframechan = iChan + 64*locstream; 
-
-		auto hdchaninfo = channelMap->GetChanInfoFromWIBElements (crate, slotloc, link, wibframechan);
-		if (fDebugLevel > 2)
+		for (int kSample=0; kSample<64; ++kSample)
 		  {
-		    std::cout << "PDHDDataInterfaceToolWIBEth: wibframechan, valid: " << wibframechan << " " << hdchaninfo.valid << std::endl;
+		    adc_vectors[jChan].push_back(frame->get_adc(jChan,kSample));
 		  }
-		if (!hdchaninfo.valid) continue;
+	      }
+	  }
 
-		unsigned int offline_chan = hdchaninfo.offlchan;
-		if (offline_chan > fMaxChan) continue;
+	if (i == 0)
+	  {
+	    crate = frame->daq_header.crate_id;
+	    slot = frame->daq_header.slot_id;
+	    stream = frame->daq_header.stream_id;
 
-		raw::RDTimeStamp rd_ts(frag->get_trigger_timestamp(), offline_chan);
-		timestamps.push_back(rd_ts);
+	    // local copy of the stream number -- change 0:3 & 64:67 to a single 0:3 number locstream
+	    // and set the link number
+	    // to be zero for stream from 0:3 and 1 for streams 64:67
+	    // n.b. locstream goes from 0 to 3 twice
+
+	    locstream = stream & 0x3;
+	    link = (stream >> 6) & 1;
 
-		float median = 0., sigma = 0.;
-		getMedianSigma(v_adc, median, sigma);
-		raw::RawDigit rd(offline_chan, v_adc.size(), v_adc);
-		rd.SetPedestal(median, sigma);
-		raw_digits.push_back(rd);
-	      }
 	  }
       }
     if (fDebugLevel > 0)
       {
-	std::cout << "PDHDDataInterfaceToolWIBEth: number of raw digits found: "  << raw_digits.size() << std::endl;
+	std::cout << "PDHDDataInterfaceToolWIBEth: crate, slot, link: "  << crate << ", " << slot << ", " << link << std::endl;
+	std::cout << "PDHDDataInterfaceToolWIBEth: stream, locstream: " << stream << ", " << locstream << std::endl;
       }
-  }
 
-  void getMedianSigma(const raw::RawDigit::ADCvector_t &v_adc, float &median,
-		      float &sigma) {
-    size_t asiz = v_adc.size();
-    int imed=0;
-    if (asiz == 0) {
-      median = 0;
-      sigma = 0;
-    }
-    else {
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
-    
-      // add in a correction suggested by David Adams, May 6, 2019
-    
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i = 0; i < asiz; ++i) {
-	if (v_adc.at(i) < imed) s1++;
-	if (v_adc.at(i) == imed) sm++;
-      }
-      if (sm > 0) {
-	float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-	if (fDebugLevel > 0)
+    uint32_t slotloc = slot;
+    slotloc &= 0x7;
+
+    // resolve all 64 channels of the frame at once; fall back to single lookups
+    // if the block is not entirely inside the map's table
+    auto chaninfos = channelMap.GetCompactChanInfoBlock(crate, slotloc, link, 64*locstream, 64);
+
+    for (size_t iChan = 0; iChan < 64; ++iChan)
+      {
+	const raw::RawDigit::ADCvector_t & v_adc = adc_vectors[iChan];
+
+	size_t wibframechan = iChan + 64*locstream; 
+
+	const auto &hdchaninfo = chaninfos ? chaninfos[iChan] :
+	  channelMap.GetCompactChanInfoFromWIBElements(crate, slotloc, link, wibframechan);
+	if (fDebugLevel > 2)
 	  {
-	    if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
+	    std::cout << "PDHDDataInterfaceToolWIBEth: wibframechan, valid: " << wibframechan << " " << hdchaninfo.valid << std::endl;
 	  }
-	median += mcorr;
+	if (!hdchaninfo.valid) continue;
+
+	unsigned int offline_chan = hdchaninfo.offlchan;
+	if (offline_chan > fMaxChan) continue;
+
+	raw::RDTimeStamp rd_ts(frag.get_trigger_timestamp(), offline_chan);
+	timestamps.push_back(rd_ts);
+
+	float median = 0., sigma = 0.;
+	getMedianSigma(v_adc, median, sigma);
+	raw::RawDigit rd(offline_chan, v_adc.size(), v_adc);
+	rd.SetPedestal(median, sigma);
+	raw_digits.push_back(rd);
       }
-    }
+  }
+
+  // Decode the fragments of one APA in parallel tasks on the TBB arena the
+  // framework runs in.  Each task fills its own buckets; the results are
+  // merged ordered by offline channel so output does not depend on scheduling.
+  void decodeFragmentsParallel(const std::vector<const dunedaq::daqdataformats::Fragment*> &frags,
+			       const dune::PD2HDChannelMapService &channelMap,
+			       RawDigits& raw_digits, RDTimeStamps &timestamps) const
+  {
+    std::vector<RawDigits> digit_buckets(frags.size());
+    std::vector<RDTimeStamps> ts_buckets(frags.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, frags.size()),
+		      [&](const tbb::blocked_range<size_t> &r)
+		      {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			  {
+			    decodeFragment(*frags[i], channelMap, digit_buckets[i], ts_buckets[i]);
+			  }
+		      });
+    pdhd::rawdecoding::mergeDigitBuckets(digit_buckets, ts_buckets, raw_digits, timestamps);
+  }
+
+  void getMedianSigma(const raw::RawDigit::ADCvector_t &v_adc, float &median,
+		      float &sigma) const {
+    if (fHistogramPedestal)
+      AdcPedestalEstimator::compute(v_adc, median, sigma);
+    else
+      AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
   }
 };
 
@@ -4,7 +4,6 @@
 #include <sstream>
 #include <cstring>
 #include <string>
-#include "TMath.h"
 
 #include "art/Framework/Services/Registry/ServiceHandle.h"
 #include "messagefacility/MessageLogger/MessageLogger.h"
@@ -13,6 +12,7 @@
 #include "detdataformats/wibeth/WIBEthFrame.hpp"
 #include "duneprototypes/Protodune/hd/ChannelMap/PD2HDChannelMapService.h"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
 
 class PDHDDataInterfaceWIBEth : public PDSPTPCDataInterfaceParent {
 
@@ -27,6 +27,7 @@ private:
   unsigned int fMaxChan = 1000000;  // no maximum for now
   unsigned int fDefaultCrate = 1;
   int fDebugLevel = 0;   // switch to turn on debugging printout
+  bool fHistogramPedestal = false;  // pedestals from AdcPedestalEstimator::compute instead of TMath
   std::string fSubDetectorString;  // two values seen in the data:  HD_TPC and VD_Bottom_TPC
   typedef std::vector<raw::RawDigit> RawDigits;
   typedef std::vector<raw::RDTimeStamp> RDTimeStamps;
@@ -38,6 +39,7 @@ public:
       fMaxChan(p.get<int>("MaxChan",1000000)),
       fDefaultCrate(p.get<unsigned int>("DefaultCrate", 1)),
       fDebugLevel(p.get<int>("DebugLevel",0)),
+      fHistogramPedestal(p.get<bool>("HistogramPedestal", false)),
       fSubDetectorString(p.get<std::string>("SubDetectorString","HD_TPC"))
   { }
 
@@ -276,36 +278,10 @@ public:
 
   void getMedianSigma(const raw::RawDigit::ADCvector_t &v_adc, float &median,
 		      float &sigma) {
-    size_t asiz = v_adc.size();
-    int imed=0;
-    if (asiz == 0) {
-      median = 0;
-      sigma = 0;
-    }
-    else {
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
-    
-      // add in a correction suggested by David Adams, May 6, 2019
-    
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i = 0; i < asiz; ++i) {
-	if (v_adc.at(i) < imed) s1++;
-	if (v_adc.at(i) == imed) sm++;
-      }
-      if (sm > 0) {
-	float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-	if (fDebugLevel > 0)
-	  {
-	    if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
-	  }
-	median += mcorr;
-      }
-    }
+    if (fHistogramPedestal)
+      AdcPedestalEstimator::compute(v_adc, median, sigma);
+    else
+      AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
   }
 };
 
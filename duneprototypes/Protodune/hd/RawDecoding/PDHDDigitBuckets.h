@@ -0,0 +1,45 @@
+#ifndef PDHDDIGITBUCKETS_H
+#define PDHDDIGITBUCKETS_H
+
+// Merge per-fragment RawDigit/RDTimeStamp buckets filled by parallel decoding
+// tasks.  Digits are appended ordered by offline channel (ties keep bucket
+// order), so the output is independent of how the tasks were scheduled.
+// Each bucket must hold one timestamp per digit.
+
+#include <algorithm>
+#include <vector>
+#include "lardataobj/RawData/RawDigit.h"
+#include "lardataobj/RawData/RDTimeStamp.h"
+
+namespace pdhd {
+namespace rawdecoding {
+
+  inline void mergeDigitBuckets(std::vector<std::vector<raw::RawDigit>> &digit_buckets,
+                                std::vector<std::vector<raw::RDTimeStamp>> &ts_buckets,
+                                std::vector<raw::RawDigit> &raw_digits,
+                                std::vector<raw::RDTimeStamp> &timestamps)
+  {
+    struct Entry { raw::ChannelID_t chan; size_t bucket; size_t index; };
+    std::vector<Entry> entries;
+    for (size_t ib = 0; ib < digit_buckets.size(); ++ib)
+      {
+        for (size_t i = 0; i < digit_buckets[ib].size(); ++i)
+          {
+            entries.push_back({digit_buckets[ib][i].Channel(), ib, i});
+          }
+      }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entry &a, const Entry &b) { return a.chan < b.chan; });
+
+    raw_digits.reserve(raw_digits.size() + entries.size());
+    timestamps.reserve(timestamps.size() + entries.size());
+    for (const auto &e : entries)
+      {
+        raw_digits.push_back(std::move(digit_buckets[e.bucket][e.index]));
+        timestamps.push_back(std::move(ts_buckets[e.bucket][e.index]));
+      }
+  }
+
+}
+}
+#endif
@@ -0,0 +1,332 @@
+#include "PDHDFragmentArena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "cetlib_except/exception.h"
+
+namespace {
+
+  // Block size for the first record; afterwards the blocks are merged to fit
+  // the largest record seen, so a steady job ends up with a single block.
+  constexpr size_t kMinBlockSize = 16*1024*1024;
+  constexpr size_t kAlign = 64;
+
+  // Records held by the arena besides those held by readers: enough for the
+  // events of a few schedules.
+  constexpr size_t kRecentRecords = 4;
+
+  inline size_t alignUp(size_t n) { return (n + kAlign - 1) & ~(kAlign - 1); }
+
+  // A fragment dataset of the file, closed when it goes out of scope.
+  class Dataset {
+  public:
+    Dataset(hid_t file, const std::string &path)
+      : fPath(path), fID(H5Dopen(file, path.c_str(), H5P_DEFAULT))
+    {
+      if (fID < 0) throw cet::exception("FragmentArena") << "Cannot open dataset " << path;
+    }
+    ~Dataset() { H5Dclose(fID); }
+    Dataset(const Dataset&) = delete;
+    Dataset& operator=(const Dataset&) = delete;
+
+    size_t size() const
+    {
+      hid_t space = H5Dget_space(fID);
+      hsize_t dims[1] = {0};
+      int ndims = (space < 0) ? -1 : H5Sget_simple_extent_ndims(space);
+      if (ndims == 1) H5Sget_simple_extent_dims(space, dims, nullptr);
+      if (space >= 0) H5Sclose(space);
+      if (ndims != 1) throw cet::exception("FragmentArena") << "Dataset " << fPath << " is not a byte array";
+      return dims[0];
+    }
+
+    void read(size_t offset, size_t nbytes, void *dst) const
+    {
+      if (nbytes == 0) return;
+      hid_t fspace = H5Dget_space(fID);
+      hsize_t start = offset;
+      hsize_t count = nbytes;
+      hid_t mspace = H5Screate_simple(1, &count, nullptr);
+      herr_t status = H5Sselect_hyperslab(fspace, H5S_SELECT_SET, &start, nullptr, &count, nullptr);
+      if (status >= 0)
+	{
+	  status = H5Dread(fID, H5T_STD_I8LE, mspace, fspace, H5P_DEFAULT, dst);
+	}
+      H5Sclose(mspace);
+      H5Sclose(fspace);
+      if (status < 0)
+	{
+	  throw cet::exception("FragmentArena") << "Cannot read " << nbytes << " bytes at " << offset
+						<< " of dataset " << fPath;
+	}
+    }
+
+  private:
+    std::string fPath;
+    hid_t fID;
+  };
+
+  // The source ID number in a fragment dataset name such as
+  // "Detector_Readout_0x0000006b_WIBEth"; false if there is none.
+  bool sourceNumberFromPath(const std::string &path, uint32_t &id)
+  {
+    size_t slash = path.rfind('/');
+    size_t pos = path.find("_0x", (slash == std::string::npos) ? 0 : slash);
+    if (pos == std::string::npos) return false;
+    const char *begin = path.c_str() + pos + 3;
+    char *end = nullptr;
+    unsigned long value = std::strtoul(begin, &end, 16);
+    if (end == begin || (*end != '_' && *end != '\0')) return false;
+    id = value;
+    return true;
+  }
+
+}
+
+pdhd::rawdecoding::FragmentArena &pdhd::rawdecoding::FragmentArena::instance()
+{
+  // Never destroyed: a file still open at exit is closed by the HDF5 library.
+  static FragmentArena *arena = new FragmentArena;
+  return *arena;
+}
+
+pdhd::rawdecoding::FragmentArena::File::~File()
+{
+  if (id >= 0) H5Fclose(id);
+}
+
+std::shared_ptr<pdhd::rawdecoding::FragmentArena::File>
+pdhd::rawdecoding::FragmentArena::openFile(const std::string &file_name)
+{
+  auto file = fFile.lock();
+  if (file && file->name == file_name) return file;
+
+  file = std::make_shared<File>();
+  file->name = file_name;
+  file->id = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file->id < 0) throw cet::exception("FragmentArena") << "Cannot open " << file_name;
+  fFile = file;
+  return file;
+}
+
+pdhd::rawdecoding::FragmentArena::RecordPtr
+pdhd::rawdecoding::FragmentArena::record(HDF5RawDataFile &rf, const record_id_t &rid)
+{
+  RecordPtr rec;
+  std::deque<RecordPtr> dropped;   // released after the lock
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    RecordKey key(rf.get_file_name(), rid);
+    auto it = fRecords.find(key);
+    if (it != fRecords.end()) rec = it->second.lock();
+    if (!rec)
+      {
+	auto file = openFile(key.first);
+	rec.reset(new Record(*this, file, rid));
+
+	// Datasets whose name does not give a unique source ID are looked up by
+	// the header at their start.
+	std::map<uint32_t, std::vector<SourceID>> by_number;
+	for (const auto &source_id : rf.get_source_ids(rid)) by_number[source_id.id].push_back(source_id);
+	std::vector<std::string> unnamed;
+	for (const auto &path : rf.get_fragment_dataset_paths(rid))
+	  {
+	    uint32_t number = 0;
+	    auto match = sourceNumberFromPath(path, number) ? by_number.find(number) : by_number.end();
+	    if (match != by_number.end() && match->second.size() == 1)
+	      {
+		rec->fEntries[match->second.front()].path = path;
+	      }
+	    else
+	      {
+		unnamed.push_back(path);
+	      }
+	  }
+	for (const auto &path : unnamed)
+	  {
+	    FragmentHeader header;
+	    Dataset(file->id, path).read(0, sizeof(header), &header);
+	    rec->fEntries[header.element_id].path = path;
+	  }
+
+	for (auto it2 = fRecords.begin(); it2 != fRecords.end(); )
+	  {
+	    if (it2->second.expired()) it2 = fRecords.erase(it2);
+	    else ++it2;
+	  }
+	fRecords[key] = rec;
+      }
+
+    fRecent.erase(std::remove(fRecent.begin(), fRecent.end(), rec), fRecent.end());
+    fRecent.push_back(rec);
+    while (fRecent.size() > kRecentRecords)
+      {
+	dropped.push_back(std::move(fRecent.front()));
+	fRecent.pop_front();
+      }
+  }
+  return rec;
+}
+
+void pdhd::rawdecoding::FragmentArena::release()
+{
+  std::deque<RecordPtr> dropped;
+  std::lock_guard<std::mutex> lock(fMutex);
+  dropped.swap(fRecent);
+}
+
+std::vector<pdhd::rawdecoding::FragmentArena::Block> pdhd::rawdecoding::FragmentArena::takeBlocks()
+{
+  std::lock_guard<std::mutex> lock(fBlockMutex);
+  std::vector<Block> blocks;
+  if (!fSpareBlocks.empty())
+    {
+      blocks.push_back(std::move(fSpareBlocks.back()));
+      fSpareBlocks.pop_back();
+    }
+  return blocks;
+}
+
+void pdhd::rawdecoding::FragmentArena::giveBlocks(std::vector<Block> &blocks)
+{
+  if (blocks.empty()) return;
+
+  // merge the blocks of a record that needed more than one
+  if (blocks.size() > 1)
+    {
+      size_t total = 0;
+      for (const auto &block : blocks) total += block.size;
+      blocks.clear();
+      Block block;
+      block.size = total;
+      block.mem.reset(new char[total]);
+      blocks.push_back(std::move(block));
+    }
+  blocks.front().used = 0;
+
+  // keep as many spare blocks as records the arena holds
+  std::lock_guard<std::mutex> lock(fBlockMutex);
+  fSpareBlocks.push_back(std::move(blocks.front()));
+  std::sort(fSpareBlocks.begin(), fSpareBlocks.end(),
+	    [](const Block &a, const Block &b) { return a.size < b.size; });
+  if (fSpareBlocks.size() > kRecentRecords) fSpareBlocks.erase(fSpareBlocks.begin());
+}
+
+pdhd::rawdecoding::FragmentArena::Record::Record(FragmentArena &arena, std::shared_ptr<File> file,
+						  const record_id_t &rid)
+  : fArena(arena), fFile(std::move(file)), fRecordID(rid), fBlocks(arena.takeBlocks())
+{
+}
+
+pdhd::rawdecoding::FragmentArena::Record::~Record()
+{
+  fEntries.clear();
+  fArena.giveBlocks(fBlocks);
+  if (fFile)
+    {
+      // the file is closed by the last record using it
+      std::lock_guard<std::mutex> lock(fArena.fMutex);
+      fFile.reset();
+    }
+}
+
+const pdhd::rawdecoding::FragmentArena::Fragment *
+pdhd::rawdecoding::FragmentArena::Record::get(const SourceID &source_id)
+{
+  std::lock_guard<std::mutex> lock(fArena.fMutex);
+  Entry &entry = findEntry(source_id);
+  if (entry.data == nullptr) load(entry, source_id);
+  return entry.view.get();
+}
+
+pdhd::rawdecoding::FragmentArena::FragmentHeader
+pdhd::rawdecoding::FragmentArena::Record::header(const SourceID &source_id)
+{
+  std::lock_guard<std::mutex> lock(fArena.fMutex);
+  Entry &entry = findEntry(source_id);
+  FragmentHeader header;
+  if (entry.data != nullptr)
+    {
+      std::memcpy(&header, entry.data, sizeof(header));
+    }
+  else
+    {
+      Dataset dataset(fFile->id, entry.path);
+      if (dataset.size() < sizeof(header))
+	{
+	  throw cet::exception("FragmentArena") << "Dataset " << entry.path << " is too small for a fragment";
+	}
+      dataset.read(0, sizeof(header), &header);
+    }
+  return header;
+}
+
+pdhd::rawdecoding::FragmentArena::Record::Entry &
+pdhd::rawdecoding::FragmentArena::Record::findEntry(const SourceID &source_id)
+{
+  auto it = fEntries.find(source_id);
+  if (it == fEntries.end())
+    {
+      throw cet::exception("FragmentArena") << "Record " << fRecordID.first << "." << fRecordID.second
+					    << " of " << fFile->name << " has no fragment for source "
+					    << source_id;
+    }
+  return it->second;
+}
+
+void pdhd::rawdecoding::FragmentArena::Record::load(Entry &entry, const SourceID &source_id)
+{
+  Dataset dataset(fFile->id, entry.path);
+  size_t size = dataset.size();
+  if (size < sizeof(FragmentHeader))
+    {
+      throw cet::exception("FragmentArena") << "Dataset " << entry.path << " is too small for a fragment";
+    }
+  char *mem = allocate(size);
+  dataset.read(0, size, mem);
+  const FragmentHeader *header = reinterpret_cast<const FragmentHeader*>(mem);
+  if (header->size != size || header->element_id < source_id || source_id < header->element_id)
+    {
+      throw cet::exception("FragmentArena") << "Dataset " << entry.path << " does not hold the fragment of source "
+					    << source_id;
+    }
+  entry.data = mem;
+  entry.view = std::make_unique<Fragment>(mem, Fragment::BufferAdoptionMode::kReadOnlyMode);
+}
+
+size_t pdhd::rawdecoding::FragmentArena::Record::payloadSize(const Entry &entry, size_t size_of_t)
+{
+  size_t size = entry.data ? entry.view->get_size() : Dataset(fFile->id, entry.path).size();
+  return (size > sizeof(FragmentHeader)) ? (size - sizeof(FragmentHeader))/size_of_t : 0;
+}
+
+void pdhd::rawdecoding::FragmentArena::Record::readPayload(const Entry &entry, size_t nbytes, void *dst)
+{
+  if (entry.data != nullptr)
+    {
+      std::memcpy(dst, entry.data + sizeof(FragmentHeader), nbytes);
+      return;
+    }
+  Dataset(fFile->id, entry.path).read(sizeof(FragmentHeader), nbytes, dst);
+}
+
+char *pdhd::rawdecoding::FragmentArena::Record::allocate(size_t nbytes)
+{
+  nbytes = alignUp(nbytes);
+  for (auto &block : fBlocks)
+    {
+      if (block.size - block.used >= nbytes)
+	{
+	  char *mem = block.mem.get() + block.used;
+	  block.used += nbytes;
+	  return mem;
+	}
+    }
+  Block block;
+  block.size = std::max(nbytes, kMinBlockSize);
+  block.mem.reset(new char[block.size]);
+  block.used = nbytes;
+  fBlocks.push_back(std::move(block));
+  return fBlocks.back().mem.get();
+}
@@ -0,0 +1,172 @@
+#ifndef PDHDFRAGMENTARENA_H
+#define PDHDFRAGMENTARENA_H
+
+// Per-record fragment store for readers of HDF5RawFile3 trigger records.
+//
+// HDF5RawDataFile::get_frag_ptr allocates and fills a new buffer on every
+// call, so each reader pays for its own read and allocation of every fragment
+// it looks at.  FragmentArena hands out one Record per trigger record, which
+// reads each fragment of the record at most once and hands out non-owning
+// (kReadOnlyMode) Fragment views that every reader in the event can share.
+//
+// Views stay valid as long as the RecordPtr they came from is held, whatever
+// other readers or schedules do in the meantime.  The arena also holds the
+// last few records itself, so readers of the same event that ask for the
+// record one after the other share the reads.  Memory blocks of released
+// records are reused by the next ones.
+//
+// All HDF5 calls are serialized, since the HDF5 library is not thread safe,
+// and are made on the thread calling the Record.  Fragments are located from
+// the dataset names of the record; the data are only read when asked for.
+// Failures throw cet::exception, as get_frag_ptr does.
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "hdf5.h"
+#include "dunecore/HDF5Utils/HDF5RawFile3Service.h"
+
+namespace pdhd {
+namespace rawdecoding {
+
+  class FragmentArena {
+
+  public:
+
+    using HDF5RawDataFile = dunedaq::hdf5libs::HDF5RawDataFile;
+    using record_id_t = HDF5RawDataFile::record_id_t;
+    using Fragment = dunedaq::daqdataformats::Fragment;
+    using FragmentHeader = dunedaq::daqdataformats::FragmentHeader;
+    using SourceID = dunedaq::daqdataformats::SourceID;
+
+    class Record;
+    using RecordPtr = std::shared_ptr<Record>;
+
+    // The arena shared by all readers in the job.
+    static FragmentArena &instance();
+
+    // The fragments of record rid of the file rf reads from.  Throws if the
+    // file cannot be opened.
+    RecordPtr record(HDF5RawDataFile &rf, const record_id_t &rid);
+
+    // Drops the records held by the arena; the file is closed once the
+    // readers have released theirs too.
+    void release();
+
+    FragmentArena(const FragmentArena&) = delete;
+    FragmentArena& operator=(const FragmentArena&) = delete;
+
+  private:
+
+    // An open HDF5 file, closed with its last record.
+    struct File {
+      std::string name;
+      hid_t id = -1;
+      ~File();
+    };
+
+    struct Block {
+      std::unique_ptr<char[]> mem;
+      size_t size = 0;
+      size_t used = 0;
+    };
+
+    using RecordKey = std::pair<std::string, record_id_t>;
+
+    FragmentArena() = default;
+
+    std::shared_ptr<File> openFile(const std::string &file_name);
+    std::vector<Block> takeBlocks();
+    void giveBlocks(std::vector<Block> &blocks);
+
+    std::mutex fMutex;                    // HDF5 calls and the record state
+    std::weak_ptr<File> fFile;
+    std::map<RecordKey, std::weak_ptr<Record>> fRecords;
+    std::deque<RecordPtr> fRecent;        // records held by the arena itself
+
+    std::mutex fBlockMutex;               // spare blocks of released records
+    std::vector<Block> fSpareBlocks;
+
+  public:
+
+    // The fragments of one trigger record.
+    class Record {
+
+    public:
+
+      ~Record();
+
+      // View of the fragment of source_id.  Throws if the record has no
+      // such fragment or it cannot be read.
+      const Fragment *get(const SourceID &source_id);
+
+      // Header of the fragment of source_id.  Reads only the header if the
+      // fragment is not yet in memory.
+      FragmentHeader header(const SourceID &source_id);
+
+      // Appends the payload of the fragment (everything after the header)
+      // to out as objects of type T and returns how many were appended.  A
+      // fragment not yet in memory is read straight into out.
+      template <class T>
+      size_t appendPayload(const SourceID &source_id, std::vector<T> &out);
+
+      Record(const Record&) = delete;
+      Record& operator=(const Record&) = delete;
+
+    private:
+
+      friend class FragmentArena;
+
+      struct Entry {
+	std::string path;                  // dataset path in the file
+	char *data = nullptr;              // arena copy, once read
+	std::unique_ptr<Fragment> view;    // kReadOnlyMode view of data
+      };
+
+      Record(FragmentArena &arena, std::shared_ptr<File> file, const record_id_t &rid);
+
+      Entry &findEntry(const SourceID &source_id);
+      void load(Entry &entry, const SourceID &source_id);
+      size_t payloadSize(const Entry &entry, size_t size_of_t);
+      void readPayload(const Entry &entry, size_t nbytes, void *dst);
+      char *allocate(size_t nbytes);
+
+      FragmentArena &fArena;
+      std::shared_ptr<File> fFile;
+      record_id_t fRecordID;
+      std::map<SourceID, Entry> fEntries;
+      std::vector<Block> fBlocks;
+
+    };
+
+  };
+
+  template <class T>
+  size_t FragmentArena::Record::appendPayload(const SourceID &source_id, std::vector<T> &out)
+  {
+    std::lock_guard<std::mutex> lock(fArena.fMutex);
+    Entry &entry = findEntry(source_id);
+    size_t n = payloadSize(entry, sizeof(T));
+    if (n == 0) return 0;
+    size_t first = out.size();
+    out.resize(first + n);
+    try
+      {
+	readPayload(entry, n*sizeof(T), out.data() + first);
+      }
+    catch (...)
+      {
+	out.resize(first);
+	throw;
+      }
+    return n;
+  }
+
+}
+}
+#endif
@@ -0,0 +1,105 @@
+#ifndef PDHDGEOIDINDEX_H
+#define PDHDGEOIDINDEX_H
+
+// Index from crate to the detector readout source IDs of one subdetector in
+// a trigger record.
+//
+// The TPC tools select the fragments of an APA by looking at the geo IDs of
+// every source ID of the record.  The geo IDs of a source do not change from
+// record to record in a file, so GeoIDIndex looks them up once per source
+// and file, and then serves every APA of every record from the index.
+//
+// Header-only and templated on the SourceID type so that it works with both
+// the HDF5RawFile2 and HDF5RawFile3 flavours of hdf5libs.
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "detdataformats/DetID.hpp"
+
+namespace pdhd {
+namespace rawdecoding {
+
+  template <class SourceID>
+  class GeoIDIndex {
+
+  public:
+
+    // Index the source IDs of record rid for subdetector subdet (e.g. "HD_TPC").
+    template <class RawFile, class RecordID>
+    void update(RawFile &rf, const RecordID &rid, const std::string &file_name, const std::string &subdet)
+    {
+      if (file_name != fFileName || subdet != fSubdet)
+	{
+	  fFileName = file_name;
+	  fSubdet = subdet;
+	  fCrates.clear();
+	  fDetIDMatch.clear();
+	}
+      fRecord.clear();
+      fAll.clear();
+      for (const auto &source_id : rf.get_source_ids(rid))
+	{
+	  // only want detector readout data (i.e. not trigger info)
+	  if (source_id.subsystem != SourceID::Subsystem::kDetectorReadout) continue;
+	  auto it = fCrates.find(source_id);
+	  if (it == fCrates.end())
+	    {
+	      it = fCrates.emplace(source_id, findCrates(rf.get_geo_ids_for_source_id(rid, source_id))).first;
+	    }
+	  if (it->second.empty()) continue;
+	  fAll.push_back(source_id);
+	  for (int crate : it->second) fRecord[crate].push_back(source_id);
+	}
+    }
+
+    // Source IDs of the current record with a geo ID in crate, in
+    // get_source_ids order.  crate -1 selects all crates.
+    const std::vector<SourceID> &sourceIDs(int crate) const
+    {
+      if (crate == -1) return fAll;
+      auto it = fRecord.find(crate);
+      return (it == fRecord.end()) ? fEmpty : it->second;
+    }
+
+  private:
+
+    template <class GeoIDs>
+    std::vector<int> findCrates(const GeoIDs &gids)
+    {
+      std::vector<int> crates;
+      for (const auto &gid : gids)
+	{
+	  uint16_t detid = 0xffff & gid;
+	  if (!matchDetID(detid)) continue;
+	  int crate = 0xffff & (gid >> 16);
+	  if (std::find(crates.begin(), crates.end(), crate) == crates.end()) crates.push_back(crate);
+	}
+      return crates;
+    }
+
+    bool matchDetID(uint16_t detid)
+    {
+      auto it = fDetIDMatch.find(detid);
+      if (it != fDetIDMatch.end()) return it->second;
+      auto detidenum = static_cast<dunedaq::detdataformats::DetID::Subdetector>(detid);
+      bool match = (dunedaq::detdataformats::DetID::subdetector_to_string(detidenum) == fSubdet);
+      fDetIDMatch[detid] = match;
+      return match;
+    }
+
+    std::string fFileName;
+    std::string fSubdet;
+    std::map<SourceID, std::vector<int>> fCrates;    // subdetector crates of each source seen in the file
+    std::map<uint16_t, bool> fDetIDMatch;            // detector ID matches fSubdet
+    std::map<int, std::vector<SourceID>> fRecord;    // crate -> source IDs of the current record
+    std::vector<SourceID> fAll;
+    std::vector<SourceID> fEmpty;
+
+  };
+
+}
+}
+#endif
@@ -7,6 +7,7 @@
 #include "art/Utilities/make_tool.h" 
 #include "canvas/Utilities/InputTag.h"
 #include "fhiclcpp/ParameterSet.h"
+#include "cetlib_except/exception.h"
 #include "art/Framework/Services/Registry/ServiceHandle.h"
 #include "messagefacility/MessageLogger/MessageLogger.h"
 #include "canvas/Persistency/Common/Assns.h"
@@ -21,7 +22,10 @@
 #include "detdataformats/trigger/TriggerPrimitive.hpp"
 #include "detdataformats/trigger/TriggerActivityData.hpp"
 #include "detdataformats/trigger/TriggerCandidateData.hpp"
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDFragmentArena.h"
+#include "duneprototypes/Protodune/hd/RawDecoding/data/TPWindow.h"
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
 
@@ -42,11 +46,51 @@ public:
   // Required functions.
   void produce(art::Event& e) override;
 
+  // Selected optional functions.
+  void endJob() override;
+
 private:
 
+  // Appends to overlays the TA or TC overlays in the payload of frag and adds
+  // their input counts to n_inputs.  Stops, with a warning, at an overlay that
+  // would run past the end of the fragment.
+  template <class Overlay>
+  void findOverlays(const dunedaq::daqdataformats::Fragment &frag,
+		    const dunedaq::daqdataformats::SourceID &source_id,
+		    std::vector<const Overlay*> &overlays, size_t &n_inputs) const;
+
+  // Copies the data and inputs of the overlays to the output collections and
+  // associates each input with its overlay.
+  template <class Overlay, class Data, class Input>
+  void fillOverlays(const std::vector<const Overlay*> &overlays, size_t n_inputs,
+		    std::vector<Data> &data_col, std::vector<Input> &input_col,
+		    art::Assns<Data,Input> &assn,
+		    art::PtrMaker<Data> &dataPtrMaker, art::PtrMaker<Input> &inputPtrMaker) const;
+
+  // The TPs of each of the fMaxTPWindows windows of a record.
+  typedef std::vector<std::vector<dunedaq::trgdataformats::TriggerPrimitive>> TPWindows;
+
+  // Window k of a record covers the fTPWindowTicks from readout_begin +
+  // k*fTPWindowTicks, so that a window product covers the same part of the
+  // readout window in every record.  The first window also takes the TPs
+  // before readout_begin and the last those after its end, so that none are
+  // dropped.
+  unsigned int tpWindowOf(uint64_t time_start, uint64_t readout_begin) const;
+
+  // Moves tps into their windows; tps is left empty.
+  void addToTPWindows(std::vector<dunedaq::trgdataformats::TriggerPrimitive> &tps, uint64_t readout_begin,
+		      TPWindows &windows) const;
+
+  // Puts each window sorted by channel and time_start in its own product,
+  // with a raw::TPWindow index of the windows.  windows is left empty.
+  void putTPWindows(art::Event& e, uint64_t readout_begin, TPWindows &windows) const;
+
   std::string fInputLabel;
   std::string fOutputInstance;
   int fDebugLevel;
+  bool fUseFragmentArena;   // read fragments through pdhd::rawdecoding::FragmentArena
+  uint64_t fTPWindowTicks;  // TP-stream window length in DTS ticks; 0: all TPs in one product
+  unsigned int fMaxTPWindows;  // number of window products; later TPs go in the last window
 };
 
 
@@ -54,10 +98,27 @@ PDHDTriggerReader3::PDHDTriggerReader3(fhicl::ParameterSet const& p)
   : EDProducer{p},
   fInputLabel(p.get<std::string>("InputLabel","daq")),
   fOutputInstance(p.get<std::string>("OutputInstance","daq")),
-  fDebugLevel(p.get<int>("DebugLevel",0))
+  fDebugLevel(p.get<int>("DebugLevel",0)),
+  fUseFragmentArena(p.get<bool>("UseFragmentArena",false)),
+  fTPWindowTicks(p.get<uint64_t>("TPWindowTicks",0)),
+  fMaxTPWindows(p.get<unsigned int>("MaxTPWindows",64))
 {
   produces<std::vector<dunedaq::trgdataformats::TriggerPrimitive>>(fOutputInstance);
 
+  //In window mode the readout TPs go in one product per time window instead, with an index of the windows
+  if (fTPWindowTicks > 0)
+    {
+      if (fMaxTPWindows == 0)
+	{
+	  throw cet::exception("PDHDTriggerReader3") << "MaxTPWindows must be at least 1 when TPWindowTicks is set";
+	}
+      produces<std::vector<raw::TPWindow>>(fOutputInstance);
+      for (unsigned int iwin = 0; iwin < fMaxTPWindows; ++iwin)
+	{
+	  produces<std::vector<dunedaq::trgdataformats::TriggerPrimitive>>(fOutputInstance+"window"+std::to_string(iwin));
+	}
+    }
+
   //TriggerActivity objects are TriggerActivityData with a list of the contained TPs.
   //Implement that as Assn between TriggerActivityData and TriggerPrimitive here
   produces<std::vector<dunedaq::trgdataformats::TriggerActivityData>>(fOutputInstance);
@@ -79,6 +140,15 @@ void PDHDTriggerReader3::produce(art::Event& e)
 {
 
   std::vector<dunedaq::trgdataformats::TriggerPrimitive> tp_col, tps_in_tas_col;
+  //in window mode each fragment's TPs are read into frag_tps and moved on to
+  //their window, so the readout TPs are never held twice.  The windows are laid
+  //out from the readout window begin of the first TP fragment, which all the
+  //fragments of a record share.
+  std::vector<dunedaq::trgdataformats::TriggerPrimitive> frag_tps;
+  TPWindows tp_windows((fTPWindowTicks > 0) ? fMaxTPWindows : 0);
+  uint64_t readout_begin = 0;
+  bool have_readout_begin = false;
+  auto &tp_dest = (fTPWindowTicks > 0) ? frag_tps : tp_col;
   std::vector<dunedaq::trgdataformats::TriggerActivityData> ta_col, tas_in_tcs_col;
   std::vector<dunedaq::trgdataformats::TriggerCandidateData> tc_col;
 
@@ -108,6 +178,9 @@ void PDHDTriggerReader3::produce(art::Event& e)
   // Fetches SourceIDs for the set of Fragments that have TriggerPrimitive data in them.
   art::ServiceHandle<dune::HDF5RawFile3Service> rawFileService;
   auto rf = rawFileService->GetPtr();
+  // the views of the record's fragments stay valid while it is held
+  pdhd::rawdecoding::FragmentArena::RecordPtr record;
+  if (fUseFragmentArena) record = pdhd::rawdecoding::FragmentArena::instance().record(*rf, rid);
  
   auto tp_sourceids = rf->get_source_ids_for_fragment_type(rid, dunedaq::daqdataformats::FragmentType::kTriggerPrimitive);
   auto ta_sourceids = rf->get_source_ids_for_fragment_type(rid, dunedaq::daqdataformats::FragmentType::kTriggerActivity);
@@ -125,127 +198,103 @@ void PDHDTriggerReader3::produce(art::Event& e)
     {
       // Perform a check to make sure we are only grabbing information from the trigger
       if (source_id.subsystem != dunedaq::daqdataformats::SourceID::Subsystem::kTrigger) continue;
-      
-      auto frag_ptr = rf->get_frag_ptr(rid, source_id);
-      auto frag_size = frag_ptr->get_size();
-      size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
-      
-      if (frag_size <= fhs) continue; // Too small to even have a header
-      
-      size_t tps = sizeof(dunedaq::trgdataformats::TriggerPrimitive);
-      size_t this_sid_no_of_tps = (frag_size - fhs) / tps;
-      size_t current_no_of_tps = tp_col.size();
-      void* frag_payload_ptr = frag_ptr->get_data();
 
-      
-      // Now you can take the block of data where frag_payload_ptr points to and copy this block of data into a vector of TriggerPrimitives,
-      // trig_vector
-      tp_col.resize(current_no_of_tps+this_sid_no_of_tps);
-      memcpy(&(tp_col[current_no_of_tps]), frag_payload_ptr, this_sid_no_of_tps * tps);
+      size_t current_no_of_tps = tp_dest.size();
+      if (fUseFragmentArena)
+	{
+	  if (fTPWindowTicks > 0 && !have_readout_begin)
+	    {
+	      readout_begin = record->header(source_id).window_begin;
+	      have_readout_begin = true;
+	    }
+	  // the payload is read from the file directly into the tail of tp_dest
+	  record->appendPayload(source_id, tp_dest);
+	}
+      else
+	{
+	  auto frag_ptr = rf->get_frag_ptr(rid, source_id);
+	  if (fTPWindowTicks > 0 && !have_readout_begin)
+	    {
+	      readout_begin = frag_ptr->get_window_begin();
+	      have_readout_begin = true;
+	    }
+	  auto frag_size = frag_ptr->get_size();
+	  size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
+
+	  if (frag_size <= fhs) continue; // Too small to even have a header
+
+	  size_t tps = sizeof(dunedaq::trgdataformats::TriggerPrimitive);
+	  size_t this_sid_no_of_tps = (frag_size - fhs) / tps;
+	  void* frag_payload_ptr = frag_ptr->get_data();
+
+	  // Now you can take the block of data where frag_payload_ptr points to and copy this block of data into a vector of TriggerPrimitives,
+	  // trig_vector
+	  tp_dest.resize(current_no_of_tps+this_sid_no_of_tps);
+	  memcpy(&(tp_dest[current_no_of_tps]), frag_payload_ptr, this_sid_no_of_tps * tps);
+	}
 
-      for (size_t i = current_no_of_tps; i < tp_col.size(); ++i)
+      for (size_t i = current_no_of_tps; i < tp_dest.size(); ++i)
       {
 	    if (fDebugLevel > 0)
 	    {
-	      std::cout << source_id << "   ;    " << i << "    ;    "  << tp_col.at(i).channel << "    ;    " << tp_col.at(i).time_start << "  ;  " << tp_col.at(i).version << std::endl;
+	      std::cout << source_id << "   ;    " << i << "    ;    "  << tp_dest.at(i).channel << "    ;    " << tp_dest.at(i).time_start << "  ;  " << tp_dest.at(i).version << std::endl;
 	    }
       }
+      if (fTPWindowTicks > 0) addToTPWindows(frag_tps, readout_begin, tp_windows);
       
     
     } // for (auto const& source_id : tp_sourceids)
   
   
 
+  // TAs and TCs are read in two passes: the first finds the overlays in all
+  // fragments, checking that each lies inside its fragment, and counts them
+  // and their inputs; the second fills the output collections, which are
+  // reserved once.  The fragments are held until both passes are done.
+  std::vector<std::unique_ptr<dunedaq::daqdataformats::Fragment>> owned_frags;
+  auto getFragment = [&](const dunedaq::daqdataformats::SourceID &source_id) -> const dunedaq::daqdataformats::Fragment*
+    {
+      if (record) return record->get(source_id);
+      owned_frags.push_back(rf->get_frag_ptr(rid, source_id));
+      return owned_frags.back().get();
+    };
+
+  std::vector<const dunedaq::trgdataformats::TriggerActivity*> ta_overlays;
+  size_t n_tps_in_tas = 0;
   for (auto const& source_id : ta_sourceids)
     {
       if (source_id.subsystem != dunedaq::daqdataformats::SourceID::Subsystem::kTrigger) continue;
-
-      auto frag_ptr = rf->get_frag_ptr(rid, source_id);
-      auto frag_size = frag_ptr->get_size();
-      size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
-
-      if (frag_size <= fhs) continue;
-
-      //loop over the data, one TA at a time
-      long remaining_data_size = (long)(frag_size-fhs);
-      char* data_ptr = (char*)(frag_ptr->get_data());
-      while(remaining_data_size>0) {
-          //create our overlay object
-          const dunedaq::trgdataformats::TriggerActivity& overlay =
-                  *reinterpret_cast<const dunedaq::trgdataformats::TriggerActivity*>(data_ptr);
-
-          //get its size
-          auto this_size = sizeof(dunedaq::trgdataformats::TriggerActivity::data_t) + //size of TriggerActivityData
-                   sizeof(uint64_t) + //n_inputs is uint64_t
-                   overlay.n_inputs*sizeof(dunedaq::trgdataformats::TriggerActivity::input_t); //size of TP inputs
-
-          //put our TA data on the output collection
-          ta_col.emplace_back(overlay.data);
-
-          //create an art::Ptr for it
-          auto const taPtr = taPtrMaker(ta_col.size()-1);
-
-          //loop through the TPs in the TA, add them to a new collection and make Assns to the TA
-          for(size_t i_tp=0; i_tp<overlay.n_inputs; ++i_tp) {
-              tps_in_tas_col.emplace_back(overlay.inputs[i_tp]);
-              auto const tpPtr = tpInTAPtrMaker(tps_in_tas_col.size()-1);
-              tp_in_tas_assn.addSingle(taPtr,tpPtr);
-          }
-          //move the read position forward
-          remaining_data_size = remaining_data_size-(long)this_size;
-          data_ptr += this_size;
-
-      } //end while(remaining_data_size>0)
+      auto frag_ptr = getFragment(source_id);
+      if (frag_ptr == nullptr) continue;
+      findOverlays(*frag_ptr, source_id, ta_overlays, n_tps_in_tas);
     }
 
-      
-      
+  std::vector<const dunedaq::trgdataformats::TriggerCandidate*> tc_overlays;
+  size_t n_tas_in_tcs = 0;
   for (auto const& source_id : tc_sourceids)
     {
       if (source_id.subsystem != dunedaq::daqdataformats::SourceID::Subsystem::kTrigger) continue;
+      auto frag_ptr = getFragment(source_id);
+      if (frag_ptr == nullptr) continue;
+      findOverlays(*frag_ptr, source_id, tc_overlays, n_tas_in_tcs);
+    }
 
-      auto frag_ptr = rf->get_frag_ptr(rid, source_id);
-      auto frag_size = frag_ptr->get_size();
-      size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
-
-      if (frag_size <= fhs) continue;
-
-      //loop over the data, one TA at a time
-      long remaining_data_size = (long)(frag_size-fhs);
-      char* data_ptr = (char*)(frag_ptr->get_data());
-
-      while(remaining_data_size>0) {
-          //create our overlay object
-          const dunedaq::trgdataformats::TriggerCandidate& overlay =
-                  *reinterpret_cast<const dunedaq::trgdataformats::TriggerCandidate*>(data_ptr);
-
-          //get its size
-          auto this_size = sizeof(dunedaq::trgdataformats::TriggerCandidate::data_t) + //size of TriggerCandidateData
-                  sizeof(uint64_t) + //n_inputs is uint64_t
-                  overlay.n_inputs*sizeof(dunedaq::trgdataformats::TriggerCandidate::input_t); //size of TA inputs
-
-          //put our TC data on the output collection
-          tc_col.emplace_back(overlay.data);
+  if (fDebugLevel > 0)
+    {
+      std::cout << "TAs: " << ta_overlays.size() << " with " << n_tps_in_tas << " TPs ; TCs: "
+		<< tc_overlays.size() << " with " << n_tas_in_tcs << " TAs" << std::endl;
+    }
 
-          //create an art::Ptr for it
-          auto const tcPtr = tcPtrMaker(tc_col.size()-1);
+  //put the TA data on the output collection and the TPs in the TAs on a new collection, with Assns to the TA
+  fillOverlays(ta_overlays, n_tps_in_tas, ta_col, tps_in_tas_col, tp_in_tas_assn, taPtrMaker, tpInTAPtrMaker);
 
-          //loop through the TPs in the TA, add them to a new collection and make Assns to the TA
-          for(size_t i_ta=0; i_ta<overlay.n_inputs; ++i_ta) {
-              tas_in_tcs_col.emplace_back(overlay.inputs[i_ta]);
-              auto const taPtr = taInTCPtrMaker(tas_in_tcs_col.size()-1);
-              ta_in_tcs_assn.addSingle(tcPtr,taPtr);
-          }
+  //same for the TCs and the TAs in them
+  fillOverlays(tc_overlays, n_tas_in_tcs, tc_col, tas_in_tcs_col, ta_in_tcs_assn, tcPtrMaker, taInTCPtrMaker);
 
-          //move the read position forward
-          remaining_data_size = remaining_data_size-(long)this_size;
-          data_ptr += this_size;
 
-      } //end while(remaining_data_size>0)
-    }
 
-
-  //the tps that were pulled in from the readout
+  //the tps that were pulled in from the readout, split into time windows if requested
+  if (fTPWindowTicks > 0) putTPWindows(e, readout_begin, tp_windows);
   e.put(std::make_unique<std::vector<dunedaq::trgdataformats::TriggerPrimitive>>(std::move(tp_col)),fOutputInstance);
 
   //the tas that were pulled in from the trigger system, the tps inside those tas, and assn of them
@@ -260,4 +309,118 @@ void PDHDTriggerReader3::produce(art::Event& e)
 
 }
 
+template <class Overlay>
+void PDHDTriggerReader3::findOverlays(const dunedaq::daqdataformats::Fragment &frag,
+				      const dunedaq::daqdataformats::SourceID &source_id,
+				      std::vector<const Overlay*> &overlays, size_t &n_inputs) const
+{
+  size_t frag_size = frag.get_size();
+  size_t fhs = sizeof(dunedaq::daqdataformats::FragmentHeader);
+  if (frag_size <= fhs) return;
+
+  //size of the data and of n_inputs, which is uint64_t, ahead of the inputs
+  const size_t head_size = sizeof(typename Overlay::data_t) + sizeof(uint64_t);
+  const size_t input_size = sizeof(typename Overlay::input_t);
+
+  //loop over the data, one overlay at a time
+  size_t remaining_data_size = frag_size - fhs;
+  const char* data_ptr = static_cast<const char*>(frag.get_data());
+  while (remaining_data_size > 0)
+    {
+      const Overlay* overlay = reinterpret_cast<const Overlay*>(data_ptr);
+      if (remaining_data_size < head_size ||
+	  overlay->n_inputs > (remaining_data_size - head_size)/input_size)
+	{
+	  mf::LogWarning("PDHDTriggerReader3") << "Truncated trigger object in fragment " << source_id
+					       << ": ignoring the last " << remaining_data_size << " bytes";
+	  break;
+	}
+      auto this_size = head_size + overlay->n_inputs*input_size;
+      overlays.push_back(overlay);
+      n_inputs += overlay->n_inputs;
+
+      //move the read position forward
+      remaining_data_size -= this_size;
+      data_ptr += this_size;
+    }
+}
+
+template <class Overlay, class Data, class Input>
+void PDHDTriggerReader3::fillOverlays(const std::vector<const Overlay*> &overlays, size_t n_inputs,
+				      std::vector<Data> &data_col, std::vector<Input> &input_col,
+				      art::Assns<Data,Input> &assn,
+				      art::PtrMaker<Data> &dataPtrMaker, art::PtrMaker<Input> &inputPtrMaker) const
+{
+  data_col.reserve(data_col.size() + overlays.size());
+  input_col.reserve(input_col.size() + n_inputs);
+  for (const Overlay* overlay : overlays)
+    {
+      data_col.emplace_back(overlay->data);
+
+      //create an art::Ptr for it
+      auto const dataPtr = dataPtrMaker(data_col.size()-1);
+
+      for (size_t i = 0; i < overlay->n_inputs; ++i)
+	{
+	  input_col.emplace_back(overlay->inputs[i]);
+	  auto const inputPtr = inputPtrMaker(input_col.size()-1);
+	  assn.addSingle(dataPtr, inputPtr);
+	}
+    }
+}
+
+unsigned int PDHDTriggerReader3::tpWindowOf(uint64_t time_start, uint64_t readout_begin) const
+{
+  if (time_start < readout_begin) return 0;
+  return (unsigned int) std::min<uint64_t>((time_start - readout_begin)/fTPWindowTicks, fMaxTPWindows - 1);
+}
+
+void PDHDTriggerReader3::addToTPWindows(std::vector<dunedaq::trgdataformats::TriggerPrimitive> &tps, uint64_t readout_begin,
+					TPWindows &windows) const
+{
+  for (const auto &tp : tps) windows[tpWindowOf(tp.time_start, readout_begin)].push_back(tp);
+  tps.clear();
+}
+
+void PDHDTriggerReader3::putTPWindows(art::Event& e, uint64_t readout_begin, TPWindows &windows) const
+{
+  using dunedaq::trgdataformats::TriggerPrimitive;
+
+  auto index = std::make_unique<std::vector<raw::TPWindow>>();
+  index->reserve(fMaxTPWindows);
+  for (unsigned int iwin = 0; iwin < fMaxTPWindows; ++iwin)
+    {
+      auto &window = windows[iwin];
+
+      //the first and last windows stretch to the TPs outside the readout window
+      raw::TPWindow entry;
+      entry.fWindow = iwin;
+      entry.fStartTime = readout_begin + iwin*fTPWindowTicks;
+      entry.fEndTime = entry.fStartTime + fTPWindowTicks;
+      if (iwin == 0 || iwin + 1 == fMaxTPWindows)
+	{
+	  for (const auto &tp : window)
+	    {
+	      entry.fStartTime = std::min<uint64_t>(entry.fStartTime, tp.time_start);
+	      entry.fEndTime = std::max<uint64_t>(entry.fEndTime, tp.time_start + 1);
+	    }
+	}
+      entry.fNTPs = window.size();
+      index->push_back(entry);
+
+      std::sort(window.begin(), window.end(),
+		[](const TriggerPrimitive &a, const TriggerPrimitive &b)
+		{ return a.channel < b.channel || (a.channel == b.channel && a.time_start < b.time_start); });
+      e.put(std::make_unique<std::vector<TriggerPrimitive>>(std::move(window)),fOutputInstance+"window"+std::to_string(iwin));
+    }
+  windows.clear();
+  e.put(std::move(index),fOutputInstance);
+}
+
+void PDHDTriggerReader3::endJob()
+{
+  // let the arena close its file once the other readers are done with it
+  if (fUseFragmentArena) pdhd::rawdecoding::FragmentArena::instance().release();
+}
+
 DEFINE_ART_MODULE(PDHDTriggerReader3)
@@ -0,0 +1,141 @@
+#include "PDHDWIBEthUnpack.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PDHD_WIBETH_HAVE_AVX2_PATH 1
+#endif
+
+namespace {
+
+  using pdhd::rawdecoding::WIBEthFrame;
+  using pdhd::rawdecoding::kWIBEthChannels;
+  using pdhd::rawdecoding::kWIBEthSamples;
+
+  // Each time sample is 64 channels x 14 bits = 112 bytes.  Four channels take
+  // 56 bits = 7 bytes, so channels 4g..4g+3 can be read with a single unaligned
+  // 64-bit load at byte 7g and shifted out by 0, 14, 28 and 42 bits.  The last
+  // group would read one byte past the sample (and, for the last sample of the
+  // last frame, past the fragment), so load it one byte earlier and shift by 8.
+
+  constexpr size_t kBytesPerSample = 112;
+  constexpr size_t kGroups = kWIBEthChannels/4;
+  constexpr uint64_t kADCMask = 0x3fff;
+
+  inline size_t groupOffset(size_t g) { return (g == kGroups-1) ? 7*g - 1 : 7*g; }
+  inline unsigned groupShift(size_t g) { return (g == kGroups-1) ? 8 : 0; }
+
+  inline const uint8_t *samplePtr(const WIBEthFrame *frame)
+  {
+    return reinterpret_cast<const uint8_t*>(&frame->adc_words[0][0]);
+  }
+
+  void unpackFrameScalar(const WIBEthFrame *frame, short **dst, size_t offset)
+  {
+    const uint8_t *sp = samplePtr(frame);
+    for (size_t t = 0; t < kWIBEthSamples; ++t)
+      {
+	const uint8_t *s = sp + t*kBytesPerSample;
+	for (size_t g = 0; g < kGroups; ++g)
+	  {
+	    uint64_t w;
+	    std::memcpy(&w, s + groupOffset(g), sizeof(w));
+	    w >>= groupShift(g);
+	    dst[4*g  ][offset + t] = w         & kADCMask;
+	    dst[4*g+1][offset + t] = (w >> 14) & kADCMask;
+	    dst[4*g+2][offset + t] = (w >> 28) & kADCMask;
+	    dst[4*g+3][offset + t] = (w >> 42) & kADCMask;
+	  }
+      }
+  }
+
+#ifdef PDHD_WIBETH_HAVE_AVX2_PATH
+
+  // Gathers group g for four consecutive time samples, so each 64-bit lane holds
+  // one sample; after shifting and masking, the four 14-bit values are packed to
+  // shorts and stored contiguously in the channel's output vector.
+
+  __attribute__((target("avx2")))
+  inline void storeFour(__m256i v, short *out)
+  {
+    const __m256i shuf = _mm256_setr_epi8(0,1,8,9,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+					  0,1,8,9,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+    const __m256i perm = _mm256_setr_epi32(0,4,1,1,1,1,1,1);
+    v = _mm256_shuffle_epi8(v, shuf);
+    v = _mm256_permutevar8x32_epi32(v, perm);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(v));
+  }
+
+  __attribute__((target("avx2")))
+  void unpackFrameAVX2(const WIBEthFrame *frame, short **dst, size_t offset)
+  {
+    const __m256i vindex = _mm256_setr_epi64x(0, kBytesPerSample, 2*kBytesPerSample, 3*kBytesPerSample);
+    const __m256i mask = _mm256_set1_epi64x(kADCMask);
+    const uint8_t *sp = samplePtr(frame);
+    for (size_t t = 0; t < kWIBEthSamples; t += 4)
+      {
+	const uint8_t *s = sp + t*kBytesPerSample;
+	for (size_t g = 0; g < kGroups; ++g)
+	  {
+	    __m256i w = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(s + groupOffset(g)), vindex, 1);
+	    if (groupShift(g)) w = _mm256_srli_epi64(w, 8);
+	    storeFour(_mm256_and_si256(w, mask),                        dst[4*g  ] + offset + t);
+	    storeFour(_mm256_and_si256(_mm256_srli_epi64(w, 14), mask), dst[4*g+1] + offset + t);
+	    storeFour(_mm256_and_si256(_mm256_srli_epi64(w, 28), mask), dst[4*g+2] + offset + t);
+	    storeFour(_mm256_and_si256(_mm256_srli_epi64(w, 42), mask), dst[4*g+3] + offset + t);
+	  }
+      }
+  }
+
+#endif
+
+  typedef void (*FrameUnpacker)(const WIBEthFrame*, short**, size_t);
+
+  void unpackAll(FrameUnpacker unpacker, const WIBEthFrame *frames, size_t n_frames,
+		 std::vector<raw::RawDigit::ADCvector_t> &adc_vectors)
+  {
+    adc_vectors.resize(kWIBEthChannels);
+    short *dst[kWIBEthChannels];
+    for (size_t iChan = 0; iChan < kWIBEthChannels; ++iChan)
+      {
+	adc_vectors[iChan].resize(n_frames*kWIBEthSamples);
+	dst[iChan] = adc_vectors[iChan].data();
+      }
+    for (size_t i = 0; i < n_frames; ++i)
+      {
+	unpacker(frames + i, dst, i*kWIBEthSamples);
+      }
+  }
+
+}
+
+bool pdhd::rawdecoding::haveWIBEthSIMDUnpack()
+{
+#ifdef PDHD_WIBETH_HAVE_AVX2_PATH
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  return have_avx2;
+#else
+  return false;
+#endif
+}
+
+void pdhd::rawdecoding::unpackWIBEthFramesScalar(const WIBEthFrame *frames, size_t n_frames,
+						 std::vector<raw::RawDigit::ADCvector_t> &adc_vectors)
+{
+  unpackAll(unpackFrameScalar, frames, n_frames, adc_vectors);
+}
+
+void pdhd::rawdecoding::unpackWIBEthFrames(const WIBEthFrame *frames, size_t n_frames,
+					   std::vector<raw::RawDigit::ADCvector_t> &adc_vectors)
+{
+#ifdef PDHD_WIBETH_HAVE_AVX2_PATH
+  if (haveWIBEthSIMDUnpack())
+    {
+      unpackAll(unpackFrameAVX2, frames, n_frames, adc_vectors);
+      return;
+    }
+#endif
+  unpackAll(unpackFrameScalar, frames, n_frames, adc_vectors);
+}
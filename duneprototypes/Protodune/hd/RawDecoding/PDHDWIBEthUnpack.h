@@ -0,0 +1,37 @@
+#ifndef PDHDWIBETHUNPACK_H
+#define PDHDWIBETHUNPACK_H
+
+// Bulk unpacking of the 14-bit ADC payload of WIBEth frames.  Frames store the
+// 64 channels of each of 64 time samples as 14 packed 64-bit words; the decoders
+// want channel-major vectors.  unpackWIBEthFrames does the transpose for a whole
+// fragment in one pass, using AVX2 when the CPU supports it and a scalar loop
+// otherwise.  Output is bit-identical to calling WIBEthFrame::get_adc.
+
+#include <cstddef>
+#include <vector>
+#include "detdataformats/wibeth/WIBEthFrame.hpp"
+#include "lardataobj/RawData/RawDigit.h"
+
+namespace pdhd {
+namespace rawdecoding {
+
+  using dunedaq::fddetdataformats::WIBEthFrame;
+
+  constexpr size_t kWIBEthChannels = 64;   // channels per WIBEth frame
+  constexpr size_t kWIBEthSamples = 64;    // time samples per WIBEth frame
+
+  // Resizes adc_vectors to 64 channels of n_frames*64 samples each and fills them.
+  // frames must point to n_frames contiguous frames (e.g. the fragment payload).
+  void unpackWIBEthFrames(const WIBEthFrame *frames, size_t n_frames,
+                          std::vector<raw::RawDigit::ADCvector_t> &adc_vectors);
+
+  // Same, but always uses the scalar path.  Exposed for testing.
+  void unpackWIBEthFramesScalar(const WIBEthFrame *frames, size_t n_frames,
+                                std::vector<raw::RawDigit::ADCvector_t> &adc_vectors);
+
+  // True if unpackWIBEthFrames will use the vectorized path on this CPU.
+  bool haveWIBEthSIMDUnpack();
+
+}
+}
+#endif
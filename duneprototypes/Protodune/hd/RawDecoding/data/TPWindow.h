@@ -0,0 +1,30 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Index entry for the time-windowed TriggerPrimitive products written by
+// PDHDTriggerReader3 in TP-stream window mode.  Window k covers
+// [fStartTime, fEndTime) in DTS ticks and its fNTPs TPs are in the product
+// with instance name <OutputInstance>window<k>, sorted by channel and
+// time_start.  Windows are laid out from the readout window begin of the
+// record, so window k covers the same part of the readout window in every
+// record.  The first and last windows also hold the TPs before and after
+// the windows, and their bounds are stretched to include them.
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef TPWindow_H
+#define TPWindow_H
+
+#include <cstdint>
+
+namespace raw {
+
+  struct TPWindow {
+    uint32_t fWindow = 0;      // window number, also the product instance suffix
+    uint64_t fStartTime = 0;   // first tick of the window
+    uint64_t fEndTime = 0;     // one past the last tick of the window
+    uint64_t fNTPs = 0;        // number of TPs in the window's product
+  };
+
+}
+
+#endif
@@ -0,0 +1,8 @@
+//File: classes.h
+//Brief: Include directives needed to generate the dictionary for the raw::TPWindow data product.
+
+//ART includes
+#include "canvas/Persistency/Common/Wrapper.h"
+
+//local includes
+#include "duneprototypes/Protodune/hd/RawDecoding/data/TPWindow.h"
@@ -0,0 +1,100 @@
+// test_PDHDWIBEthUnpack.cxx
+//
+// Test that the bulk WIBEth unpackers reproduce WIBEthFrame::get_adc bit for bit.
+
+#include <string>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstring>
+#include "duneprototypes/Protodune/hd/RawDecoding/PDHDWIBEthUnpack.h"
+
+#undef NDEBUG
+#include <cassert>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using pdhd::rawdecoding::WIBEthFrame;
+using ADCVectors = vector<raw::RawDigit::ADCvector_t>;
+
+//**********************************************************************
+
+// Reference: the per-sample loop used by PDHDDataInterfaceWIBEth3 before the bulk unpacker.
+ADCVectors unpackWithGetAdc(const vector<WIBEthFrame>& frames) {
+  ADCVectors adc_vectors(64);
+  for ( const WIBEthFrame& frame : frames ) {
+    for ( int jChan=0; jChan<64; ++jChan ) {
+      for ( int kSample=0; kSample<64; ++kSample ) {
+        adc_vectors[jChan].push_back(frame.get_adc(jChan, kSample));
+      }
+    }
+  }
+  return adc_vectors;
+}
+
+//**********************************************************************
+
+int test_PDHDWIBEthUnpack(size_t nframes =17) {
+  const string myname = "test_PDHDWIBEthUnpack: ";
+#ifdef NDEBUG
+  cout << myname << "NDEBUG must be off." << endl;
+  abort();
+#endif
+  string line = "-----------------------------";
+
+  cout << myname << line << endl;
+  cout << myname << "Filling " << nframes << " frames with random words." << endl;
+  vector<WIBEthFrame> frames(nframes);
+  std::mt19937_64 gen(12345);
+  for ( WIBEthFrame& frame : frames ) {
+    vector<uint64_t> words(sizeof(WIBEthFrame)/sizeof(uint64_t));
+    for ( uint64_t& word : words ) word = gen();
+    std::memcpy(&frame, words.data(), sizeof(WIBEthFrame));
+  }
+  // All-ones frame exercises the mask at every straddle.
+  if ( nframes > 1 ) std::memset(&frames[1], 0xff, sizeof(WIBEthFrame));
+
+  ADCVectors ref = unpackWithGetAdc(frames);
+
+  cout << myname << line << endl;
+  cout << myname << "Checking scalar unpacker." << endl;
+  ADCVectors scalar;
+  pdhd::rawdecoding::unpackWIBEthFramesScalar(frames.data(), frames.size(), scalar);
+  assert( scalar == ref );
+
+  cout << myname << line << endl;
+  cout << myname << "Checking dispatched unpacker (SIMD: "
+       << pdhd::rawdecoding::haveWIBEthSIMDUnpack() << ")." << endl;
+  ADCVectors fast(3);   // wrong size on input: unpacker must resize
+  pdhd::rawdecoding::unpackWIBEthFrames(frames.data(), frames.size(), fast);
+  assert( fast == ref );
+
+  cout << myname << line << endl;
+  cout << myname << "Checking empty input." << endl;
+  pdhd::rawdecoding::unpackWIBEthFrames(frames.data(), 0, fast);
+  assert( fast.size() == 64 );
+  for ( const auto& v : fast ) assert( v.empty() );
+
+  cout << myname << line << endl;
+  cout << myname << "Done." << endl;
+  return 0;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  size_t nframes = 17;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NFRAMES]" << endl;
+      return 0;
+    }
+    nframes = std::stoul(sarg);
+  }
+  return test_PDHDWIBEthUnpack(nframes);
+}
+
+//**********************************************************************
@@ -132,6 +132,84 @@ namespace CRT
   {
     return trigger.dump(lhs);
   }
+
+  //Compact layouts of CRT::Hit and CRT::Trigger for CRT-heavy samples.  A CompactHit has no virtual table and stores the strip number
+  //in 8 bits, so it takes 4 bytes instead of 24 in memory and 3 instead of 10 on disk.  The accessors match CRT::Hit and CRT::Trigger.
+  class CompactHit
+  {
+    public:
+      CompactHit(uint8_t channel, short adc): fChannel(channel), fADC(adc) {}
+
+      //Default constructor to make ROOT happy.  Marked like a default-constructed CRT::Hit.
+      CompactHit(): fChannel(std::numeric_limits<decltype(fChannel)>::max()), fADC(std::numeric_limits<decltype(fADC)>::max()) {}
+
+      CompactHit(const CRT::Hit& hit): fChannel(hit.Channel()), fADC(hit.ADC()) {}
+
+      inline size_t Channel() const { return fChannel; }
+      inline short ADC() const { return fADC; }
+      inline bool IsDefault() const { return fADC == std::numeric_limits<decltype(fADC)>::max(); }
+
+      template <class STREAM>
+      STREAM& dump(STREAM& stream) const
+      {
+        stream << "CRT::CompactHit Dump:\n"
+               << "Channel: " << (unsigned)fChannel << "\n"
+               << "ADC: " << fADC << "\n"
+               << "Was this CRT::CompactHit default-constructed? " << (IsDefault()?"true":"false") << "\n";
+        return stream;
+      }
+
+    private:
+      uint8_t fChannel; //Strip within the CRT module, as in CRT::Hit::fChannel.  There are 64 per module.
+      short fADC; //Same as CRT::Hit::fADC
+  };
+
+  template <class STREAM>
+  STREAM& operator << (STREAM& lhs, const CRT::CompactHit& hit)
+  {
+    return hit.dump(lhs);
+  }
+
+  class CompactTrigger
+  {
+    public:
+      CompactTrigger(const unsigned short channel, const unsigned long long timestamp, std::vector<CRT::CompactHit>&& hits):
+                     fChannel(channel), fTimestamp(timestamp), fHits(std::move(hits)) {}
+
+      CompactTrigger(): fChannel(std::numeric_limits<decltype(fChannel)>::max()),
+                        fTimestamp(std::numeric_limits<decltype(fTimestamp)>::max()), fHits() {} //Default constructor to satisfy ROOT.
+
+      CompactTrigger(const CRT::Trigger& trigger): fChannel(trigger.Channel()), fTimestamp(trigger.Timestamp()),
+                                                   fHits(trigger.Hits().begin(), trigger.Hits().end()) {}
+
+      inline unsigned short Channel() const { return fChannel; }
+      inline unsigned long long Timestamp() const { return fTimestamp; }
+      inline const std::vector<CRT::CompactHit>& Hits() const { return fHits; }
+      inline bool IsDefault() const { return fChannel == std::numeric_limits<decltype(fChannel)>::max(); }
+
+      template <class STREAM>
+      STREAM& dump(STREAM& stream) const
+      {
+        stream << "CRT::CompactTrigger dump:\n"
+               << "Channel: " << fChannel << "\n"
+               << "Timestamp: " << fTimestamp << "\n"
+               << "Hits:\n";
+        for(const auto& hit: fHits) hit.dump(stream);
+
+        return stream;
+      }
+
+    private:
+      unsigned short fChannel; //Same as CRT::Trigger::fChannel
+      unsigned long long fTimestamp; //Same as CRT::Trigger::fTimestamp
+      std::vector<CRT::CompactHit> fHits; //All activity in CRT strips within this module when it was read out
+  };
+
+  template <class STREAM>
+  STREAM& operator <<(STREAM& lhs, const CRT::CompactTrigger& trigger)
+  {
+    return trigger.dump(lhs);
+  }
 }
 
 #endif //CRT_TRIGGER_H
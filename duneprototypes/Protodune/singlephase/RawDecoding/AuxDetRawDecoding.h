@@ -0,0 +1,306 @@
+// AuxDetRawDecoding.h
+//
+// Per-fragment decoding of the ProtoDUNE-SP auxiliary detector fragments:
+// CTB, timing and CRT.  PDSPCTBRawDecoder, TimingRawDecoder and CRTRawDecoder
+// each decode one of these, and PDSPAuxRawDecoder decodes all three in one
+// pass over the raw fragments.  The decoders share these functions so they
+// make the same products.
+//
+// Everything is inline: pdspctb.h defines its accessors out of line, so it
+// can only be included once per module.
+
+#ifndef AuxDetRawDecoding_H
+#define AuxDetRawDecoding_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "artdaq-core/Data/Fragment.hh"
+#include "cetlib_except/exception.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "dunepdlegacy/Overlays/CTBFragment.hh"
+#include "dunepdlegacy/Overlays/TimingFragment.hh"
+#include "dunepdlegacy/Overlays/CRTFragment.hh"
+
+#include "lardataobj/RawData/RDTimeStamp.h"
+#include "dunecore/DuneObj/ProtoDUNETimeStamp.h"
+#include "duneprototypes/Protodune/singlephase/CTB/data/pdspctb.h"
+#include "duneprototypes/Protodune/singlephase/CRT/data/CRTTrigger.h"
+
+namespace dune {
+
+  // CTB words of an event, split by word type as in raw::ctb::pdspctb.
+
+  struct CTBWords {
+    std::vector<raw::ctb::Trigger> trigs;
+    std::vector<raw::ctb::ChStatus> chstats;
+    std::vector<raw::ctb::Feedback> feedbacks;
+    std::vector<raw::ctb::Misc> miscs;
+    std::vector<raw::ctb::WordIndex> indexes;
+
+    void clear() {
+      trigs.clear();
+      chstats.clear();
+      feedbacks.clear();
+      miscs.clear();
+      indexes.clear();
+    }
+
+    raw::ctb::pdspctb product() {
+      return raw::ctb::pdspctb(trigs, chstats, feedbacks, miscs, indexes);
+    }
+  };
+
+  // Append the words of a CTB fragment.  Uses the same logic as
+  // dune-raw-data/Overlays/CTBFragment.cc:operator<<
+
+  inline void decodeCTBFragment(const artdaq::Fragment& frag, CTBWords& words) {
+    dune::CTBFragment ctbfrag(frag);
+
+    for (size_t iword = 0; iword < ctbfrag.NWords(); ++iword)
+      {
+        size_t ix=0;
+        uint32_t wt=0;
+        if (ctbfrag.Trigger(iword))
+          {
+            raw::ctb::Trigger tstruct;
+            tstruct.word_type = ctbfrag.Trigger(iword)->word_type;
+            wt = tstruct.word_type;
+            tstruct.trigger_word = ctbfrag.Trigger(iword)->trigger_word;
+            tstruct.timestamp = ctbfrag.Trigger(iword)->timestamp;
+            ix = words.trigs.size();
+            words.trigs.push_back(tstruct);
+          }
+        else if (ctbfrag.ChStatus(iword))
+          {
+            raw::ctb::ChStatus cstruct;
+            cstruct.word_type = ctbfrag.ChStatus(iword)->word_type;
+            wt = cstruct.word_type;
+            cstruct.pds = ctbfrag.ChStatus(iword)->pds;
+            cstruct.crt = ctbfrag.ChStatus(iword)->crt;
+            cstruct.beam_hi = ctbfrag.ChStatus(iword)->beam_hi;
+            cstruct.beam_lo = ctbfrag.ChStatus(iword)->beam_lo;
+            cstruct.timestamp = ctbfrag.ChStatus(iword)->timestamp;
+            ix = words.chstats.size();
+            words.chstats.push_back(cstruct);
+          }
+        else if (ctbfrag.Feedback(iword))
+          {
+            raw::ctb::Feedback fstruct;
+            fstruct.word_type = ctbfrag.Feedback(iword)->word_type;
+            wt = fstruct.word_type;
+            fstruct.padding = ctbfrag.Feedback(iword)->padding;
+            fstruct.source = ctbfrag.Feedback(iword)->source;
+            fstruct.code = ctbfrag.Feedback(iword)->code;
+            fstruct.timestamp = ctbfrag.Feedback(iword)->timestamp;
+            ix = words.feedbacks.size();
+            words.feedbacks.push_back(fstruct);
+          }
+        else
+          {
+            raw::ctb::Misc mstruct;
+            mstruct.word_type = ctbfrag.Word(iword)->word_type;
+            wt = mstruct.word_type;
+            mstruct.payload = ctbfrag.Word(iword)->payload;
+            mstruct.timestamp = ctbfrag.Word(iword)->timestamp;
+            ix = words.miscs.size();
+            words.miscs.push_back(mstruct);
+          }
+
+        raw::ctb::WordIndex wstruct;
+        wstruct.word_type = wt;
+        wstruct.index = ix;
+        words.indexes.push_back(wstruct);
+      }
+  }
+
+  // Append the timestamps of a timing fragment.  Throws if the fragment
+  // version cannot be determined.
+
+  inline void decodeTimingFragment(const artdaq::Fragment& rawFrag,
+                                   std::vector<raw::RDTimeStamp>& rdtimestamps,
+                                   std::vector<dune::ProtoDUNETimeStamp>& pdtimestamps) {
+    dune::TimingFragment frag(rawFrag);
+    // Try to determine the version of the fragment. This is
+    // complicated because early versions of the fragment didn't
+    // have a metadata object with the version, so for those, we
+    // have to look at the size of the fragment (actually the size
+    // of the payload, which excludes the header and metadata)
+    int fragmentVersion=0;
+    if(rawFrag.hasMetadata()){
+      dune::TimingFragment::Metadata const* metadata=rawFrag.metadata<dune::TimingFragment::Metadata>();
+      fragmentVersion=metadata->fragment_version;
+    }
+    else{
+      size_t dataSizeBytes=rawFrag.dataSizeBytes();
+      // The first version of the fragment had 6 uint32_t words
+      if(dataSizeBytes==6*sizeof(uint32_t)){
+        fragmentVersion=1;
+      }
+      // The second version of the fragment had 12 uint32_t words,
+      // as the last spill start/end and last run start timestamps
+      // were added
+      else if(dataSizeBytes==12*sizeof(uint32_t)){
+        fragmentVersion=2;
+      }
+      else{
+        throw cet::exception("TimingRawDecoder::produce") << "Fragment had no metadata and unexpected size " << dataSizeBytes << " bytes. Can't determined timing fragment version";
+      }
+    }
+
+    uint16_t scmd = (frag.get_scmd() & 0xFFFF);  // mask this just to make sure.  Though scmd only has four relevant bits, the method is declared uint32_t.
+    rdtimestamps.emplace_back(frag.get_tstamp(),scmd);
+
+    dune::ProtoDUNETimeStamp pdts;
+    pdts.setCookie(frag.get_cookie());
+    pdts.setTriggerType((dune::ProtoDUNETimingCommand)frag.get_scmd());
+    pdts.setReservedBits(frag.get_tcmd());
+    pdts.setTimeStamp(frag.get_tstamp());
+    pdts.setEventCounter(frag.get_evtctr());
+    // TODO: Checksum isn't set by the board reader yet
+    pdts.setChecksumGood(true);
+    pdts.setVersion(fragmentVersion);
+    // The additional timestamps were not added until version 2 of the timing fragment
+    if(fragmentVersion>=2){
+      pdts.setLastRunStart(frag.get_last_runstart_timestamp());
+      pdts.setLastSpillStart(frag.get_last_spillstart_timestamp());
+      pdts.setLastSpillEnd(frag.get_last_spillend_timestamp());
+    }
+    else{
+      // Set to 0xfff... if not present
+      pdts.setLastRunStart(~0ul);
+      pdts.setLastSpillStart(~0ul);
+      pdts.setLastSpillEnd(~0ul);
+    }
+
+    pdtimestamps.push_back(pdts);
+  }
+
+  // Map from CRT raw data module number to offline module number.  With
+  // matchOfflineMapping false each module maps to itself.
+
+  inline std::vector<size_t> crtChannelMap(bool matchOfflineMapping, size_t nModules) {
+    if (matchOfflineMapping)
+      {
+        //Based on v6 geometry (TY)
+        return {24, 25, 30, 18, 15,  7, 13, 12, 11, 10,  6, 14, 19, 31, 26, 27,
+                22, 23, 29, 17,  8,  0,  3,  2,  5,  4,  1,  9, 16, 28, 20, 21};
+      }
+    std::vector<size_t> channelMap;
+    for(size_t module = 0; module < nModules; ++module) channelMap.push_back(module); //Map each index to itself
+    return channelMap;
+  }
+
+  // Offline strip number of a raw CRT channel.
+
+  inline size_t crtOfflineChannel(unsigned int module, unsigned int channel) {
+    size_t offline_channel = channel;
+    if (module == 14 || module == 15 ||
+        module == 8 || module == 9 || module == 10 || module == 11 ||
+        module == 4 || module == 5 ||
+        module == 30 || module == 31 ||
+        module == 24 || module == 25 || module == 26 || module == 27 ||
+        module == 20 || module == 21){ //Strips need to be flipped (TY)
+      if (channel<32){
+        offline_channel = (31-channel)*2;
+      }
+      else{
+        offline_channel = (63-channel)*2+1;
+      }
+    }
+    else{//Strips do not need to be flipped
+      if (channel<32){
+        offline_channel = channel*2;
+      }
+      else{
+        offline_channel = (channel-32)*2+1;
+      }
+    }
+    //Flip the two layers
+    if (offline_channel%2==0) ++offline_channel;
+    else --offline_channel;
+    return offline_channel;
+  }
+
+  // The triggers of an event's CRT fragments, recorded in one pass as a
+  // struct of arrays.  The hits of trigger i are [firstHit[i], firstHit[i+1])
+  // and their strips are already the offline strip numbers.  makeTriggers
+  // turns them into CRT::Trigger or CRT::CompactTrigger products.
+
+  struct CRTRawTriggers {
+    std::vector<uint16_t> module;            // raw data module number
+    std::vector<uint64_t> time;              // fifty_mhz_time
+    std::vector<uint32_t> rawTime;           // raw_backend_time
+    std::vector<uint32_t> firstHit{0};
+    std::vector<uint8_t> hitChannel;
+    std::vector<uint16_t> hitADC;
+
+    size_t size() const { return module.size(); }
+
+    void clear() {
+      module.clear();
+      time.clear();
+      rawTime.clear();
+      firstHit.assign(1, 0);
+      hitChannel.clear();
+      hitADC.clear();
+    }
+
+    void add(const CRT::Fragment& frag) {
+      module.push_back(frag.module_num());
+      time.push_back(frag.fifty_mhz_time());
+      rawTime.push_back(frag.raw_backend_time());
+      for(size_t hitNum = 0; hitNum < frag.num_hits(); ++hitNum)
+        {
+          const auto hit = *(frag.hit(hitNum));
+          hitChannel.push_back(crtOfflineChannel(frag.module_num(), hit.channel));
+          hitADC.push_back(hit.adc);
+        }
+      firstHit.push_back(hitChannel.size());
+    }
+
+    // Earliest time of the recorded triggers, or the largest uint64_t if
+    // there are none.
+
+    uint64_t earliestTime() const {
+      uint64_t earliest = std::numeric_limits<uint64_t>::max();
+      for (uint64_t t : time) earliest = std::min(earliest, t);
+      return earliest;
+    }
+
+    // Append one TRIGGER (CRT::Trigger or CRT::CompactTrigger) per recorded
+    // trigger.  Triggers from modules that are not in the channel map are
+    // dropped.
+
+    template <class TRIGGER>
+    void makeTriggers(const std::vector<size_t>& channelMap, std::vector<TRIGGER>& triggers) const {
+      using Hits = std::decay_t<decltype(std::declval<const TRIGGER&>().Hits())>;
+      triggers.reserve(triggers.size() + size());
+      for (size_t itrig = 0; itrig < size(); ++itrig)
+        {
+          if (module[itrig] >= channelMap.size())
+            {
+              mf::LogWarning("Bad CRT Channel") << "Got CRT channel number " << module[itrig] << " that is greater than the number of boards"
+                                                << " in the channel map: " << channelMap.size() << ".  Throwing out this Trigger.\n";
+              continue;
+            }
+          Hits hits;
+          hits.reserve(firstHit[itrig+1] - firstHit[itrig]);
+          for (size_t ihit = firstHit[itrig]; ihit < firstHit[itrig+1]; ++ihit)
+            {
+              hits.emplace_back(hitChannel[ihit], hitADC[ihit]);
+            }
+          triggers.emplace_back(channelMap[module[itrig]], time[itrig], std::move(hits));
+        }
+    }
+  };
+
+}
+
+#endif
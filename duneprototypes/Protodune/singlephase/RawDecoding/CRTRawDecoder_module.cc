@@ -31,6 +31,7 @@
 
 //dunetpc includes
 #include "duneprototypes/Protodune/singlephase/CRT/data/CRTTrigger.h"
+#include "duneprototypes/Protodune/singlephase/RawDecoding/AuxDetRawDecoding.h"
 #include "dunecore/Geometry/ProtoDUNESPCRTSorter.h"
 
 //ROOT includes
@@ -86,11 +87,16 @@ namespace CRT
       std::vector<size_t> fChannelMap; //Simple map from raw data module number to offline module number.  Initialization depends on 
                                        //fMatchOfflineMapping above.
 
+      const bool fCompactHits; //Put CRT::CompactTriggers in the Event instead of CRT::Triggers.  They hold the same information in less space.
+
       // Compartmentalize internal functionality so that I can reuse it with both regular Fragments and "container" Fragments
-      void FragmentToTriggers(const artdaq::Fragment& artFrag, std::unique_ptr<std::vector<CRT::Trigger>>& triggers);
+      void RecordFragment(const artdaq::Fragment& artFrag);
+
+      // Fill the sync plots from the triggers recorded in this Event.  For the first Event of every job, fEarliestTime is set to the 
+      // earliest time in that Event first.
+      void FillSyncPlots();
 
-      // For the first Event of every job, I want to set fEarliestTime to the earliest time in that Event
-      void SetEarliestTime(const artdaq::Fragment& frag);
+      dune::CRTRawTriggers fRawTriggers; //Triggers from this Event's Fragments, recorded in a single pass over them
 
       //Sync diagnostic plots
       struct PerModule
@@ -115,10 +121,12 @@ namespace CRT
   CRTRawDecoder::CRTRawDecoder(fhicl::ParameterSet const & p): EDProducer{p}, fFragTag(p.get<std::string>("RawDataTag")), 
                                                                fLookForContainer(p.get<bool>("LookForContainer", false)),
                                                                fMatchOfflineMapping(p.get<bool>("MatchOfflineMapping", true)),
+                                                               fCompactHits(p.get<bool>("CompactHits", false)),
                                                                fEarliestTime(std::numeric_limits<decltype(fEarliestTime)>::max())
   {
     // Call appropriate produces<>() functions here.
-    produces<std::vector<CRT::Trigger>>();
+    if(fCompactHits) produces<std::vector<CRT::CompactTrigger>>();
+    else produces<std::vector<CRT::Trigger>>();
     consumes<std::vector<artdaq::Fragment>>(fFragTag);
  
     //Register callback to make new plots on every file
@@ -126,7 +134,7 @@ namespace CRT
     tfs->registerFileSwitchCallback(this, &CRTRawDecoder::createSyncPlots);
   }
 
-  void CRTRawDecoder::FragmentToTriggers(const artdaq::Fragment& artFrag, std::unique_ptr<std::vector<CRT::Trigger>>& triggers)
+  void CRTRawDecoder::RecordFragment(const artdaq::Fragment& artFrag)
   {
     CRT::Fragment frag(artFrag);
                                                                                                                                                    
@@ -134,99 +142,45 @@ namespace CRT
     /*frag.print_header();
     frag.print_hits();*/
                                                                                                                                                    
-    std::vector<CRT::Hit> hits;
-                                                                                                                                                   
-    //Make a CRT::Hit from each non-zero ADC value in this Fragment
-    for(size_t hitNum = 0; hitNum < frag.num_hits(); ++hitNum)
-    {
-      const auto hit = *(frag.hit(hitNum));
-      MF_LOG_DEBUG("CRTRaw") << "Channel: " << (int)(hit.channel) << "\n"
-                          << "ADC: " << hit.adc << "\n";
-      //Determine the offline channel number for each strip
-      size_t offline_channel = hit.channel;
-      if (frag.module_num() == 14 ||
-          frag.module_num() == 15 ||
-          frag.module_num() == 8 ||
-          frag.module_num() == 9 ||
-          frag.module_num() == 10 ||
-          frag.module_num() == 11 ||
-          frag.module_num() == 4 ||
-          frag.module_num() == 5 ||
-          frag.module_num() == 30 ||
-          frag.module_num() == 31 ||
-          frag.module_num() == 24 ||
-          frag.module_num() == 25 ||
-          frag.module_num() == 26 ||
-          frag.module_num() == 27 ||
-          frag.module_num() == 20 ||
-          frag.module_num() == 21){ //Strips need to be flipped (TY)
-        if (hit.channel<32){
-          offline_channel = (31-hit.channel)*2;
-        }
-        else{
-          offline_channel = (63-hit.channel)*2+1;
-        }
-      }
-      else{//Strips do not need to be flipped
-        if (hit.channel<32){
-          offline_channel = hit.channel*2;
-        }
-        else{
-          offline_channel = (hit.channel-32)*2+1;
-        }
-      }
-      //Flip the two layers
-      if (offline_channel%2==0) ++offline_channel;
-      else --offline_channel;
-      hits.emplace_back(offline_channel, hit.adc);
-      //MF_LOG_DEBUG("CRT Hits") CRT::operator << hits.back() << "\n"; //TODO: Some function template from the message service interferes with my  
-                                                                    //      function template from namespace CRT.  using namespace CRT seems like 
-                                                                    //      it should solve this, but it doesn't seem to.
-    }
-                                                                                                                                                   
     MF_LOG_DEBUG("CRTFragments") << "Module: " << frag.module_num() << "\n"
                               << "Number of hits: " << frag.num_hits() << "\n"
                               << "Fifty MHz time: " << frag.fifty_mhz_time() << "\n";
-   
-    try
-    {  
-      triggers->emplace_back(fChannelMap.at(frag.module_num()), frag.fifty_mhz_time(), std::move(hits)); 
-    }
-    catch(const std::out_of_range& e)
-    {
-      mf::LogWarning("Bad CRT Channel") << "Got CRT channel number " << frag.module_num() << " that is greater than the number of boards"
-                                        << " in the channel map: " << fChannelMap.size() << ".  Throwing out this Trigger.\n";
-    }
-    
-    //Make diagnostic plots for sync pulses
-    const auto& plots = fSyncPlots[frag.module_num()];
-    const double deltaT = (frag.fifty_mhz_time() - fEarliestTime)*1.6e-8; //TODO: Get size of clock ticks from a service
-    if(deltaT > 0 && deltaT < 1e6) //Ignore time differences less than 1s and greater than 1 day
-                                   //TODO: Understand why these cases come up
-    {
-      plots.fLowerTimeVersusTime->SetPoint(plots.fLowerTimeVersusTime->GetN(), deltaT, frag.raw_backend_time());
-    }
-    else
-    {
-      mf::LogWarning("SyncPlots") << "Got time difference " << deltaT << " that was not included in sync plots.\n"
-                                  << "lhs is " << frag.fifty_mhz_time() << ", and rhs is " << fEarliestTime << ".\n"
-                                  << "Hardware raw time is " << frag.raw_backend_time() << ".\n";
-    }
+
+    fRawTriggers.add(frag);
   }
 
-  void CRTRawDecoder::SetEarliestTime(const artdaq::Fragment& frag)
+  void CRTRawDecoder::FillSyncPlots()
   {
-    CRT::Fragment crt(frag);
-    if(crt.fifty_mhz_time() < fEarliestTime) fEarliestTime = crt.fifty_mhz_time();
+    if(fEarliestTime == std::numeric_limits<decltype(fEarliestTime)>::max()) fEarliestTime = fRawTriggers.earliestTime();
+
+    for(size_t trig = 0; trig < fRawTriggers.size(); ++trig)
+    {
+      const auto module = fRawTriggers.module[trig];
+      if(module >= fSyncPlots.size()) continue;
+
+      //Make diagnostic plots for sync pulses
+      const auto& plots = fSyncPlots[module];
+      const double deltaT = (fRawTriggers.time[trig] - fEarliestTime)*1.6e-8; //TODO: Get size of clock ticks from a service
+      if(deltaT > 0 && deltaT < 1e6) //Ignore time differences less than 1s and greater than 1 day
+                                     //TODO: Understand why these cases come up
+      {
+        plots.fLowerTimeVersusTime->SetPoint(plots.fLowerTimeVersusTime->GetN(), deltaT, fRawTriggers.rawTime[trig]);
+      }
+      else
+      {
+        mf::LogWarning("SyncPlots") << "Got time difference " << deltaT << " that was not included in sync plots.\n"
+                                    << "lhs is " << fRawTriggers.time[trig] << ", and rhs is " << fEarliestTime << ".\n"
+                                    << "Hardware raw time is " << fRawTriggers.rawTime[trig] << ".\n";
+      }
+    }
   }
   
   //Read artdaq::Fragments produced by fFragTag, and use CRT::Fragment to convert them to CRT::Triggers.  
   void CRTRawDecoder::produce(art::Event & e)
   {
-    //Create an empty container of CRT::Triggers.  Any Triggers in this container will be put into the 
-    //event at the end of produce.  I will try to fill this container, but just not produce any CRT::Triggers 
-    //if there are no input artdaq::Fragments.  
-    auto triggers = std::make_unique<std::vector<CRT::Trigger>>();
+    //Record the triggers of every Fragment in one pass.  I will try to fill fRawTriggers, but just not produce 
+    //any CRT::Triggers if there are no input artdaq::Fragments.  
+    fRawTriggers.clear();
 
     try
     {
@@ -236,32 +190,15 @@ namespace CRT
 
       if(fLookForContainer)
       {
-        //If this is the first event, set fEarliestTime
-        if(fEarliestTime == std::numeric_limits<decltype(fEarliestTime)>::max())
-        {
-          for(const auto& frag: *fragHandle) 
-          {
-            artdaq::ContainerFragment container(frag);
-            for(size_t pos = 0; pos < container.block_count(); ++pos) SetEarliestTime(*container[pos]);
-          }
-        }
-
         for(const auto& artFrag: *fragHandle)
         {
           artdaq::ContainerFragment container(artFrag);
-          for(size_t pos = 0; pos < container.block_count(); ++pos) FragmentToTriggers(*container[pos], triggers); 
+          for(size_t pos = 0; pos < container.block_count(); ++pos) RecordFragment(*container[pos]); 
         }
       }
       else
       {
-        //If this is the first event, set fEarliestTime
-        if(fEarliestTime == std::numeric_limits<decltype(fEarliestTime)>::max())
-        {
-          for(const auto& frag: *fragHandle) SetEarliestTime(frag);
-        }
-
-        //Convert each fragment into a CRT::Trigger.
-        for(const auto& artFrag: *fragHandle) FragmentToTriggers(artFrag, triggers);
+        for(const auto& artFrag: *fragHandle) RecordFragment(artFrag);
       }
     }
     catch(const cet::exception& exc) //If there are no artdaq::Fragments in this Event, just add an empty container of CRT::Triggers.
@@ -270,8 +207,21 @@ namespace CRT
                                     << "not doing anything.\n";
     }
 
+    FillSyncPlots();
+
     //Put a vector of CRT::Triggers into this Event for other modules to read.
-    e.put(std::move(triggers));
+    if(fCompactHits)
+    {
+      auto triggers = std::make_unique<std::vector<CRT::CompactTrigger>>();
+      fRawTriggers.makeTriggers(fChannelMap, *triggers);
+      e.put(std::move(triggers));
+    }
+    else
+    {
+      auto triggers = std::make_unique<std::vector<CRT::Trigger>>();
+      fRawTriggers.makeTriggers(fChannelMap, *triggers);
+      e.put(std::move(triggers));
+    }
   }
   
   void CRT::CRTRawDecoder::beginJob()
@@ -281,50 +231,7 @@ namespace CRT
     //Set up channel mapping base on user configuration
     art::ServiceHandle<geo::Geometry> geom;
     const auto nModules = geom->NAuxDets();
-    if(fMatchOfflineMapping) 
-    {
-//      std::vector<const geo::AuxDetGeo*> auxDets; //The function to retrieve this vector seems to have been made protected
-//      for(size_t auxDet = 0; auxDet < nModules; ++auxDet) auxDets.push_back(&geom->AuxDet(auxDet));
-//
-//      fChannelMap = CRTSorter::Mapping(auxDets); //Match whatever the current AuxDet sorter does.  
-      //Based on v6 geometry (TY)
-      fChannelMap.push_back(24);
-      fChannelMap.push_back(25);
-      fChannelMap.push_back(30);
-      fChannelMap.push_back(18);
-      fChannelMap.push_back(15);
-      fChannelMap.push_back(7);
-      fChannelMap.push_back(13);
-      fChannelMap.push_back(12);
-      fChannelMap.push_back(11);
-      fChannelMap.push_back(10);
-      fChannelMap.push_back(6);
-      fChannelMap.push_back(14);
-      fChannelMap.push_back(19);
-      fChannelMap.push_back(31);
-      fChannelMap.push_back(26);
-      fChannelMap.push_back(27);
-      fChannelMap.push_back(22);
-      fChannelMap.push_back(23);
-      fChannelMap.push_back(29);
-      fChannelMap.push_back(17);
-      fChannelMap.push_back(8);
-      fChannelMap.push_back(0);
-      fChannelMap.push_back(3);
-      fChannelMap.push_back(2);
-      fChannelMap.push_back(5);
-      fChannelMap.push_back(4);
-      fChannelMap.push_back(1);
-      fChannelMap.push_back(9);
-      fChannelMap.push_back(16);
-      fChannelMap.push_back(28);
-      fChannelMap.push_back(20);
-      fChannelMap.push_back(21);
-    }
-    else 
-    {
-      for(size_t module = 0; module < nModules; ++module) fChannelMap.push_back(module); //Map each index to itself
-    }
+    fChannelMap = dune::crtChannelMap(fMatchOfflineMapping, nModules);
   }
 
   void CRT::CRTRawDecoder::createSyncPlots()
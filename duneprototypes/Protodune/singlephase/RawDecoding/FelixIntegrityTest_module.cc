@@ -27,6 +27,12 @@
 #include <memory>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cmath>
+#include "cetlib_except/exception.h"
+#include "tbb/parallel_for.h"
 
 namespace dune {
   class FelixIntegrityTest;
@@ -68,6 +74,8 @@ public:
 
     bool bad;
 
+    uint64_t frames_checked = 0;
+
     void print() const {
       std::cout
         << "SequenceID: " << sequenceID
@@ -90,9 +98,57 @@ public:
 private:
   ErrorMetrics _process(const artdaq::Fragment& frag);
 
+  // Fast scan: the same tests as _process without printing, checking only
+  // one chunk of frames in _sample_stride.  Safe to call in parallel.
+  ErrorMetrics _scan(const artdaq::Fragment& frag) const;
+  void _analyze_fast(const art::Event& evt);
+
+  // Add a fragment's results to the counts and error maps
+  void _count(const ErrorMetrics& errm);
+
+  // Write the error summary since the last flush as one JSON line
+  void _flush_summary(const art::Event* evt);
+
+  // A fragment to test, either one in the event or one copied out of a
+  // container fragment.
+  struct FragmentRef {
+    const artdaq::Fragment* frag = nullptr;
+    std::unique_ptr<const artdaq::Fragment> block;  // owns frag if it came out of a container fragment
+  };
+
+  // Error counts per fiber
+  struct Location {
+    uint64_t crate_no, slot_no, fiber_no;
+    bool operator<(const Location& b) const {
+      if(crate_no == b.crate_no && slot_no == b.slot_no) {
+        return fiber_no < b.fiber_no;
+      } else if(crate_no == b.crate_no) {
+        return slot_no < b.slot_no;
+      }
+      return crate_no < b.crate_no;
+    }
+  };
+  struct Errors {
+    unsigned long meta_err, timestamp_err, convert_count_err, error_fields_set;
+    void operator+=(const Errors& other) {
+      meta_err += other.meta_err;
+      timestamp_err += other.timestamp_err;
+      convert_count_err += other.convert_count_err;
+      error_fields_set += other.error_fields_set;
+    }
+  };
+
   // Variables read from the fcl file
   std::string _input_label;
   bool _expect_container_fragments;
+  bool _fast_scan;
+  double _sample_fraction;
+  unsigned _summary_interval;
+  std::string _summary_file;
+
+  // Frames are sampled in chunks of this many for the fast scan
+  static constexpr unsigned _scan_chunk_frames = 64;
+  unsigned _sample_stride = 1;
 
   // Keeping track of fragment metadata
   dune::FelixFragmentBase::Metadata run_meta = {0xcba};
@@ -102,21 +158,49 @@ private:
 
   // COLDATA constants
   const uint16_t convert_count_increase = 1;
-  std::vector<ErrorMetrics> test_results;
   unsigned n_good_frags = 0;
   unsigned n_bad_frags = 0;
+  std::map<Location, Errors> errMap;
+
+  // Counts since the last summary flush
+  unsigned _flush_events = 0;
+  unsigned long _flush_frags = 0;
+  unsigned long _flush_bad_frags = 0;
+  unsigned long _flush_frames_checked = 0;
+  std::map<Location, Errors> _flush_errMap;
+  std::ofstream _summary_out;
 };
 
 
 dune::FelixIntegrityTest::FelixIntegrityTest(fhicl::ParameterSet const & pset)
   : EDAnalyzer(pset),
     _input_label(pset.get<std::string>("RawDataLabel")),
-    _expect_container_fragments(pset.get<bool>("ExpectContainerFragments", true)) {}
+    _expect_container_fragments(pset.get<bool>("ExpectContainerFragments", true)),
+    _fast_scan(pset.get<bool>("FastScan", false)),
+    _sample_fraction(pset.get<double>("SampleFraction", 1.0)),
+    _summary_interval(pset.get<unsigned>("SummaryInterval", 0)),
+    _summary_file(pset.get<std::string>("SummaryFile", "")) {
+  if(!(_sample_fraction > 0 && _sample_fraction <= 1)) {
+    throw cet::exception("FelixIntegrityTest") << "SampleFraction must be in (0, 1], got " << _sample_fraction;
+  }
+  _sample_stride = std::max(1L, std::lround(1/_sample_fraction));
+}
 
 void dune::FelixIntegrityTest::beginJob(){
+  if(_summary_interval > 0 && !_summary_file.empty()) {
+    _summary_out.open(_summary_file, std::ios::app);
+    if(!_summary_out) {
+      throw cet::exception("FelixIntegrityTest") << "Cannot open summary file " << _summary_file;
+    }
+  }
 }
 
 void dune::FelixIntegrityTest::analyze(const art::Event & evt){
+  if(_fast_scan) {
+    _analyze_fast(evt);
+    return;
+  }
+
   std::cout << "-------------------- FELIX Integrity Test -------------------";
 
   if (_expect_container_fragments) {
@@ -144,9 +228,7 @@ void dune::FelixIntegrityTest::analyze(const art::Event & evt){
       artdaq::ContainerFragment cont_frag(cont);
       for (size_t ii = 0; ii < cont_frag.block_count(); ++ii)
       {
-        const ErrorMetrics this_err = _process(*cont_frag[ii]);
-        test_results.push_back(this_err);
-        this_err.bad? ++n_bad_frags : ++n_good_frags;
+        _count(_process(*cont_frag[ii]));
       }
     }
   }
@@ -174,14 +256,100 @@ void dune::FelixIntegrityTest::analyze(const art::Event & evt){
 
     for(auto const& frag: *frags)
     {
-      const ErrorMetrics this_err = _process(frag);
-      test_results.push_back(this_err);
-      this_err.bad? ++n_bad_frags : ++n_good_frags;
+      _count(_process(frag));
     }
   }
+  if(_summary_interval > 0 && ++_flush_events >= _summary_interval) _flush_summary(&evt);
+}
+
+void dune::FelixIntegrityTest::_analyze_fast(const art::Event & evt){
+  std::vector<FragmentRef> frags;
+  if (_expect_container_fragments) {
+    auto cont_frags = evt.getHandle<artdaq::Fragments>(art::InputTag(_input_label, "ContainerFELIX"));
+    if (!cont_frags) {
+      mf::LogWarning("FelixIntegrityTest") << "Container FELIX data not found in event " << evt.event();
+    } else {
+      for (auto const& cont : *cont_frags) {
+        artdaq::ContainerFragment cont_frag(cont);
+        for (size_t ii = 0; ii < cont_frag.block_count(); ++ii) {
+          FragmentRef ref;
+          ref.block = cont_frag[ii];
+          ref.frag = ref.block.get();
+          frags.push_back(std::move(ref));
+        }
+      }
+    }
+  } else {
+    auto raw_frags = evt.getHandle<artdaq::Fragments>(art::InputTag(_input_label, "FELIX"));
+    if (!raw_frags) {
+      mf::LogWarning("FelixIntegrityTest") << "Raw FELIX data not found in event " << evt.event();
+    } else {
+      for (auto const& frag : *raw_frags) {
+        FragmentRef ref;
+        ref.frag = &frag;
+        frags.push_back(std::move(ref));
+      }
+    }
+  }
+
+  // The first fragment of the job sets the expected metadata, as in _process
+  if(run_meta.control_word == 0xcba && !frags.empty()) {
+    run_meta = *frags.front().frag->metadata<dune::FelixFragmentBase::Metadata>();
+  }
+
+  std::vector<ErrorMetrics> results(frags.size());
+  tbb::parallel_for(size_t(0), frags.size(), [&](size_t i) { results[i] = _scan(*frags[i].frag); });
+  for(const ErrorMetrics& errm : results) _count(errm);
+
+  if(_summary_interval > 0 && ++_flush_events >= _summary_interval) _flush_summary(&evt);
+}
+
+void dune::FelixIntegrityTest::_count(const ErrorMetrics& errm) {
+  errm.bad? ++n_bad_frags : ++n_good_frags;
+  Location loc = {errm.crate_no, errm.slot_no, errm.fiber_no};
+  Errors err = {(unsigned long)errm.meta_err, (unsigned long)errm.timestamp_err,
+                (unsigned long)errm.convert_count_err, (unsigned long)errm.error_fields_set};
+  errMap[loc] += err;
+  if(_summary_interval > 0) {
+    ++_flush_frags;
+    if(errm.bad) ++_flush_bad_frags;
+    _flush_frames_checked += errm.frames_checked;
+    if(err.meta_err || err.timestamp_err || err.convert_count_err || err.error_fields_set) _flush_errMap[loc] += err;
+  }
+}
+
+void dune::FelixIntegrityTest::_flush_summary(const art::Event* evt) {
+  std::ostringstream rec;
+  rec << "{";
+  if(evt) rec << "\"run\":" << evt->run() << ",\"subrun\":" << evt->subRun() << ",\"event\":" << evt->event() << ",";
+  rec << "\"events\":" << _flush_events
+      << ",\"fragments\":" << _flush_frags
+      << ",\"bad_fragments\":" << _flush_bad_frags
+      << ",\"frames_checked\":" << _flush_frames_checked
+      << ",\"errors\":[";
+  bool first = true;
+  for(const auto& p : _flush_errMap) {
+    if(!first) rec << ",";
+    first = false;
+    rec << "{\"crate\":" << p.first.crate_no << ",\"slot\":" << p.first.slot_no << ",\"fiber\":" << p.first.fiber_no
+        << ",\"meta\":" << p.second.meta_err << ",\"timestamp\":" << p.second.timestamp_err
+        << ",\"convert_count\":" << p.second.convert_count_err << ",\"error_fields\":" << p.second.error_fields_set << "}";
+  }
+  rec << "]}";
+
+  if(_summary_out.is_open()) _summary_out << rec.str() << std::endl;
+  else mf::LogInfo("FelixIntegrityTest") << rec.str();
+
+  _flush_events = 0;
+  _flush_frags = 0;
+  _flush_bad_frags = 0;
+  _flush_frames_checked = 0;
+  _flush_errMap.clear();
 }
 
 void dune::FelixIntegrityTest::endJob() {
+  if(_summary_interval > 0 && _flush_events > 0) _flush_summary(nullptr);
+
   const unsigned long n_frags = n_bad_frags + n_good_frags;
   std::cout
       << "\nProcessed " << n_bad_frags+n_good_frags
@@ -189,35 +357,6 @@ void dune::FelixIntegrityTest::endJob() {
       << " good fragments. Success rate: "
       << (double)n_good_frags/n_frags << "/1.\n\n";
 
-  // Create structs for easier looping.
-  struct Location {
-    uint64_t crate_no, slot_no, fiber_no;
-    bool operator<(const Location& b) const {
-      if(crate_no == b.crate_no && slot_no == b.slot_no) {
-        return fiber_no < b.fiber_no;
-      } else if(crate_no == b.crate_no) {
-        return slot_no < b.slot_no;
-      }
-      return crate_no < b.crate_no;
-    }
-  };
-  struct Errors {
-    unsigned long meta_err, timestamp_err, convert_count_err, error_fields_set;
-    void operator+=(const Errors& other) {
-      meta_err += other.meta_err;
-      timestamp_err += other.timestamp_err;
-      convert_count_err += other.convert_count_err;
-      error_fields_set += other.error_fields_set;
-    }
-  };
-  // Loop over collected error metrics to find their origin
-  std::map<Location, Errors> errMap;
-  for(const ErrorMetrics& errm : test_results) {
-    Location loc = {errm.crate_no, errm.slot_no, errm.fiber_no};
-    Errors err = {(unsigned long)errm.meta_err, (unsigned long)errm.timestamp_err,
-                  (unsigned long)errm.convert_count_err, (unsigned long)errm.error_fields_set};
-    errMap[loc] += err;
-  }
   // Print the error rate in a nice table
   std::cout << "Error rates\n";
   std::cout << "Crate:Slot:Fiber | Metadata error | Timestamp error | Convert count error | Error fields set\n"
@@ -407,6 +546,77 @@ dune::FelixIntegrityTest::ErrorMetrics dune::FelixIntegrityTest::_process(const
   outem.error_fields_set = error_field_failed;
 
   outem.bad = timestamp_failed || convert_count_failed || error_field_failed;
+  outem.frames_checked = flxfrag.total_frames();
+
+  return outem;
+}
+
+dune::FelixIntegrityTest::ErrorMetrics dune::FelixIntegrityTest::_scan(const artdaq::Fragment& frag) const
+{
+  dune::FelixFragment flxfrag(frag);
+  const dune::FelixFragmentBase::Metadata* meta = frag.metadata<dune::FelixFragmentBase::Metadata>();
+  const unsigned nframes = flxfrag.total_frames();
+
+  ErrorMetrics outem;
+  outem.sequenceID = frag.sequenceID();
+  outem.fragmentID = frag.fragmentID();
+  outem.type = frag.type();
+  outem.timestamp = frag.timestamp();
+  outem.crate_no = flxfrag.crate_no();
+  outem.slot_no = flxfrag.slot_no();
+  outem.fiber_no = flxfrag.fiber_no();
+  outem.meta = *meta;
+  outem.meta_err = meta->control_word != run_meta.control_word
+                || meta->version != run_meta.version
+                || meta->reordered != run_meta.reordered
+                || meta->compressed != run_meta.compressed
+                || meta->num_frames != run_meta.num_frames
+                || meta->offset_frames != run_meta.offset_frames
+                || meta->window_frames != run_meta.window_frames;
+
+  bool timestamp_failed = nframes != meta->window_frames;
+  if(nframes > 0) {
+    timestamp_failed |= frag.timestamp() - meta->offset_frames*timestamp_increase - flxfrag.timestamp(0) >= timestamp_increase;
+  }
+
+  // Check one chunk in _sample_stride, starting at a chunk that moves with
+  // the sequence ID so every frame is checked over a run.  Each frame is
+  // compared with the one before it.  The values are gathered first and
+  // compared without early exits so the comparisons vectorize.
+  bool convert_count_failed = false;
+  uint64_t ts[_scan_chunk_frames + 1];
+  int cc[4][_scan_chunk_frames + 1];
+  const unsigned nchunks = (nframes + _scan_chunk_frames - 1)/_scan_chunk_frames;
+  for(unsigned chunk = frag.sequenceID() % _sample_stride; chunk < nchunks; chunk += _sample_stride) {
+    const unsigned first = std::max(1u, chunk*_scan_chunk_frames);
+    const unsigned last = std::min(nframes, (chunk + 1)*_scan_chunk_frames);
+    if(first >= last) continue;
+    const unsigned n = last - first + 1;
+    for(unsigned i = 0; i < n; ++i) {
+      const unsigned fi = first - 1 + i;
+      ts[i] = flxfrag.timestamp(fi);
+      for(unsigned bi = 0; bi < 4; ++bi) cc[bi][i] = flxfrag.coldata_convert_count(fi, bi);
+    }
+    unsigned ts_bad = 0;
+    unsigned cc_bad = 0;
+    for(unsigned i = 1; i < n; ++i) {
+      ts_bad |= (ts[i] - ts[i-1] != timestamp_increase);
+      // The first two counts and last two counts need to be identical
+      cc_bad |= (cc[0][i] != cc[1][i]) | (cc[2][i] != cc[3][i]);
+      for(unsigned bi = 0; bi < 2; ++bi) {
+        const int diff = cc[bi][i] - cc[bi][i-1];
+        cc_bad |= (diff != convert_count_increase) & (diff != convert_count_increase - (1<<16));
+      }
+    }
+    timestamp_failed |= ts_bad != 0;
+    convert_count_failed |= cc_bad != 0;
+    outem.frames_checked += n - 1;
+  }
+
+  outem.timestamp_err = timestamp_failed;
+  outem.convert_count_err = convert_count_failed;
+  outem.error_fields_set = false;
+  outem.bad = timestamp_failed || convert_count_failed;
 
   return outem;
 }
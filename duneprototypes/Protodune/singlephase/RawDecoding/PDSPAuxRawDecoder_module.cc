@@ -0,0 +1,211 @@
+////////////////////////////////////////////////////////////////////////
+// Class:       PDSPAuxRawDecoder
+// Plugin Type: producer
+// File:        PDSPAuxRawDecoder_module.cc
+//
+// Decodes the CTB, timing and CRT fragments of an event in one module.
+// Each input fragment product is read once, container fragments are
+// unpacked once, and each contained fragment goes to the decoder for its
+// fragment type.  The three decoders then run in parallel.
+//
+// The products are the same as those of PDSPCTBRawDecoder,
+// TimingRawDecoder and CRTRawDecoder, with the same instance names, made by
+// the shared functions in AuxDetRawDecoding.h.  The diagnostic histograms
+// and event time files of those modules are not made here.
+////////////////////////////////////////////////////////////////////////
+
+#include "art/Framework/Core/EDProducer.h"
+#include "art/Framework/Core/ModuleMacros.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "canvas/Utilities/InputTag.h"
+#include "fhiclcpp/ParameterSet.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "larcore/Geometry/Geometry.h"
+#include "larcorealg/Geometry/GeometryCore.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tbb/parallel_invoke.h"
+
+// artdaq and dunepdlegacy includes
+
+#include "artdaq-core/Data/ContainerFragment.hh"
+#include "dunepdlegacy/Overlays/FragmentType.hh"
+
+// dunetpc includes
+
+#include "duneprototypes/Protodune/singlephase/RawDecoding/AuxDetRawDecoding.h"
+
+namespace dune {
+  class PDSPAuxRawDecoder;
+}
+
+class dune::PDSPAuxRawDecoder : public art::EDProducer {
+public:
+  explicit PDSPAuxRawDecoder(fhicl::ParameterSet const & p);
+
+  // Plugins should not be copied or assigned.
+  PDSPAuxRawDecoder(PDSPAuxRawDecoder const &) = delete;
+  PDSPAuxRawDecoder(PDSPAuxRawDecoder &&) = delete;
+  PDSPAuxRawDecoder & operator = (PDSPAuxRawDecoder const &) = delete;
+  PDSPAuxRawDecoder & operator = (PDSPAuxRawDecoder &&) = delete;
+
+  void produce(art::Event & e) override;
+  void beginJob() override;
+
+private:
+
+  // A fragment to decode, either one in the event or one copied out of a
+  // container fragment.
+  struct FragmentRef {
+    const artdaq::Fragment* frag = nullptr;
+    std::unique_ptr<const artdaq::Fragment> block;  // owns frag if it came out of a container fragment
+  };
+
+  std::string fInputLabel;
+  std::vector<std::string> fInputInstances;
+  std::string fCTBOutputLabel;
+  std::string fTimingOutputLabel;
+  std::string fCRTOutputLabel;
+  bool fCRTMatchOfflineMapping;
+  bool fParallelDecode;
+
+  std::vector<size_t> fCRTChannelMap;
+
+  void addFragment(FragmentRef&& ref, std::vector<FragmentRef>& ctbFrags,
+                   std::vector<FragmentRef>& timingFrags, std::vector<FragmentRef>& crtFrags) const;
+};
+
+
+dune::PDSPAuxRawDecoder::PDSPAuxRawDecoder(fhicl::ParameterSet const & p)
+  : EDProducer{p}
+{
+  fInputLabel = p.get<std::string>("InputLabel", "daq");
+  fInputInstances = p.get<std::vector<std::string>>("InputInstances");
+  fCTBOutputLabel = p.get<std::string>("CTBOutputLabel", "daq");
+  fTimingOutputLabel = p.get<std::string>("TimingOutputLabel", "daq");
+  fCRTOutputLabel = p.get<std::string>("CRTOutputLabel", "");
+  fCRTMatchOfflineMapping = p.get<bool>("CRTMatchOfflineMapping", true);
+  fParallelDecode = p.get<bool>("ParallelDecode", true);
+
+  for (auto const& instance : fInputInstances)
+    {
+      consumes<artdaq::Fragments>(art::InputTag(fInputLabel, instance));
+    }
+
+  produces<std::vector<raw::ctb::pdspctb> >(fCTBOutputLabel);
+  produces<std::vector<raw::RDTimeStamp> >(fTimingOutputLabel);
+  produces<std::vector<dune::ProtoDUNETimeStamp> >(fTimingOutputLabel);
+  produces<std::vector<CRT::Trigger> >(fCRTOutputLabel);
+}
+
+void dune::PDSPAuxRawDecoder::beginJob()
+{
+  size_t nModules = 0;
+  if (!fCRTMatchOfflineMapping)
+    {
+      nModules = art::ServiceHandle<geo::Geometry>()->NAuxDets();
+    }
+  fCRTChannelMap = dune::crtChannelMap(fCRTMatchOfflineMapping, nModules);
+}
+
+void dune::PDSPAuxRawDecoder::addFragment(FragmentRef&& ref, std::vector<FragmentRef>& ctbFrags,
+                                          std::vector<FragmentRef>& timingFrags, std::vector<FragmentRef>& crtFrags) const
+{
+  switch (ref.frag->type())
+    {
+    case dune::detail::CTB:
+      ctbFrags.push_back(std::move(ref));
+      break;
+    case dune::detail::TIMING:
+      timingFrags.push_back(std::move(ref));
+      break;
+    case dune::detail::CRT:
+      crtFrags.push_back(std::move(ref));
+      break;
+    default:
+      MF_LOG_DEBUG("PDSPAuxRawDecoder") << "Skipping fragment of type " << (unsigned)ref.frag->type();
+    }
+}
+
+void dune::PDSPAuxRawDecoder::produce(art::Event & evt)
+{
+  // collect the fragments of each type, unpacking container fragments once
+
+  std::vector<FragmentRef> ctbFrags;
+  std::vector<FragmentRef> timingFrags;
+  std::vector<FragmentRef> crtFrags;
+
+  for (auto const& instance : fInputInstances)
+    {
+      auto frags = evt.getHandle<artdaq::Fragments>(art::InputTag(fInputLabel, instance));
+      if (!frags) continue;
+      for (auto const& frag : *frags)
+        {
+          if (frag.type() == artdaq::Fragment::ContainerFragmentType)
+            {
+              artdaq::ContainerFragment cont_frag(frag);
+              for (size_t ii = 0; ii < cont_frag.block_count(); ++ii)
+                {
+                  FragmentRef ref;
+                  ref.block = cont_frag[ii];
+                  ref.frag = ref.block.get();
+                  addFragment(std::move(ref), ctbFrags, timingFrags, crtFrags);
+                }
+            }
+          else
+            {
+              FragmentRef ref;
+              ref.frag = &frag;
+              addFragment(std::move(ref), ctbFrags, timingFrags, crtFrags);
+            }
+        }
+    }
+
+  // decode.  Each decoder keeps its fragments in input order.
+
+  dune::CTBWords ctbWords;
+  std::vector<raw::RDTimeStamp> rdtimestamps;
+  std::vector<dune::ProtoDUNETimeStamp> pdtimestamps;
+  auto triggers = std::make_unique<std::vector<CRT::Trigger>>();
+
+  auto decodeCTB = [&]()
+    {
+      for (auto const& ref : ctbFrags) dune::decodeCTBFragment(*ref.frag, ctbWords);
+    };
+  auto decodeTiming = [&]()
+    {
+      for (auto const& ref : timingFrags) dune::decodeTimingFragment(*ref.frag, rdtimestamps, pdtimestamps);
+    };
+  auto decodeCRT = [&]()
+    {
+      dune::CRTRawTriggers crtTriggers;
+      for (auto const& ref : crtFrags) crtTriggers.add(CRT::Fragment(*ref.frag));
+      crtTriggers.makeTriggers(fCRTChannelMap, *triggers);
+    };
+
+  if (fParallelDecode)
+    {
+      tbb::parallel_invoke(decodeCTB, decodeTiming, decodeCRT);
+    }
+  else
+    {
+      decodeCTB();
+      decodeTiming();
+      decodeCRT();
+    }
+
+  auto pdspctbs = std::make_unique<std::vector<raw::ctb::pdspctb>>();
+  pdspctbs->push_back(ctbWords.product());  // just one for now
+  evt.put(std::move(pdspctbs), fCTBOutputLabel);
+  evt.put(std::make_unique<decltype(rdtimestamps)>(std::move(rdtimestamps)), fTimingOutputLabel);
+  evt.put(std::make_unique<decltype(pdtimestamps)>(std::move(pdtimestamps)), fTimingOutputLabel);
+  evt.put(std::move(triggers), fCRTOutputLabel);
+}
+
+DEFINE_ART_MODULE(dune::PDSPAuxRawDecoder)
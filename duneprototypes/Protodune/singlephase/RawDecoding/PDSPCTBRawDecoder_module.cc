@@ -21,13 +21,12 @@
 
 // artdaq and dunepdlegacy includes
 
-#include "dunepdlegacy/Overlays/CTBFragment.hh"
 #include "artdaq-core/Data/ContainerFragment.hh"
 #include "dunepdlegacy/Overlays/FragmentType.hh"
 
 // dunetpc includes
 
-#include "duneprototypes/Protodune/singlephase/CTB/data/pdspctb.h"
+#include "duneprototypes/Protodune/singlephase/RawDecoding/AuxDetRawDecoding.h"
 
 class PDSPCTBRawDecoder;
 
@@ -56,13 +55,7 @@ private:
   std::string fInputNonContainerInstance;
   std::string fOutputLabel;
 
-  void _process_CTB_AUX(const artdaq::Fragment& frag);
-
-  std::vector<raw::ctb::Trigger> fTrigs;
-  std::vector<raw::ctb::ChStatus> fChStats;
-  std::vector<raw::ctb::Feedback> fFeedbacks;
-  std::vector<raw::ctb::Misc> fMiscs;
-  std::vector<raw::ctb::WordIndex> fWordIndexes;
+  dune::CTBWords fWords;
 
 };
 
@@ -82,11 +75,7 @@ PDSPCTBRawDecoder::PDSPCTBRawDecoder(fhicl::ParameterSet const & p)
 void PDSPCTBRawDecoder::produce(art::Event & evt)
 {
 
-  fTrigs.clear();
-  fChStats.clear();
-  fFeedbacks.clear();
-  fMiscs.clear();
-  fWordIndexes.clear();
+  fWords.clear();
 
   // look first for container fragments and then non-container fragments
 
@@ -101,7 +90,7 @@ void PDSPCTBRawDecoder::produce(art::Event & evt)
 	  artdaq::ContainerFragment cont_frag(cont);
 	  for (size_t ii = 0; ii < cont_frag.block_count(); ++ii)
 	    {
-	      _process_CTB_AUX(*cont_frag[ii]);
+	      dune::decodeCTBFragment(*cont_frag[ii], fWords);
 	    }
 	}
     }
@@ -112,79 +101,14 @@ void PDSPCTBRawDecoder::produce(art::Event & evt)
     {
       for(auto const& frag: *frags)
 	{
-	  _process_CTB_AUX(frag);
+	  dune::decodeCTBFragment(frag, fWords);
 	}
     }
 
-  raw::ctb::pdspctb ctbdp(fTrigs,fChStats,fFeedbacks,fMiscs,fWordIndexes);
-  pdspctbs.push_back(ctbdp);  // just one for now
+  pdspctbs.push_back(fWords.product());  // just one for now
   evt.put(std::make_unique<std::vector<raw::ctb::pdspctb>>(std::move(pdspctbs)),fOutputLabel);
 
 }
 
-void PDSPCTBRawDecoder::_process_CTB_AUX(const artdaq::Fragment& frag)
-{
-  dune::CTBFragment ctbfrag(frag);
-
-  // use the same logic in dune-raw-data/Overlays/CTBFragment.cc:operator<<
-
-  for (size_t iword = 0; iword < ctbfrag.NWords(); ++iword)
-    {
-      size_t ix=0;
-      uint32_t wt=0;
-      if (ctbfrag.Trigger(iword))
-	{
-	  raw::ctb::Trigger tstruct;
-	  tstruct.word_type = ctbfrag.Trigger(iword)->word_type;
-	  wt = tstruct.word_type;
-	  tstruct.trigger_word = ctbfrag.Trigger(iword)->trigger_word;
-	  tstruct.timestamp = ctbfrag.Trigger(iword)->timestamp;
-	  ix = fTrigs.size();
-	  fTrigs.push_back(tstruct);
-	}
-      else if (ctbfrag.ChStatus(iword))
-	{
-	  raw::ctb::ChStatus cstruct;
-	  cstruct.word_type = ctbfrag.ChStatus(iword)->word_type;
-	  wt = cstruct.word_type;
-	  cstruct.pds = ctbfrag.ChStatus(iword)->pds;
-	  cstruct.crt = ctbfrag.ChStatus(iword)->crt;
-	  cstruct.beam_hi = ctbfrag.ChStatus(iword)->beam_hi;
-	  cstruct.beam_lo = ctbfrag.ChStatus(iword)->beam_lo;
-	  cstruct.timestamp = ctbfrag.ChStatus(iword)->timestamp;
-	  ix = fChStats.size();
-	  fChStats.push_back(cstruct);
-	}
-      else if (ctbfrag.Feedback(iword))
-	{
-	  raw::ctb::Feedback fstruct;
-	  fstruct.word_type = ctbfrag.Feedback(iword)->word_type;
-	  wt = fstruct.word_type;
-	  fstruct.padding = ctbfrag.Feedback(iword)->padding;
-	  fstruct.source = ctbfrag.Feedback(iword)->source;
-	  fstruct.code = ctbfrag.Feedback(iword)->code;
-	  fstruct.timestamp = ctbfrag.Feedback(iword)->timestamp;
-	  ix = fFeedbacks.size();
-	  fFeedbacks.push_back(fstruct);
-	}
-      else
-	{
-	  raw::ctb::Misc mstruct;
-	  mstruct.word_type = ctbfrag.Word(iword)->word_type;
-	  wt = mstruct.word_type;
-	  mstruct.payload = ctbfrag.Word(iword)->payload;
-	  mstruct.timestamp = ctbfrag.Word(iword)->timestamp;
-	  ix = fMiscs.size();
-	  fMiscs.push_back(mstruct);
-	}
-
-      raw::ctb::WordIndex wstruct;
-      wstruct.word_type = wt;
-      wstruct.index = ix;
-      fWordIndexes.push_back(wstruct);
-
-    }
-}
-
 
 DEFINE_ART_MODULE(PDSPCTBRawDecoder)
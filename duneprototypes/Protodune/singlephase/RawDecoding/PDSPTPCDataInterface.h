@@ -32,6 +32,7 @@
 #include "artdaq-core/Data/Fragment.hh"
 #include "artdaq-core/Data/ContainerFragment.hh"
 #include "dunecore/DuneObj/PDSPTPCDataInterfaceParent.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
 
 class PDSPTPCDataInterface : public PDSPTPCDataInterfaceParent {
 
@@ -76,6 +77,7 @@ class PDSPTPCDataInterface : public PDSPTPCDataInterfaceParent {
   unsigned int  _full_tick_count;
   bool          _enforce_error_free;
   bool          _enforce_no_duplicate_channels;
+  bool          _histogram_pedestal;
   bool          _drop_small_rce_frags;
   size_t        _rce_frag_small_size;
   bool          _rce_drop_frags_with_badsf;
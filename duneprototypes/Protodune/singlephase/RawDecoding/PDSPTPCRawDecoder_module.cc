@@ -12,7 +12,7 @@
 //  an optional GetManyByType if we don't know in advance what labels we're going to see
 ////////////////////////////////////////////////////////////////////////
 
-#include "art/Framework/Core/EDProducer.h"
+#include "art/Framework/Core/SharedProducer.h"
 #include "art/Framework/Core/ModuleMacros.h"
 #include "art/Framework/Principal/Event.h"
 #include "art/Framework/Principal/Handle.h"
@@ -27,6 +27,9 @@
 
 #include <memory>
 #include <cmath>
+#include <array>
+#include <atomic>
+#include "tbb/parallel_for.h"
 
 // ROOT includes
 #include "TH1.h"
@@ -59,18 +62,20 @@
 
 // DUNE includes
 #include "dunecore/DuneObj/RDStatus.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
+#include "duneprototypes/Protodune/singlephase/Utility/AdcDigitCompressor.h"
 
 class PDSPTPCRawDecoder;
 
-class PDSPTPCRawDecoder : public art::EDProducer {
+class PDSPTPCRawDecoder : public art::SharedProducer {
 
 public:
-  explicit PDSPTPCRawDecoder(fhicl::ParameterSet const & p);
+  explicit PDSPTPCRawDecoder(fhicl::ParameterSet const & p, art::ProcessingFrame const &);
   PDSPTPCRawDecoder(PDSPTPCRawDecoder const &) = delete;
   PDSPTPCRawDecoder(PDSPTPCRawDecoder &&) = delete;
   PDSPTPCRawDecoder & operator = (PDSPTPCRawDecoder const &) = delete;
   PDSPTPCRawDecoder & operator = (PDSPTPCRawDecoder &&) = delete;
-  void produce(art::Event & e) override;
+  void produce(art::Event & e, art::ProcessingFrame const &) override;
 
 private:
   typedef std::vector<raw::RawDigit> RawDigits;
@@ -130,17 +135,16 @@ private:
   size_t        _felix_frag_small_size;
   bool          _felix_check_buffer_size;
   size_t        _felix_buffer_size_checklimit;
+  bool          _felix_fused_decode;
+  bool          _parallel_decode;
 
   bool          _compress_Huffman;
+  bool          _compress_smallest;
   bool          _print_coldata_convert_count;
+  bool          _histogram_pedestal;
 
   //declare histogram data memebers
   bool	_make_histograms;
-  unsigned int 	duplicate_channels;
-  unsigned int 	error_counter;
-  unsigned int incorrect_ticks;
-  unsigned int rcechans;
-  unsigned int felixchans;
   TH1D * fIncorrectTickNumbers;
   //TH1I * fIncorrectTickNumbersZoomed;
   TH1I * fParticipRCE;
@@ -150,36 +154,75 @@ private:
   TH1I * fFragSizeRCE;
   TH1I * fFragSizeFELIX;
 
-  // flags and state needed for the data integrity enforcement mechanisms
-
-  unsigned int  _tick_count_this_event; // for use in comparing tick counts for all channels
-  bool          _initialized_tick_count_this_event;
-  bool          _discard_data;
-  const unsigned int  _duplicate_channel_checklist_size=15360;
-  bool          _duplicate_channel_checklist[15360]; 
-  bool          _DiscardedCorruptData;
-  bool          _KeptCorruptData;
+  // flags and counters needed for the data integrity enforcement mechanisms and
+  // the error histograms, for an event or for one fragment of it
+
+  struct DecodeStatus
+  {
+    bool          discard_data = false;          // true if we're going to drop the whole event's worth of data
+    bool          DiscardedCorruptData = false;  // can be set to true if we drop some of the event's data
+    bool          KeptCorruptData = false;       // true if we identify a corruption candidate but are skipping the test to drop it
+    unsigned int  duplicate_channels = 0;
+    unsigned int  error_counter = 0;
+    unsigned int  incorrect_ticks = 0;
+    unsigned int  rcechans = 0;
+    unsigned int  felixchans = 0;
+    void merge(const DecodeStatus &other);
+  };
+
+  // one RCE or FELIX fragment to decode, and what decoding it produced
+
+  struct FragmentTask
+  {
+    const artdaq::Fragment *frag = nullptr;
+    std::unique_ptr<const artdaq::Fragment> block;  // owns frag if it came out of a container fragment
+    bool is_rce = false;
+    size_t ntickscheck = 0;                         // median RCE nticks of the fragment's product
+
+    RawDigits raw_digits;
+    RDTimeStamps timestamps;
+    std::vector<size_t> tick_counts;                // of each stream or channel, for the event-wide comparison
+    DecodeStatus status;
+  };
+
+  // per-event state.  The fragments are collected first, then decoded in
+  // parallel tasks that share only the duplicate channel checklist, and then
+  // merged in the order they were collected.
+
+  static constexpr unsigned int _duplicate_channel_checklist_size=15360;
+
+  struct EventContext
+  {
+    EventContext();
+    bool markChannel(unsigned int offlineChannel);  // returns true if the channel was already seen
+
+    dune::PdspChannelMapService *channelMap = nullptr;
+    DecodeStatus status;
+    std::vector<FragmentTask> tasks;
+    std::vector<art::Handle<artdaq::Fragments>> handles;  // products to drop from the event once decoded
+    std::array<std::atomic<uint64_t>, _duplicate_channel_checklist_size/64> duplicate_channel_checklist;
+  };
 
   // internal methods
 
-  bool _processRCE(art::Event &evt, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm);
-  bool _rceProcContNCFrags(art::Handle<artdaq::Fragments> frags, size_t &n_rce_frags, bool is_container, 
-			   art::Event &evt, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm);
-  bool _process_RCE_AUX(const artdaq::Fragment& frag, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm, size_t ntickscheck);
-  void _process_RCE_nticksvf(const artdaq::Fragment& frag, std::vector<size_t> &nticksvec);
+  bool _processRCE(art::Event &evt, EventContext &ctx) const;
+  bool _rceProcContNCFrags(art::Handle<artdaq::Fragments> frags, size_t &n_rce_frags, bool is_container, EventContext &ctx) const;
+  bool _process_RCE_AUX(EventContext &ctx, FragmentTask &task) const;
+  void _process_RCE_nticksvf(const artdaq::Fragment& frag, std::vector<size_t> &nticksvec) const;
 
-  bool _processFELIX(art::Event &evt, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm);
-  bool _felixProcContNCFrags(art::Handle<artdaq::Fragments> frags, size_t &n_felix_frags, bool is_container, art::Event &evt, RawDigits& raw_digits,
-			     RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm);
-  bool _process_FELIX_AUX(const artdaq::Fragment& frag, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm);
+  bool _processFELIX(art::Event &evt, EventContext &ctx) const;
+  bool _felixProcContNCFrags(art::Handle<artdaq::Fragments> frags, size_t &n_felix_frags, bool is_container, EventContext &ctx) const;
+  bool _process_FELIX_AUX(EventContext &ctx, FragmentTask &task) const;
 
-  void computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma);
+  void _addFragmentTasks(EventContext &ctx, const artdaq::Fragment &frag, bool is_container, bool is_rce, size_t ntickscheck, size_t &n_frags) const;
+  void _decodeFragments(EventContext &ctx) const;
+  void _checkTickCounts(EventContext &ctx) const;
 
-  std::vector<int16_t> _buffer;
+  void computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma) const;
 };
 
 
-PDSPTPCRawDecoder::PDSPTPCRawDecoder(fhicl::ParameterSet const & p) : EDProducer{p}
+PDSPTPCRawDecoder::PDSPTPCRawDecoder(fhicl::ParameterSet const & p, art::ProcessingFrame const &) : SharedProducer{p}
 {
   std::vector<int> emptyivec;
   _apas_to_decode = p.get<std::vector<int> >("APAsToDecode",emptyivec);
@@ -233,6 +276,8 @@ PDSPTPCRawDecoder::PDSPTPCRawDecoder(fhicl::ParameterSet const & p) : EDProducer
   _felix_frag_small_size = p.get<unsigned int>("FELIXSmallFragSize",10000);
   _felix_check_buffer_size = p.get<bool>("FELIXCheckBufferSize",true);
   _felix_buffer_size_checklimit = p.get<unsigned int>("FELIXBufferSizeCheckLimit",10000000);
+  _felix_fused_decode = p.get<bool>("FELIXFusedDecode",true);
+  _parallel_decode = p.get<bool>("ParallelDecode",true);
 
   _output_label = p.get<std::string>("OutputDataLabel");
 
@@ -245,7 +290,9 @@ PDSPTPCRawDecoder::PDSPTPCRawDecoder(fhicl::ParameterSet const & p) : EDProducer
   _enforce_no_duplicate_channels = p.get<bool>("EnforceNoDuplicateChannels", true);
 
   _compress_Huffman = p.get<bool>("CompressHuffman",false);
+  _compress_smallest = p.get<bool>("CompressSmallest",true);
   _print_coldata_convert_count = p.get<bool>("PrintColdataConvertCount",false);
+  _histogram_pedestal = p.get<bool>("HistogramPedestal",false);
 
   _min_offline_channel = p.get<long int>("MinOfflineChannel",-1);
   _max_offline_channel = p.get<long int>("MaxOfflineChannel",-1);
@@ -309,10 +356,52 @@ PDSPTPCRawDecoder::PDSPTPCRawDecoder(fhicl::ParameterSet const & p) : EDProducer
       fFragSizeFELIX = tFileService->make<TH1I>("fFragSizeFELIX", "FELIX Fragment Size", 100, 0.5, 57600000.5);
       fFragSizeFELIX->GetXaxis()->SetTitle("Size of FELIX Fragments (bytes)");
     }
+
+  // events are independent apart from the histograms
+
+  if (_make_histograms)
+    {
+      serialize<art::InEvent>(art::TFileService::resource_name());
+    }
+  else
+    {
+      async<art::InEvent>();
+    }
 }
 
-void PDSPTPCRawDecoder::produce(art::Event &e)
+PDSPTPCRawDecoder::EventContext::EventContext()
 {
+  for (auto &word : duplicate_channel_checklist) word.store(0, std::memory_order_relaxed);
+}
+
+bool PDSPTPCRawDecoder::EventContext::markChannel(unsigned int offlineChannel)
+{
+  uint64_t bit = uint64_t(1) << (offlineChannel % 64);
+  return duplicate_channel_checklist[offlineChannel/64].fetch_or(bit, std::memory_order_relaxed) & bit;
+}
+
+void PDSPTPCRawDecoder::DecodeStatus::merge(const DecodeStatus &other)
+{
+  discard_data |= other.discard_data;
+  DiscardedCorruptData |= other.DiscardedCorruptData;
+  KeptCorruptData |= other.KeptCorruptData;
+  duplicate_channels += other.duplicate_channels;
+  error_counter += other.error_counter;
+  incorrect_ticks += other.incorrect_ticks;
+  rcechans += other.rcechans;
+  felixchans += other.felixchans;
+}
+
+void PDSPTPCRawDecoder::produce(art::Event &e, art::ProcessingFrame const &)
+{
+  EventContext ctx;
+  art::ServiceHandle<dune::PdspChannelMapService> channelMap;
+  ctx.channelMap = channelMap.get();
+
+  _processRCE(e,ctx);
+  _processFELIX(e,ctx);
+  _decodeFragments(ctx);
+
   RawDigits raw_digits;
   RDTimeStamps rd_timestamps;
   RDTsAssocs rd_ts_assocs;
@@ -320,30 +409,37 @@ void PDSPTPCRawDecoder::produce(art::Event &e)
   RDPmkr rdpm(e,_output_label);
   TSPmkr tspm(e,_output_label);
 
-  error_counter = 0; //reset the errors to zero for each run
-  incorrect_ticks = 0;
-  duplicate_channels = 0;
-  rcechans = 0;
-  felixchans = 0;
+  // collect the fragments' data in the order the serial decoding would have made it
 
-  _initialized_tick_count_this_event = false;
-  _discard_data = false;   // true if we're going to drop the whole event's worth of data
-  _DiscardedCorruptData = false;   // can be set to true if we drop some of the event's data
-  _KeptCorruptData = false;      // true if we identify a corruption candidate but are skipping the test to drop it
+  DecodeStatus &status = ctx.status;
+  for (auto &task : ctx.tasks)
+    {
+      status.merge(task.status);
+      for (size_t i=0; i<task.raw_digits.size(); ++i)
+	{
+	  raw_digits.push_back(std::move(task.raw_digits[i]));
+	  rd_timestamps.push_back(task.timestamps[i]);
+
+	  //associate the raw digit and the timestamp data products
+	  auto const rawdigitptr = rdpm(raw_digits.size()-1);
+	  auto const rdtimestampptr = tspm(rd_timestamps.size()-1);
+	  rd_ts_assocs.addSingle(rawdigitptr,rdtimestampptr);
+	}
+      task.raw_digits.clear();
+      task.timestamps.clear();
+    }
+  _checkTickCounts(ctx);
 
-  for (size_t i=0; i<_duplicate_channel_checklist_size; ++i) _duplicate_channel_checklist[i] = false;
-  
-  _processRCE(e,raw_digits,rd_timestamps,rd_ts_assocs,rdpm,tspm);
-  _processFELIX(e,raw_digits,rd_timestamps,rd_ts_assocs,rdpm,tspm);
+  for (auto &handle : ctx.handles) handle.removeProduct();
 
   //Make the histograms for error checking. (other histograms are filled within the _process and _AUX functions)
   if(_make_histograms)
     {
-      fErrorsNumber->Fill(log2(error_counter));
-      fDuplicatesNumber->Fill(duplicate_channels);
-      fIncorrectTickNumbers->Fill(log2(incorrect_ticks));
-      fParticipFELIX->Fill(felixchans);
-      fParticipRCE->Fill(rcechans);
+      fErrorsNumber->Fill(log2(status.error_counter));
+      fDuplicatesNumber->Fill(status.duplicate_channels);
+      fIncorrectTickNumbers->Fill(log2(status.incorrect_ticks));
+      fParticipFELIX->Fill(status.felixchans);
+      fParticipRCE->Fill(status.rcechans);
       //fIncorrectTickNumbersZoomed->Fill(incorrect_ticks);
     }
 
@@ -351,11 +447,11 @@ void PDSPTPCRawDecoder::produce(art::Event &e)
     {
       MF_LOG_WARNING("PDSPTPCRawDecoder:") << "Wrong Total number of Channels " << raw_digits.size()  
 					   << " which is not " << _full_channel_count << ". Discarding Data";
-      _DiscardedCorruptData = true;
-      _discard_data = true;
+      status.DiscardedCorruptData = true;
+      status.discard_data = true;
     }
 
-  if (_discard_data)
+  if (status.discard_data)
     {
       RawDigits empty_raw_digits;
       RDTimeStamps empty_rd_timestamps;
@@ -369,11 +465,17 @@ void PDSPTPCRawDecoder::produce(art::Event &e)
     }
   else
     {
+      // all channels of the event at once, in parallel
+      if (_compress_Huffman)
+	{
+	  AdcDigitCompressor::compress(raw_digits, _compress_smallest);
+	}
+
       RDStatuses statuses;
       unsigned int statword=0;
-      if (_DiscardedCorruptData) statword |= 1;
-      if (_KeptCorruptData) statword |= 2;
-      statuses.emplace_back(_DiscardedCorruptData,_KeptCorruptData,statword);
+      if (status.DiscardedCorruptData) statword |= 1;
+      if (status.KeptCorruptData) statword |= 2;
+      statuses.emplace_back(status.DiscardedCorruptData,status.KeptCorruptData,statword);
       e.put(std::make_unique<decltype(raw_digits)>(std::move(raw_digits)),_output_label);
       e.put(std::make_unique<decltype(rd_timestamps)>(std::move(rd_timestamps)),_output_label);
       e.put(std::make_unique<decltype(rd_ts_assocs)>(std::move(rd_ts_assocs)),_output_label);
@@ -381,7 +483,7 @@ void PDSPTPCRawDecoder::produce(art::Event &e)
     }
 }
 
-bool PDSPTPCRawDecoder::_processRCE(art::Event &evt, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm)
+bool PDSPTPCRawDecoder::_processRCE(art::Event &evt, EventContext &ctx) const
 {
   size_t n_rce_frags = 0;
   bool have_data=false;
@@ -397,7 +499,7 @@ bool PDSPTPCRawDecoder::_processRCE(art::Event &evt, RawDigits& raw_digits, RDTi
 	      if (cont_frags)
 		{
 		  have_data = true;
-	          if (! _rceProcContNCFrags(cont_frags, n_rce_frags, true, evt, raw_digits, timestamps, tsassocs, rdpm, tspm))
+	          if (! _rceProcContNCFrags(cont_frags, n_rce_frags, true, ctx))
 		    {
 		      return false;
 		    }
@@ -409,7 +511,7 @@ bool PDSPTPCRawDecoder::_processRCE(art::Event &evt, RawDigits& raw_digits, RDTi
 	      if (frags)
 		{
 		  have_data_nc = true;
-	          if (! _rceProcContNCFrags(frags, n_rce_frags, false, evt, raw_digits, timestamps, tsassocs, rdpm, tspm))
+	          if (! _rceProcContNCFrags(frags, n_rce_frags, false, ctx))
 		    {
 		      return false;
 		    }
@@ -432,7 +534,7 @@ bool PDSPTPCRawDecoder::_processRCE(art::Event &evt, RawDigits& raw_digits, RDTi
 	          if (fraghv.at(ihandle).provenance()->inputTag().instance().find("Container") != std::string::npos)
 		    {
 		      have_data = true;
-		      if (! _rceProcContNCFrags(fraghv.at(ihandle), n_rce_frags, true, evt, raw_digits, timestamps, tsassocs, rdpm, tspm) )
+		      if (! _rceProcContNCFrags(fraghv.at(ihandle), n_rce_frags, true, ctx) )
 			{
 			  return false;
 			}
@@ -440,7 +542,7 @@ bool PDSPTPCRawDecoder::_processRCE(art::Event &evt, RawDigits& raw_digits, RDTi
 		  else
 		    {
 		      have_data_nc = true;
-		      if (! _rceProcContNCFrags(fraghv.at(ihandle), n_rce_frags, false, evt, raw_digits, timestamps, tsassocs, rdpm, tspm))
+		      if (! _rceProcContNCFrags(fraghv.at(ihandle), n_rce_frags, false, ctx))
 			{
 			  return false;
 			}
@@ -463,7 +565,7 @@ bool PDSPTPCRawDecoder::_processRCE(art::Event &evt, RawDigits& raw_digits, RDTi
 }
 
 bool PDSPTPCRawDecoder::_rceProcContNCFrags(art::Handle<artdaq::Fragments> frags, size_t &n_rce_frags, bool is_container, 
-					    art::Event &evt, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm)
+					    EventContext &ctx) const
 {
   //size of RCE fragments into histogram
   if(_make_histograms)
@@ -505,9 +607,9 @@ bool PDSPTPCRawDecoder::_rceProcContNCFrags(art::Handle<artdaq::Fragments> frags
   if (nticksvec.size() == 0)
     {
       MF_LOG_WARNING("_process_RCE:") << " No valid nticks to check.  Discarding Event.";
-      _discard_data = true; 
-      _DiscardedCorruptData = true;
-      frags.removeProduct();
+      ctx.status.discard_data = true; 
+      ctx.status.DiscardedCorruptData = true;
+      ctx.handles.push_back(frags);
       return false;
     }
   size_t nticksmedian = TMath::Median(nticksvec.size(),nticksvec.data()) + 0.01;  // returns a double -- want to make sure it gets truncated to the right integer
@@ -524,43 +626,32 @@ bool PDSPTPCRawDecoder::_rceProcContNCFrags(art::Handle<artdaq::Fragments> frags
 	  if ( _drop_events_with_small_rce_frags )
 	    { 
 	      MF_LOG_WARNING("_process_RCE:") << " Small RCE fragment size: " << frag.sizeBytes() << " Discarding Event on request.";
-	      _discard_data = true; 
-	      _DiscardedCorruptData = true;
-	      frags.removeProduct();
+	      ctx.status.discard_data = true; 
+	      ctx.status.DiscardedCorruptData = true;
+	      ctx.handles.push_back(frags);
 	      return false;
 	    }
 	  if ( _drop_small_rce_frags )
 	    { 
 	      MF_LOG_WARNING("_process_RCE:") << " Small RCE fragment size: " << frag.sizeBytes() << " Discarding just this fragment on request.";
-	      _DiscardedCorruptData = true;
+	      ctx.status.DiscardedCorruptData = true;
 	      process_flag = false;
 	    }
-	  _KeptCorruptData = true;
+	  ctx.status.KeptCorruptData = true;
 	}
       if (process_flag)
 	{
-	  if (is_container)
-	    {
-	      artdaq::ContainerFragment cont_frag(frag);
-	      for (size_t ii = 0; ii < cont_frag.block_count(); ++ii)
-		{
-		  if (_process_RCE_AUX(*cont_frag[ii], raw_digits, timestamps, tsassocs, rdpm, tspm, nticksmedian)) ++n_rce_frags;
-		}
-	    }
-	  else
-	    {
-	      if (_process_RCE_AUX(frag, raw_digits, timestamps,tsassocs, rdpm, tspm, nticksmedian)) ++n_rce_frags;
-	    }
+	  _addFragmentTasks(ctx, frag, is_container, true, nticksmedian, n_rce_frags);
 	}
     }
-  frags.removeProduct();
+  ctx.handles.push_back(frags);
   return true;
 }
 
 void PDSPTPCRawDecoder::_process_RCE_nticksvf(
 					      const artdaq::Fragment& frag, 
 					      std::vector<size_t> &nticksvec
-					      )
+					      ) const
 {
 
   if (_rce_hex_dump)
@@ -644,20 +735,18 @@ void PDSPTPCRawDecoder::_process_RCE_nticksvf(
 
 }
 
-bool PDSPTPCRawDecoder::_process_RCE_AUX(
-					 const artdaq::Fragment& frag, 
-					 RawDigits& raw_digits,
-					 RDTimeStamps &timestamps,
-					 RDTsAssocs &tsassocs,
-					 RDPmkr &rdpm, TSPmkr &tspm,
-					 size_t ntickscheck
-					 )
+bool PDSPTPCRawDecoder::_process_RCE_AUX(EventContext &ctx, FragmentTask &task) const
 {
+  const artdaq::Fragment& frag = *task.frag;
+  RawDigits& raw_digits = task.raw_digits;
+  RDTimeStamps &timestamps = task.timestamps;
+  DecodeStatus &st = task.status;
+  size_t ntickscheck = task.ntickscheck;
 
   if (_rce_enforce_fragment_type_match && (frag.type() != _rce_fragment_type)) 
     {
       MF_LOG_WARNING("_process_RCE_AUX:") << " RCE fragment type " << (int) frag.type() << " doesn't match expected value: " << _rce_fragment_type << " Discarding RCE fragment";
-      _DiscardedCorruptData = true;
+      st.DiscardedCorruptData = true;
       return false;
     }
   //MF_LOG_INFO("_Process_RCE_AUX")
@@ -665,7 +754,7 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
   //<< "   fragmentID = " << frag.fragmentID()
   //<< "   fragmentType = " << (unsigned)frag.type()
   //<< "   Timestamp =  " << frag.timestamp();
-  art::ServiceHandle<dune::PdspChannelMapService> channelMap;
+  dune::PdspChannelMapService *channelMap = ctx.channelMap;
 
   dune::RceFragment rce(frag);
   artdaq::Fragment cfragloc(frag);
@@ -678,8 +767,8 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
   if (!isOkay)
     {
       MF_LOG_WARNING("_process_RCE_AUX:") << "RCE Fragment isOkay failed: " << cdsize << " Discarding this fragment"; 
-      error_counter++;
-      _DiscardedCorruptData = true;
+      st.error_counter++;
+      st.DiscardedCorruptData = true;
       return false; 
     }
 
@@ -739,10 +828,10 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 	    {
 	      MF_LOG_WARNING("_process_RCE:") << "Bad  slot, fiber number, discarding fragment on request: " 
 					      << " " << slotNumber << " " << fiberNumber;
-              _DiscardedCorruptData = true;
+              st.DiscardedCorruptData = true;
 	      return false;
 	    }
-	  _KeptCorruptData = true;
+	  st.KeptCorruptData = true;
 	}
 
       if (_print_coldata_convert_count)
@@ -781,7 +870,7 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
       if(_make_histograms)
 	{
 	  //log the participating RCE channels
-	  rcechans=rcechans+n_ch;
+	  st.rcechans=st.rcechans+n_ch;
 	}
 
       // check the number of ticks and allow FEMB302 to have 10% fewer
@@ -796,7 +885,7 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 	{
 	  MF_LOG_WARNING("_process_RCE_AUX:") << "Nticks differs from median or FEMB302 nticks not expected: " << n_ticks << " " 
 					      << ntickscheck << " Discarding this fragment";
-	  _DiscardedCorruptData = true;
+	  st.DiscardedCorruptData = true;
 	  return false;
 	} 
 
@@ -806,36 +895,17 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 	    {
 	      MF_LOG_WARNING("_process_RCE_AUX:") << "Nticks not the required value: " << n_ticks << " " 
 						  << _full_tick_count << " Discarding Data";
-	      error_counter++;
-	      incorrect_ticks++;
-	      _discard_data = true;
-              _DiscardedCorruptData = true;
+	      st.error_counter++;
+	      st.incorrect_ticks++;
+	      st.discard_data = true;
+              st.DiscardedCorruptData = true;
 	      return false; 
 	    }
-	  _KeptCorruptData = true;
+	  st.KeptCorruptData = true;
 	}
 
-      if (!_initialized_tick_count_this_event)
-	{
-	  _initialized_tick_count_this_event = true;
-	  _tick_count_this_event = n_ticks;
-	}
-      else
-	{
-	  if (n_ticks != _tick_count_this_event)
-	    {
-	      if (_enforce_same_tick_count)
-		{
-		  MF_LOG_WARNING("_process_RCE_AUX:") << "Nticks different for two channel streams: " << n_ticks 
-						      << " vs " << _tick_count_this_event << " Discarding Data";
-		  error_counter++;
-		  _discard_data = true;
-		  _DiscardedCorruptData = true;
-		  return false;
-		}
-	    }
-	  _KeptCorruptData = true;
-	}
+      // compared with the other streams and channels of the event in _checkTickCounts
+      task.tick_counts.push_back(n_ticks);
 
 
       //MF_LOG_INFO("_Process_RCE_AUX")
@@ -853,25 +923,23 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 	    {
 	      MF_LOG_WARNING("_process_RCE_AUX:") << "n_ch*nticks too large: " << n_ch << " * " << n_ticks << " = " << 
 		buffer_size << " larger than: " <<  _rce_buffer_size_checklimit << ".  Discarding this fragment";
-	      _DiscardedCorruptData = true;
+	      st.DiscardedCorruptData = true;
 	      return false;
 	    }
 	  else
 	    {
-	      _KeptCorruptData = true;
+	      st.KeptCorruptData = true;
 	    }
 	}
 
-      if (_buffer.capacity() < buffer_size)
+      // one buffer per thread, reused from fragment to fragment
+      static thread_local std::vector<int16_t> buffer;
+      if (buffer.size() < buffer_size)
 	{
-	  //  MF_LOG_INFO("_process_RCE_AUX")
-	  //<< "Increase buffer size from " << _buffer.capacity()
-	  //<< " to " << buffer_size;
-
-	  _buffer.reserve(buffer_size);
+	  buffer.resize(buffer_size);
 	}
 
-      int16_t* adcs = _buffer.data();
+      int16_t* adcs = buffer.data();
       bool sgmcdretcode = rce_stream->getMultiChannelData(adcs);
       if (!sgmcdretcode)
 	{
@@ -879,11 +947,11 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 	    {
 	      MF_LOG_WARNING("_process_RCE_AUX:") << "getMutliChannelData returns error flag: " 
 						  << " c:s:f:ich: " << crateNumber << " " << slotNumber << " " << fiberNumber << " Discarding Data";
-	      error_counter++;
-              _DiscardedCorruptData = true;
+	      st.error_counter++;
+              st.DiscardedCorruptData = true;
 	      return false;
 	    }
-	  _KeptCorruptData = true;
+	  st.KeptCorruptData = true;
 	}
 
       //std::cout << "RCE raw decoder trj: " << crateNumber << " " << slotNumber << " " << fiberNumber << std::endl;
@@ -929,25 +997,24 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 
 	  if (offlineChannel < _duplicate_channel_checklist_size)
 	    {
-	      if (_duplicate_channel_checklist[offlineChannel])
+	      if (ctx.markChannel(offlineChannel))
 		{
 		  if(_make_histograms)
 		    {
-		      duplicate_channels++;
+		      st.duplicate_channels++;
 		    }
 
 		  if (_enforce_no_duplicate_channels)
 		    {
 		      MF_LOG_WARNING("_process_RCE_AUX:") << "Duplicate Channel: " << offlineChannel
 							  << " c:s:f:ich: " << crateNumber << " " << slotNumber << " " << fiberNumber << " " << i_ch << " Discarding Data";
-		      error_counter++;
-		      _discard_data = true;
-		      _DiscardedCorruptData = true;
+		      st.error_counter++;
+		      st.discard_data = true;
+		      st.DiscardedCorruptData = true;
 		      return false;
 		    }
-		  _KeptCorruptData = true;
+		  st.KeptCorruptData = true;
 		}
-	      _duplicate_channel_checklist[offlineChannel] = true;
 	    }
 	  
 	  float median=0;
@@ -958,24 +1025,13 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 
 	  auto uncompressed_nticks = v_adc.size();  // can be different from n_ticks due to padding of FEMB 302
 
-	  raw::Compress_t cflag=raw::kNone;
-	  if (_compress_Huffman)
-	    {
-	      cflag = raw::kHuffman;
-	      raw::Compress(v_adc,cflag);
-	    }
-	  // here n_ticks is the uncompressed size as required by the constructor
-	  raw::RawDigit raw_digit(offlineChannel, uncompressed_nticks, v_adc, cflag);
-	  raw_digit.SetPedestal(median,sigma);
-	  raw_digits.push_back(raw_digit);  
+	  // compression, if requested, is done for the whole event in produce
+	  raw_digits.emplace_back(offlineChannel, uncompressed_nticks, std::move(v_adc), raw::kNone);
+	  raw_digits.back().SetPedestal(median,sigma);
 
+	  // the association is made when the fragments are merged in produce
 	  raw::RDTimeStamp rdtimestamp(rce_stream->getTimeStamp(),offlineChannel);
 	  timestamps.push_back(rdtimestamp);
-
-	  //associate the raw digit and the timestamp data products
-	  auto const rawdigitptr = rdpm(raw_digits.size()-1);
-	  auto const rdtimestampptr = tspm(timestamps.size()-1);
-	  tsassocs.addSingle(rawdigitptr,rdtimestampptr);            
 	}
     }
 
@@ -984,7 +1040,7 @@ bool PDSPTPCRawDecoder::_process_RCE_AUX(
 
 
 
-bool PDSPTPCRawDecoder::_processFELIX(art::Event &evt, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm)
+bool PDSPTPCRawDecoder::_processFELIX(art::Event &evt, EventContext &ctx) const
 {
   size_t n_felix_frags = 0;
   bool have_data=false;
@@ -1000,7 +1056,7 @@ bool PDSPTPCRawDecoder::_processFELIX(art::Event &evt, RawDigits& raw_digits, RD
 	      if (cont_frags)
 		{
 		  have_data = true;
-	          if (! _felixProcContNCFrags(cont_frags, n_felix_frags, true, evt, raw_digits, timestamps, tsassocs, rdpm, tspm))
+	          if (! _felixProcContNCFrags(cont_frags, n_felix_frags, true, ctx))
 		    {
 		      return false;
 		    }
@@ -1012,7 +1068,7 @@ bool PDSPTPCRawDecoder::_processFELIX(art::Event &evt, RawDigits& raw_digits, RD
 	      if (frags)
 		{
 		  have_data_nc = true;
-	          if (! _felixProcContNCFrags(frags, n_felix_frags, false, evt, raw_digits, timestamps, tsassocs, rdpm, tspm))
+	          if (! _felixProcContNCFrags(frags, n_felix_frags, false, ctx))
 		    {
 		      return false;
 		    }
@@ -1035,7 +1091,7 @@ bool PDSPTPCRawDecoder::_processFELIX(art::Event &evt, RawDigits& raw_digits, RD
 	          if (fraghv.at(ihandle).provenance()->inputTag().instance().find("Container") != std::string::npos)
 		    {
 		      have_data = true;
-		      if (! _felixProcContNCFrags(fraghv.at(ihandle), n_felix_frags,true, evt, raw_digits, timestamps, tsassocs, rdpm, tspm) )
+		      if (! _felixProcContNCFrags(fraghv.at(ihandle), n_felix_frags,true, ctx) )
 			{
 			  return false;
 			}
@@ -1043,7 +1099,7 @@ bool PDSPTPCRawDecoder::_processFELIX(art::Event &evt, RawDigits& raw_digits, RD
 		  else
 		    {
 		      have_data_nc = true;
-		      if (! _felixProcContNCFrags(fraghv.at(ihandle), n_felix_frags, false, evt, raw_digits, timestamps, tsassocs, rdpm, tspm))
+		      if (! _felixProcContNCFrags(fraghv.at(ihandle), n_felix_frags, false, ctx))
 			{
 			  return false;
 			}
@@ -1076,7 +1132,7 @@ bool PDSPTPCRawDecoder::_processFELIX(art::Event &evt, RawDigits& raw_digits, RD
 }
 
 bool PDSPTPCRawDecoder::_felixProcContNCFrags(art::Handle<artdaq::Fragments> frags, size_t &n_felix_frags, bool is_container, 
-					      art::Event &evt, RawDigits& raw_digits, RDTimeStamps &timestamps, RDTsAssocs &tsassocs, RDPmkr &rdpm, TSPmkr &tspm)
+					      EventContext &ctx) const
 {
   //size of FELIX fragments into histogram
   if(_make_histograms)
@@ -1099,45 +1155,35 @@ bool PDSPTPCRawDecoder::_felixProcContNCFrags(art::Handle<artdaq::Fragments> fra
 	  if ( _drop_events_with_small_felix_frags )
 	    { 
 	      MF_LOG_WARNING("_process_FELIX:") << " Small FELIX fragment size: " << frag.sizeBytes() << " Discarding Event on request.";
-	      _discard_data = true; 
-	      _DiscardedCorruptData = true;
-	      frags.removeProduct();
+	      ctx.status.discard_data = true; 
+	      ctx.status.DiscardedCorruptData = true;
+	      ctx.handles.push_back(frags);
 	      return false;
 	    }
 	  if ( _drop_small_felix_frags )
 	    { 
 	      MF_LOG_WARNING("_process_FELIX:") << " Small FELIX fragment size: " << frag.sizeBytes() << " Discarding just this fragment on request.";
-	      _DiscardedCorruptData = true;
+	      ctx.status.DiscardedCorruptData = true;
 	      process_flag = false;
 	    }
-	  _KeptCorruptData = true;
+	  ctx.status.KeptCorruptData = true;
 	}
       if (process_flag)
 	{
-	  if (is_container)
-	    {
-	      artdaq::ContainerFragment cont_frag(frag);
-	      for (size_t ii = 0; ii < cont_frag.block_count(); ++ii)
-		{
-		  if (_process_FELIX_AUX(*cont_frag[ii], raw_digits, timestamps, tsassocs, rdpm, tspm)) ++n_felix_frags;
-		}
-	    }
-	  else
-	    {
-	      if (_process_FELIX_AUX(frag, raw_digits, timestamps,tsassocs, rdpm, tspm)) ++n_felix_frags;
-	    }
+	  _addFragmentTasks(ctx, frag, is_container, false, 0, n_felix_frags);
 	}
     }
-  frags.removeProduct();
+  ctx.handles.push_back(frags);
   return true;
 }
 
 
-bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigits& raw_digits,
-					   RDTimeStamps &timestamps,
-					   RDTsAssocs &tsassocs,
-					   RDPmkr &rdpm, TSPmkr &tspm)
+bool PDSPTPCRawDecoder::_process_FELIX_AUX(EventContext &ctx, FragmentTask &task) const
 {
+  const artdaq::Fragment& frag = *task.frag;
+  RawDigits& raw_digits = task.raw_digits;
+  RDTimeStamps &timestamps = task.timestamps;
+  DecodeStatus &st = task.status;
 
   //std::cout 
   //<< "   SequenceID = " << frag.sequenceID()
@@ -1177,12 +1223,12 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
   // check against _felix_fragment_type
   if ( _felix_enforce_fragment_type_match && (frag.type() != _felix_fragment_type) )
     {
-      _DiscardedCorruptData = true;
+      st.DiscardedCorruptData = true;
       MF_LOG_WARNING("_process_FELIX_AUX:") << " FELIX fragment type " << (int) frag.type() << " doesn't match expected value: " << _felix_fragment_type << " Discarding FELIX fragment";
       return false;
     }
 
-  art::ServiceHandle<dune::PdspChannelMapService> channelMap;
+  dune::PdspChannelMapService *channelMap = ctx.channelMap;
 
   //Load overlay class.
   dune::FelixFragment felix(frag);
@@ -1229,11 +1275,11 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
     {
       if (_felix_drop_frags_with_badsf)  // we'll check the fiber later
 	{
-	  _DiscardedCorruptData = true;
+	  st.DiscardedCorruptData = true;
 	  MF_LOG_WARNING("_process_FELIX_AUX:") << "Invalid slot:  s=" << (int) slot << " discarding FELIX data.";
 	  return false;
 	}
-      _KeptCorruptData = true;
+      st.KeptCorruptData = true;
     }
 
   if (_print_coldata_convert_count)
@@ -1257,18 +1303,18 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
 	{
 	  MF_LOG_WARNING("_process_FELIX_AUX:") << "n_channels*n_frames too large: " << n_channels << " * " << n_frames << " = " << 
 	    n_frames*n_channels << " larger than: " <<  _felix_buffer_size_checklimit << ".  Discarding this fragment";
-	  _DiscardedCorruptData = true;
+	  st.DiscardedCorruptData = true;
 	  return false;
 	}
       else
 	{
-	  _KeptCorruptData = true;
+	  st.KeptCorruptData = true;
 	}
     }
 
   if(_make_histograms)
     {
-      felixchans=felixchans+n_channels;
+      st.felixchans=st.felixchans+n_channels;
     }
 
   for (unsigned int iframe=0; iframe<n_frames; ++iframe)
@@ -1277,22 +1323,37 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
 	{
 	  if (_enforce_error_free )
 	    {
-	      _DiscardedCorruptData = true;
+	      st.DiscardedCorruptData = true;
 	      MF_LOG_WARNING("_process_FELIX_AUX:") << "WIB Errors on frame: " << iframe << " : " << felix.wib_errors(iframe)
 						    << " Discarding Data";
-	      error_counter++;
+	      st.error_counter++;
 	      // drop just this fragment
-	      //_discard_data = true;
+	      //st.discard_data = true;
 	      return true;
 	    }
-	  _KeptCorruptData = true;
+	  st.KeptCorruptData = true;
 	}
     }
 
-  // check optimization of this -- size not reserved
+  // In fused mode all channels are unpacked in one pass over the frames,
+  // instead of one pass per channel with get_ADCs_by_channel, and each
+  // channel's vector is moved into its RawDigit.
+
+  std::vector<raw::RawDigit::ADCvector_t> chan_adcs;
+  if (_felix_fused_decode)
+    {
+      chan_adcs.resize(n_channels);
+      for (auto &adcs : chan_adcs) adcs.resize(n_frames);
+      for (unsigned int iframe=0; iframe<n_frames; ++iframe)
+	{
+	  for (unsigned int ch=0; ch<n_channels; ++ch)
+	    {
+	      chan_adcs[ch][iframe] = felix.get_ADC(iframe, ch);
+	    }
+	}
+    }
 
   raw::RawDigit::ADCvector_t v_adc;
-  //v_adc.reserve(n_frames*n_channels);
   // Fill the adc vector.  
 
   for(unsigned ch = 0; ch < n_channels; ++ch) {
@@ -1312,7 +1373,7 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
       {
 	MF_LOG_WARNING("_process_FELIX_AUX:") << " Fiber number " << (int) fiber << " is expected to be 1 or 2 -- revisit logic";
 	fiberloc = 1;
-	error_counter++;
+	st.error_counter++;
 	if (_felix_drop_frags_with_badsf) 
 	  {
 	    MF_LOG_WARNING("_process_FELIX_AUX:") << " Dropping FELIX Data";
@@ -1340,15 +1401,23 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
 
     v_adc.clear();
     //std::cout<<"crate:slot:fiber = "<<crate<<", "<<slot<<", "<<fiber<<std::endl;
-    std::vector<dune::adc_t> waveform( felix.get_ADCs_by_channel(ch) );
-    for(unsigned int nframe=0;nframe<waveform.size();nframe++){
-      // if(ch==0 && nframe<100) {
-      //  if(nframe==0) std::cout<<"Print the first 100 ADCs of Channel#1"<<std::endl;  
-      //  std::cout<<waveform.at(nframe)<<"  ";
-      //  if(nframe==99) std::cout<<std::endl;
-      // }
-      v_adc.push_back(waveform.at(nframe));  
-    }
+    if (_felix_fused_decode)
+      {
+	v_adc = std::move(chan_adcs[ch]);
+      }
+    else
+      {
+	std::vector<dune::adc_t> waveform( felix.get_ADCs_by_channel(ch) );
+	v_adc.reserve(waveform.size());
+	for(unsigned int nframe=0;nframe<waveform.size();nframe++){
+	  // if(ch==0 && nframe<100) {
+	  //  if(nframe==0) std::cout<<"Print the first 100 ADCs of Channel#1"<<std::endl;  
+	  //  std::cout<<waveform.at(nframe)<<"  ";
+	  //  if(nframe==99) std::cout<<std::endl;
+	  // }
+	  v_adc.push_back(waveform.at(nframe));  
+	}
+      }
 
     if ( v_adc.size() != _full_tick_count)
       {
@@ -1356,57 +1425,37 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
 	  {
 	    MF_LOG_WARNING("_process_FELIX_AUX:") << "Nticks not the required value: " << v_adc.size() << " " 
 						  << _full_tick_count << " Discarding Data";
-	    error_counter++;
-	    incorrect_ticks++;
-	    _discard_data = true;
-	    _DiscardedCorruptData = true;
+	    st.error_counter++;
+	    st.incorrect_ticks++;
+	    st.discard_data = true;
+	    st.DiscardedCorruptData = true;
 	    return true; 
 	  }
-	_KeptCorruptData = true;
+	st.KeptCorruptData = true;
       }
 
-    if (!_initialized_tick_count_this_event)
-      {
-	_initialized_tick_count_this_event = true;
-	_tick_count_this_event = v_adc.size();
-      }
-    else
-      {
-	if (_enforce_same_tick_count)
-	  {
-	    if (v_adc.size() != _tick_count_this_event)
-	      {
-		MF_LOG_WARNING("_process_FELIX_AUX:") << "Nticks different for two channel streams: " << v_adc.size() 
-						      << " vs " << _tick_count_this_event << " Discarding Data";
-		error_counter++;
-		_discard_data = true;
-		_DiscardedCorruptData = true;
-		return true;
-	      }
-	    _KeptCorruptData = true;
-	  }
-      }
+    // compared with the other streams and channels of the event in _checkTickCounts
+    task.tick_counts.push_back(v_adc.size());
 
     if (offlineChannel < _duplicate_channel_checklist_size)
       {
-	if (_duplicate_channel_checklist[offlineChannel])
+	if (ctx.markChannel(offlineChannel))
 	  {
 	    if(_make_histograms)
 	      {
-		duplicate_channels++;
+		st.duplicate_channels++;
 	      }
 	    if (_enforce_no_duplicate_channels)
 	      {
 		MF_LOG_WARNING("_process_FELIX_AUX:") << "Duplicate Channel: " << offlineChannel
 						      << " c:s:f:ich: " << (int) crate << " " << (int) slot << " " << (int) fiber << " " << (int) ch << " Discarding Data";
-		error_counter++;
-		_discard_data = true;
-		_DiscardedCorruptData = true;
+		st.error_counter++;
+		st.discard_data = true;
+		st.DiscardedCorruptData = true;
 		return true;
 	      }
-	    _KeptCorruptData = true;	    
+	    st.KeptCorruptData = true;	    
 	  }
-	_duplicate_channel_checklist[offlineChannel] = true;
       }
 
     float median=0;
@@ -1414,116 +1463,119 @@ bool PDSPTPCRawDecoder::_process_FELIX_AUX(const artdaq::Fragment& frag, RawDigi
     computeMedianSigma(v_adc,median,sigma);
 
     auto n_ticks = v_adc.size();
-    raw::Compress_t cflag=raw::kNone;
-    if (_compress_Huffman)
-      {
-	cflag = raw::kHuffman;
-	raw::Compress(v_adc,cflag);
-      }
-    // here n_ticks is the uncompressed size as required by the constructor
-    raw::RawDigit raw_digit(offlineChannel, n_ticks, v_adc, cflag);
-    raw_digit.SetPedestal(median,sigma);
-    raw_digits.push_back(raw_digit);
+    // compression, if requested, is done for the whole event in produce
+    raw_digits.emplace_back(offlineChannel, n_ticks, std::move(v_adc), raw::kNone);
+    raw_digits.back().SetPedestal(median,sigma);
 
+    // the association is made when the fragments are merged in produce
     raw::RDTimeStamp rdtimestamp(felix.timestamp(),offlineChannel);
     timestamps.push_back(rdtimestamp);
-
-    //associate the raw digit and the timestamp data products
-    auto const rawdigitptr = rdpm(raw_digits.size()-1);
-    auto const rdtimestampptr = tspm(timestamps.size()-1);
-    tsassocs.addSingle(rawdigitptr,rdtimestampptr);
   }
   return true;
 }
 
 
-// compute median and sigma.  Sigma is half the distance between the upper and lower bounds of the
-// 68% region where 34% is above the median and 34% is below ("centered" on the median).
+// queue a fragment, or the blocks of a container fragment, for decoding
 
-void PDSPTPCRawDecoder::computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma)
+void PDSPTPCRawDecoder::_addFragmentTasks(EventContext &ctx, const artdaq::Fragment &frag, bool is_container,
+					  bool is_rce, size_t ntickscheck, size_t &n_frags) const
 {
-  size_t asiz = v_adc.size();
-  int imed=0;
-  if (asiz == 0)
+  if (is_container)
     {
-      median = 0;
-      sigma = 0;
+      artdaq::ContainerFragment cont_frag(frag);
+      for (size_t ii = 0; ii < cont_frag.block_count(); ++ii)
+	{
+	  FragmentTask task;
+	  task.block = cont_frag[ii];
+	  task.frag = task.block.get();
+	  task.is_rce = is_rce;
+	  task.ntickscheck = ntickscheck;
+	  ctx.tasks.push_back(std::move(task));
+	  ++n_frags;
+	}
     }
   else
     {
-      // this is actually faster than the code below by about one second per event.
-      // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
-
-      imed = TMath::Median(asiz,v_adc.data()) + 0.01;  // add an offset to make sure the floor gets the right integer
-      median = imed;
-      sigma = TMath::RMS(asiz,v_adc.data());
+      FragmentTask task;
+      task.frag = &frag;
+      task.is_rce = is_rce;
+      task.ntickscheck = ntickscheck;
+      ctx.tasks.push_back(std::move(task));
+      ++n_frags;
+    }
+}
 
-      // add in a correction suggested by David Adams, May 6, 2019
+// decode the queued fragments, each in its own TBB task if requested
 
-      size_t s1 = 0;
-      size_t sm = 0;
-      for (size_t i=0; i<asiz; ++i)
+void PDSPTPCRawDecoder::_decodeFragments(EventContext &ctx) const
+{
+  auto decode = [this, &ctx](FragmentTask &task)
+    {
+      if (task.is_rce)
 	{
-	  if (v_adc[i] < imed) s1++;
-	  if (v_adc[i] == imed) sm++;
+	  _process_RCE_AUX(ctx, task);
 	}
-      if (sm > 0)
+      else
 	{
-	  float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
-	  //if (std::abs(mcorr)>1.0) std::cout << "mcorr: " << mcorr << std::endl;
-	  median += mcorr;
+	  _process_FELIX_AUX(ctx, task);
 	}
-    }
+    };
 
+  if (_parallel_decode)
+    {
+      tbb::parallel_for(size_t(0), ctx.tasks.size(), [&](size_t i) { decode(ctx.tasks[i]); });
+    }
+  else
+    {
+      for (auto &task : ctx.tasks) decode(task);
+    }
+}
 
+// all streams and channels of the event should have the same number of ticks.  The comparison is
+// done once the fragments are decoded, in fragment order, so it does not depend on which task ran first.
 
-  // never do this, but keep the code around in case we want it later
+void PDSPTPCRawDecoder::_checkTickCounts(EventContext &ctx) const
+{
+  DecodeStatus &status = ctx.status;
+  bool initialized = false;
+  size_t tick_count = 0;
+  for (const auto &task : ctx.tasks)
+    {
+      for (size_t n_ticks : task.tick_counts)
+	{
+	  if (!initialized)
+	    {
+	      initialized = true;
+	      tick_count = n_ticks;
+	      continue;
+	    }
+	  if (task.is_rce || _enforce_same_tick_count)
+	    {
+	      if (n_ticks != tick_count && _enforce_same_tick_count)
+		{
+		  MF_LOG_WARNING(task.is_rce ? "_process_RCE_AUX:" : "_process_FELIX_AUX:")
+		    << "Nticks different for two channel streams: " << n_ticks
+		    << " vs " << tick_count << " Discarding Data";
+		  status.error_counter++;
+		  status.discard_data = true;
+		  status.DiscardedCorruptData = true;
+		  break;
+		}
+	      status.KeptCorruptData = true;
+	    }
+	}
+    }
+}
 
-  // if (asiz > 100000000)
-  //   {
-  //     size_t mednum = asiz/2;
-  //     size_t m1snum = mednum - ( (float) asiz )*0.34;
-  //     size_t p1snum = mednum + ( (float) asiz )*0.34;
 
-  //     std::map<size_t,size_t> adcmap;
-  //     for (auto const adc : v_adc)
-  // 	{
-  // 	  auto mapiter = adcmap.find(adc);
-  // 	  if (mapiter != adcmap.end())
-  // 	    {
-  // 	      mapiter->second ++;
-  // 	    }
-  // 	  else
-  // 	    {
-  // 	      adcmap[adc] = 1;
-  // 	    }
-  // 	}
+// compute median and sigma.  See AdcPedestalEstimator.h
 
-  //     // find quantiles, -1 sigma, median, plus 1 sigma
-  //     size_t sum = 0;
-  //     size_t m1s = 0;
-  //     size_t p1s = 0;
-  //     size_t m = 0;
-  //     for (auto const &mv : adcmap)
-  // 	{
-  // 	  sum += mv.second;
-  // 	  if (m1s == 0 && sum >= m1snum) 
-  // 	    {
-  // 	      m1s = mv.first;
-  // 	    }
-  // 	  if (m == 0 && sum >= mednum)
-  // 	    {
-  // 	      m = mv.first;
-  // 	    }
-  // 	  if (p1s == 0 && sum >= p1snum)
-  // 	    {
-  // 	      p1s = mv.first;
-  // 	      break;
-  // 	    }
-  // 	}
-  //     median = (float) m;
-  //     sigma = ((float) (p1s - m1s))/2.0;
-  //   }
+void PDSPTPCRawDecoder::computeMedianSigma(raw::RawDigit::ADCvector_t &v_adc, float &median, float &sigma) const
+{
+  if (_histogram_pedestal)
+    AdcPedestalEstimator::compute(v_adc, median, sigma);
+  else
+    AdcPedestalEstimator::computeTMath(v_adc, median, sigma);
 }
 
 DEFINE_ART_MODULE(PDSPTPCRawDecoder)
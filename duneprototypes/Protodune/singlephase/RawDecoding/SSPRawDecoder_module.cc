@@ -40,6 +40,9 @@
 // C++ Includes
 #include <memory>
 #include <map>
+#include <vector>
+
+#include "tbb/parallel_for.h"
 
 namespace dune {
   class SSPRawDecoder;
@@ -84,9 +87,33 @@ public:
     unsigned long internal_interpol;
     uint64_t internal_timestamp; //internal timestamps necessary for 150 Mhz sample matching, if desired.
   };
-  void readHeader(const SSPDAQ::EventHeader* daqHeader, struct trig_variables* tv);
+  void readHeader(const SSPDAQ::EventHeader* daqHeader, struct trig_variables* tv) const;
+
+  // An SSP fragment.  Non-container fragments are used in place from the
+  // event; a container block can only be read through a Fragment of its own.
+  struct FragmentRef {
+    const artdaq::Fragment* frag = nullptr;
+    std::unique_ptr<const artdaq::Fragment> block;  // owns frag if it came out of a container fragment
+  };
 
-  void getFragments(art::Event &evt,std::vector<artdaq::Fragment>* fragments);
+  // One packet (waveform) of a fragment.  The ADC values stay in the fragment.
+  struct Packet {
+    trig_variables trig;
+    const unsigned short* adcs = nullptr;
+    unsigned int nADC = 0;
+    unsigned int channel = 0;
+    unsigned int mappedchannel = 0;
+    double time = 0;
+    int output = -1;               // 0: waveforms, 1: external, 2: internal, -1: not kept
+    size_t index = 0;              // position in the output collection
+    unsigned short maxadc = 0;
+    uint64_t adcsum = 0;
+    std::vector<recob::OpHit> foundHits;  // from the waveform, if FindHits is set
+  };
+
+  void getFragments(art::Event &evt,std::vector<FragmentRef>* fragments);
+  void readPackets(const artdaq::Fragment& frag, double opticalFrequency, std::vector<Packet>& packets) const;
+  raw::OpDetWaveform makeWaveform(Packet& packet, double tickPeriod) const;
   void beginJob() override;
   void endJob() override;
   void beginEvent(art::EventNumber_t eventNumber);
@@ -94,7 +121,7 @@ public:
   void setRootObjects();
 
   recob::OpHit ConstructOpHit(detinfo::DetectorClocksData const& clockData,
-                              trig_variables &trig, unsigned int channel);
+                              trig_variables &trig, unsigned int channel) const;
 
 private:
 
@@ -106,6 +133,14 @@ private:
   std::string fIntTrigOutputLabel;
   bool fUseChannelMap;
   bool fDebug;
+  bool fParallelDecode;
+
+  // streaming hit finder run on the waveforms while they are decoded
+  bool         fFindHits;
+  std::string  fFoundHitSuffix;     ///< appended to the output labels for the found hits
+  double       fHitThreshold;       ///< ADC above the running baseline that starts a hit
+  double       fHitEndThreshold;    ///< ADC above the running baseline below which a hit ends
+  double       fHitBaselineSamples; ///< time constant of the running baseline, in samples
   raw::Compress_t        fCompression;      ///< compression type to use
   unsigned int           fZeroThreshold;    ///< Zero suppression threshold
 
@@ -189,12 +224,17 @@ dune::SSPRawDecoder::SSPRawDecoder(fhicl::ParameterSet const & pset)
   if (!fSplitTriggers) {
     produces< std::vector<raw::OpDetWaveform> > (fOutputDataLabel);
     produces< std::vector<recob::OpHit> > (fOutputDataLabel);
+    if (fFindHits) produces< std::vector<recob::OpHit> > (fOutputDataLabel + fFoundHitSuffix);
   }
   else{
     produces< std::vector<raw::OpDetWaveform> > (fExtTrigOutputLabel);
     produces< std::vector<raw::OpDetWaveform> > (fIntTrigOutputLabel);
     produces< std::vector<recob::OpHit> > (fExtTrigOutputLabel);
     produces< std::vector<recob::OpHit> > (fIntTrigOutputLabel);
+    if (fFindHits) {
+      produces< std::vector<recob::OpHit> > (fExtTrigOutputLabel + fFoundHitSuffix);
+      produces< std::vector<recob::OpHit> > (fIntTrigOutputLabel + fFoundHitSuffix);
+    }
   }
 }
 
@@ -208,6 +248,12 @@ void dune::SSPRawDecoder::reconfigure(fhicl::ParameterSet const& pset) {
   fUseChannelMap = pset.get<bool>("UseChannelMap");
   number_of_packets=pset.get<int>("number_of_packets");
   fDebug = pset.get<bool>("Debug");
+  fParallelDecode = pset.get<bool>("ParallelDecode", true);
+  fFindHits = pset.get<bool>("FindHits", false);
+  fFoundHitSuffix = pset.get<std::string>("FoundHitSuffix", "found");
+  fHitThreshold = pset.get<double>("HitThreshold", 30);
+  fHitEndThreshold = pset.get<double>("HitEndThreshold", 10);
+  fHitBaselineSamples = std::max(1.0, pset.get<double>("HitBaselineSamples", 64));
   fZeroThreshold=0;
   fCompression=raw::kNone;
 
@@ -257,6 +303,13 @@ void dune::SSPRawDecoder::printParameterSet(){
     std::cout << "fExtTrigOutputLabel: " << fExtTrigOutputLabel << std::endl;
     std::cout << "fIntTrigOutputLabel: " << fIntTrigOutputLabel << std::endl;
   }    
+  std::cout << "fFindHits: " << (fFindHits ? "true" : "false") << std::endl;
+  if (fFindHits) {
+    std::cout << "fFoundHitSuffix: " << fFoundHitSuffix << std::endl;
+    std::cout << "fHitThreshold: " << fHitThreshold << std::endl;
+    std::cout << "fHitEndThreshold: " << fHitEndThreshold << std::endl;
+    std::cout << "fHitBaselineSamples: " << fHitBaselineSamples << std::endl;
+  }
   std::cout << "fDebug: ";
   if(fDebug) std::cout << "true" << std::endl;
   else std::cout << "false" << std::endl;
@@ -272,7 +325,7 @@ void dune::SSPRawDecoder::setRootObjects(){
   frag_sizes_ = tFileService->make<TH1D>("ssp_frag_sizes","SSP: frag_sizes",960,0,2e6);  
 }
 
-void dune::SSPRawDecoder::readHeader(const SSPDAQ::EventHeader* daqHeader, struct trig_variables* tv){
+void dune::SSPRawDecoder::readHeader(const SSPDAQ::EventHeader* daqHeader, struct trig_variables* tv) const {
 
   
   tv->header = daqHeader->header;                          // the 'start of header word' (should always be 0xAAAAAAAA)
@@ -312,7 +365,7 @@ void dune::SSPRawDecoder::readHeader(const SSPDAQ::EventHeader* daqHeader, struc
   
 }
 
-void dune::SSPRawDecoder::getFragments(art::Event &evt, std::vector<artdaq::Fragment> *fragments){
+void dune::SSPRawDecoder::getFragments(art::Event &evt, std::vector<FragmentRef> *fragments){
 
   art::EventNumber_t eventNumber = evt.event();
 
@@ -345,7 +398,7 @@ void dune::SSPRawDecoder::getFragments(art::Event &evt, std::vector<artdaq::Frag
 
   if (have_data)
     {
-      for (auto cont : *containerFragments)
+      for (auto const& cont : *containerFragments)
         {
           //std::cout << "container fragment type: " << (unsigned)cont.type() << std::endl;
           artdaq::ContainerFragment contf(cont);
@@ -353,11 +406,10 @@ void dune::SSPRawDecoder::getFragments(art::Event &evt, std::vector<artdaq::Frag
             {
               size_t fragSize = contf.fragSize(ii);
               frag_sizes_->Fill(fragSize);
-              //artdaq::Fragment thisfrag;
-              //thisfrag.resizeBytes(fragSize);
-            
-              //memcpy(thisfrag.headerAddress(), contf.at(ii), fragSize);
-              fragments->emplace_back(*contf[ii]);
+              FragmentRef ref;
+              ref.block = contf[ii];
+              ref.frag = ref.block.get();
+              fragments->push_back(std::move(ref));
             }
         }
     }
@@ -394,7 +446,9 @@ void dune::SSPRawDecoder::getFragments(art::Event &evt, std::vector<artdaq::Frag
   if (have_data2)
     {
       for(auto const& rawfrag: *rawFragments){
-        fragments->emplace_back( rawfrag );
+        FragmentRef ref;
+        ref.frag = &rawfrag;
+        fragments->push_back(std::move(ref));
       }
     }
 }
@@ -426,6 +480,142 @@ void dune::SSPRawDecoder::endJob(){
 
 }
 
+void dune::SSPRawDecoder::readPackets(const artdaq::Fragment& frag, double opticalFrequency,
+                                      std::vector<Packet>& packets) const {
+
+  ///> Create a SSPFragment from the generic artdaq fragment
+  dune::SSPFragment sspf(frag);
+
+  const SSPDAQ::MillisliceHeader* meta=0;
+
+  ///> get the information from the header
+  if(frag.hasMetadata()) meta = &(frag.metadata<SSPFragment::Metadata>()->sliceHeader); ///> get the metadata
+  else std::cout << "SSP fragment has no metadata associated with it." << std::endl;
+  if(meta) packets.reserve(meta->nTriggers);
+
+  ///> get a pointer to the first packet in the millislice
+  const unsigned int* dataPointer = sspf.dataBegin();
+
+  ///> loop over the packets in the millislice
+  while(( meta==0 || packets.size()<meta->nTriggers) && dataPointer<sspf.dataEnd() ){
+
+    ///> get the packet header
+    const SSPDAQ::EventHeader* daqHeader=reinterpret_cast<const SSPDAQ::EventHeader*>(dataPointer);
+
+    /// read the header to provide the trigger variables structure
+    Packet packet;
+    readHeader(daqHeader, &packet.trig);
+
+    /// time
+    // DO NOT USE clockData.OpticalClock().TickPeriod()!!!! It is not precise enough
+    // use OpticalClock().Frequency, and do the division yourself with high precission.
+    packet.time = double(packet.trig.timestamp_nova % 1000000000 ) / opticalFrequency;
+    //true time truncated by 10 digits in order to make sure the math works correctly
+    packet.channel = ((trunc(frag.fragmentID()/10) -1 )*4 + frag.fragmentID()%10 -1 )*number_of_packets + packet.trig.channel_id;
+
+    ///> increment the data pointer past the packet header
+    dataPointer+=sizeof(SSPDAQ::EventHeader)/sizeof(unsigned int);
+
+    ///> get the number of ADC values in the packet and a pointer to the first one
+    packet.nADC=(packet.trig.length-sizeof(SSPDAQ::EventHeader)/sizeof(unsigned int))*2;
+    packet.adcs=reinterpret_cast<const unsigned short*>(dataPointer);
+
+    ///> increment the data pointer to the end of the current packet (to the start of the next packet header, if available)
+    dataPointer+=packet.nADC/2;
+
+    packets.push_back(packet);
+  }
+}
+
+raw::OpDetWaveform dune::SSPRawDecoder::makeWaveform(Packet& packet, double tickPeriod) const {
+
+  // Get information from the header, //added by Jingbo
+  unsigned short     OpChannel   =  (unsigned short) packet.mappedchannel;   ///< Derived Optical channel
+  raw::OpDetWaveform Waveform(packet.time, OpChannel, packet.nADC);
+  Waveform.assign(packet.adcs, packet.adcs + packet.nADC);
+
+  //calculating relevant values in decoder because what comes out of the trigger header seems incorrect-Bryan Ramson
+  unsigned long calbasesum = 0;
+  unsigned short maxadc = 0;
+  unsigned long calintsum = 0;
+  unsigned short  calpeaktime = 0;
+  unsigned int calpeaksum =0;
+  uint64_t adcsum = 0;
+
+  // Hit finder: a hit starts when a sample is more than fHitThreshold above
+  // the running baseline and ends when it drops below fHitEndThreshold.  The
+  // baseline starts at the mean of the pedestal samples and only follows
+  // the waveform outside hits.
+  double baseline = 0;
+  bool inHit = false;
+  size_t hitStart = 0;
+  size_t hitPeakSample = 0;
+  double hitPeak = 0;
+  double hitArea = 0;
+  auto closeHit = [&](size_t hitEnd) {
+    double peakTime = packet.time + hitPeakSample*tickPeriod; // microseconds
+    packet.foundHits.emplace_back(OpChannel,
+                                  peakTime,  // Relative Time
+                                  peakTime,  // Absolute time
+                                  0,         // Frame, not used by DUNE
+                                  (hitEnd - hitStart)*tickPeriod,
+                                  hitArea,
+                                  hitPeak,
+                                  hitArea / SPESize, // PE
+                                  0.);
+    inHit = false;
+  };
+  if (fFindHits && packet.nADC > 0) {
+    size_t nbase = std::max<size_t>(1, std::min<size_t>(i1, packet.nADC));
+    for(size_t idata = 0; idata < nbase; idata++) baseline += packet.adcs[idata];
+    baseline /= nbase;
+  }
+
+  for(size_t idata = 0; idata < packet.nADC; idata++) {
+    ///> get the 'idata-th' ADC value
+    unsigned short adc = packet.adcs[idata];
+    if(idata < i1) calbasesum +=  static_cast<unsigned long>(adc); //added by Bryan Ramson
+    if(idata > i1+m1 && idata <= i2+i1+m1) calintsum += static_cast<unsigned long>(adc); //added by Bryan Ramson
+    if(idata >= i1+m1+m2 && idata <= i1+2*m1+m2) calpeaksum += static_cast<unsigned int>(adc); //added by Bryan Ramson
+
+    maxadc = std::max(maxadc,adc); //added by Bryan Ramson
+    if(maxadc == adc) calpeaktime = idata; //added by Bryan Ramson
+    adcsum += adc;
+
+    if (fFindHits) {
+      double amp = adc - baseline;
+      if (!inHit) {
+        if (amp > fHitThreshold) {
+          inHit = true;
+          hitStart = idata;
+          hitPeakSample = idata;
+          hitPeak = amp;
+          hitArea = 0;
+        }
+        else baseline += amp/fHitBaselineSamples;
+      }
+      if (inHit) {
+        hitArea += amp;
+        if (amp > hitPeak) {
+          hitPeak = amp;
+          hitPeakSample = idata;
+        }
+        if (amp < fHitEndThreshold) closeHit(idata + 1);
+      }
+    }
+  }
+  if (inHit) closeHit(packet.nADC);
+
+  packet.trig.baselinesum = calbasesum;
+  packet.trig.intsum = calintsum;
+  packet.trig.peaktime = calpeaktime;
+  packet.trig.peaksum = calpeaksum;
+  packet.maxadc = maxadc;
+  packet.adcsum = adcsum;
+
+  return Waveform;
+}
+
 void dune::SSPRawDecoder::produce(art::Event & evt){
 
   art::ServiceHandle<art::TFileService> tFileService;
@@ -434,16 +624,12 @@ void dune::SSPRawDecoder::produce(art::Event & evt){
   //MF_LOG_INFO("SSPRawDecoder") << "-------------------- SSP RawDecoder -------------------";
   // Implementation of required member function here.
 
-  art::EventNumber_t eventNumber = evt.event();  
-  
   /// Get the fragments (Container or Raw)
-  std::vector<artdaq::Fragment> fragments;
+  std::vector<FragmentRef> fragments;
   getFragments(evt,&fragments);
 
   unsigned int allPacketsProcessed = 0;
-  unsigned int waveform_counter = 0;
   uint64_t ssptrigtime = 0;
-  std::map<int, int> packets_per_fragment;
 
   // just to make sure -- the std::move from the previous event should clear them out, but this is
   // not guaranteed by the standard.
@@ -454,48 +640,32 @@ void dune::SSPRawDecoder::produce(art::Event & evt){
   hits.clear();
   int_hits.clear();
   ext_hits.clear();
-  
-  /// Process all packets:
-  
+
   auto const clockData = art::ServiceHandle<detinfo::DetectorClocksService const>()->DataFor(evt);
-  for(auto const& frag: fragments){
-    if((unsigned)frag.type() != 3) continue;
- 
-    ///> Create a SSPFragment from the generic artdaq fragment
-    dune::SSPFragment sspf(frag);
-    
-    const SSPDAQ::MillisliceHeader* meta=0;
-    
-    ///> get the information from the header
-    if(frag.hasMetadata()) meta = &(frag.metadata<SSPFragment::Metadata>()->sliceHeader); ///> get the metadata
-    else std::cout << "SSP fragment has no metadata associated with it." << std::endl;
-    
-    ///> get a pointer to the first packet in the millislice
-    const unsigned int* dataPointer = sspf.dataBegin();
-    
-    ///> loop over the packets in the millislice
-    unsigned int packetsProcessed=0;
-    while(( meta==0 || packetsProcessed<meta->nTriggers) && dataPointer<sspf.dataEnd() ){
-      
-      ///> get the packet header
-      const SSPDAQ::EventHeader* daqHeader=reinterpret_cast<const SSPDAQ::EventHeader*>(dataPointer);
-      
-      /// read the header to provide the trigger variables structure        
-      struct trig_variables trig;
-      readHeader(daqHeader, &trig);
-      
-      /// time
-      ////long double time = trig.timestamp_nova*clockData.OpticalClock().TickPeriod(); //in experiment microseconds
-      // DO NOT USE clockData.OpticalClock().TickPeriod()!!!! It is not precise enough
-      // use OpticalClock().Frequency, and do the division yourself with high precission.
-      double time = double(trig.timestamp_nova % 1000000000 ) / double(clockData.OpticalClock().Frequency());
-      //true time truncated by 10 digits in order to make sure the math works correctly
-      //std::cout << time << std::endl;
-      unsigned int channel = ((trunc(frag.fragmentID()/10) -1 )*4 + frag.fragmentID()%10 -1 )*number_of_packets + trig.channel_id;
+  double opticalFrequency = clockData.OpticalClock().Frequency();
+  double tickPeriod = clockData.OpticalClock().TickPeriod();
+
+  /// Read the packet headers of all fragments.  The fragments are independent,
+  /// so this is done in parallel.
+  std::vector<std::vector<Packet>> packets(fragments.size());
+  auto scan = [&](size_t ifrag) {
+    if((unsigned)fragments[ifrag].frag->type() != 3) return;
+    readPackets(*fragments[ifrag].frag, opticalFrequency, packets[ifrag]);
+  };
+  if (fParallelDecode) tbb::parallel_for(size_t(0), fragments.size(), scan);
+  else for (size_t ifrag = 0; ifrag < fragments.size(); ++ifrag) scan(ifrag);
+
+  /// Reference times, histograms and the output slot of each packet, in
+  /// fragment and packet order so the collections come out as before.
+  size_t nout[3] = {0, 0, 0};
+  for(auto& fragPackets: packets){
+    for(auto& packet: fragPackets){
+      trig_variables const& trig = packet.trig;
+      unsigned int channel = packet.channel;
 
       //set external reference time to the first time stamp of the run, if a lower time stamp is found, adjust
       if(allreftime==0 || (allreftime > trig.timestamp_nova)) allreftime=trig.timestamp_nova;
-      
+
       //internal and external reference times on external (beam/cosmic window triggers). Can be used to time external timestamp down to the internal timesample. Might want to try this at some point in production...
       if(trig.type==48) {
         if (ssptrigtime==0) {
@@ -508,7 +678,7 @@ void dune::SSPRawDecoder::produce(art::Event & evt){
         if(int_ireftime_[ssp_map_[trig.module_id]] == 0) int_ireftime_[ssp_map_[trig.module_id]] = trig.internal_timestamp;
         if(ext_ireftime_[ssp_map_[trig.module_id]] == 0) ext_ireftime_[ssp_map_[trig.module_id]] = trig.timestamp_nova;  
       }
-     
+
       // Trigger type histogram
       if (trigger_type_.find(channel) == trigger_type_.end())
         {
@@ -522,82 +692,61 @@ void dune::SSPRawDecoder::produce(art::Event & evt){
       
       if ( trig.type == 16 ) trigger_type_[channel]->Fill(1);
       if ( trig.type == 48 ) trigger_type_[channel]->Fill(2);
-      
-      ///> increment the data pointer past the packet header
-      dataPointer+=sizeof(SSPDAQ::EventHeader)/sizeof(unsigned int);
-      
-      //>get the information from the data
-      bool verb_values = false;
-      
-      ///> get the number of ADC values in the packet
-      unsigned int nADC=(trig.length-sizeof(SSPDAQ::EventHeader)/sizeof(unsigned int))*2;
-      
-      ///> get a pointer to the first ADC value
-      const unsigned short* adcPointer=reinterpret_cast<const unsigned short*>(dataPointer);
-      
-      char histname[100];
-      sprintf(histname,"evt%i_frag%d_wav%d",eventNumber, frag.fragmentID(), packetsProcessed);
-      
-      TH1D* hist=new TH1D("hist","hist",nADC,0,nADC);
-      
+
       // map the channel number to offline if requested
-      
-      unsigned int mappedchannel = channel;
-      if (fUseChannelMap) mappedchannel = channelMap->SSPOfflineChannelFromOnlineChannel(channel);
-      
-      // Get information from the header, //added by Jingbo
-      
-      unsigned short     OpChannel   =  (unsigned short) mappedchannel;   ///< Derived Optical channel
-      raw::OpDetWaveform Waveform(time, OpChannel, nADC);
-      
-      //calculating relevant values in decoder because what comes out of the trigger header seems incorrect-Bryan Ramson
-      unsigned long calbasesum = 0;
-      unsigned short maxadc = 0;
-      unsigned long calintsum = 0;
-      unsigned short  calpeaktime = 0;
-      unsigned int calpeaksum =0;
-      ///> copy the waveforms
-      for(size_t idata = 0; idata < nADC; idata++) {
-        ///> get the 'idata-th' ADC value
-        const unsigned short* adc = adcPointer + idata;
-        if(idata < i1) calbasesum +=  static_cast<unsigned long>(*adc); //added by Bryan Ramson
-        if(idata > i1+m1 && idata <= i2+i1+m1) calintsum += static_cast<unsigned long>(*adc); //added by Bryan Ramson
-        if(idata >= i1+m1+m2 && idata <= i1+2*m1+m2) calpeaksum += static_cast<unsigned int>(*adc); //added by Bryan Ramson
-        
-        maxadc = std::max(maxadc,*adc); //added by Bryan Ramson
-        if(maxadc == *adc) calpeaktime = idata; //added by Bryan Ramson
-        Waveform.push_back(*adc); //added by Jingbo
-        waveform_counter++;
-        
-        n_adc_counter_++;
-        adc_cumulative_ += (uint64_t)(*adc);
-        
-        ///> Waveform 
-        hist->SetBinContent(idata+1,*adc);
-        
-        if (idata >= verb_adcs_) verb_values = false;
-        
-        verb_values = false; //don't print adc. Added by J.Wang
-        if(verb_values) {
-          if(idata == 0&&verb_adcs_>0) std::cout << "Printing the " << nADC << " ADC values saved with the packet:" << std::endl;
-          std::cout << *adc << " ";
-        }
-      }// idata
-
-      // pedestal, area and peak (according to the Register table, the  SSP User Manual has i1 and i2 inverted)
-      double pedestal = calbasesum / ((double)i1);    
-      double area = calintsum-(pedestal*i2);
-      if(area<0) area=0; //On external triggers area over "peak" less pedestal could be negative which is nonsense.
-      double peak = maxadc;
-     
-      trig.baselinesum = calbasesum;
-      trig.intsum = calintsum;
-      trig.peaktime = calpeaktime;
-      trig.peaksum = calpeaksum;
-      
+      packet.mappedchannel = channel;
+      if (fUseChannelMap) packet.mappedchannel = channelMap->SSPOfflineChannelFromOnlineChannel(channel);
+
+      // Split into internal and external triggers if that has been set.
+      if (!fSplitTriggers) packet.output = 0;
+      else if (trig.type == 48) packet.output = 1;
+      else if (trig.type == 16) packet.output = 2;
+      else {
+        std::cerr << "Unknown trigger type " << trig.type << ", cannot assign to appropriate data product with SplitTriggers enabled." << std::endl;
+      }
+      if (packet.output >= 0) packet.index = nout[packet.output]++;
+    }
+    allPacketsProcessed += fragPackets.size();
+  }
+
+  n_event_packets_->Fill(allPacketsProcessed);
+
+  /// The collections are sized from the packet headers, and each packet
+  /// fills its own slot, again in parallel over fragments.
+  std::vector<raw::OpDetWaveform>* waveformOut[3] = {&waveforms, &ext_waveforms, &int_waveforms};
+  std::vector<recob::OpHit>* hitOut[3] = {&hits, &ext_hits, &int_hits};
+  for (int iout = 0; iout < 3; ++iout) {
+    waveformOut[iout]->resize(nout[iout]);
+    hitOut[iout]->resize(nout[iout]);
+  }
+
+  auto fill = [&](size_t ifrag) {
+    for(auto& packet: packets[ifrag]){
+      raw::OpDetWaveform Waveform = makeWaveform(packet, tickPeriod);
+      if (packet.output < 0) continue;
+      (*hitOut[packet.output])[packet.index] = ConstructOpHit(clockData, packet.trig, packet.mappedchannel);
+      (*waveformOut[packet.output])[packet.index] = std::move(Waveform);
+    }
+  };
+  if (fParallelDecode) tbb::parallel_for(size_t(0), packets.size(), fill);
+  else for (size_t ifrag = 0; ifrag < packets.size(); ++ifrag) fill(ifrag);
+
+  for(auto const& fragPackets: packets){
+    for(auto const& packet: fragPackets){
+      n_adc_counter_ += packet.nADC;
+      adc_cumulative_ += packet.adcsum;
+
       if(verb_meta_) {
+        trig_variables const& trig = packet.trig;
+
+        // pedestal, area and peak (according to the Register table, the  SSP User Manual has i1 and i2 inverted)
+        double pedestal = trig.baselinesum / ((double)i1);    
+        double area = trig.intsum-(pedestal*i2);
+        if(area<0) area=0; //On external triggers area over "peak" less pedestal could be negative which is nonsense.
+        double peak = packet.maxadc;
+
         std::cout
-          << "Channel:                            " << channel                   << std::endl
+          << "Channel:                            " << packet.channel            << std::endl
           << "Header:                             " << trig.header               << std::endl
           << "Length:                             " << trig.length               << std::endl
           << "Trigger type:                       " << trig.type                 << std::endl
@@ -624,41 +773,29 @@ void dune::SSPRawDecoder::produce(art::Event & evt){
           << "Peak heigth                         " << peak                      << std::endl
           << std::endl;
       }
-            
-      ///> increment the data pointer to the end of the current packet (to the start of the next packet header, if available)
-      dataPointer+=nADC/2;
-      
-      // Put waveform and ophit into collections
-      // Split into internal and external triggers if that has been set.
-      if (!fSplitTriggers) {
-        waveforms.emplace_back( Waveform );
-        hits.emplace_back( ConstructOpHit(clockData, trig, mappedchannel) );
-      }
-      else{
-        if (trig.type == 48 ) {
-          ext_waveforms.emplace_back( Waveform );
-          ext_hits.emplace_back( ConstructOpHit(clockData, trig, mappedchannel) );
-        }
-        else if (trig.type == 16) {
-          int_waveforms.emplace_back( Waveform );
-          int_hits.emplace_back( ConstructOpHit(clockData, trig, mappedchannel) );
-        }
-        else {
-          std::cerr << "Unknown trigger type " << trig.type << ", cannot assign to appropriate data product with SplitTriggers enabled." << std::endl;
-        }
-      }
+    }
+  }
 
-      hist->Delete();
-    
-      ++packetsProcessed; // packets
+  // The found hits go in packet order to the collection of their waveforms.
+  if (fFindHits) {
+    std::vector<recob::OpHit> foundHits[3];
+    for(auto& fragPackets: packets){
+      for(auto& packet: fragPackets){
+        if (packet.output < 0) continue;
+        auto& found = foundHits[packet.output];
+        found.insert(found.end(), std::make_move_iterator(packet.foundHits.begin()),
+                     std::make_move_iterator(packet.foundHits.end()));
+      }
     }
-    
-    packets_per_fragment[frag.fragmentID()] = packetsProcessed;
-    allPacketsProcessed += packetsProcessed;
-  }//frag: fragments
-  
-  n_event_packets_->Fill(allPacketsProcessed);
-  
+    if (!fSplitTriggers) {
+      evt.put(std::make_unique<std::vector<recob::OpHit>>(std::move(foundHits[0])), fOutputDataLabel + fFoundHitSuffix);
+    }
+    else {
+      evt.put(std::make_unique<std::vector<recob::OpHit>>(std::move(foundHits[1])), fExtTrigOutputLabel + fFoundHitSuffix);
+      evt.put(std::make_unique<std::vector<recob::OpHit>>(std::move(foundHits[2])), fIntTrigOutputLabel + fFoundHitSuffix);
+    }
+  }
+
   if (!fSplitTriggers) {
     evt.put(std::make_unique<decltype(waveforms)>(std::move(waveforms)), fOutputDataLabel);
     evt.put(std::make_unique<decltype(hits)>(     std::move(hits)),      fOutputDataLabel);
@@ -674,7 +811,7 @@ void dune::SSPRawDecoder::produce(art::Event & evt){
 
 
 recob::OpHit dune::SSPRawDecoder::ConstructOpHit(detinfo::DetectorClocksData const& clockData,
-                                                 trig_variables &trig, unsigned int channel)
+                                                 trig_variables &trig, unsigned int channel) const
 {
   // Get basic information from the header
   unsigned short     OpChannel   = channel;         ///< Derived Optical channel
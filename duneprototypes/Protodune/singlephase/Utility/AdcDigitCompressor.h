@@ -0,0 +1,56 @@
+// AdcDigitCompressor.h
+//
+// Compression stage for the RawDigits of an event, run once after decoding.
+//
+// The decoders used to call raw::Compress on each channel inside their
+// decoding loops.  compress takes the whole event's uncompressed digits and
+// compresses them in parallel over channels.  Each channel is stored with the
+// codec that gives the smaller vector, Huffman or none, and the digit's
+// Compression() flag records which, so raw::Uncompress handles every channel
+// as before.  Noisy channels, whose differences do not fit the Huffman code,
+// otherwise come out larger than the raw samples.
+//
+// With smallest false every channel is Huffman coded, as the decoders did.
+
+#ifndef AdcDigitCompressor_H
+#define AdcDigitCompressor_H
+
+#include <utility>
+#include <vector>
+#include "lardataobj/RawData/RawDigit.h"
+#include "lardataobj/RawData/raw.h"
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
+class AdcDigitCompressor {
+
+public:
+
+  using Digits = std::vector<raw::RawDigit>;
+
+  // Compress the uncompressed digits in [first, digits.size()).  Digits that
+  // are already compressed are left alone.
+  static void compress(Digits& digits, bool smallest =true, size_t first =0) {
+    if ( first >= digits.size() ) return;
+    tbb::parallel_for(tbb::blocked_range<size_t>(first, digits.size(), 16),
+                      [&](const tbb::blocked_range<size_t>& r) {
+      for ( size_t i=r.begin(); i!=r.end(); ++i ) compressOne(digits[i], smallest);
+    });
+  }
+
+  // Compress one digit in place.  Returns the codec it is stored with.
+  static raw::Compress_t compressOne(raw::RawDigit& digit, bool smallest =true) {
+    if ( digit.Compression() != raw::kNone || digit.NADC() == 0 ) return digit.Compression();
+    raw::RawDigit::ADCvector_t adcs(digit.ADCs());
+    raw::Compress(adcs, raw::kHuffman);
+    if ( smallest && adcs.size() >= digit.NADC() ) return raw::kNone;
+    float pedestal = digit.GetPedestal();
+    float sigma = digit.GetSigma();
+    digit = raw::RawDigit(digit.Channel(), digit.Samples(), std::move(adcs), raw::kHuffman);
+    digit.SetPedestal(pedestal, sigma);
+    return raw::kHuffman;
+  }
+
+};
+
+#endif
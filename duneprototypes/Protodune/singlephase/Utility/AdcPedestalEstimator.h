@@ -0,0 +1,137 @@
+// AdcPedestalEstimator.h
+//
+// Median/sigma pedestal estimate shared by the TPC raw decoders.
+//
+// computeTMath is the algorithm the decoders have used since 2019:
+// TMath::Median, then TMath::RMS, then a pass for the median correction
+// suggested by David Adams (May 6, 2019).
+//
+// compute gives the same median and correction from a counting histogram
+// of the ADC values, filled in one pass together with the sums for the RMS.
+// The histogram covers 14-bit ADCs and is reused between calls on the same
+// thread, so there is no allocation per channel.  Inputs with values
+// outside [0, 16384) fall back to computeTMath.
+//
+// With modeCorrection false, both return the plain TMath::Median (not
+// truncated to an integer) as some older decoders do.
+
+#ifndef AdcPedestalEstimator_H
+#define AdcPedestalEstimator_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "TMath.h"
+
+class AdcPedestalEstimator {
+
+public:
+
+  using AdcVector = std::vector<short>;
+
+  static constexpr int nbin = 1 << 14;
+
+  static void compute(const AdcVector& v_adc, float& median, float& sigma, bool modeCorrection =true) {
+    compute(v_adc.data(), v_adc.size(), median, sigma, modeCorrection);
+  }
+
+  static void computeTMath(const AdcVector& v_adc, float& median, float& sigma, bool modeCorrection =true) {
+    computeTMath(v_adc.data(), v_adc.size(), median, sigma, modeCorrection);
+  }
+
+  static void compute(const short* adcs, size_t asiz, float& median, float& sigma, bool modeCorrection =true) {
+    if ( asiz == 0 ) {
+      median = 0;
+      sigma = 0;
+      return;
+    }
+    thread_local std::array<uint32_t, nbin> hist{};
+    int amin = nbin;
+    int amax = -1;
+    int64_t sum = 0;
+    int64_t sumsq = 0;
+    for ( size_t i=0; i<asiz; ++i ) {
+      int adc = adcs[i];
+      if ( adc < 0 || adc >= nbin ) {
+        if ( amax >= amin ) std::memset(&hist[amin], 0, (amax - amin + 1)*sizeof(uint32_t));
+        computeTMath(adcs, asiz, median, sigma, modeCorrection);
+        return;
+      }
+      ++hist[adc];
+      if ( adc < amin ) amin = adc;
+      if ( adc > amax ) amax = adc;
+      sum += adc;
+      sumsq += int64_t(adc)*adc;
+    }
+
+    // Order statistics as in TMath::Median: the middle element for odd sizes,
+    // the mean of the two middle elements for even sizes.
+    size_t khi = asiz/2;
+    size_t klo = (asiz % 2 == 0) ? khi - 1 : khi;
+    int alo = amin;
+    int ahi = amin;
+    size_t cum = 0;
+    for ( int adc=amin; adc<=amax; ++adc ) {
+      size_t next = cum + hist[adc];
+      if ( cum <= klo && klo < next ) alo = adc;
+      if ( cum <= khi && khi < next ) { ahi = adc; break; }
+      cum = next;
+    }
+    double n = asiz;
+    double tot = double(sumsq) - double(sum)*double(sum)/n;
+    sigma = asiz > 1 ? std::sqrt(std::abs(tot)/(n - 1.0)) : 0.0;
+
+    if ( ! modeCorrection ) {
+      median = 0.5*(alo + ahi);
+      std::memset(&hist[amin], 0, (amax - amin + 1)*sizeof(uint32_t));
+      return;
+    }
+
+    int imed = 0.5*(alo + ahi) + 0.01;  // same offset as the TMath version
+    median = imed;
+
+    size_t s1 = 0;
+    for ( int adc=amin; adc<imed && adc<=amax; ++adc ) s1 += hist[adc];
+    size_t sm = (imed >= amin && imed <= amax) ? hist[imed] : 0;
+    if ( sm > 0 ) {
+      float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
+      median += mcorr;
+    }
+
+    std::memset(&hist[amin], 0, (amax - amin + 1)*sizeof(uint32_t));
+  }
+
+  static void computeTMath(const short* adcs, size_t asiz, float& median, float& sigma, bool modeCorrection =true) {
+    if ( asiz == 0 ) {
+      median = 0;
+      sigma = 0;
+      return;
+    }
+    // the RMS includes tails from bad samples and signals and may not be the best RMS calc.
+    if ( ! modeCorrection ) {
+      median = TMath::Median(asiz, adcs);
+      sigma = TMath::RMS(asiz, adcs);
+      return;
+    }
+    int imed = TMath::Median(asiz, adcs) + 0.01;  // add an offset to make sure the floor gets the right integer
+    median = imed;
+    sigma = TMath::RMS(asiz, adcs);
+
+    // add in a correction suggested by David Adams, May 6, 2019
+    size_t s1 = 0;
+    size_t sm = 0;
+    for ( size_t i=0; i<asiz; ++i ) {
+      if ( adcs[i] < imed ) s1++;
+      if ( adcs[i] == imed ) sm++;
+    }
+    if ( sm > 0 ) {
+      float mcorr = (-0.5 + (0.5*(float) asiz - (float) s1)/ ((float) sm) );
+      median += mcorr;
+    }
+  }
+
+};
+
+#endif
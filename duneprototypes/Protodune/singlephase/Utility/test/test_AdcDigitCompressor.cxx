@@ -0,0 +1,117 @@
+// test_AdcDigitCompressor.cxx
+//
+// Test AdcDigitCompressor: every channel must uncompress to its original
+// samples and be stored with the smaller of the two codecs when that is
+// requested.  Quiet channels should be Huffman coded and most noisy ones
+// left alone.
+
+#include <string>
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include "duneprototypes/Protodune/singlephase/Utility/AdcDigitCompressor.h"
+
+#undef NDEBUG
+#include <cassert>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using AdcVector = raw::RawDigit::ADCvector_t;
+
+//**********************************************************************
+
+AdcVector makeChannel(std::mt19937& gen, float noise, size_t nsam) {
+  std::normal_distribution<float> dist(900, noise);
+  AdcVector adcs(nsam);
+  // 12-bit samples: the Huffman code keeps the top bit for coded words
+  for ( short& adc : adcs ) adc = std::min(4095L, std::max(0L, std::lround(dist(gen))));
+  return adcs;
+}
+
+//**********************************************************************
+
+int test_AdcDigitCompressor(int nchan =512, int nsam =6000) {
+  const string myname = "test_AdcDigitCompressor: ";
+#ifdef NDEBUG
+  cout << myname << "NDEBUG must be off." << endl;
+  abort();
+#endif
+  string line = "-----------------------------";
+
+  cout << myname << line << endl;
+  cout << myname << "Making " << nchan << " channels of " << nsam << " samples." << endl;
+  std::mt19937 gen(2021);
+  vector<AdcVector> chans;
+  AdcDigitCompressor::Digits digits;
+  for ( int ich=0; ich<nchan; ++ich ) {
+    // every eighth channel is too noisy for the Huffman code
+    float noise = ich % 8 == 0 ? 200.0 : 1.0;
+    chans.push_back(makeChannel(gen, noise, nsam));
+    digits.emplace_back(ich, nsam, chans.back(), raw::kNone);
+    digits.back().SetPedestal(900 + ich, 1.5);
+  }
+  AdcDigitCompressor::Digits digitsAll(digits);
+
+  cout << myname << line << endl;
+  cout << myname << "Compressing." << endl;
+  AdcDigitCompressor::compress(digits);
+  AdcDigitCompressor::compress(digitsAll, false);
+  size_t nword = 0;
+  int nnone = 0;
+  for ( int ich=0; ich<nchan; ++ich ) {
+    const raw::RawDigit& dig = digits[ich];
+    const raw::RawDigit& digAll = digitsAll[ich];
+    assert( dig.Channel() == raw::ChannelID_t(ich) );
+    assert( dig.Samples() == size_t(nsam) );
+    assert( dig.GetPedestal() == 900 + ich );
+    assert( dig.GetSigma() == 1.5 );
+    AdcVector huff(chans[ich]);
+    raw::Compress(huff, raw::kHuffman);
+    assert( dig.Compression() == (huff.size() < size_t(nsam) ? raw::kHuffman : raw::kNone) );
+    if ( ich % 8 != 0 ) assert( dig.Compression() == raw::kHuffman );
+    if ( dig.Compression() == raw::kNone ) ++nnone;
+    assert( dig.NADC() <= size_t(nsam) );
+    assert( digAll.Compression() == raw::kHuffman );
+    for ( const raw::RawDigit* pdig : {&dig, &digAll} ) {
+      AdcVector adcs(nsam);
+      raw::Uncompress(pdig->ADCs(), adcs, pdig->Compression());
+      assert( adcs == chans[ich] );
+    }
+    nword += dig.NADC();
+  }
+  cout << myname << "Compressed to " << nword << " of " << nchan*nsam << " words, "
+       << nnone << " channels uncompressed." << endl;
+  assert( nnone > nchan/16 );
+
+  cout << myname << line << endl;
+  cout << myname << "Checking compressed digits are left alone." << endl;
+  AdcDigitCompressor::Digits again(digits);
+  AdcDigitCompressor::compress(again);
+  for ( int ich=0; ich<nchan; ++ich ) assert( again[ich].ADCs() == digits[ich].ADCs() );
+
+  cout << myname << line << endl;
+  cout << myname << "Done." << endl;
+  return 0;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  int nchan = 512;
+  int nsam = 6000;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NCHAN] [NSAM]" << endl;
+      return 0;
+    }
+    nchan = std::stoi(sarg);
+  }
+  if ( argc > 2 ) nsam = std::stoi(argv[2]);
+  return test_AdcDigitCompressor(nchan, nsam);
+}
+
+//**********************************************************************
@@ -0,0 +1,120 @@
+// test_AdcPedestalEstimator.cxx
+//
+// Test AdcPedestalEstimator: the histogram estimate must reproduce the
+// TMath median and median correction exactly and the RMS to float precision.
+// Also reports the time per channel for both versions.
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include "duneprototypes/Protodune/singlephase/Utility/AdcPedestalEstimator.h"
+
+#undef NDEBUG
+#include <cassert>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using AdcVector = AdcPedestalEstimator::AdcVector;
+using Clock = std::chrono::steady_clock;
+
+//**********************************************************************
+
+bool checkOne(const AdcVector& adcs, string label) {
+  bool ok = true;
+  for ( bool corr : {true, false} ) {
+    float med1 = 0, sig1 = 0, med2 = 0, sig2 = 0;
+    AdcPedestalEstimator::computeTMath(adcs, med1, sig1, corr);
+    AdcPedestalEstimator::compute(adcs, med2, sig2, corr);
+    if ( med1 != med2 || std::abs(sig1 - sig2) > 1.e-5*std::max(1.0f, sig1) ) {
+      cout << label << (corr ? "" : " (no correction)") << ": TMath " << med1 << " " << sig1
+           << ", histogram " << med2 << " " << sig2 << endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+//**********************************************************************
+
+int test_AdcPedestalEstimator(int nchan =2000, int nsam =6000) {
+  const string myname = "test_AdcPedestalEstimator: ";
+#ifdef NDEBUG
+  cout << myname << "NDEBUG must be off." << endl;
+  abort();
+#endif
+  string line = "-----------------------------";
+
+  cout << myname << line << endl;
+  cout << myname << "Checking edge cases." << endl;
+  assert( checkOne(AdcVector(), "empty") );
+  assert( checkOne(AdcVector{900}, "one") );
+  assert( checkOne(AdcVector{900, 901}, "two") );
+  assert( checkOne(AdcVector{0, 16383, 16383, 2}, "limits") );
+  assert( checkOne(AdcVector{-5, 900, 901, 900}, "negative") );
+  assert( checkOne(AdcVector{20000, 900, 901}, "overflow") );
+  assert( checkOne(AdcVector{900, 900, 900}, "after overflow") );
+
+  cout << myname << line << endl;
+  cout << myname << "Checking " << nchan << " random channels of " << nsam << " samples." << endl;
+  std::mt19937 gen(2019);
+  vector<AdcVector> chans(nchan);
+  for ( int ich=0; ich<nchan; ++ich ) {
+    std::normal_distribution<float> noise(500 + 3*ich % 1500, 1 + ich % 7);
+    AdcVector& adcs = chans[ich];
+    adcs.resize(nsam + ich % 2);  // odd and even sizes
+    for ( short& adc : adcs ) adc = std::lround(noise(gen));
+    // a few signal-like excursions
+    for ( int isam=ich % 100; isam<nsam; isam+=997 ) adcs[isam] += 300;
+    assert( checkOne(adcs, "channel " + std::to_string(ich)) );
+  }
+
+  cout << myname << line << endl;
+  cout << myname << "Timing." << endl;
+  float med = 0, sig = 0;
+  double chk = 0;
+  auto t0 = Clock::now();
+  for ( const AdcVector& adcs : chans ) {
+    AdcPedestalEstimator::computeTMath(adcs, med, sig);
+    chk += med;
+  }
+  auto t1 = Clock::now();
+  for ( const AdcVector& adcs : chans ) {
+    AdcPedestalEstimator::compute(adcs, med, sig);
+    chk -= med;
+  }
+  auto t2 = Clock::now();
+  double usTMath = std::chrono::duration<double, std::micro>(t1 - t0).count()/nchan;
+  double usHist = std::chrono::duration<double, std::micro>(t2 - t1).count()/nchan;
+  cout << myname << std::fixed << std::setprecision(2)
+       << "    TMath: " << std::setw(8) << usTMath << " us/channel" << endl;
+  cout << myname << "Histogram: " << std::setw(8) << usHist << " us/channel" << endl;
+  assert( chk == 0.0 );
+
+  cout << myname << line << endl;
+  cout << myname << "Done." << endl;
+  return 0;
+}
+
+//**********************************************************************
+
+int main(int argc, char* argv[]) {
+  int nchan = 2000;
+  int nsam = 6000;
+  if ( argc > 1 ) {
+    string sarg(argv[1]);
+    if ( sarg == "-h" ) {
+      cout << "Usage: " << argv[0] << " [NCHAN] [NSAM]" << endl;
+      return 0;
+    }
+    nchan = std::stoi(sarg);
+  }
+  if ( argc > 2 ) nsam = std::stoi(argv[2]);
+  return test_AdcPedestalEstimator(nchan, nsam);
+}
+
+//**********************************************************************